@@ -2,6 +2,7 @@
 clear all
 %close all
 data = importdata('C:/Users/Owner/Dropbox/Battery_Research/CycEIS_to_CV/GreyNCA_QofC/Gry_5A00.tvi');
+%data = readtvib('C:/Users/Owner/Dropbox/Battery_Research/CycEIS_to_CV/GreyNCA_QofC/Gry_5A00.tvib'); %bcp66 -b
 time = data(:,1);
 volts = data(:,2);
 current = data(:,3);
@@ -1,6 +1,7 @@
 // Program to measure battery response to arbitrary I using HP66332 and Prologix/Fenrir GPIB on Raspberry Pi
 // JBS & CJD, Jan 2021
 
+#define _GNU_SOURCE				// fopencookie for the .tvia writer (tvia.h)
 #include    <stdio.h>
 #include    <stdlib.h>
 #include    <string.h>
@@ -22,37 +23,85 @@ FILE *logfile;										// to log errors
 double meastime;
 
 #include "prologix.h"
+#include "scpi66.h"
+#include "tviring.h"
+#include "tvia.h"
+#include "opt66.h"
+
+void show(struct rec66 *r, char *buf)	// display line, formatted by the writer thread
+{
+	double *x=r->u.x;
+	char *p=buf;
+
+	p += sprintf(p,"pt%.0lf: %.3lfs V=%.3lf, I=%+.3lf; dt=%.3lfs %.1lf/s dQ=%sAh ",
+			x[0],x[1],x[2],x[3],x[4],x[5],r66s(x[6]/3600.0,3));
+	if(r->k) sprintf(p,"L%d/%.0lf ",r->k,x[7]);			// list chunk
+}
 
 int main(int argc, char* argv[])
 {
 	FILE *tvi, *ti;
 	int hp;
 	char USBpath[64];
-	char rbuf[256], wbuf[128];
+	char wbuf[128];
  	time_t tstart,tnow;
 	struct timespec ts, tn;
-    double lastmeastime, vm, im, tin, iin, Vmax,Vmin, dQ=0.00, dt;
+    double lastmeastime, vm, im, tin, iin, Vmax,Vmin, dQ=0.00, dt, vset, iset;
     int gpibaddr=5;
     char baseName[64], fname[128], cinline[256];
-    int i,j,narg=0,npts=0,nlines=0,scpi;
+    int i,narg=0,npts=0,nlines=0;
     struct termios spset;
+    struct rate66 rate;
+    struct ring66 ring;
+    struct tvit tt;
+    int binary, archive;
+    double shw[8];
+    int listmode=FALSE, nseg=0, maxseg=0, nchunk, c, k0, n;	// LIST playback of the .ti waveform
+    struct seg66 *seg=NULL;
+    char cmd[2][2048];
+    double tprev, iprev, late, cut, upl, sched, tgo, tend, tfin=0.00, dur;
+    int done, esr, ne, nlerr=0;
+    char ebuf[128];
 
 
 	// version 0.99: copy from bzp66 v2.02
 	// version 1.00: fixed bug where dQ was not initialised
-    float version = 1.50;    
-    if (argc<4+1 || argc>5+1) { // ??
+	// version 1.51: setpoint & V/I readback pipelined into one transaction (scpi66.h), show samples/s
+	// version 1.60: optional LIST playback, .ti compiled to 66332A list chunks, host only measures
+	// version 1.61: files & display written by a thread fed from a lock-free ring (tviring.h)
+	// version 1.62: -b option writes binary .tvib
+	// version 1.63: replies read by poll() with RTT-adaptive deadlines, numbers parsed in place (rx66.h)
+	// version 1.64: bring-up waits on *OPC? instead of fixed sleeps, skips *RST when already set up (up66)
+	// version 1.65: -a option writes a compressed .tvia archive (tvia.h)
+	// version 1.66: -t option times each sample's phases into a .timing sidecar (tvitime.h)
+	// version 1.67: list chunk end never before its shortest dwells, chunk gaps in usage & log, bad .ti lines via r66err
+	// version 1.68: next list only once the instrument reports the last done (*OPC, *ESR?), errors checked each chunk
+    float version = 1.68;    
+
+	opt66(&argc,argv);							// -x options out of the positional args
+	binary = opt66on('b');
+	archive = opt66on('a');						// records handed over as for -b
+	if(archive) binary=1;
+    if (argc<4+1 || argc>6+1) { // ??
         fprintf(stderr,"bap66 V%.2f jbs&cjd Jan 2021, Apr 2023\n", version);
         fprintf(stderr,"Battery arbitrary waveform measurement via Prologix/Fenrir GPIB-USB & 66332A.\n");
-        fprintf(stderr,"Usage: bap66 USB Vmin Vmax baseName [Addr]\n");
+        fprintf(stderr,"Usage: bap66 USB Vmin Vmax baseName [Addr [list]]\n");
         fprintf(stderr,"where-  USB is the rPi USB address (/dev/ttyUSB0, /dev/ttyACM0, etc);\n");
 	fprintf(stderr,"        Vmin/Vmax are voltage limits (aborts outside this range);\n");
         fprintf(stderr,"        baseName is the file string to be used;\n");
-        fprintf(stderr,"        Addr is the optional GPIB bus address, def=%d.\n",gpibaddr);
+        fprintf(stderr,"        Addr is the optional GPIB bus address, def=%d;\n",gpibaddr);
+        fprintf(stderr,"        list (optional) plays the .ti waveform from the instrument's LIST memory,\n");
+        fprintf(stderr,"          %d steps a chunk; the next chunk can only be uploaded once one ends, so at each\n",LISTPTS);
+        fprintf(stderr,"          boundary the last level is held while the end is seen (*OPC) and the next goes\n");
+        fprintf(stderr,"          up (some tens of ms, logged with any list errors),\n");
+        fprintf(stderr,"          taken back from the next chunk's dwells to keep the waveform on schedule.\n");
         fprintf(stderr,"Sources current described by a .ti file, measuring V & I to .tvi file.\n");
         fprintf(stderr,"Creates baseName.tvi, basename.log, reads basename.ti file.\n");
         fprintf(stderr,"Assumes ti file contains seconds-amps pairs (or blank lines).\n");
         fprintf(stderr,"Requires no drivers, communicates using ++cmd protocol.\n");
+        fprintf(stderr,"Option -b writes binary .tvib (tvib.h, tvibconv converts) instead of .tvi.\n");
+        fprintf(stderr,"Option -a writes a compressed .tvia archive (tvia.h) instead, read as it is by tvibconv & the analysis tools.\n");
+        fprintf(stderr,"Option -t times each sample's bus & calc phases and the file writes into baseName.timing (tvitime reads it).\n");
         fprintf(stderr,"\n");
         exit(1);
     }
@@ -75,6 +124,11 @@ int main(int argc, char* argv[])
 	if(argc>++narg) gpibaddr = atoi(argv[narg]);
 	if(gpibaddr<1 || gpibaddr>30) err("Bad GPIB_Address given.\n");
 
+	if(argc>++narg){
+		if(strstr(argv[narg],"list")==NULL) err("Unknown mode (expected 'list').");
+		listmode=TRUE;
+	}
+
 	// open a log file for problem/progress reports
 	strcpy(fname,baseName);
 	strcat(fname,".log");
@@ -85,7 +139,7 @@ int main(int argc, char* argv[])
 	sprintf(wbuf,"%s started, logfile opened, at %s",argv[0],ctime(&tstart));
 	wbuf[strlen(wbuf)-1]='\0';	// clip off newline
 	progress(wbuf);
-	for(wbuf[0]='\0',i=0;i<argc;i++){strcat(wbuf,argv[i]);strcat(wbuf," ");}
+	for(wbuf[0]='\0',i=0;i<opt66argc;i++){strcat(wbuf,opt66argv[i]);strcat(wbuf," ");}
 	progress(wbuf);
 
 	// open the input file
@@ -97,10 +151,18 @@ int main(int argc, char* argv[])
 
 	// open the output file
 	strcpy(fname,baseName);
-	strcat(fname,".tvi");
-	tvi = fopen(fname,"w+");			// tvi file open 
+	strcat(fname,archive?".tvia":binary?".tvib":".tvi");
+	if(binary){
+		sprintf(wbuf,"bap66 v%.2f",version);
+		if(archive) tvi = tviacreate(fname,3,"t V I",NULL,wbuf,opt66argc,opt66argv,tstart);
+		else tvi = tvibcreate(fname,3,"t V I",wbuf,opt66argc,opt66argv,tstart);
+	}else tvi = fopen(fname,"w+");		// tvi file open 
 	if(tvi==NULL) err("Cannot open tvi file to write.");
 	progress("tvi file open.");
+	strcpy(fname,baseName);
+	strcat(fname,".timing");
+	sprintf(wbuf,"bap66 v%.2f",version);
+	if(tvitcreate(&tt,opt66on('t')?fname:NULL,wbuf,opt66argc,opt66argv,tstart,&rx66s.twr,&rx66s.trd)) err("Cannot open timing file to write.");
 
 //New bit
 
@@ -125,103 +187,175 @@ int main(int argc, char* argv[])
 	// set up the prologix for 66332
 	msg("Setting up prologix interface for 66332... ");
 	initPrologix(hp);							// set up interface
-	sprintf(wbuf,"++addr %d\n", gpibaddr);
-	wrtstr(hp,wbuf);								// point to our instr
 	progress("Prologix set up.");
 
-	// grab bus, terminate instrument communications, ID instrument
-	msg("Checking GPIB bus... ");
-	sprintf(wbuf,"++ifc\n");wrtstr(hp,wbuf);		// send INTERFACE CLEAR
-	tickle(500);
-	sprintf(wbuf,"++clr\n");wrtstr(hp,wbuf);		// send CLEAR to instrument itself
-	msg("Waiting while bus clears... ");
-	tickle(500);
-	progress("Bus cleared.");
-
-	// initialize HP function
-	msg("Check ID of Instrument... ");
-	wrtstr(hp,"*IDN?\n");						// ask for IDN
-	tickle(300);
-	rbuf[0]='\0';								// clear string
-	getmsg(hp,rbuf);							// get message from addr
-	if(strstr(rbuf,"66332")==NULL){
-		fprintf(stderr,"Instrument at %d identifies as:'%s' (%ld chars)",gpibaddr,rbuf,strlen(rbuf));
-		err("Bad instrument ID");
-	}else{
-		for(i=0;i<strlen(rbuf);i++){if(rbuf[i]=='\r'||rbuf[i]=='\n')rbuf[i]='\0';}
-		progress(rbuf);
-	}
-	progress("Instrument ID checked OK; initialising...");
-	sprintf(wbuf,"*RST;\n");wrtstr(hp,wbuf); 		// reset
-	tickle(2500);
-	sprintf(wbuf,"SENSe:CURRent:RANGe MAX;\n"); 	// 5A range
-	wrtstr(hp,wbuf);
-
-	msg("Checking for instrument errors... ");
-	j=0;
-	do{
-		sprintf(wbuf,"SYST:ERR?;\n");wrtstr(hp,wbuf); 	// ask for errors
-		tickle(300);
-		rbuf[0]='\0';
-		getmsg(hp,rbuf);								// Tx
-		i=sscanf(rbuf,"%d",&scpi);						// Rx
-		sprintf(wbuf,"err check (%d): %s",j++,rbuf);
-		progress(wbuf);msg(wbuf);
-	}while(i!=1 || scpi!=0);
+	// clear bus, ID instrument, reset only if not already set up, empty error queue (scpi66.h)
+	msg("Bringing up instrument... ");
+	up66(hp,USBpath,gpibaddr,"SENSe:CURRent:RANGe MAX\n");	// 5A range
 
 	progress("Entering main loop...");
-	sprintf(wbuf,"VOLT %.6lf;CURR %.6lf\n",1.00,0.00);	// set V & I to harmless values
-	wrtstr(hp,wbuf);tickle(50);							// send	
-	wrtstr(hp,"OUTP ON\n");tickle(50);					// enable output
+	vset=1.00; iset=0.00;								// harmless V & I until first .ti line
+	sprintf(wbuf,"VOLT %.6lf;CURR %.6lf\n",vset,iset);	// set V & I to harmless values
+	wrtstr(hp,wbuf);									// send	
+	wrtstr(hp,"OUTP ON\n");ready66(hp,UP66TMAX);		// enable output, on once *OPC? answers
 	// TIME: in Raspbian, use clock_gettime()
 	clock_gettime(CLOCK_REALTIME, &ts);					// present into ts(tart) structure
 	clock_gettime(CLOCK_REALTIME, &tn);					// present into tn(ow) structure
 	lastmeastime = meastime = 0.00; 					// init meastime
 	dt=0.00;
+	r66starttim(&ring,tvi,NULL,logfile,tt.f,binary,show);		// no file or screen i/o in the loop from here
+	rate66init(&rate);
+
+	if(listmode){									// compile .ti into list segments
+		tprev=0.00; iprev=0.00;						// harmless 0A until first .ti time
+		while ( fgets(cinline,254,ti) != NULL ) {
+			nlines++;
+			if(strlen(cinline)<3){continue;}		// too small for time-current value
+			if(2!=sscanf(cinline,"%lf %lf",&tin,&iin)){
+				cinline[strcspn(cinline,"\r\n")]='\0';
+				sprintf(wbuf,"Failed to get 2 floats in line %d (%.60s)",nlines,cinline);
+				r66err(&ring,wbuf);				// the writer is running, let it drain
+			}
+			if(tin>tprev){							// previous level held until tin
+				vset=(iprev<0.00)?Vmin-0.001:Vmax+0.001;
+				if(nseg>0 && seg[nseg-1].i==fabs(iprev) && seg[nseg-1].v==vset){
+					seg[nseg-1].dwell += tin-tprev;	// same level, stretch it
+				}else{
+					if(nseg>=maxseg){
+						maxseg = maxseg? 2*maxseg : 1024;
+						seg = realloc(seg,maxseg*sizeof(struct seg66));
+						if(seg==NULL) r66err(&ring,"Out of memory compiling .ti file.");
+					}
+					seg[nseg].v = vset;
+					seg[nseg].i = fabs(iprev);
+					seg[nseg].dwell = tin-tprev;
+					nseg++;
+				}
+				tprev=tin;
+			}
+			iprev=iin;
+		}
+		if(nseg<1) r66err(&ring,"No waveform segments in .ti file.");
+		nchunk = (nseg+LISTPTS-1)/LISTPTS;
+		sprintf(wbuf,"Compiled %d lines to %d segments, %d list chunks, %.1lfs.",nlines,nseg,nchunk,tprev);
+		r66text(&ring,R66SAY,wbuf);
+
+		listsetup(hp);
+		listcmd(cmd[0],seg,MIN(LISTPTS,nseg),0.00);
+		upl=0.00; cut=0.00; sched=0.00;				// boundary gap, dwell cut, chunk schedule
+		wrtstr(hp,cmd[0]);
+		if((ne=listerr(hp,ebuf,sizeof(ebuf)))>0){	// the instrument has it all when this answers
+			sprintf(wbuf,"List chunk 1: %d errors, %.60s",ne,ebuf);
+			r66err(&ring,wbuf);
+		}
+		clock_gettime(CLOCK_REALTIME, &ts);			// time zero is the first trigger
+		tgo=0.00;
+		for(c=0;c<nchunk;c++){
+			k0 = c*LISTPTS; n = MIN(LISTPTS,nseg-k0);
+			for(dur=0.00,i=0;i<n;i++) dur+=seg[k0+i].dwell;
+			tend = MAX(tgo+dur-cut,tgo+n*LISTDWMIN);	// when this chunk's list is due to run out, dwells cut no shorter than LISTDWMIN
+			late = tgo-sched-cut;					// residual left after the cut
+			sched += dur;
+			if(c+1<nchunk){							// compile next chunk while this one plays
+				cut = MAX(0.00,late+upl);
+				listcmd(cmd[(c+1)%2],seg+k0+n,MIN(LISTPTS,nseg-k0-n),cut);
+			}
+			for(done=FALSE;!done;){					// host only measures, until the instrument says the list is done
+				r66time(&ring,&tt);					// -t: the last sample's phases
+				do{
+					clock_gettime(CLOCK_REALTIME, &tn);
+					meastime = (tn.tv_sec-ts.tv_sec)+(double)((tn.tv_nsec-ts.tv_nsec))/GIG;
+					i=meas2(hp,&vm,&im);
+				}while(i!=2);
+				tvitbus(&tt);
+				rate66tick(&rate);
+				if(vm>Vmax || vm<Vmin){ r66text(&ring,R66LOG,"Hit a voltage limit... "); }
+				dt=meastime-lastmeastime; lastmeastime = meastime;
+				dQ+=dt*im;									// accumulate delta charge
+				shw[0]=npts++; shw[1]=meastime; shw[2]=vm; shw[3]=im; shw[4]=dt; shw[5]=rate.now; shw[6]=dQ; shw[7]=nchunk;
+				r66show(&ring,npts%1000==1,c+1,shw,8);		// screen, every 1000th to log
+				r66tvi(&ring,R66TVI,3,meastime,vm,im);		// triple to tvi file
+				while(!done && meastime+2.0*dt>=tend){		// due before another sample would end: ask until it has played out
+					esr = atoi(rx66query(hp,"*ESR?\n",0.0));
+					tvitbus(&tt);
+					clock_gettime(CLOCK_REALTIME, &tn);
+					tfin = (tn.tv_sec-ts.tv_sec)+(double)((tn.tv_nsec-ts.tv_nsec))/GIG;
+					if((esr&ESRERR) && (ne=listerr(hp,ebuf,sizeof(ebuf)))>0){	// not already drained after the upload
+						nlerr += ne;
+						sprintf(wbuf,"List chunk %d: %d errors while playing, %.60s",c+1,ne,ebuf);
+						r66text(&ring,R66LOG,wbuf);
+					}
+					done = esr&ESROPC;
+					if(!done && tfin>tend+LISTTMO) r66err(&ring,"List never reported done (*OPC)... aborting run!");
+				}
+			}
+			if(c+1<nchunk){							// the list memory is free from now: output holds the last level
+				rx66write(hp,cmd[(c+1)%2]);			// next list straight after this one
+				ne = listerr(hp,ebuf,sizeof(ebuf));	// answered once it is all in
+				tvitbus(&tt);						// in the last sample's time
+				clock_gettime(CLOCK_REALTIME, &tn);
+				tgo = (tn.tv_sec-ts.tv_sec)+(double)((tn.tv_nsec-ts.tv_nsec))/GIG;
+				upl = (c==0)? tgo-tend : 0.8*upl+0.2*(tgo-tend);	// learn the gap, due end to next list in, seeing it done included
+				if(ne>0){							// rejected, this chunk's waveform is lost
+					nlerr += ne;
+					sprintf(wbuf,"List chunk %d: %d errors on upload, %.60s",c+2,ne,ebuf);
+					r66text(&ring,R66LOG,wbuf);
+				}
+			}
+		}
+		sprintf(wbuf,"List playback ended %.3lfs behind schedule (seen %.0lfms later); %d chunk gaps of ~%.1lfms, %d list errors.",tend-sched,1000.0*(tfin-tend),nchunk-1,1000.0*upl,nlerr);
+		r66text(&ring,R66LOG,wbuf);
+	}
+
 	// now iterate read-set loop until .ti file ends
-	while ( fgets(cinline,254,ti) != NULL ) {		// there is another line
+	while ( !listmode && fgets(cinline,254,ti) != NULL ) {		// there is another line
         nlines++;       /* count lines in */
         if(strlen(cinline)<3){continue;}			// too small for time-current value
 		if(2!=sscanf(cinline,"%lf %lf",&tin,&iin)){
-			fprintf(stderr,"Failed to get 2 floats in line %d (%s)\n",nlines,cinline);
-			exit(1);
+			cinline[strcspn(cinline,"\r\n")]='\0';
+			sprintf(wbuf,"Failed to get 2 floats in line %d (%.60s)",nlines,cinline);
+			r66err(&ring,wbuf);					// the writer is running, let it drain
         }
         // if meastime is ahead of time read in, tin, read in more lines to increase value
         if(meastime>tin){continue;}
         // set & measure until meastime again > tin
         while(meastime<tin){
+			r66time(&ring,&tt);						// -t: the last sample's phases
 			// READOUT V & I
 			do{
 				clock_gettime(CLOCK_REALTIME, &tn);					// present into tn(ow) structure
 				meastime = (tn.tv_sec-ts.tv_sec)+(double)((tn.tv_nsec-ts.tv_nsec))/GIG; // meastime
-				wrtstr(hp,"MEAS:VOLT?\n");			// request the terminal voltage
-				getmsg(hp,rbuf);
-				i=sscanf(rbuf,"%lf",&vm);
-				wrtstr(hp,"MEAS:CURR?\n");
-				getmsg(hp,rbuf);
-				i+=sscanf(rbuf,"%lf",&im);
+				i=setmeas(hp,vset,iset,&vm,&im);		// latest setpoint out, V & I back, one transaction
 			}while(i!=2);											// something went wrong?
+			tvitbus(&tt);
+			rate66tick(&rate);
 			if(vm>Vmax || vm<Vmin){								// hit a voltage limit!
 //				sprintf(wbuf,"VOLT %.6lf;CURR %.6lf\n",1.00,0.00);	// set V & I to harmless values
 //				wrtstr(hp,wbuf);tickle(50);							// send	
 //				wrtstr(hp,"OUTP OFF\n");tickle(50);					// enable output
-				progress("Hit a voltage limit... ");
+				r66text(&ring,R66LOG,"Hit a voltage limit... ");
 //				err("Hit a voltage limit... aborting run!");
 			}
 			dt=meastime-lastmeastime; lastmeastime = meastime;
 			dQ+=dt*im;										// accumulate delta charge
-			sprintf(rbuf,"pt%d: %.3lfs V=%.3lf, I=%+.3lf; dt=%.3lfs dQ=%sAh ",
-					npts++,meastime,vm,im,dt,sengstr(dQ/3600.0,3));
-			msg(rbuf);
-			if(npts%1000==1){fprintf(logfile,"%s\n",rbuf);}
-			fprintf(tvi,"%.3lf %s %s\n", meastime, engstr(vm,6), engstr(im,6));	// triple to tvi file
+			shw[0]=npts++; shw[1]=meastime; shw[2]=vm; shw[3]=im; shw[4]=dt; shw[5]=rate.now; shw[6]=dQ;
+			r66show(&ring,npts%1000==1,0,shw,7);		// screen, every 1000th to log
+			r66tvi(&ring,R66TVI,3,meastime,vm,im);		// triple to tvi file
 		}
-		sprintf(wbuf,"VOLT %.6lf;CURR %.6lf\n",(iin<0.00)?Vmin-0.001:Vmax+0.001,fabs(iin)); // set V & I
-		wrtstr(hp,wbuf);							// send	
+		vset=(iin<0.00)?Vmin-0.001:Vmax+0.001;		// set V & I, sent with next measurement
+		iset=fabs(iin);
 	}
+	if(!listmode) setonly(hp,vset,iset);			// the last .ti line's setpoint goes out too
 
-	progress("Completed measurement sequence.");
+	r66time(&ring,&tt);
 	wrtstr(hp,"OUTP OFF\n");					// disable outputs
+	r66stop(&ring);								// drain files & display
+	tvitclose(&tt);
+	progress("Completed measurement sequence.");
+	sprintf(wbuf,"Achieved %.2lf samples/s over %ld samples.",rate.run,rate.n);
+	progress(wbuf);
+	rx66stats(wbuf);
+	progress(wbuf);
 
 	time(&tnow);
 	sprintf(wbuf,"bap66 done (took %ld secs, %.1f hours)",
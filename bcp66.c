@@ -1,6 +1,7 @@
 // Program to cycle a battery using an HP/Agilent/Keysight 66332A on Raspberry Pi via Prologix 
 // JBS Nov 2020
 
+#define _GNU_SOURCE				// fopencookie for the .tvia writer (tvia.h)
 #include    <stdio.h>
 #include    <stdlib.h>
 #include    <string.h>
@@ -20,6 +21,20 @@
 
 FILE *logfile;				// to log errors
 #include "prologix.h"
+#include "scpi66.h"
+#include "tviring.h"
+#include "tvia.h"
+#include "opt66.h"
+
+char *statenames[]={"???","CHG","DIS","PRE","SET","EQU"};
+
+void show(struct rec66 *r, char *buf)	// display line, formatted by the writer thread
+{
+	double *x=r->u.x;
+
+	sprintf(buf, "pt%.0lf/%.0lf: %.0lfs, V=%.3lf I=%s cyc=%d dt=%.2lfs %.1lf/s dwell=%.0lf Q=%sAh C%c %s",
+		x[0],x[1],x[2],x[3],r66s(x[4],3),r->k,x[5],x[6],x[7],r66s(x[8]/3600.0,3),x[9]?'C':'V',statenames[(int)x[10]]);
+}
 
 int main(int argc, char* argv[])
 {
@@ -33,19 +48,23 @@ int main(int argc, char* argv[])
 	struct timespec ts, tn;
 	double deltat=0.00,meastime,lastmeastime;
     double Ich, Idis, Ich_end, Idis_end, iset;
-    double Vmin, Vmax, vnow=0.00, inow=0.00;
+    double Vmin, Vmax, vnow=0.00, inow=0.00, vset;
     double batQ=0.00, Qmax=0.00;
     float Qfinal, fsmax=0.94, Tsmin, Tsincesec;
     int tdwellplus,tdwellminus,ncyc,tfinal,cycle=0;
 	int dwell;
 	int ccmodeCounter;
     int state, finished=0, CCmode;
-    char *statename;
     long int npts=0, ets, nlines=0;
     int gpibaddr=5, argcnt=0;
     char baseName[64], logfname[128];
 	struct termios spset;
 	int restplus=0, restminus=0;
+	struct rate66 rate;
+	struct ring66 ring;
+	struct tvit tt;
+	int binary, archive;
+	double shw[11];
 
 	// version 1.0: adjusted for 66332A
 	// version 1.01: fixed ets/meastime check
@@ -55,7 +74,19 @@ int main(int argc, char* argv[])
 	// version 1.06: add check for crazy current value
 	// version 1.07: init inow and deltat to zero to stop (?) silly batQ values at start
 	// version 1.08: add option for rest (I=0) during tdwell
-    float version = 1.08;
+	// version 1.10: setpoint & V/I readback pipelined into one transaction (scpi66.h), show samples/s
+	// version 1.11: files & display written by a thread fed from a lock-free ring (tviring.h)
+	// version 1.12: -b option writes binary .tvib
+	// version 1.13: replies read by poll() with RTT-adaptive deadlines, numbers parsed in place (rx66.h)
+	// version 1.14: bring-up waits on *OPC? instead of fixed sleeps, skips *RST when already set up (up66)
+	// version 1.15: -a option writes a compressed .tvia archive (tvia.h)
+	// version 1.16: -t option times each sample's phases into a .timing sidecar (tvitime.h)
+    float version = 1.16;
+
+	opt66(&argc,argv);							// -x options out of the positional args
+	binary = opt66on('b');
+	archive = opt66on('a');						// records handed over as for -b
+	if(archive) binary=1;
 
     if (argc<13+1 || argc>15+1) { // ??
         fprintf(stderr,"bcp66 V%.2f jbs&cjd Nov 2020, June 2021, Sep 2021\n", version);
@@ -75,12 +106,15 @@ int main(int argc, char* argv[])
         fprintf(stderr,"        optionally Addr is the GPIB bus address, def=%d.\n",gpibaddr);
         fprintf(stderr,"        optionally fsmax is the max sample frequency, def=%.2f.\n",fsmax);
         fprintf(stderr,"Cycles the battery by the CCCV method, while measuring V & I,\n");
-        fprintf(stderr,"~8 samples/second, tvi file entries limited by fsmax.\n");
+        fprintf(stderr,"~20 samples/second, tvi file entries limited by fsmax.\n");
         fprintf(stderr,"If tdwell+/- is <0, the period is set and current is set to zero (CV->rest).\n");
         fprintf(stderr,"Assuming a 66332A instrument on Prologix/Fenrir USB-GPIB interface.\n");
         fprintf(stderr,"Requires no drivers, controls prologix using ++cmd protocol.\n");
         fprintf(stderr,"Creates basename.log & baseName.tvi with time-volts-amps-dQ-cyc quintuples.\n");
         fprintf(stderr,"Displays: #points, elapsed time, V, I, cycle, Tsample, CV time, dQ, and CC/CV mode.\n");
+        fprintf(stderr,"Option -b writes binary .tvib (tvib.h, tvibconv converts) instead of .tvi.\n");
+        fprintf(stderr,"Option -a writes a compressed .tvia archive (tvia.h) instead, read as it is by tvibconv & the analysis tools.\n");
+        fprintf(stderr,"Option -t times each sample's bus, wait & calc phases and the file writes into baseName.timing (tvitime reads it).\n");
         fprintf(stderr,"\n");
         exit(1);
     }
@@ -155,7 +189,7 @@ int main(int argc, char* argv[])
 	time(&tstart);									// note the time of start
 	sprintf(wbuf,"%s started, logfile opened, at %s",argv[0],ctime(&tstart));
 	progress(wbuf);
-	for(wbuf[0]='\0',i=0;i<argc;i++){strcat(wbuf,argv[i]);strcat(wbuf," ");}
+	for(wbuf[0]='\0',i=0;i<opt66argc;i++){strcat(wbuf,opt66argv[i]);strcat(wbuf," ");}
 	progress(wbuf);
 
 	// find interface
@@ -175,51 +209,29 @@ int main(int argc, char* argv[])
 
 	msg("Setting up prologix interface... ");
 	initPrologix(hp);								// set ip inteface
-	sprintf(wbuf,"++addr %d\n", gpibaddr);
-	wrtstr(hp,wbuf);								// point to our instr
-
-
-	// grab bus, terminate communications, ID instrument
-	msg("Clearing GPIB bus... ");
-	sprintf(wbuf,"++ifc\n");wrtstr(hp,wbuf);		// send INTERFACE CLEAR
-	sprintf(wbuf,"++clr\n");wrtstr(hp,wbuf);		// send CLEAR to hp itself
-	msg("Waiting while bus clears... ");
-	tickle(1000);									// allow stuff to happen
-
-	msg("Check ID of Instrument... ");
-	wrtstr(hp,"*IDN?\n");						// ask for IDN
-	getmsg(hp,rbuf);							// get message from addr
-	if(strstr(rbuf,"66332")==NULL){
-		fprintf(stderr,"Instrument at %d identifies as:'%s' (%d chars)",gpibaddr,rbuf,strlen(rbuf));
-		err("Bad instrument ID");
-	}else{
-		progress(rbuf);
-	}
 
-	// initialize HP function
-	msg("Setting up hp... ");
-	sprintf(wbuf,"*RST;\n");wrtstr(hp,wbuf); 		// init ADC parameters
-	tickle(2500);
+	// clear bus, ID instrument, reset only if not already set up, empty error queue (scpi66.h)
+	msg("Bringing up instrument... ");
 	if(Ich>0.02 || Idis>0.02){										// big currents
-		sprintf(wbuf,"SENSe:CURRent:RANGe MAX\n");wrtstr(hp,wbuf); 	// 5A range
+		strcpy(wbuf,"SENSe:CURRent:RANGe MAX\n"); 					// 5A range
 	}else{
-		sprintf(wbuf,"SENSe:CURRent:RANGe MIN\n");wrtstr(hp,wbuf); 	// 20mA range
+		strcpy(wbuf,"SENSe:CURRent:RANGe MIN\n"); 					// 20mA range
 	}
-
-	msg("Checking for instrument errors... ");
-	do{
-		i=0;
-		sprintf(wbuf,"SYST:ERR?;\n");wrtstr(hp,wbuf); 	// check for errors
-		getmsg(hp,rbuf);
-		sscanf(rbuf,"%d",&i);
-		if(i){progress(rbuf);msg(rbuf);}
-	}while(i);
+	up66(hp,USBpath,gpibaddr,wbuf);
 
 	// now open tvi file
 	strcpy(logfname,baseName);
-	strcat(logfname,".tvi");
-	tvi = fopen(logfname,"w+");							// tvi file open 
+	strcat(logfname,archive?".tvia":binary?".tvib":".tvi");
+	if(binary){
+		sprintf(wbuf,"bcp66 v%.2f",version);
+		if(archive) tvi = tviacreate(logfname,5,"t V I Ah cyc",NULL,wbuf,opt66argc,opt66argv,tstart);
+		else tvi = tvibcreate(logfname,5,"t V I Ah cyc",wbuf,opt66argc,opt66argv,tstart);
+	}else tvi = fopen(logfname,"w+");					// tvi file open 
 	if(tvi==NULL) err("Cannot open tvi file");
+	strcpy(logfname,baseName);
+	strcat(logfname,".timing");
+	sprintf(wbuf,"bcp66 v%.2f",version);
+	if(tvitcreate(&tt,opt66on('t')?logfname:NULL,wbuf,opt66argc,opt66argv,tstart,&rx66s.twr,&rx66s.trd)) err("Cannot open timing file");
 
 
 #define CHARGE 1
@@ -231,6 +243,7 @@ int main(int argc, char* argv[])
 	state=CHARGE;									// start going up to Vmax
 	CCmode=TRUE;ccmodeCounter=0;					// assume in CC mode to start
 	inow=Ich;										// assume I large (not decayed)
+	vset=Vmax; iset=fabs(Ich);						// first setpoint goes out with first measurement
 	time(&tmark);									// time in seconds for dwells
 	clock_gettime(CLOCK_REALTIME, &ts);				// present into ts(tart) structure
 	clock_gettime(CLOCK_REALTIME, &tn);				// present into tn(ow) structure
@@ -238,7 +251,10 @@ int main(int argc, char* argv[])
 	wrtstr(hp,"OUTP ON;\n"); 						// enable output
 	Tsincesec=0.0;									// no time elapsed since last tvi file entry
 	msg("Commencing main state-machine loop... ");
+	r66starttim(&ring,tvi,NULL,logfile,tt.f,binary,show);	// no file or screen i/o in the loop from here
+	rate66init(&rate);
 	while(!finished){
+		r66time(&ring,&tt);							// -t: the last sample's phases
 
 		// in Raspbian, use clock_gettime()
 		lastmeastime = meastime;					// deal with time
@@ -249,103 +265,91 @@ int main(int argc, char* argv[])
 		time(&tnow);
 		ets = (long)tnow-tstart;					// total Elapsed Time in Secs
 
-		do{
-			wrtstr(hp,"MEAS:VOLT?\n"); 			// request the terminal voltage
-			getmsg(hp,rbuf);					// read it...
-			sscanf(rbuf,"%lf",&vnow);  			// scanf it...
-			wrtstr(hp,"MEAS:CURR?\n"); 			// request the terminal CURRENT ch1
-			getmsg(hp,rbuf);  					// read it...
-			sscanf(rbuf,"%lf",&inow);    		// scanf it...
-		}while(inow>100.0 || inow<-100.0);		// crazy result
+		// send last setpoint & read V & I back in one bus transaction
+		while(setmeas(hp,vset,iset,&vnow,&inow)!=2 || inow>100.0 || inow<-100.0);	// crazy result
+		tvitbus(&tt);
+		rate66tick(&rate);
 
 		if(npts%64==0){						// every so many cycles
 			do{
 				i=0;
-				sprintf(wbuf,"SYST:ERR?\n");wrtstr(hp,wbuf); 	// check for errors
-				getmsg(hp,rbuf);
+				sprintf(wbuf,"SYST:ERR?\n");rx66write(hp,wbuf); 	// check for errors
+				rx66getmsg(hp,rbuf);
 				sscanf(rbuf,"%d",&i);
-				if(i){progress(rbuf);msg(rbuf);}
+				if(i){r66text(&ring,R66SAY,rbuf);}
 			}while(i);
+			tvitbus(&tt);
 		}
 
 		switch(state){									// chg/dischg/etc state machine
 			default:
 			case CHARGE:
-				statename="CHG";
 				if(restplus && !CCmode){ iset=0.00; }else{ iset=fabs(Ich); }
-				sprintf(wbuf,"VOLT %.4lf;CURR %.4lf;\n",Vmax,iset); // set V & I
-				wrtstr(hp,wbuf);									// send	
+				vset=Vmax;											// V & I sent with next measurement
 				time(&tnow);dwell=tnow-tmark;
 				if(CCmode){time(&tmark);}
 				else{											// out of CC
 					if(dwell>tdwellplus || (!restplus && inow<Ich_end) ){ // charge done
 						if(cycle!=0){							// just done ch/dis cycle
-							fprintf(logfile,"# Cycle=%d, dQ=%.1lfC, %sAh\n",cycle,batQ,sengstr(batQ/3600.0,3));
+							sprintf(wbuf,"# Cycle=%d, dQ=%.1lfC, %sAh",cycle,batQ,sengstr(batQ/3600.0,3));
+							r66text(&ring,R66LOG,wbuf);
 							//Qmax=MAX(Qmax,fabs(batQ));// dont keep chg capacity
 						}
-						progress("Completed a cycle.");
-						fprintf(logfile,"Charge transferred %sC, %sAh\n",sengstr(batQ,3),sengstr(batQ/3600.0,3));
+						r66text(&ring,R66LOG,"Completed a cycle.");
+						sprintf(wbuf,"Charge transferred %sC, %sAh",sengstr(batQ,3),sengstr(batQ/3600.0,3));
+						r66text(&ring,R66LOG,wbuf);
 						cycle++;								// inc # cycle
 						batQ=0.00;								// reset charge counter
 						dwell=0;				// no dwell any more
 						if(cycle>ncyc){							// done cycling
 							state=POSTSET;						// go to Qset phase
 							time(&tmark);						// reset dwell time
-							msg("Moving to charge setting phase...");
-							progress("Moving to charge setting phase...");
+							r66text(&ring,R66SAY,"Moving to charge setting phase...");
 							CCmode=TRUE;ccmodeCounter=0;		// set safe for next state
 						}
 						else{									// start next cycle
 							state=DISCHARGE;
-							msg("Moving to DISCHARGE...");
-							progress("Moving to DISCHARGE...");
+							r66text(&ring,R66SAY,"Moving to DISCHARGE...");
 						}
 						CCmode=TRUE;ccmodeCounter=0;			// set safe for next state
 					}
 				}
 			break;
 			case DISCHARGE:
-				statename="DIS";
 				if(restminus && !CCmode){ iset=0.00; }else{ iset=fabs(Idis); }
-				sprintf(wbuf,"VOLT %.4lf;CURR %.4lf;\n",Vmin,iset);		// set V & I
-				wrtstr(hp,wbuf);											// send
+				vset=Vmin;													// V & I sent with next measurement
 				time(&tnow);dwell=tnow-tmark;
 				if(CCmode){time(&tmark);}							// reset dwelltime
 				else{
 					if(dwell>tdwellminus || (!restminus && fabs(inow)<Idis_end)){ // discharge done
-						fprintf(logfile,"Charge transferred %sC, %sAh\n",sengstr(batQ,3),sengstr(batQ/3600,3));
+						sprintf(wbuf,"Charge transferred %sC, %sAh",sengstr(batQ,3),sengstr(batQ/3600,3));
+						r66text(&ring,R66LOG,wbuf);
 						Qmax=MAX(Qmax,fabs(batQ));					// keep capacity
 						batQ=0.00;									// reset charge counter
 						state=CHARGE;								// start next cycle
 						dwell=0;				// no dwell any more
 						time(&tmark);
-						msg("Moving to CHARGE...");
-						progress("Moving to CHARGE...");
+						r66text(&ring,R66SAY,"Moving to CHARGE...");
 						CCmode=TRUE;ccmodeCounter=0;				// safe for next state
 					}
 				}
 			break;
 			case POSTSET:										// on way to prescribed Q
-				statename="SET";
 				iset=fabs(Idis);
-				sprintf(wbuf,"VOLT %.4lf;CURR %.4lf;\n",Vmin,iset); // set V & I
-				wrtstr(hp,wbuf);										// send	
+				vset=Vmin;												// V & I sent with next measurement
 				if(Qmax<0.001){
 					wrtstr(hp,"OUTP OFF;\n"); 						// disable output
-					err("Qmax too small... aborting SET phase");
+					r66err(&ring,"Qmax too small... aborting SET phase");
 				}
 				if(fabs(batQ)/Qmax>(1-Qfinal/100.0)){					// Q low enough
 					time(&tmark);
 					state=EQUILIBRATE;
-					msg("Moving to final settling phase...");
-					progress("Moving to final settling phase...");
+					r66text(&ring,R66SAY,"Moving to final settling phase...");
 				}
 			break;
 			case EQUILIBRATE:
-				statename="EQU";
 				time(&tnow);dwell=tnow-tmark;
-				sprintf(wbuf,"VOLT %.4lf;CURR %.4lf;\n",(Vmax+Vmin)/2.0,0.00); // set V & I
-				wrtstr(hp,wbuf);											// send			
+				vset=(Vmax+Vmin)/2.0; iset=0.00;							// V & I sent with next measurement
 				if(dwell>tfinal)finished=TRUE;
 			break;
 		}
@@ -367,17 +371,20 @@ int main(int argc, char* argv[])
 		if(npts++ && Tsincesec>Tsmin){					// not first point, OK to log
 			Tsincesec=0.0;
 			nlines+=1;
-			fprintf(tvi, "%.3lf %.3lf %.3lf  %s %d\n", meastime,vnow,inow,engstr(batQ/3600.0,3),cycle);fflush(tvi);
-		}
-		sprintf(wbuf, "pt%ld/%ld: %lds, V=%.3lf I=%s cyc=%d dt=%.2lfs dwell=%d Q=%sAh C%c %s", 
-					nlines,npts,ets,vnow,sengstr(inow,3),cycle,deltat,dwell,
-						sengstr(batQ/3600.0,3),CCmode?'C':'V',statename);
-		msg(wbuf);								// screen display
-		if(ccmodeCounter>-2 && ccmodeCounter<2){
-			progress(wbuf);						// log a display line before mode changes
+			r66tvi5(&ring,meastime,vnow,inow,batQ/3600.0,cycle);
 		}
+		shw[0]=nlines; shw[1]=npts; shw[2]=ets; shw[3]=vnow; shw[4]=inow; shw[5]=deltat;
+		shw[6]=rate.now; shw[7]=dwell; shw[8]=batQ; shw[9]=CCmode; shw[10]=state;
+		r66show(&ring,ccmodeCounter>-2 && ccmodeCounter<2,cycle,shw,11);	// screen, logged before mode changes
 	}
+	r66time(&ring,&tt);
 	wrtstr(hp,"OUTP OFF;\n"); 						// disable output
+	r66stop(&ring);								// drain files & display
+	tvitclose(&tt);
+	sprintf(wbuf,"Achieved %.2lf samples/s over %ld samples.",rate.run,rate.n);
+	progress(wbuf);
+	rx66stats(wbuf);
+	progress(wbuf);
 
 	time(&tnow);
 	sprintf(wbuf,"bcp66 done (took %ld secs, %.1f hours).\n",tnow-tstart,(tnow-tstart)/3600.00);	// display we are finished
@@ -2,6 +2,7 @@
 // optionally includes frequency/z analysis by system calls to dftp & ff
 // JBS Dec 24, 2020
 
+#define _GNU_SOURCE				// cpu affinity for real-time mode (sclk66.h)
 #include    <stdio.h>
 #include    <stdlib.h>
 #include    <string.h>
@@ -30,6 +31,53 @@ FILE *logfile;										// to log errors
 double elapstime;
 
 #include "prologix.h"
+#include "scpi66.h"
+#include "tviring.h"
+#include "tvia.h"
+#include "opt66.h"
+#include "sclk66.h"
+#include "zdft.h"
+#include "zfit.h"
+#include "zfft.h"
+
+#define SHDIG 1		// display flags, in rec66.k
+#define SHVOID 2
+#define SHPRE 4
+#define SHPULSE 8
+
+void show(struct rec66 *r, char *buf)	// display line, formatted by the writer thread
+{
+	double *x=r->u.x;
+
+	if(r->k&SHDIG){
+		sprintf(buf,"pt%.0lf: %.3lfs V=%.3lf, I=%+.3lf; blk=%.0lf %.1lf/s dQ=%sAh %c %.0lf%% (%.1lfH to go)",
+			x[0],x[1],x[2],x[3],x[4],x[5],r66s(x[6]/3600.0,3),(r->k&SHPRE)?'<':'+',x[7],x[8]);
+	}else{
+		sprintf(buf,"pt%.0lf: %.3lfs V=%.3lf, I=%+.3lf; dt=%.3lfs %.1lf/s dQ=%sAh %c %c %c %.0lf%% (%.1lfH to go)",
+			x[0],x[1],x[2],x[3],x[4],x[5],r66s(x[6]/3600.0,3),(r->k&SHVOID)?'X':'O',(r->k&SHPRE)?'<':'+',
+			(r->k&SHPULSE)?'P':'M',x[7],x[8]);
+	}
+}
+
+// another whole cycle in the live estimate: Z at each tone to the log, the worst
+// standard error to the screen; returns that worst relative error
+double livez(struct ring66 *r, struct zdftlive *l, double *f, int nf)
+{
+	char buf[R66TXT];
+	double worst=0.0;
+	int i, iw=0;
+
+	for(i=0;i<nf;i++){
+		snprintf(buf,R66TXT,"Live Z, %d cycles: %sHz %sOhm %.2lf +/-%.2lf%%",l->ncyc,engstr(f[i],4),
+			engstr(cabs(l->Z[i]),4),carg(l->Z[i])*180.0/PI,100.0*l->se[i]);
+		r66text(r,R66LOG,buf);
+		if(l->se[i]>worst){ worst=l->se[i]; iw=i; }
+	}
+	if(l->ncyc<2) return worst;						// no scatter from one cycle yet
+	snprintf(buf,R66TXT,"Live Z after %d cycles: within +/-%.2lf%% (worst at %sHz)",l->ncyc,100.0*worst,engstr(f[iw],4));
+	r66text(r,R66SAY,buf);
+	return worst;
+}
 
 int main(int argc, char* argv[])
 {
@@ -38,30 +86,48 @@ int main(int argc, char* argv[])
 	char USBpath[64];
 	char rbuf[256], wbuf[128];
  	time_t tstart,tnow,tmark;
-	struct timespec ts, tn;
     double lastelapstime, lastvb, lastib;
     double Tcyc, mt_time=0.0, p_time=0.0;
     int gpibaddr=5;
     char baseName[64], logfname[128];
     float ncyc,fmin,fmax,Vmin,Vmax,Imax,ftmp,Xcyc;
     double deltaQ,ib,vb,Istim,dQ=0.00,dt,dtmp;
-    double freq, f[NFREQS], period;
-    double a[NFREQS], ph[NFREQS], iqf;
+    double freq, *f, period;
+    double *a, *ph, iqf;
     double Ibiggest=-100.0, Ismallest=100.0;
-    int i,j, nf=0, narg=0, npts=0, datvoid,scpi;
-    double mag,pha,fcheck,discard;
-    double imag[NFREQS],vmag[NFREQS],ipha[NFREQS],vpha[NFREQS];
+    int i,j, nf=0, narg=0, npts=0, datvoid;
+    double mag,pha,discard;
+    double *imag,*vmag,*ipha,*vpha,*fz,*zse;
     int sink=FALSE,getz=FALSE,refine=FALSE,readFreqs=FALSE;
 	struct termios spset;
+	struct rate66 rate;
+	struct ring66 ring;
+	struct tvit tt;
+	int binary, archive;
+	struct sclk66 clk;
+	double Ts=0.00, tcal;
+	double shw[9];
 	double actualImax,Imultiplier;
 	int qloops, eqI=FALSE, inpulse=FALSE, npulses=0;
 	double Pf, Pw, Ip, tr;
 	double dQexpected=0.00, Qerror;
 	double itrim, i_error, errpc;
-
-
-	FILE *fmp, *ffz, *bat, *frq, *gs, *ff, *ptvi;
-	char dftname[256],ffname[256], cmd[256];
+	int digmode=FALSE, armed=FALSE, dpts=0, nblk, ngap=0, k;		// digitizer array mode, fmax>2.5Hz
+	double dtint=0.00, tarm=0.00, tblk, tk, mtk, hdt, lasttk=-1.0, *vblk=NULL, *iblk=NULL;
+	double gap, gapsum=0.00, gapmax=0.00;		// unsampled time between sweeps
+
+
+	FILE *fmp, *ffz, *frq, *ptvi;
+	char dftname[256],ffname[256];
+	struct zdft zd, zl;						// after the run, live
+	struct zdftlive zlv;
+	struct zfit zfv, zfi;					// refined V & I
+	int npoly=2;							// -p, drift order+1
+	double ztol=0.0;						// -z, relative
+	int zok=0, zdone=FALSE;
+	double fbase;
+	int ndense=0, dense=FALSE, nmax, pts;	// -d, dense spectrum (zfft.h)
+	long nread;
     complex double cf[NFREQS], vf[NFREQS], z[NFREQS];
 
 	// version 3.00: cloned from bzp66 v 2.16
@@ -71,7 +137,30 @@ int main(int argc, char* argv[])
 	// version 6.01: gain reduced to 1.1 for itrim 
 	// version 6.03: fixing bug that crashes program around trim code
 	// version 6.04: initialise dQ... duh.
-    float version = 6.04; 
+	// version 6.05: setpoint & V/I readback pipelined into one transaction (scpi66.h), show samples/s
+	// version 6.10: digitizer array mode for fmax>2.5Hz, V/I blocks fetched with reconstructed times
+	// version 6.11: files & display written by a thread fed from a lock-free ring (tviring.h)
+	// version 6.12: -b option writes binary .tvib & .ptvib
+	// version 6.13: replies read by poll() with RTT-adaptive deadlines, numbers parsed in place (rx66.h)
+	// version 6.14: loop paced on a CLOCK_MONOTONIC grid (-s), real-time mode (-r), lateness stats (sclk66.h)
+	// version 6.15: bring-up waits on *OPC? instead of fixed sleeps, skips *RST when already set up (up66)
+	// version 6.16: V & I at all frequencies in one pass over the tvi (zdft.h), no .bat/.tmp or dftp calls
+	// version 6.17: live Z at each tone every cycle with its standard error, -z stops once settled
+	// version 6.18: ff refinement is an in-process simultaneous LS fit of V & I in two threads (zfit.h), -p drift order
+	// version 6.19: dense mode (-d), hundreds to thousands of tones on harmonics of fmin, Z by FFT (zfft.h)
+	// version 6.20: -a option writes compressed .tvia & .ptvia archives (tvia.h)
+	// version 6.21: -t option times each sample's phases into a .timing sidecar (tvitime.h)
+    float version = 6.21; 
+
+	opt66(&argc,argv);							// -x options out of the positional args
+	binary = opt66on('b');
+	archive = opt66on('a');						// records handed over as for -b
+	if(archive) binary=TRUE;
+	if(opt66val('s')!=NULL) Ts = atof(opt66val('s'));
+	if(opt66val('z')!=NULL) ztol = 0.01*atof(opt66val('z'));
+	if(opt66val('p')!=NULL) npoly = atoi(opt66val('p'))+1;
+	if(npoly<1 || npoly>ZFITPOLY) err("Drift order (-p) out of range.");
+	if(opt66val('d')!=NULL) ndense = atoi(opt66val('d'));
     if (argc<14+1 || argc>17+1) { // ??
         fprintf(stderr,"bz3p66 V%.2f jbs&cjd, Dec 2020 -> Oct 2021\n", version);
         fprintf(stderr,"Battery Z measurement with triphasic pulses via Prologix/Fenrir GPIB-USB & 66332A.\n");
@@ -89,16 +178,34 @@ int main(int argc, char* argv[])
         fprintf(stderr,"        tr is the rest period after the triphasic pulse before resuming multitone;\n");
         fprintf(stderr,"        baseName is the file string to be used;\n");
         fprintf(stderr,"        Addr is the optional GPIB bus address, def=%d.\n",gpibaddr);
-        fprintf(stderr,"        dftp is the [path]name of Scott/Farrow dft program (dftp,dvtv,etc);\n");
-        fprintf(stderr,"        ff is the [path]name of the Scott/Finer multitone optimiser program.\n");
+        fprintf(stderr,"        dftp, any word (e.g. dftp), turns on the built-in single-pass DFT;\n");
+        fprintf(stderr,"        ff, any word (e.g. ff), also fits all tones to V & I at once by least squares.\n");
         fprintf(stderr,"Makes a multitone tvi/Z measurement by sourcing current, measuring V & I.\n");
         fprintf(stderr,"If the USB parameter is set to \"skip\" the tvi measurement is skipped.\n");
-        fprintf(stderr,"Creates baseName.tvi, basename.log, [.bat, .fmp, [.ffz]] files.\n");
-        fprintf(stderr,"Z optionally computed by calls to dftp [& ff] at each frequency.\n");
-        fprintf(stderr,".bat file is dft script, fmp has dft's z values, ffz is refined fmp.\n");
+        fprintf(stderr,"Creates baseName.tvi, basename.log, [.fmp, [.ffz]] files.\n");
+        fprintf(stderr,"Z optionally computed at every frequency in one pass over the .tvi (or .tvib),\n");
+        fprintf(stderr,"over whole cycles at fmin, trend removed; fmp has the z values, ffz is refined fmp (ff).\n");
+        fprintf(stderr,"The ff fit has a drift polynomial, order set by -pN (0-%d, default 1).\n",ZFITPOLY-1);
         fprintf(stderr,"Frequencies are a 1-2-5 sequence between fmin and fmax;\n");
-        fprintf(stderr,"if fmax<0 frequencies are read from baseName.frq file, up to %d freqs.\n",NFREQS);
+        fprintf(stderr,"if fmax>2.5Hz (up to %.0lfHz) V & I come from the 66332A digitizer in blocks;\n",DIGFMAX);
+        fprintf(stderr,"  I is still stepped by the host, at least %d setpoints a period of fmax, so a slow\n",DIGSPP);
+        fprintf(stderr,"  bus lowers fmax (checked at start); ~2s sweeps, V & I not sampled for the tens\n");
+        fprintf(stderr,"  of ms each fetch & re-arm takes between them (logged).\n");
+        fprintf(stderr,"if fmax<0 frequencies are read from baseName.frq file, any number.\n");
+        fprintf(stderr,"Option -dN is dense mode: N tones log-spaced on the harmonics of fmin up to fmax,\n");
+        fprintf(stderr,"  Z by FFT of each cycle resampled (zfft.h); also used for >%d tones from a .frq file.\n",ZDFTMAX);
+        fprintf(stderr,"  No live Z or -z in dense mode, ff only up to %d tones.\n",ZFITMAX);
         fprintf(stderr,"Requires no drivers, communicates using ++cmd protocol.\n");
+        fprintf(stderr,"Option -b writes binary .tvib/.ptvib (tvib.h, tvibconv converts) instead of .tvi/.ptvi.\n");
+        fprintf(stderr,"Option -a writes compressed .tvia/.ptvia archives (tvia.h, some 7x smaller than .tvi,\n");
+        fprintf(stderr,"  t & V kept to 1e-6, I to 1e-9), read by the analysis tools and tvibconv as they are.\n");
+        fprintf(stderr,"Option -sTs samples on a fixed Ts second grid (default: measured bus time +25%%),\n");
+        fprintf(stderr,"  -r[cpu] runs the loop SCHED_FIFO, memory locked, pinned to cpu (default last).\n");
+        fprintf(stderr,"  Lateness against the grid is summarised in the log.\n");
+        fprintf(stderr,"Option -t times each sample's wait, bus & calc phases and the file writes into\n");
+        fprintf(stderr,"  baseName.timing (tvitime reads it).\n");
+        fprintf(stderr,"Z at each tone is updated every cycle at fmin during the run (log), with its standard error;\n");
+        fprintf(stderr,"  option -ztol (%%) ends the run early once every tone is within tol for 2 cycles (>=%d cycles).\n",ZDFTSTOP);
         fprintf(stderr,"Writes complete data, including pulses, to basename.ptvi file.\n");
         fprintf(stderr,"\n");
         exit(1);
@@ -141,14 +248,15 @@ int main(int argc, char* argv[])
 	ncyc = atof(argv[++narg]);
 	if(ncyc<1.1) err("Too few cycles requested.");
 	
-    fmin = atof(argv[++narg]);
+    fmin = fbase = atof(argv[++narg]);			// fbase keeps it exact for dense tones
 	if(fmin<0.1e-6) err("fmin is too small");
 	if(fmin>0.5) err("fmin is too large");
 
     fmax = atof(argv[++narg]);
     if(fmax<0){fmax=fabs(fmax);readFreqs=TRUE;}
 	if(fmax<1e-6) err("fmax is too small");
-	if(fmax>2.5) err("fmax is too large");
+	if(fmax>DIGFMAX) err("fmax is too large");
+	if(fmax>2.5) digmode=TRUE;				// too fast for polled MEAS, use digitizer
 	if(fmin>=fmax) err("Fmin>=Fmax");
 	
     Xcyc = atof(argv[++narg]);
@@ -187,26 +295,22 @@ int main(int argc, char* argv[])
 	sprintf(wbuf,"%s v%.2f started, logfile opened, at %s",argv[0],version,ctime(&tstart));
 	wbuf[strlen(wbuf)-1]='\0';	// clip off newline
 	progress(wbuf);
-	for(wbuf[0]='\0',i=0;i<argc;i++){strcat(wbuf,argv[i]);strcat(wbuf," ");}
+	for(wbuf[0]='\0',i=0;i<opt66argc;i++){strcat(wbuf,opt66argv[i]);strcat(wbuf," ");}
 	progress(wbuf);
 
 	// optional requests
 	if(argc>++narg) {						// this param means we do the dft 
 		getz=TRUE;
-		strcpy(dftname,argv[narg]);			// program to call
+		strcpy(dftname,argv[narg]);			// was the program to call, now just turns on zdft.h
 		strcpy(logfname,baseName); strcat(logfname,".fmp");
 		fmp = fopen(logfname,"w+");			// fmp file open
 		if(fmp==NULL) err("Cannot open fmp file");
-		progress(".fmp file open.\n");
-		strcpy(logfname,baseName); strcat(logfname,".bat");
-		bat = fopen(logfname,"w+");			// batch file open 
-		if(bat==NULL) err("Cannot open bat file");
-		progress(".bat file open.\n");
+		progress(".fmp file open.");
 	}
 
 	if(argc>++narg) {						// this param means we do ff
 		refine=TRUE;
-		strcpy(ffname,argv[narg]);			// ff program name to call
+		strcpy(ffname,argv[narg]);			// was the ff program to call, now just turns on zfit.h
 		progress("Opening .ffz file...");	// for refined fmp results
 		strcpy(logfname,baseName); strcat(logfname,".ffz");
 		ffz = fopen(logfname,"w+");			// ffz file open 
@@ -224,7 +328,12 @@ int main(int argc, char* argv[])
 	}
 
 	// compute frequencies
-	for(i=0;i<NFREQS;i++){
+	nmax = MAX(NFREQS,ndense);
+	f = malloc(nmax*sizeof(double));
+	if(f==NULL) err("Out of memory for tones.");
+	if(ndense>0){							// dense, log-spaced on harmonics of fmin
+		nf = zfftgrid(fbase,fmax,ndense,f);
+	}else for(i=0;i<NFREQS;i++){
 		switch(i%3){							// is a 1-2-5 sequence/decade
 			default:
 			case 0: freq=1.0e-7; break;
@@ -239,7 +348,12 @@ int main(int argc, char* argv[])
 	}
 	if(readFreqs){							// overwrite f[] from file
 		nf=0;
-		while(nf<NFREQS && NULL!=fgets(rbuf,255,frq) ){	// for each line in frq file
+		while(NULL!=fgets(rbuf,255,frq) ){	// for each line in frq file, as many as there are
+			if(nf>=nmax){
+				nmax *= 2;
+				f = realloc(f,nmax*sizeof(double));
+				if(f==NULL) err("Out of memory for tones.");
+			}
 			f[nf]=0; i=0;
 			i=sscanf(rbuf,"%le",&f[nf]);
 			if(i==1 && f[nf]>=fmin && f[nf]<=fmax){nf++;}
@@ -249,8 +363,17 @@ int main(int argc, char* argv[])
 			fprintf(frq,"%s\n",engstr(f[i],6));
 		}
 	}fclose(frq);							// won't need this again
-	if(nf>NFREQS)err("frq file contained too many frequencies");
 	if(nf<1)err("frq file contained no acceptable frequencies");
+	dense = (ndense>0 || nf>ZDFTMAX);		// too many tones for zdft.h, FFT instead
+	if(dense && !zfftharm(nf,f)) err("Dense mode needs every tone on a harmonic of the lowest.");
+	if(dense && ztol>0.0) err("No live Z (-z) in dense mode.");
+	if(refine && nf>ZFITMAX) err("Too many tones for ff.");
+	a = malloc(nf*sizeof(double)); ph = malloc(nf*sizeof(double));
+	imag = malloc(nf*sizeof(double)); vmag = malloc(nf*sizeof(double));
+	ipha = malloc(nf*sizeof(double)); vpha = malloc(nf*sizeof(double));
+	fz = malloc(nf*sizeof(double)); zse = malloc(nf*sizeof(double));
+	if(a==NULL || ph==NULL || imag==NULL || vmag==NULL || ipha==NULL || vpha==NULL || fz==NULL || zse==NULL)
+		err("Out of memory for tones.");
 	sprintf(rbuf,"Using %d frequencies.",nf);
 	progress(rbuf);
 	msg(rbuf);
@@ -258,13 +381,23 @@ int main(int argc, char* argv[])
 	if(skip==FALSE){				// execute actual measurement
 		// now open tvi file
 		strcpy(logfname,baseName);
-		strcat(logfname,".tvi");
-		tvi = fopen(logfname,"w+");						// tvi file open 
+		strcat(logfname,archive?".tvia":binary?".tvib":".tvi");
+		if(binary){
+			sprintf(wbuf,"bz3p66 v%.2f",version);
+			if(archive) tvi = tviacreate(logfname,3,"t V I",NULL,wbuf,opt66argc,opt66argv,tstart);
+			else tvi = tvibcreate(logfname,3,"t V I",wbuf,opt66argc,opt66argv,tstart);
+		}else tvi = fopen(logfname,"w+");				// tvi file open 
 		if(tvi==NULL) err("Cannot open tvi file");
 		strcpy(logfname,baseName);
-		strcat(logfname,".ptvi");
-		ptvi = fopen(logfname,"w+");						// ptvi file open 
+		strcat(logfname,archive?".ptvia":binary?".ptvib":".ptvi");
+		if(archive) ptvi = tviacreate(logfname,3,"t V I",NULL,wbuf,opt66argc,opt66argv,tstart);
+		else if(binary) ptvi = tvibcreate(logfname,3,"t V I",wbuf,opt66argc,opt66argv,tstart);
+		else ptvi = fopen(logfname,"w+");				// ptvi file open 
 		if(ptvi==NULL) err("Cannot open .ptvi file");
+		strcpy(logfname,baseName);
+		strcat(logfname,".timing");
+		sprintf(wbuf,"bz3p66 v%.2f",version);
+		if(tvitcreate(&tt,opt66on('t')?logfname:NULL,wbuf,opt66argc,opt66argv,tstart,&rx66s.twr,&rx66s.trd)) err("Cannot open .timing file");
 
 		// open interface, NOTRANS apparently not supported
 		hp = open(USBpath, O_RDWR | O_NOCTTY | O_NONBLOCK); // open port, no hanging
@@ -285,19 +418,8 @@ int main(int argc, char* argv[])
 		// set up the prologix for 66332
 		msg("Setting up prologix interface for 66332... ");
 		initPrologix(hp);							// set up inteface
-		sprintf(wbuf,"++addr %d\n", gpibaddr);
-		wrtstr(hp,wbuf);								// point to our instr
 		progress("Prologix set up.");
 
-		// grab bus, terminate instrument communications, ID instrument
-		msg("Checking GPIB bus... ");
-		sprintf(wbuf,"++ifc\n");wrtstr(hp,wbuf);		// send INTERFACE CLEAR
-		tickle(500);
-		sprintf(wbuf,"++clr\n");wrtstr(hp,wbuf);		// send CLEAR to instrument itself
-		msg("Waiting while bus clears... ");
-		tickle(2500);
-		progress("Bus cleared.");
-
 		// compute amplitudes & phases
 		msg("Finding mag & phases of tones... ");
 		actualImax=0.00;
@@ -327,60 +449,64 @@ int main(int argc, char* argv[])
 		}
 		period = 1.0/fmin;					// period of multitone "cycle"
 
-		// initialize HP function
-		msg("Check ID of Instrument... ");
-		wrtstr(hp,"*IDN?\n");						// ask for IDN
-		tickle(300);
-		rbuf[0]='\0';								// clear string
-		getmsg(hp,rbuf);							// get message from addr
-		if(strstr(rbuf,"66332")==NULL){
-			fprintf(stderr,"Instrument at %d identifies as:'%s' (%ld chars)",gpibaddr,rbuf,strlen(rbuf));
-			err("Bad instrument ID");
-		}else{
-			for(i=0;i<strlen(rbuf);i++){if(rbuf[i]=='\r'||rbuf[i]=='\n')rbuf[i]='\0';}
-			progress(rbuf);
-		}
-		progress("Instrument ID checked OK; initialising...");
-		sprintf(wbuf,"*RST;\n");wrtstr(hp,wbuf); 		// reset
-		tickle(2500);
+		// clear bus, ID instrument, reset only if not already set up, empty error queue (scpi66.h)
+		msg("Bringing up instrument... ");
 		if(Imax>0.02 || (sink && Imax>10e-3)){									// big currents
-			sprintf(wbuf,"SENSe:CURRent:RANGe MAX;\n"); 	// 5A range
+			strcpy(wbuf,"SENSe:CURRent:RANGe MAX\n"); 	// 5A range
 		}else{
-			sprintf(wbuf,"SENSe:CURRent:RANGe MIN;\n"); 	// 20mA range
-		}wrtstr(hp,wbuf);
-
-		msg("Checking for instrument errors... ");
-		j=0;
-		do{
-			sprintf(wbuf,"SYST:ERR?;\n");wrtstr(hp,wbuf); 	// ask for errors
-			tickle(300);
-			rbuf[0]='\0';
-			getmsg(hp,rbuf);								// Tx
-			i=sscanf(rbuf,"%d",&scpi);						// Rx
-			sprintf(wbuf,"err check (%d): %s",j++,rbuf);
-			progress(wbuf);msg(wbuf);
-		}while(i!=1 || scpi!=0);
-
+			strcpy(wbuf,"SENSe:CURRent:RANGe MIN\n"); 	// 20mA range
+		}
+		up66(hp,USBpath,gpibaddr,wbuf);
+
+		if(digmode){								// V & I sampled by the instrument
+			dtint = digtint(1.0/(20.0*fmax));		// 20 samples per period of highest tone
+			dpts = MIN(DIGPTS,(int)(2.0/dtint));	// ~2s per sweep
+			vblk = malloc(dpts*sizeof(double));
+			iblk = malloc(dpts*sizeof(double));
+			if(vblk==NULL || iblk==NULL) err("Out of memory for digitizer blocks.");
+			digsetup(hp,dpts,dtint);
+			sprintf(rbuf,"Digitizer array mode: %d points every %sS per sweep.",dpts,engstr(dtint,4));
+			progress(rbuf);msg(rbuf);
+		}
 
 		// now iterate set-read loop until required time has elapsed
-		wrtstr(hp,"OUTP ON\n");tickle(500);				// enable outputs
+		if(!digmode && Ts<=0.00){						// grid period from a few timed transactions
+			tcal = rx66now();
+			for(i=0;i<10;i++) meas2(hp,&vb,&ib);
+			Ts = sclk66auto((rx66now()-tcal)/10.0);
+		}
+		if(digmode && Ts<=0.00) Ts = MAX(1e-3*DIGSTEER,sclk66auto(digsteer(hp,Vmax)));	// host only steers
+		if(digmode && fmax*DIGSPP*Ts>1.0+1e-9){			// staircase too coarse for the top tone
+			sprintf(rbuf,"fmax is too large for a %sS steering grid, %d setpoints a period allow %.1lfHz.",
+				engstr(Ts,4),DIGSPP,1.0/(DIGSPP*Ts));
+			err(rbuf);
+		}
+		sprintf(rbuf,"Sample grid %sS.",engstr(Ts,4));
+		progress(rbuf);msg(rbuf);
+		wrtstr(hp,"OUTP ON\n");ready66(hp,UP66TMAX);		// enable outputs, on once *OPC? answers
 		time(&tmark);									// time in seconds for dwells
-		clock_gettime(CLOCK_REALTIME, &ts);				// present into ts(tart) structure
-		clock_gettime(CLOCK_REALTIME, &tn);				// present into tn(ow) structure
-		lastelapstime = elapstime = (tn.tv_sec-ts.tv_sec)+(tn.tv_nsec-ts.tv_nsec)/GIG; // init time
+		lastelapstime = elapstime = 0.00;						// time zero is the grid origin
 		dt=0.00;
 		Tcyc = 1/Pf + Pw + tr;
 		msg("Commencing main measurement loop... ");
 		progress("Commencing main measurement loop... ");
-		while(mt_time<=period*ncyc+Xcyc*period+dt+1.0){		// not covered discard+window+margin yet
+		r66starttim(&ring,tvi,ptvi,logfile,tt.f,binary,show);	// no file or screen i/o in the loop from here
+		if(opt66on('r')) sclk66rt(opt66val('r')==NULL? -1 : atoi(opt66val('r')));	// writer thread stays normal
+		sclk66init(&clk,Ts);							// grid starts now
+		rate66init(&rate);
+		if(!dense) zdftinit(&zl,nf,f,period);			// live Z over the logged samples
+		zdftliveinit(&zlv);
+		if(digmode){digarm(hp); tarm=elapstime; armed=TRUE;}		// first sweep
+		while(armed || (!zdone && mt_time<=period*ncyc+Xcyc*period+dt+1.0)){	// not covered discard+window+margin, or a sweep to fetch
+			r66time(&ring,&tt);							// -t: the last sample's phases
 
 			// there is elapstime = tnow-tstart, all the time spent making the measurement
 			// the period of a cycle of pulse & multitone, Tcyc = 1/Pf + Pw + tr; 
 			// we are in a pulse when time%Tcyc < Pw;
 			// mt_time is the time spent delivering the multitone (excludes time in the pulse)
-			// TIME: in Raspbian, use clock_gettime()
-			clock_gettime(CLOCK_REALTIME, &tn);			// present into tn(ow) structure
-			elapstime = (tn.tv_sec-ts.tv_sec)+(double)((tn.tv_nsec-ts.tv_nsec))/GIG; // set elapsed time
+			// TIME: next slot of the monotonic sample grid
+			elapstime = sclk66wait(&clk);				// sleep to it, elapsed time on the grid
+			tvitmark(&tt,TVITWAIT);
 			
 			if(fmod(elapstime,Tcyc) < (Pw+tr)){ 			// in pulse
 				if(inpulse==FALSE){npulses++;}				// count triphasic pulses
@@ -413,30 +539,83 @@ int main(int argc, char* argv[])
 				Ismallest = MIN(Ismallest,Istim);
 			}
 
-			// set required V & I, change heading towards Vmin/Vmax
-			sprintf(wbuf,"VOLT %.6lf;CURR %.6lf\n",						// set V & I
-				(Istim<0.00)?(0.99*Vmin):(1.01*Vmax),fabs(Istim+itrim));// add in itrim to correct Q drift
-			wrtstr(hp,wbuf);											// send	
+			if(digmode){								// host only steers I, digitizer measures
+				setonly(hp,(Istim<0.00)?(0.99*Vmin):(1.01*Vmax),fabs(Istim+itrim));
+				tvitbus(&tt);
+				hdt=elapstime-lastelapstime;
+				lastelapstime = elapstime;
+				dQexpected += Istim*hdt;				// expected delta charge, host timeline
+				if(elapstime<tarm+dpts*dtint+0.005){continue;}	// sweep still running
+				nblk = digfetch(hp,vblk,iblk,dpts);		// both arrays in one reply
+				tblk = tarm;
+				if(!zdone && mt_time<=period*ncyc+Xcyc*period+dt+1.0){
+					digarm(hp);							// next sweep, once this one is in
+					tarm = sclk66now(&clk);
+					gap = tarm-(tblk+dpts*dtint);		// not sampled while fetching & re-arming
+					gapsum += gap;
+					gapmax = MAX(gapmax,gap);
+					ngap++;
+				}else{
+					armed = FALSE;						// that was the last, still under stimulus
+				}
+				tvitbus(&tt);
+				if(nblk<dpts){
+					sprintf(rbuf,"Short digitizer block (%d/%d points) at %.3lfs",nblk,dpts,tblk);
+					r66text(&ring,R66LOG,rbuf);
+				}
+				for(k=0;k<nblk;k++){					// rebuild each sample's time
+					tk = tblk+k*dtint;
+					vb = vblk[k]; ib = iblk[k];
+					rate66tick(&rate);
+					if(vb>=Vmax || vb<=Vmin){			// hit a voltage limit!
+						wrtstr(hp,"OUTP OFF\n");		// disable outputs
+						r66text(&ring,R66LOG,"Hit voltage limit in digitizer block... aborting run!");
+						r66err(&ring,"Hit voltage limit... aborting run!");
+					}
+					dt = (lasttk<0.0)? dtint : tk-lasttk;	// spans the gap between sweeps
+					lasttk = tk;
+					npts++;
+					dQ+=dt*ib;							// accumulate delta charge
+					if(fmod(tk,Tcyc) < (Pw+tr)){continue;}	// pulse samples only go to .ptvi
+					mtk = tk - (floor(tk/Tcyc)+1.0)*(Pw+tr);	// multitone time of this sample
+					if(mtk>(Xcyc*period)){
+						r66tvi(&ring,R66TVI,4,mtk,vb,ib);
+						if(!dense) zdftadd(&zl,mtk,vb,ib);
+						if(!dense && zdftlive(&zl,&zlv)){			// a cycle completed, live Z
+							zok = (livez(&ring,&zlv,f,nf)<ztol && zlv.ncyc>=ZDFTSTOP)? zok+1 : 0;
+							zdone = (zok>=2);						// settled two cycles running
+						}
+					}
+				}
+				for(k=0;k<nblk;k++){					// complete data file
+					r66tvi(&ring,R66PTVI,4,tblk+k*dtint,vblk[k],iblk[k]);
+				}
+				Qerror = dQexpected-dQ;					// charge leaked
+				i_error = Qerror/elapstime;				// Q=it so i=Q/t amps apparent error
+				shw[0]=npts; shw[1]=elapstime; shw[2]=vb; shw[3]=ib; shw[4]=nblk; shw[5]=rate.now; shw[6]=dQ;
+				shw[7]=(int)(100.0*mt_time/(period*(Xcyc+ncyc)));
+				shw[8]=((period*ncyc+Xcyc*period+1.0)*(Tcyc*Pf)-elapstime)/3600.0;
+				r66show(&ring,TRUE,SHDIG|(mt_time<Xcyc*period?SHPRE:0),shw,9);	// screen & log, per block
+				continue;
+			}
 
-			// READOUT V & I
+			// set required V & I, change heading towards Vmin/Vmax, add in itrim to correct Q drift
+			// and READOUT V & I in the same transaction
 			datvoid=FALSE;						// reset warning, retry measurement
-			wrtstr(hp,"MEAS:VOLT?\n");			// request the terminal voltage
-			getmsg(hp,rbuf);
-			i=sscanf(rbuf,"%lf",&vb);
-			wrtstr(hp,"MEAS:CURR?\n");
-			getmsg(hp,rbuf);
-			i+=sscanf(rbuf,"%lf",&ib);
+			i=setmeas(hp,(Istim<0.00)?(0.99*Vmin):(1.01*Vmax),fabs(Istim+itrim),&vb,&ib);
+			tvitbus(&tt);
 			if(i!=2)datvoid=TRUE;			// something went wrong, did not get 2 numbers
+			rate66tick(&rate);
 			
 			if(datvoid==FALSE && vb>=Vmax){		// hit hi voltage limit!
 				wrtstr(hp,"OUTP OFF\n");					// disable outputs
-				progress("Hit high voltage limit... aborting run!");
-				err("Hit high voltage limit... aborting run!");
+				r66text(&ring,R66LOG,"Hit high voltage limit... aborting run!");
+				r66err(&ring,"Hit high voltage limit... aborting run!");
 			}
 			if(datvoid==FALSE && vb<=Vmin){		// hit lo voltage limit!
 				wrtstr(hp,"OUTP OFF\n");					// disable outputs
-				progress("Hit low voltage limit... aborting run!");
-				err("Hit low voltage limit... aborting run!");
+				r66text(&ring,R66LOG,"Hit low voltage limit... aborting run!");
+				r66err(&ring,"Hit low voltage limit... aborting run!");
 			}
 
 			if(!datvoid){
@@ -451,25 +630,47 @@ int main(int argc, char* argv[])
 					sprintf(rbuf,"--dQ target=%s, actual dQ=%s, (%.2lf%%) -> i_error=%s, itrim=%s", 
 						engstr(dQexpected,4), engstr(dQ,4), errpc, 
 							engstr(i_error,4), engstr(itrim,4) );
-					progress(rbuf);
+					r66text(&ring,R66LOG,rbuf);
 				}
 			}
-			sprintf(rbuf,"pt%d: %.3lfs V=%.3lf, I=%+.3lf; dt=%.3lfs dQ=%sAh %c %c %c %d%% (%.1lfH to go)",
-				npts++,elapstime,vb,ib,dt,sengstr(dQ/3600.0,3),datvoid?'X':'O',mt_time<Xcyc*period?'<':'+',
-				inpulse?'P':'M',
-				(int)(100.0*mt_time/(period*(Xcyc+ncyc))),
-					((period*ncyc+Xcyc*period+1.0)*(Tcyc*Pf)-elapstime)/3600.0 );
-			msg(rbuf);
-			if(npts%1000==1){fprintf(logfile,"%s\n",rbuf);}
+			shw[0]=npts++; shw[1]=elapstime; shw[2]=vb; shw[3]=ib; shw[4]=dt; shw[5]=rate.now; shw[6]=dQ;
+			shw[7]=(int)(100.0*mt_time/(period*(Xcyc+ncyc)));
+			shw[8]=((period*ncyc+Xcyc*period+1.0)*(Tcyc*Pf)-elapstime)/3600.0;
+			r66show(&ring,npts%1000==1,(datvoid?SHVOID:0)|(mt_time<Xcyc*period?SHPRE:0)|(inpulse?SHPULSE:0),shw,9);
 			if(datvoid){continue;}					// bad data, don't log
 			if(inpulse==FALSE && (mt_time>(Xcyc*period))){	// do not log measurements to the tvi file if in the pulse!
-				fprintf(tvi,"%.3lf %s %s\n", mt_time, engstr(vb,6), engstr(ib,6));	// triple to tvi file
+				r66tvi(&ring,R66TVI,3,mt_time,vb,ib);	// triple to tvi file
+				if(!dense) zdftadd(&zl,mt_time,vb,ib);
+				if(!dense && zdftlive(&zl,&zlv)){			// a cycle completed, live Z
+					zok = (livez(&ring,&zlv,f,nf)<ztol && zlv.ncyc>=ZDFTSTOP)? zok+1 : 0;
+					zdone = (zok>=2);						// settled two cycles running
+				}
 			}
-			fprintf(ptvi,"%.3lf %s %s\n", elapstime, engstr(vb,6), engstr(ib,6));	// triple to complete data file
+			r66tvi(&ring,R66PTVI,3,elapstime,vb,ib);	// triple to complete data file
 
 		}
-		progress("Completed measurement sequence.");
+		r66time(&ring,&tt);
 		wrtstr(hp,"OUTP OFF\n");					// disable outputs
+		r66stop(&ring);								// drain files & display
+		tvitclose(&tt);
+		if(zdone){									// ff & the DFT take what there is
+			sprintf(rbuf,"Z settled within %.2lf%% after %d cycles, stopped early.",100.0*ztol,zlv.ncyc);
+			progress(rbuf);
+			ncyc = zlv.ncyc;
+		}
+		if(!dense) zdftfree(&zl);
+		sclk66report(&clk,rbuf);
+		progress(rbuf);
+		if(digmode && ngap>0){
+			sprintf(rbuf,"Digitizer: %d gaps between sweeps for fetch & re-arm, mean %sS, max %sS, %.2lf%% of the run unsampled.",
+				ngap,engstr(gapsum/ngap,3),engstr(gapmax,3),100.0*gapsum/elapstime);
+			progress(rbuf);msg(rbuf);
+		}
+		progress("Completed measurement sequence.");
+		sprintf(rbuf,"Achieved %.2lf samples/s over %ld samples.",rate.run,rate.n);
+		progress(rbuf);
+		rx66stats(rbuf);
+		progress(rbuf);
 		fclose(tvi);
 		fclose(ptvi);
 		sprintf(rbuf,"Largest current = %s ", sengstr(Ibiggest,3));
@@ -478,115 +679,58 @@ int main(int argc, char* argv[])
 		progress(rbuf);
 	}
 
-	if(getz){	// use dftp to estimate V and I at each frequency, and so z
-		for(i=0;i<nf;i++){				// for each frequency
-			// call to dft I then V at that frequency >bat
-			fprintf(bat,"%s %s.tvi %s 1 0 D L C 3 %c>%s.tmp\n",dftname,baseName,engstr(f[i],3),i?'>':' ',baseName);
-			fprintf(bat,"%s %s.tvi %s 1 0 D L  >>%s.tmp\n",dftname,baseName,engstr(f[i],3),baseName);
+	if(getz && dense){	// too many tones for zdft.h, FFT of each cycle resampled (zfft.h)
+		strcpy(logfname,baseName);
+		strcat(logfname,archive?".tvia":binary?".tvib":".tvi");
+		progress("FFT of the tvi file, cycle by cycle...");
+		j = zfftfile(logfname,nf,f,vmag,vpha,imag,ipha,zse,&pts);
+		for(k=0,i=1;i<nf;i++) if(zse[i]>zse[k]) k=i;
+		sprintf(rbuf,"FFT: %d tones, %d whole cycles at fmin, %d points per cycle, Z within +/-%.2lf%% (worst at %sHz).",
+			nf,j,pts,100.0*zse[k],engstr(f[k],4));
+		progress(rbuf);
+		for(i=0;i<nf;i++){
+			// write fmp
+			mag=vmag[i]/imag[i];
+			pha=vpha[i]-ipha[i];
+			fprintf(fmp,"%s %s %.2lf\n",engstr(f[i],6),engstr(mag,4),pha);
 		}
-		fclose(bat);
-		// exec bat 
-		sprintf(cmd,"chmod +x %s.bat\n",baseName);
-		progress(cmd);
-		if(-1==system(cmd)){
-			err("Call to make batch file executable failed");}
-		sprintf(cmd,"./%s.bat\n",baseName);
-		progress(cmd);
-		if(-1==system(cmd)){
-			err("Call to batch file failed");}
-		// read result from tmp, compute z
-		progress("Opening .tmp file...");	// tmp file from script
+		fclose(fmp);
+	}else if(getz){	// V & I at every frequency from one pass over the .tvi (zdft.h), and so z
+		for(fmin=1e30,i=0;i<nf;i++){ fz[i]=f[i]; fmin=MIN(fmin,f[i]); }
+		zdftinit(&zd,nf,fz,1.0/fmin);
 		strcpy(logfname,baseName);
-		strcat(logfname,".tmp");
-		bat = fopen(logfname,"r");			// reuse batch file pointer
-		if(bat==NULL) err("Cannot open tmp file");
-		progress(".tmp open.");		
-		// read raw data from tmp file and compute fmp
+		strcat(logfname,archive?".tvia":binary?".tvib":".tvi");
+		progress("Single-pass DFT of the tvi file...");
+		nread = zdftfile(&zd,logfname);
+		j = zdftcycles(&zd);
+		sprintf(rbuf,"DFT: %ld samples, %d bins, %d whole cycles at fmin.",nread,zd.nb,j);
+		progress(rbuf);
+		zdftwin(&zd,0,MAX(j,1),vmag,vpha,imag,ipha);	// all whole cycles (or what there is)
 		for(i=0;i<nf;i++){
-			fgets(rbuf, 255, bat);
-			sscanf(rbuf,"%le %le %le",&fcheck,&imag[i],&ipha[i]);
-			if(relerr(fcheck,f[i])>0.01){err("Line in .tmp with wrong frequency!");}
-			fgets(rbuf, 255, bat);
-			sscanf(rbuf,"%le %le %le",&fcheck,&vmag[i],&vpha[i]);
-			if(relerr(fcheck,f[i])>0.01){err("Line pair in .tmp with different frequencies!");}
 			// write fmp
 			mag=vmag[i]/imag[i];
 			pha=vpha[i]-ipha[i];
 			fprintf(fmp,"%s %s %.2lf\n",engstr(f[i],6),engstr(mag,4),pha);
 		}
 		fclose(fmp);
+		zdftfree(&zd);
 	}
 
-	if(refine){	// use estimates to start optimiser, refine V & I, get refined z (.ffz)
-		// ff ipfile.tvi cn Tw Tx <frequencyFile> <guessFile>
-		// write current guess
-		strcpy(logfname,baseName);
-		strcat(logfname,".gs");
-		gs = fopen(logfname,"w+");	 
-		if(gs==NULL) err("Cannot open .gs file for ff.");
-		for(i=0;i<nf;i++){
-			fprintf(gs,"%s %s %.2lf\n",engstr(f[i],6),engstr(imag[i],3),ipha[i]);
-		} fclose(gs);
-		// refine (if Xcyc, use all of ncyc, else dump 0.5 cycles)
+	if(refine){	// all tones & drift fitted to V & I at once, in-process (zfit.h), refined z (.ffz)
+		// window: if Xcyc, use all of ncyc, else dump 0.5 cycles
 		discard = MAX(0,(MIN(0.5,0.5-Xcyc)));
-		sprintf(cmd,"%s %s.tvi 3 %.2lf %.2lf %s.frq %s.gs >hold.ffi\n",
-			ffname,baseName,ncyc-discard-0.01,discard,baseName,baseName);
-		progress(cmd);
-		if(-1==system(cmd)){err("Call to FinerFit file failed");}
-		// retrieve refined current
-		gs = fopen("hold.ffi","r");	 
-		if(gs==NULL) err("Cannot open hold.ffi file.");
-		i=0;
-		while(NULL!=fgets(rbuf, 255, gs)){
-			j=sscanf(rbuf,"%le %le %le",&fcheck,&imag[i],&ipha[i]);
-			if(j!=3){
-				fprintf(stderr,"read spurious hold.ffi line: %s\n",rbuf); 
-				continue;
-			}
-			if(relerr(fcheck,f[i])>0.01){
-				progress(rbuf);
-				sprintf(rbuf,"Line in hold.ffi with unexpected frequency (%le/%le)",f[i],fcheck);
-				progress(rbuf);
-				err("ff failed?");
-			}
-			i+=1;
-		} fclose(gs);
-		if(i!=nf){sprintf(rbuf,"Bad number of frequency lines in hold.ffi (%d/%d).",i,nf);err(rbuf);}
-		
-		// write voltage guess
 		strcpy(logfname,baseName);
-		strcat(logfname,".gsv");
-		gs = fopen(logfname,"w+");	 
-		if(gs==NULL) err("Cannot open .gsv file for ff.");
-		for(i=0;i<nf;i++){
-			fprintf(gs,"%s %s %.2lf\n",engstr(f[i],6),engstr(vmag[i],3),vpha[i]);
-		} fclose(gs);
-		// refine (if Xcyc, use all of ncyc, else dump 0.5 cycles)
-		sprintf(cmd,"%s %s.tvi 2 %.2lf %.2lf %s.frq %s.gsv >hold.ffv\n",
-			ffname,baseName,ncyc-discard-0.01,discard,baseName,baseName);
-		progress(cmd);
-		if(-1==system(cmd)){err("Call to FinerFit file failed");}
-		// retrieve refined V
-		gs = fopen("hold.ffv","r");	 
-		if(gs==NULL) err("Cannot open hold.ffv file.");
-		i=0;
-		while(NULL!=fgets(rbuf, 255, gs)){
-			j=sscanf(rbuf,"%le %le %le",&fcheck,&vmag[i],&vpha[i]);
-			if(j!=3){fprintf(stderr,"read hold.ffv line: %s\n",rbuf); continue;}
-			if(relerr(fcheck,f[i])>0.01){
-				progress(rbuf);
-				sprintf(rbuf,"Line in hold.ffv with unexpected frequency (%le/%le)",f[i],fcheck);
-				progress(rbuf);
-				err("ff failed?");
-			}
-			i++;
-		} fclose(gs);
-		if(i!=nf){sprintf(rbuf,"Bad number of frequency lines in hold.ffv (%d/%d).",i,nf);err(rbuf);}
-
-		// write refined Z
-		for(i=0;i<nf;i++){
-			mag=vmag[i]/imag[i];
-			pha=vpha[i]-ipha[i];
+		strcat(logfname,archive?".tvia":binary?".tvib":".tvi");
+		sprintf(rbuf,"Least-squares fit of %d tones, drift order %d, over %.2lf cycles after %.2lf...",
+			nf,npoly-1,ncyc-discard-0.01,discard);
+		progress(rbuf);
+		nread = zfitvi(logfname,nf,f,npoly,discard/fmin,(ncyc-0.01)/fmin,&zfv,&zfi);
+		if(!zfv.ok || !zfi.ok) err("Least-squares fit failed (too few samples, or tones not resolved).");
+		sprintf(rbuf,"Fit: %ld samples, residual %sV & %sA rms.",nread,engstr(zfv.rms,3),engstr(zfi.rms,3));
+		progress(rbuf);
+		for(i=0;i<nf;i++){			// write refined Z
+			mag=zfv.amp[i]/zfi.amp[i];
+			pha=zfv.pha[i]-zfi.pha[i];
 			fprintf(ffz,"%s %s %.2lf\n",engstr(f[i],6),engstr(mag,4),pha);	
 		}
 		fclose(ffz);
@@ -8,6 +8,7 @@
 // sprintf(wbuf,":SOURce:VOLTage:RANGe %f;\n",1.011*Vmax); // set V range (plus a bit)(v6)
 //******************************************************************************
 
+#define _GNU_SOURCE				// cpu affinity for real-time mode (sclk66.h)
 #include    <stdio.h>
 #include    <stdlib.h>
 #include    <string.h>
@@ -39,6 +40,46 @@ FILE *logfile;										// to log errors
 double meastime;
 
 #include "prologix.h"
+#include "scpi66.h"
+#include "tviring.h"
+#include "tvia.h"
+#include "opt66.h"
+#include "sclk66.h"
+#include "zdft.h"
+#include "zfft.h"
+
+#define SHDIG 1		// display flags, in rec66.k
+#define SHVOID 2
+#define SHPRE 4
+
+void show(struct rec66 *r, char *buf)	// display line, formatted by the writer thread
+{
+	double *x=r->u.x;
+
+	sprintf(buf,"pt%.0lf: %.3lfs V=%.3lf, I=%+.3lf,%c dt=%.3lfs %.1lf/s dQ=%sAh %c %c %.0lf%% (%.1lfH to go)",
+		x[0],x[1],x[2],x[3],(int)x[9]+'a',x[4],x[5],r66s(x[6]/3600.0,3),
+		(r->k&SHDIG)?'D':((r->k&SHVOID)?'X':'O'),(r->k&SHPRE)?'<':'+',x[7],x[8]);
+}
+
+// another whole cycle in the live estimate: Z at each tone to the log, the worst
+// standard error to the screen; returns that worst relative error
+double livez(struct ring66 *r, struct zdftlive *l, double *f, int nf)
+{
+	char buf[R66TXT];
+	double worst=0.0;
+	int i, iw=0;
+
+	for(i=0;i<nf;i++){
+		snprintf(buf,R66TXT,"Live Z, %d cycles: %sHz %sOhm %.2lf +/-%.2lf%%",l->ncyc,engstr(f[i],4),
+			engstr(cabs(l->Z[i]),4),carg(l->Z[i])*180.0/PI,100.0*l->se[i]);
+		r66text(r,R66LOG,buf);
+		if(l->se[i]>worst){ worst=l->se[i]; iw=i; }
+	}
+	if(l->ncyc<2) return worst;						// no scatter from one cycle yet
+	snprintf(buf,R66TXT,"Live Z after %d cycles: within +/-%.2lf%% (worst at %sHz)",l->ncyc,100.0*worst,engstr(f[iw],4));
+	r66text(r,R66SAY,buf);
+	return worst;
+}
 
 int main(int argc, char* argv[])
 {
@@ -47,21 +88,27 @@ int main(int argc, char* argv[])
 	char USBpath[64];
 	char rbuf[256], wbuf[128];
  	time_t tstart,tnow,tmark;
-	struct timespec ts, tn;
     double lastmeastime, lastvb, lastib;
     int gpibaddr=5;
     char baseName[64], logfname[128];
     float ncyc,fmin,fmax,Vmin,Vmax,Imax,ftmp,Xcyc;
     double deltaQ,ib,vb,Istim,dQ,dt,dtmp;
-    double freq, f[NFREQS], period;
-    double a[NFREQS], ph[NFREQS], iqf;
+    double freq, *f, period;
+    double *a, *ph, iqf;
     double Ibiggest=-100.0, Ismallest=100.0;
     double dQbiggest=-1000.0, dQsmallest=1000.0;
-    int i,j, nf=0, narg=0, npts=0, datvoid,scpi;
+    int i,j, nf=0, narg=0, npts=0, datvoid;
     double mag,pha,fcheck,discard;
-    double imag[NFREQS],vmag[NFREQS],ipha[NFREQS],vpha[NFREQS];
+    double *imag,*vmag,*ipha,*vpha,*fz,*zse;
     int getz=FALSE,refine=FALSE,readFreqs=FALSE;
 	struct termios spset;
+	struct rate66 rate;
+	struct ring66 ring;
+	struct tvit tt;
+	int binary, archive;
+	struct sclk66 clk;
+	double Ts=0.00, tcal;
+	double shw[10];
 	double actualImax,Imultiplier;
 	int qloops, eqI=FALSE;
 	double Idc, fdc, dQdc, fracycle, tdc;
@@ -75,9 +122,19 @@ int main(int argc, char* argv[])
 	//************************************************************************
 
 	double deltaf,minDeltaf,badf;
+	int digmode=FALSE, armed=FALSE, dpts=0, nblk, ngap=0, k;		// digitizer array mode, fmax>2.5Hz
+	double dtint=0.00, tarm=0.00, tblk, tk, hdt, lasttk=-1.0, *vblk=NULL, *iblk=NULL;
+	double gap, gapsum=0.00, gapmax=0.00;		// unsampled time between sweeps
 
-	FILE *fmp, *ffz, *bat, *frq, *gs, *ff;
+	FILE *fmp, *ffz, *frq, *gs, *ff;
 	char dftname[256],ffname[256], cmd[256];
+	struct zdft zd, zl;						// after the run, live
+	struct zdftlive zlv;
+	double ztol=0.0;						// -z, relative
+	int zok=0, zdone=FALSE;
+	double fbase;
+	int ndense=0, dense=FALSE, nmax, pts, nb;	// -d, dense spectrum (zfft.h)
+	long nread;
     complex double cf[NFREQS], vf[NFREQS], z[NFREQS];
 
 	// version 2.01: fixed bug in processing .frq file (non-numeric lines ignored)
@@ -119,7 +176,27 @@ int main(int argc, char* argv[])
 	// version 6.19: attempt to fix dQ drift, allow == updates periodically without zero cross
 	// version 6.20: rework application of itrim, improve logfile diagnostics
 	// version 6.21: allow zero Idc
-    float version = 6.21; 
+	// version 6.22: setpoint & V/I readback pipelined into one transaction (scpi66.h), show samples/s
+	// version 6.30: digitizer array mode for fmax>2.5Hz, V/I blocks fetched with reconstructed times
+	// version 6.31: files & display written by a thread fed from a lock-free ring (tviring.h)
+	// version 6.32: -b option writes binary .tvib
+	// version 6.33: replies read by poll() with RTT-adaptive deadlines, numbers parsed in place (rx66.h)
+	// version 6.34: loop paced on a CLOCK_MONOTONIC grid (-s), real-time mode (-r), lateness stats (sclk66.h)
+	// version 6.35: bring-up waits on *OPC? instead of fixed sleeps, skips *RST when already set up (up66)
+	// version 6.36: V & I at all frequencies in one pass over the tvi (zdft.h), no .bat/.tmp or dftp calls
+	// version 6.37: live Z at each tone every cycle with its standard error, -z stops once settled
+	// version 6.38: dense mode (-d), hundreds to thousands of tones on harmonics of fmin, Z by FFT (zfft.h)
+	// version 6.39: -a option writes a compressed .tvia archive (tvia.h)
+	// version 6.40: -t option times each sample's phases into a .timing sidecar (tvitime.h)
+    float version = 6.40; 
+
+	opt66(&argc,argv);							// -x options out of the positional args
+	binary = opt66on('b');
+	archive = opt66on('a');						// records handed over as for -b
+	if(archive) binary=TRUE;
+	if(opt66val('s')!=NULL) Ts = atof(opt66val('s'));
+	if(opt66val('z')!=NULL) ztol = 0.01*atof(opt66val('z'));
+	if(opt66val('d')!=NULL) ndense = atoi(opt66val('d'));
     if (argc<12+1 || argc>14+1) { // ??
         fprintf(stderr,"bzdcp66 ------------  V%.2f jbs&cjd Dec 2020 -> Nov 2021\n", version);
         fprintf(stderr,"Battery Z measurement with dc, via Prologix/Fenrir GPIB-USB & 66332A, optional DFT.\n");
@@ -135,18 +212,36 @@ int main(int argc, char* argv[])
         fprintf(stderr,"        fdc is the frequency of the squarewave at Idc;\n");
         fprintf(stderr,"        baseName is the file string to be used;\n");
         fprintf(stderr,"        Addr is the optional GPIB bus address, def=%d.\n",gpibaddr);
-        fprintf(stderr,"        dftp is the [path]name of Scott/Farrow dft program (dftp,dvtv,etc);\n");
+        fprintf(stderr,"        dftp, any word (e.g. dftp), turns on the built-in single-pass DFT;\n");
         fprintf(stderr,"Makes a multitone tvi/Z measurement by sourcing current, measuring V & I.\n");
         fprintf(stderr,"If the USB parameter is set to \"skip\" the tvi measurement is skipped.\n");
         fprintf(stderr,"NB: If Imax<0 battery is discharging, so dQmax boundary checking is ignored.\n");
-        fprintf(stderr,"Creates baseName.tvi, basename.log, [.bat, .fmp] files.\n");
-        fprintf(stderr,"Z optionally computed by calls to dftp at each frequency.\n");
-        fprintf(stderr,"The .bat file is dft script, fmp has dft's z values.\n");
+        fprintf(stderr,"Creates baseName.tvi, basename.log, [.fmp] files.\n");
+        fprintf(stderr,"Z optionally computed at every frequency and fdc harmonic in one pass over the\n");
+        fprintf(stderr,".tvi (or .tvib), over whole cycles at fmin, trend removed; fmp has the z values,\n");
+        fprintf(stderr,"the fdc harmonics (1,3,5,7) go to the log.\n");
         fprintf(stderr,"Frequencies are a 1-2-5 sequence between fmin and fmax;\n");
-        fprintf(stderr,"if fmax<0, frequencies are read from baseName.frq file, up to %d freqs.\n",NFREQS);
+        fprintf(stderr,"if fmax>2.5Hz (up to %.0lfHz) V & I come from the 66332A digitizer in blocks;\n",DIGFMAX);
+        fprintf(stderr,"  I is still stepped by the host, at least %d setpoints a period of fmax, so a slow\n",DIGSPP);
+        fprintf(stderr,"  bus lowers fmax (checked at start); ~2s sweeps, V & I not sampled for the tens\n");
+        fprintf(stderr,"  of ms each fetch & re-arm takes between them (logged).\n");
+        fprintf(stderr,"if fmax<0, frequencies are read from baseName.frq file, any number.\n");
+        fprintf(stderr,"Option -dN is dense mode: N tones log-spaced on the harmonics of fmin up to fmax,\n");
+        fprintf(stderr,"  Z by FFT of each cycle resampled (zfft.h); also used for >%d tones from a .frq file.\n",ZDFTMAX-4);
+        fprintf(stderr,"  No live Z or -z in dense mode; fdc harmonics only reported if on harmonics of fmin.\n");
         fprintf(stderr,"fdc should be chosen so that none of its harmonics clash with multitones.\n");
         fprintf(stderr,"Requires no drivers, communicates using ++cmd protocol.\n");
-        fprintf(stderr,"Measures for (ncyc+Xcyc)/fmin seconds, then does dft calls.\n");
+        fprintf(stderr,"Option -b writes binary .tvib (tvib.h, tvibconv converts) instead of .tvi.\n");
+        fprintf(stderr,"Option -a writes a compressed .tvia archive (tvia.h, some 7x smaller than .tvi,\n");
+        fprintf(stderr,"  t & V kept to 1e-6, I to 1e-9), read by the analysis tools and tvibconv as it is.\n");
+        fprintf(stderr,"Option -sTs samples on a fixed Ts second grid (default: measured bus time +25%%),\n");
+        fprintf(stderr,"  -r[cpu] runs the loop SCHED_FIFO, memory locked, pinned to cpu (default last).\n");
+        fprintf(stderr,"  Lateness against the grid is summarised in the log.\n");
+        fprintf(stderr,"Option -t times each sample's wait, bus & calc phases and the file writes into\n");
+        fprintf(stderr,"  baseName.timing (tvitime reads it).\n");
+        fprintf(stderr,"Z at each tone is updated every cycle at fmin during the run (log), with its standard error;\n");
+        fprintf(stderr,"  option -ztol (%%) ends the run early once every tone is within tol for 2 cycles (>=%d cycles).\n",ZDFTSTOP);
+        fprintf(stderr,"Measures for (ncyc+Xcyc)/fmin seconds, then does the DFT.\n");
         fprintf(stderr,"Corrects for 1/2 LSB DAC error in 66332.\n");
         fprintf(stderr,"\n");
         exit(1);
@@ -189,14 +284,15 @@ int main(int argc, char* argv[])
 	ncyc = atof(argv[++narg]);
 	if(ncyc<1.1) err("Too few cycles requested.");
 	
-    fmin = atof(argv[++narg]);
+    fmin = fbase = atof(argv[++narg]);			// fbase keeps it exact for dense tones
 	if(fmin<0.1e-6) err("fmin is too small");
 	if(fmin>0.5) err("fmin is too large");
 
     fmax = atof(argv[++narg]);
     if(fmax<0){fmax=fabs(fmax);readFreqs=TRUE;}
 	if(fmax<1e-6) err("fmax is too small");
-	if(fmax>2.5) err("fmax is too large");
+	if(fmax>DIGFMAX) err("fmax is too large");
+	if(fmax>2.5) digmode=TRUE;				// too fast for polled MEAS, use digitizer
 	if(fmin>=fmax) err("Fmin>=Fmax");
 	
     Xcyc = atof(argv[++narg]);
@@ -225,21 +321,17 @@ int main(int argc, char* argv[])
 	sprintf(wbuf,"%s v%.2f started, logfile opened, at %s",argv[0],version,ctime(&tstart));
 	wbuf[strlen(wbuf)-1]='\0';	// clip off newline
 	progress(wbuf);
-	for(wbuf[0]='\0',i=0;i<argc;i++){strcat(wbuf,argv[i]);strcat(wbuf," ");}
+	for(wbuf[0]='\0',i=0;i<opt66argc;i++){strcat(wbuf,opt66argv[i]);strcat(wbuf," ");}
 	progress(wbuf);
 
 	// optional requests
 	if(argc>++narg) {						// this param means we do the dft 
 		getz=TRUE;
-		strcpy(dftname,argv[narg]);			// program to call
+		strcpy(dftname,argv[narg]);			// was the program to call, now just turns on zdft.h
 		strcpy(logfname,baseName); strcat(logfname,".fmp");
 		fmp = fopen(logfname,"w+");			// fmp file open
 		if(fmp==NULL) err("Cannot open fmp file");
 		progress(".fmp file open.");
-		strcpy(logfname,baseName); strcat(logfname,".bat");
-		bat = fopen(logfname,"w+");			// batch file open 
-		if(bat==NULL) err("Cannot open bat file");
-		progress(".bat file open.");
 	}
 
 // 	if(argc>++narg) {						// this param means we do ff
@@ -262,7 +354,12 @@ int main(int argc, char* argv[])
 	}
 
 	// compute frequencies
-	for(i=0;i<NFREQS;i++){
+	nmax = MAX(NFREQS,ndense);
+	f = malloc(nmax*sizeof(double));
+	if(f==NULL) err("Out of memory for tones.");
+	if(ndense>0){							// dense, log-spaced on harmonics of fmin
+		nf = zfftgrid(fbase,fmax,ndense,f);
+	}else for(i=0;i<NFREQS;i++){
 		switch(i%3){							// is a 1-2-5 sequence/decade
 			default:
 			case 0: freq=1.0e-7; break;
@@ -277,7 +374,12 @@ int main(int argc, char* argv[])
 	}
 	if(readFreqs){							// overwrite f[] from file
 		nf=0;
-		while(nf<NFREQS && NULL!=fgets(rbuf,255,frq) ){	// for each line in frq file
+		while(NULL!=fgets(rbuf,255,frq) ){	// for each line in frq file, as many as there are
+			if(nf>=nmax){
+				nmax *= 2;
+				f = realloc(f,nmax*sizeof(double));
+				if(f==NULL) err("Out of memory for tones.");
+			}
 			f[nf]=0; i=0;
 			i=sscanf(rbuf,"%le",&f[nf]);
 			if(i==1 && f[nf]>=fmin && f[nf]<=fmax){nf++;}
@@ -287,8 +389,16 @@ int main(int argc, char* argv[])
 			fprintf(frq,"%s\n",engstr(f[i],6));
 		}
 	}fclose(frq);							// won't need this again
-	if(nf>NFREQS)err("frq file contained too many frequencies");
 	if(nf<1)err("frq file contained no acceptable frequencies");
+	dense = (ndense>0 || nf+4>ZDFTMAX);		// too many tones for zdft.h, FFT instead
+	if(dense && !zfftharm(nf,f)) err("Dense mode needs every tone on a harmonic of the lowest.");
+	if(dense && ztol>0.0) err("No live Z (-z) in dense mode.");
+	a = malloc(nf*sizeof(double)); ph = malloc(nf*sizeof(double));
+	imag = malloc((nf+4)*sizeof(double)); vmag = malloc((nf+4)*sizeof(double));		// tones & fdc harmonics
+	ipha = malloc((nf+4)*sizeof(double)); vpha = malloc((nf+4)*sizeof(double));
+	fz = malloc((nf+4)*sizeof(double)); zse = malloc((nf+4)*sizeof(double));
+	if(a==NULL || ph==NULL || imag==NULL || vmag==NULL || ipha==NULL || vpha==NULL || fz==NULL || zse==NULL)
+		err("Out of memory for tones.");
 	sprintf(rbuf,"Using %d frequencies.",nf);
 	progress(rbuf);
 	msg(rbuf);
@@ -361,9 +471,18 @@ int main(int argc, char* argv[])
 	if(skip==FALSE){				// execute actual measurement
 		// now open tvi file
 		strcpy(logfname,baseName);
-		strcat(logfname,".tvi");
-		tvi = fopen(logfname,"w+");						// tvi file open 
+		strcat(logfname,archive?".tvia":binary?".tvib":".tvi");
+		if(binary){
+			if(refine) err("ff reads text .tvi, leave out -b/-a (or convert with tvibconv).");
+			sprintf(wbuf,"bzdcp66 v%.2f",version);
+			if(archive) tvi = tviacreate(logfname,3,"t V I",NULL,wbuf,opt66argc,opt66argv,tstart);
+			else tvi = tvibcreate(logfname,3,"t V I",wbuf,opt66argc,opt66argv,tstart);
+		}else tvi = fopen(logfname,"w+");				// tvi file open 
 		if(tvi==NULL) err("Cannot open tvi file");
+		strcpy(logfname,baseName);
+		strcat(logfname,".timing");
+		sprintf(wbuf,"bzdcp66 v%.2f",version);
+		if(tvitcreate(&tt,opt66on('t')?logfname:NULL,wbuf,opt66argc,opt66argv,tstart,&rx66s.twr,&rx66s.trd)) err("Cannot open .timing file");
 
 		// open interface, NOTRANS apparently not supported
 		hp = open(USBpath, O_RDWR | O_NOCTTY | O_NONBLOCK); // open port, no hanging
@@ -384,62 +503,43 @@ int main(int argc, char* argv[])
 		// set up the prologix for 66332
 		msg("Setting up prologix interface for 66332... ");
 		initPrologix(hp);							// set up inteface
-		sprintf(wbuf,"++addr %d\n", gpibaddr);
-		wrtstr(hp,wbuf);								// point to our instr
 		progress("Prologix set up.");
 
-		// grab bus, terminate instrument communications, ID instrument
-		msg("Checking GPIB bus... ");
-		sprintf(wbuf,"++ifc\n");wrtstr(hp,wbuf);		// send INTERFACE CLEAR
-		tickle(500);
-		sprintf(wbuf,"++clr\n");wrtstr(hp,wbuf);		// send CLEAR to instrument itself
-		msg("Waiting while bus clears... ");
-		tickle(2500);
-		progress("Bus cleared.");
-
-		// initialize HP function
-		msg("Check ID of Instrument... ");
-		wrtstr(hp,"*IDN?\n");						// ask for IDN
-		tickle(300);
-		rbuf[0]='\0';								// clear string
-		getmsg(hp,rbuf);							// get message from addr
-		if(strstr(rbuf,"66332")==NULL){
-			fprintf(stderr,"Instrument at %d identifies as:'%s' (%ld chars)",gpibaddr,rbuf,strlen(rbuf));
-			err("Bad instrument ID");
-		}else{
-			for(i=0;i<strlen(rbuf);i++){if(rbuf[i]=='\r'||rbuf[i]=='\n')rbuf[i]='\0';}
-			progress(rbuf);
-		}
-		progress("Instrument ID checked OK; initialising...");
-		
-		//****************************************************************
-		
-		sprintf(wbuf,"*RST;\n");wrtstr(hp,wbuf); 		// reset
-		tickle(2500);
-		sprintf(wbuf,"SENSe:CURRent:RANGe MAX;\n"); 	// 5A range
-		wrtstr(hp,wbuf);
-
-		msg("Checking for instrument errors... ");
-		j=0;
-		do{
-			sprintf(wbuf,"SYST:ERR?;\n");wrtstr(hp,wbuf); 	// ask for errors
-			tickle(300);
-			rbuf[0]='\0';
-			getmsg(hp,rbuf);								// Tx
-			i=sscanf(rbuf,"%d",&scpi);						// Rx
-			sprintf(wbuf,"err check (%d): %s",j++,rbuf);
-			progress(wbuf);msg(wbuf);
-		}while(i!=1 || scpi!=0);
+		// clear bus, ID instrument, reset only if not already set up, empty error queue (scpi66.h)
+		msg("Bringing up instrument... ");
+		up66(hp,USBpath,gpibaddr,"SENSe:CURRent:RANGe MAX\n");	// 5A range
 		
 		//********************************************************************
 
+		if(digmode){								// V & I sampled by the instrument
+			dtint = digtint(1.0/(20.0*fmax));		// 20 samples per period of highest tone
+			dpts = MIN(DIGPTS,(int)(2.0/dtint));	// ~2s per sweep
+			vblk = malloc(dpts*sizeof(double));
+			iblk = malloc(dpts*sizeof(double));
+			if(vblk==NULL || iblk==NULL) err("Out of memory for digitizer blocks.");
+			digsetup(hp,dpts,dtint);
+			sprintf(rbuf,"Digitizer array mode: %d points every %sS per sweep.",dpts,engstr(dtint,4));
+			progress(rbuf);msg(rbuf);
+		}
+
 
 		// now iterate set-read loop until required time has elapsed
-		wrtstr(hp,"OUTP ON\n");tickle(500);				// enable outputs
+		if(!digmode && Ts<=0.00){						// grid period from a few timed transactions
+			tcal = rx66now();
+			for(i=0;i<10;i++) meas2(hp,&vb,&ib);
+			Ts = sclk66auto((rx66now()-tcal)/10.0);
+		}
+		if(digmode && Ts<=0.00) Ts = MAX(1e-3*DIGSTEER,sclk66auto(digsteer(hp,Vmax)));	// host only steers
+		if(digmode && fmax*DIGSPP*Ts>1.0+1e-9){			// staircase too coarse for the top tone
+			sprintf(rbuf,"fmax is too large for a %sS steering grid, %d setpoints a period allow %.1lfHz.",
+				engstr(Ts,4),DIGSPP,1.0/(DIGSPP*Ts));
+			err(rbuf);
+		}
+		sprintf(rbuf,"Sample grid %sS.",engstr(Ts,4));
+		progress(rbuf);msg(rbuf);
+		wrtstr(hp,"OUTP ON\n");ready66(hp,UP66TMAX);		// enable outputs, on once *OPC? answers
 		time(&tmark);									// time in seconds for dwells
-		clock_gettime(CLOCK_REALTIME, &ts);				// present into ts(tart) structure
-		clock_gettime(CLOCK_REALTIME, &tn);				// present into tn(ow) structure
-		lastmeastime = meastime = (tn.tv_sec-ts.tv_sec)+(tn.tv_nsec-ts.tv_nsec)/GIG; // init meastime
+		lastmeastime = meastime = 0.00;						// time zero is the grid origin
 		dt=0.00;
 		dQ=0.00;
 		
@@ -452,11 +552,19 @@ int main(int argc, char* argv[])
 		
 		msg("Commencing main measurement loop... ");
 		progress("Commencing main measurement loop... ");
-		while(meastime<=period*ncyc+Xcyc*period+dt+1.0){		// not covered discard+window+margin yet
-
-			// TIME: in Raspbian, use clock_gettime()
-			clock_gettime(CLOCK_REALTIME, &tn);			// present into tn(ow) structure
-			meastime = (tn.tv_sec-ts.tv_sec)+(double)((tn.tv_nsec-ts.tv_nsec))/GIG; // update meastime
+		r66starttim(&ring,tvi,NULL,logfile,tt.f,binary,show);	// no file or screen i/o in the loop from here
+		if(opt66on('r')) sclk66rt(opt66val('r')==NULL? -1 : atoi(opt66val('r')));	// writer thread stays normal
+		sclk66init(&clk,Ts);							// grid starts now
+		rate66init(&rate);
+		if(!dense) zdftinit(&zl,nf,f,period);			// live Z over the logged samples
+		zdftliveinit(&zlv);
+		if(digmode){digarm(hp); tarm=meastime; armed=TRUE;}		// first sweep
+		while(armed || (!zdone && meastime<=period*ncyc+Xcyc*period+dt+1.0)){	// not covered discard+window+margin, or a sweep to fetch
+			r66time(&ring,&tt);							// -t: the last sample's phases
+
+			// TIME: next slot of the monotonic sample grid
+			meastime = sclk66wait(&clk);				// sleep to it, elapsed time on the grid
+			tvitmark(&tt,TVITWAIT);
 
 			// calculate STIMULUS ***********************************************
 			for(Istim=0.0,i=0;i<nf;i++){				// sum Istim over each tone
@@ -482,28 +590,78 @@ int main(int argc, char* argv[])
 			Ismallest = MIN(Ismallest,Istim);
 
 			// set required V & I, change heading towards Vmin/Vmax, include trim correction
-			sprintf(wbuf,"VOLT %.6lf;CURR %.6lf\n",(Istim+itrim<0.00)?(0.99*Vmin):(1.01*Vmax),fabs(Istim+itrim)); // set V & I
-			wrtstr(hp,wbuf);							// send	
-
-			// READOUT V & I
+			// and READOUT V & I in the same transaction
 			datvoid=FALSE;						// reset warning, retry measurement
-			wrtstr(hp,"MEAS:VOLT?\n");			// request the terminal voltage
-			getmsg(hp,rbuf);
-			i=sscanf(rbuf,"%lf",&vb);
-			wrtstr(hp,"MEAS:CURR?\n");
-			getmsg(hp,rbuf);
-			i+=sscanf(rbuf,"%lf",&ib);
-			if(i!=2)datvoid=TRUE;			// something went wrong
+			if(digmode){						// host only steers I, digitizer measures
+				setonly(hp,(Istim+itrim<0.00)?(0.99*Vmin):(1.01*Vmax),fabs(Istim+itrim));
+				tvitbus(&tt);
+				hdt=meastime-lastmeastime;
+				lastmeastime = meastime;
+				dQtarget += hdt*Istim;			// expected charge excursion, host timeline
+				if(sink==FALSE && fabs(dQtarget)>deltaQ){		// should never happen!
+					r66err(&ring,"target delta_Q exceeded specified limit (should never happen)!\n");
+				}
+				if(meastime>=tarm+dpts*dtint+0.005){		// sweep finished
+					nblk = digfetch(hp,vblk,iblk,dpts);		// both arrays in one reply
+					tblk = tarm;
+					if(!zdone && meastime<=period*ncyc+Xcyc*period+dt+1.0){
+						digarm(hp);							// next sweep, once this one is in
+						tarm = sclk66now(&clk);
+						gap = tarm-(tblk+dpts*dtint);		// not sampled while fetching & re-arming
+						gapsum += gap;
+						gapmax = MAX(gapmax,gap);
+						ngap++;
+					}else{
+						armed = FALSE;						// that was the last, still under stimulus
+					}
+					tvitbus(&tt);
+					if(nblk<dpts){
+						sprintf(rbuf,"Short digitizer block (%d/%d points) at %.3lfs",nblk,dpts,tblk);
+						r66text(&ring,R66LOG,rbuf);
+					}
+					for(k=0;k<nblk;k++){					// rebuild each sample's time
+						tk = tblk+k*dtint;
+						vb = vblk[k]; ib = iblk[k];
+						rate66tick(&rate);
+						if(vb>=Vmax || vb<=Vmin){			// hit a voltage limit!
+							wrtstr(hp,"OUTP OFF\n");		// disable outputs
+							r66text(&ring,R66LOG,"Hit voltage limit in digitizer block... aborting run!");
+							r66err(&ring,"Hit voltage limit... aborting run!");
+						}
+						dt = (lasttk<0.0)? dtint : tk-lasttk;	// spans the gap between sweeps
+						lasttk = tk;
+						npts++;
+						dQ += dt*ib;						// accumulate measured delta charge
+						if(sink==FALSE && fabs(dQ)>1.01*deltaQ){	// exceeded limit+1%
+							r66err(&ring,"actual delta_Q exceeded specified limit (by 1 percent)\n");
+						}
+						if(tk>=Xcyc*period){
+							r66tvi(&ring,R66TVI,4,tk,vb,ib);
+							if(!dense) zdftadd(&zl,tk,vb,ib);
+							if(!dense && zdftlive(&zl,&zlv)){			// a cycle completed, live Z
+								zok = (livez(&ring,&zlv,f,nf)<ztol && zlv.ncyc>=ZDFTSTOP)? zok+1 : 0;
+								zdone = (zok>=2);						// settled two cycles running
+							}
+						}
+					}
+				}
+				datvoid=TRUE;					// samples already handled, none for below
+			}else{
+				i=setmeas(hp,(Istim+itrim<0.00)?(0.99*Vmin):(1.01*Vmax),fabs(Istim+itrim),&vb,&ib);
+				tvitbus(&tt);
+				if(i!=2)datvoid=TRUE;			// something went wrong
+				rate66tick(&rate);
+			}
 			
 			if(datvoid==FALSE && vb>=Vmax){		// hit hi voltage limit!
 				wrtstr(hp,"OUTP OFF\n");					// disable outputs
-				progress("Hit high voltage limit... aborting run!");
-				err("Hit high voltage limit... aborting run!");
+				r66text(&ring,R66LOG,"Hit high voltage limit... aborting run!");
+				r66err(&ring,"Hit high voltage limit... aborting run!");
 			}
 			if(datvoid==FALSE && vb<=Vmin){		// hit lo voltage limit!
 				wrtstr(hp,"OUTP OFF\n");					// disable outputs
-				progress("Hit low voltage limit... aborting run!");
-				err("Hit low voltage limit... aborting run!");
+				r66text(&ring,R66LOG,"Hit low voltage limit... aborting run!");
+				r66err(&ring,"Hit low voltage limit... aborting run!");
 			}
 			
 			// Now check charge excursion in case of DAC error creep
@@ -512,11 +670,11 @@ int main(int argc, char* argv[])
 				lastmeastime = meastime;	// deal with time
 				dQ += dt*ib;					// accumulate measured delta charge
 				if(sink==FALSE && fabs(dQ)>1.01*deltaQ){		// exceeded limit+1%
-					err("actual delta_Q exceeded specified limit (by 1 percent)\n");
+					r66err(&ring,"actual delta_Q exceeded specified limit (by 1 percent)\n");
 				}
 				dQtarget += dt*Istim;		// expected charge excursion (delta Q) (v6)
 				if(sink==FALSE && fabs(dQtarget)>deltaQ){		// should never happen! (v6)
-					err("target delta_Q exceeded specified limit (should never happen)!\n");
+					r66err(&ring,"target delta_Q exceeded specified limit (should never happen)!\n");
 				}
 			}
 			dQbiggest = MAX(dQbiggest,dQ);
@@ -529,14 +687,14 @@ int main(int argc, char* argv[])
 				i_error = Qerror/meastime;					// Q=it so i=Q/t amps apparent error
 				sprintf(rbuf,"==dQ target %sAh crossed zero @%d, dQ=%sAh, (%.3lf%%) -> i_error=%s, itrim=%s", 
 					sengstr(dQtarget/3600.0,4), npts, sengstr(dQ/3600.0,4), 100*Qerror/deltaQ, engstr(i_error,4), engstr(itrim,3) );
-				progress(rbuf);
+				r66text(&ring,R66LOG,rbuf);
 			}
 			if( npts%20000==19999 ){	// well into measurement 
 				Qerror = dQtarget-dQ;					// how far out really?
 				i_error = Qerror/meastime;				// Q=it so i=Q/t amps apparent error
 				sprintf(rbuf,"===dQ target =%sAh @%d, dQ=%sAh, (%.3lf%% of permitted) -> i_error=%s", 
 					sengstr(dQtarget/3600.0,4), npts, sengstr(dQ/3600.0,4), 100*Qerror/deltaQ, engstr(i_error,4) );
-				progress(rbuf);
+				r66text(&ring,R66LOG,rbuf);
 			}
 			// when squarewave switches sign we may update itrim (v6)
 			if(midcycle!=last_midcycle){	// switched
@@ -545,39 +703,59 @@ int main(int argc, char* argv[])
 				errpc = 100.0*itrim/Imax;
 				sprintf(rbuf," ++Idc crossed zero, pt%d: updating itrim to %s, %.3lf%% of Imax", 
 					npts, engstr(itrim,4), errpc );
-				progress(rbuf);
+				r66text(&ring,R66LOG,rbuf);
 			}
 			
 			// info display
 			fase = (int)(fracycle*4);
-			sprintf(rbuf,"pt%d: %.3lfs V=%.3lf, I=%+.3lf,%c dt=%.3lfs dQ=%sAh %c %c %d%% (%.1lfH to go)",
-				npts++,meastime,vb,ib,fase+'a',
-				dt,sengstr(dQ/3600.0,3),datvoid?'X':'O',meastime<Xcyc*period?'<':'+',
-				(int)(100.0*meastime/(period*(Xcyc+ncyc))),
-					((period*ncyc+Xcyc*period+dt+1.0)-meastime)/3600.0 );
-			msg(rbuf);
-			if(npts%1000==17){
-				fprintf(logfile,"%s\n",rbuf);
-				fflush(logfile);
-			}
+			shw[0]=digmode?npts:npts++; shw[1]=meastime; shw[2]=vb; shw[3]=ib; shw[4]=dt; shw[5]=rate.now; shw[6]=dQ;
+			shw[7]=(int)(100.0*meastime/(period*(Xcyc+ncyc)));
+			shw[8]=((period*ncyc+Xcyc*period+dt+1.0)-meastime)/3600.0;
+			shw[9]=fase;
+			r66show(&ring,npts%1000==17 || npts%5000==19,
+				(digmode?SHDIG:0)|(datvoid?SHVOID:0)|(meastime<Xcyc*period?SHPRE:0),shw,10);
 			if(npts%5000==18){
-				fprintf(logfile,"Istim_max= %s, Istim_min= %s dQ_max= %s, dQ_min= %s\n", 
+				sprintf(rbuf,"Istim_max= %s, Istim_min= %s dQ_max= %s, dQ_min= %s", 
 					engstr(Ibiggest,3),engstr(Ismallest,3),engstr(dQbiggest/3600.0,3),engstr(dQsmallest/3600.0,3));
-				fflush(logfile);
+				r66text(&ring,R66LOG,rbuf);
 			}
 			if(npts%5000==19){
-				fprintf(logfile,"%s\n",rbuf);
-				fprintf(logfile,"Istim=%s, itrim=%s (Iset=%s), i_meas=%s \n", 
+				sprintf(rbuf,"Istim=%s, itrim=%s (Iset=%s), i_meas=%s ", 
 					sengstr(Istim,5),sengstr(itrim,5),sengstr(Istim+itrim,5),sengstr(ib,5) );
-				fflush(logfile);
+				r66text(&ring,R66LOG,rbuf);
 			}
 			if(datvoid){continue;}					// bad data, don't log
 			if(meastime<Xcyc*period){ continue; }	// in the discard window, don't log
-			fprintf(tvi,"%.3lf %s %s\n", meastime, engstr(vb,6), engstr(ib,6));	// triple to tvi file
+			r66tvi(&ring,R66TVI,3,meastime,vb,ib);	// triple to tvi file
+			if(!dense) zdftadd(&zl,meastime,vb,ib);
+			if(!dense && zdftlive(&zl,&zlv)){			// a cycle completed, live Z
+				zok = (livez(&ring,&zlv,f,nf)<ztol && zlv.ncyc>=ZDFTSTOP)? zok+1 : 0;
+				zdone = (zok>=2);						// settled two cycles running
+			}
 
 		}
-		progress("Completed measurement sequence.");
+		r66time(&ring,&tt);
 		wrtstr(hp,"OUTP OFF\n");					// disable outputs
+		r66stop(&ring);								// drain files & display
+		tvitclose(&tt);
+		if(zdone){									// ff & the DFT take what there is
+			sprintf(rbuf,"Z settled within %.2lf%% after %d cycles, stopped early.",100.0*ztol,zlv.ncyc);
+			progress(rbuf);
+			ncyc = zlv.ncyc;
+		}
+		if(!dense) zdftfree(&zl);
+		sclk66report(&clk,rbuf);
+		progress(rbuf);
+		if(digmode && ngap>0){
+			sprintf(rbuf,"Digitizer: %d gaps between sweeps for fetch & re-arm, mean %sS, max %sS, %.2lf%% of the run unsampled.",
+				ngap,engstr(gapsum/ngap,3),engstr(gapmax,3),100.0*gapsum/meastime);
+			progress(rbuf);msg(rbuf);
+		}
+		progress("Completed measurement sequence.");
+		sprintf(rbuf,"Achieved %.2lf samples/s over %ld samples.",rate.run,rate.n);
+		progress(rbuf);
+		rx66stats(rbuf);
+		progress(rbuf);
 		fclose(tvi);
 		sprintf(rbuf,"Largest current = %s ", sengstr(Ibiggest,3));
 		progress(rbuf);
@@ -585,51 +763,56 @@ int main(int argc, char* argv[])
 		progress(rbuf);
 	}
 
-	if(getz){	// use dftp to estimate V and I at each frequency, and so z
-		for(i=0;i<nf;i++){				// for each frequency
-			// call to dft I then V at that frequency >bat
-			fprintf(bat,"%s %s.tvi %s 1 0 D L C 3 %c>%s.tmp\n",dftname,baseName,engstr(f[i],3),i?'>':' ',baseName);
-			fprintf(bat,"%s %s.tvi %s 1 0 D L  >>%s.tmp\n",dftname,baseName,engstr(f[i],3),baseName);
+	if(getz && dense){	// too many tones for zdft.h, FFT of each cycle resampled (zfft.h)
+		for(i=0;i<nf;i++) fz[i]=f[i];
+		for(i=0;i<4;i++) fz[nf+i]=(2*i+1)*fdc;		// fdc harmonics too if they are on FFT bins
+		nb = zfftharm(nf+4,fz)? nf+4 : nf;
+		if(nb==nf) progress("fdc is not on a harmonic of fmin, no fdc harmonics.");
+		strcpy(logfname,baseName);
+		strcat(logfname,archive?".tvia":binary?".tvib":".tvi");
+		progress("FFT of the tvi file, cycle by cycle...");
+		j = zfftfile(logfname,nb,fz,vmag,vpha,imag,ipha,zse,&pts);
+		for(k=0,i=1;i<nf;i++) if(zse[i]>zse[k]) k=i;
+		sprintf(rbuf,"FFT: %d tones, %d whole cycles, %d points per cycle, Z within +/-%.2lf%% (worst at %sHz).",
+			nf,j,pts,100.0*zse[k],engstr(f[k],4));
+		progress(rbuf);
+		for(i=0;i<nf;i++){
+			// write fmp
+			mag=vmag[i]/imag[i];
+			pha=vpha[i]-ipha[i];
+			fprintf(fmp,"%s %s %.2lf\n",engstr(f[i],6),engstr(mag,4),pha);
 		}
-		fprintf(bat,"%s %s.tvi %s 1 0 D L C 3 >>%s.tmp\n",dftname,baseName,engstr(fdc,8),baseName);
-		fprintf(bat,"%s %s.tvi %s 1 0 D L  >>%s.tmp\n",dftname,baseName,engstr(fdc,8),baseName);
-		fprintf(bat,"%s %s.tvi %s 1 0 D L C 3 >>%s.tmp\n",dftname,baseName,engstr(3.0*fdc,8),baseName);
-		fprintf(bat,"%s %s.tvi %s 1 0 D L  >>%s.tmp\n",dftname,baseName,engstr(3.0*fdc,8),baseName);
-		fprintf(bat,"%s %s.tvi %s 1 0 D L C 3 >>%s.tmp\n",dftname,baseName,engstr(5.0*fdc,8),baseName);
-		fprintf(bat,"%s %s.tvi %s 1 0 D L  >>%s.tmp\n",dftname,baseName,engstr(5.0*fdc,8),baseName);
-		fprintf(bat,"%s %s.tvi %s 1 0 D L C 3 >>%s.tmp\n",dftname,baseName,engstr(7.0*fdc,8),baseName);
-		fprintf(bat,"%s %s.tvi %s 1 0 D L  >>%s.tmp\n",dftname,baseName,engstr(7.0*fdc,8),baseName);
-		fclose(bat);
-		// exec bat 
-		sprintf(cmd,"chmod +x %s.bat\n",baseName);
-		progress(cmd);
-		if(-1==system(cmd)){
-			err("Call to make batch file executable failed");}
-		sprintf(cmd,"./%s.bat\n",baseName);
-		progress(cmd);
-		if(-1==system(cmd)){
-			err("Call to batch file failed");}
-		// read result from tmp, compute z
-		progress("Opening .tmp file...");	// tmp file from script
+		fclose(fmp);
+		for(i=nf;i<nb;i++){							// square-wave harmonics, to the log
+			sprintf(rbuf,"fdc harmonic %d: %sHz V=%sV I=%sA Z=%sOhm %.2lf",2*(i-nf)+1,engstr(fz[i],6),
+				engstr(vmag[i],4),engstr(imag[i],4),engstr(imag[i]>0.0?vmag[i]/imag[i]:0.0,4),vpha[i]-ipha[i]);
+			progress(rbuf);
+		}
+	}else if(getz){	// V & I at every frequency from one pass over the .tvi (zdft.h), and so z
+		for(fmin=1e30,i=0;i<nf;i++){ fz[i]=f[i]; fmin=MIN(fmin,f[i]); }
+		for(i=0;i<4;i++) fz[nf+i]=(2*i+1)*fdc;		// and the square wave's 1st, 3rd, 5th & 7th
+		zdftinit(&zd,nf+4,fz,1.0/fmin);
 		strcpy(logfname,baseName);
-		strcat(logfname,".tmp");
-		bat = fopen(logfname,"r");			// reuse batch file pointer
-		if(bat==NULL) err("Cannot open tmp file");
-		progress(".tmp open.");		
-		// read raw data from tmp file and compute fmp
+		strcat(logfname,archive?".tvia":binary?".tvib":".tvi");
+		progress("Single-pass DFT of the tvi file...");
+		nread = zdftfile(&zd,logfname);
+		j = zdftcycles(&zd);
+		sprintf(rbuf,"DFT: %ld samples, %d bins, %d whole cycles at fmin.",nread,zd.nb,j);
+		progress(rbuf);
+		zdftwin(&zd,0,MAX(j,1),vmag,vpha,imag,ipha);	// all whole cycles (or what there is)
 		for(i=0;i<nf;i++){
-			fgets(rbuf, 255, bat);
-			sscanf(rbuf,"%le %le %le",&fcheck,&imag[i],&ipha[i]);
-			if(relerr(fcheck,f[i])>0.01){err("Line in .tmp with wrong frequency!");}
-			fgets(rbuf, 255, bat);
-			sscanf(rbuf,"%le %le %le",&fcheck,&vmag[i],&vpha[i]);
-			if(relerr(fcheck,f[i])>0.01){err("Line pair in .tmp with different frequencies!");}
 			// write fmp
 			mag=vmag[i]/imag[i];
 			pha=vpha[i]-ipha[i];
 			fprintf(fmp,"%s %s %.2lf\n",engstr(f[i],6),engstr(mag,4),pha);
 		}
 		fclose(fmp);
+		for(i=nf;i<nf+4;i++){						// square-wave harmonics, to the log
+			sprintf(rbuf,"fdc harmonic %d: %sHz V=%sV I=%sA Z=%sOhm %.2lf",2*(i-nf)+1,engstr(fz[i],6),
+				engstr(vmag[i],4),engstr(imag[i],4),engstr(imag[i]>0.0?vmag[i]/imag[i]:0.0,4),vpha[i]-ipha[i]);
+			progress(rbuf);
+		}
+		zdftfree(&zd);
 	}
 
 	if(refine){	// use estimates to start optimiser, refine V & I, get refined z (.ffz)
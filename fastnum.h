@@ -0,0 +1,72 @@
+// fastnum.h: in-place decimal number parsing without sscanf()
+// stand-alone, usable by the acquisition programs and the analysis tools
+// JBS & CJD 2026
+//
+// Numbers such as "+1.23456E-01" are parsed where they lie in the receive
+// buffer.  Up to 19 significant digits are gathered into an integer; when it
+// fits in 53 bits and the power of ten is within 10^22 the result is one exact
+// multiply or divide (Clinger's fast path), so it is correctly rounded, the
+// same as strtod().  Anything else (long mantissas, huge exponents, inf/nan)
+// falls back to strtod() on the same characters.
+
+#ifndef FASTNUM_H
+#define FASTNUM_H
+
+#include	<stdlib.h>
+#include	<stdint.h>
+
+static const double fastnum_p10[23]={1e0,1e1,1e2,1e3,1e4,1e5,1e6,1e7,1e8,1e9,1e10,1e11,
+	1e12,1e13,1e14,1e15,1e16,1e17,1e18,1e19,1e20,1e21,1e22};
+
+// parse one number at s; *end is left after it (== s if there was none)
+double fastnum(char *s, char **end)
+{
+	char *p=s;
+	uint64_t m=0;
+	int neg=0, nd=0, e=0, x=0, xneg=0, any=0;
+	double r;
+
+	if(*p=='+' || *p=='-') neg = (*p++=='-');
+	for(;*p>='0' && *p<='9';p++,any=1){
+		if(nd<19){ m=m*10+(*p-'0'); if(m) nd++; }
+		else e++;									// digits beyond 19 only scale
+	}
+	if(*p=='.'){
+		for(p++;*p>='0' && *p<='9';p++,any=1){
+			if(nd<19){ m=m*10+(*p-'0'); if(m) nd++; e--; }
+		}
+	}
+	if(!any){ return strtod(s,end); }				// "inf", "nan", or nothing
+	if(*p=='e' || *p=='E'){
+		char *q=p+1;
+		if(*q=='+' || *q=='-') xneg = (*q++=='-');
+		if(*q>='0' && *q<='9'){
+			for(;*q>='0' && *q<='9';q++) if(x<10000) x=x*10+(*q-'0');
+			e += xneg? -x : x;
+			p=q;
+		}
+	}
+	if(nd>=19 || m>((uint64_t)1<<53) || e>22 || e<-22) return strtod(s,end);	// not exact, be careful
+	*end=p;
+	r = (double)m;
+	r = (e<0)? r/fastnum_p10[-e] : r*fastnum_p10[e];
+	return neg? -r : r;
+}
+
+// pull up to n numbers from a reply ("1.23;4.56" or "1.23,4.56"), returns # found
+int fastnums(char *s, double *x, int n)
+{
+	int k=0;
+	char *e;
+
+	while(*s==' ') s++;
+	while(k<n && *s){
+		x[k] = fastnum(s,&e);
+		if(e==s) break;								// not a number, give up
+		k++;
+		for(s=e; *s==';' || *s==',' || *s==' ' || *s=='\t'; s++);
+	}
+	return k;
+}
+
+#endif
@@ -1,27 +1,124 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
-
-#define PI 3.14159265358979323846
+#include "tvicond.h"
+#include "tvird.h"
+#include "tvicyx.h"
+#include "getut.h"
+#include "tvifol.h"
+#include "opt66.h"
 
 int sign(double x){
   if(x<=0) return -1;
   else return 1;
 }
 
+// The cycles are found by tvicyx.h, from the .cyx sidecar when it is up to date
+// (tvicyx builds it) or else block by block on -jN threads.  Each cycle's sums
+// then start from its first sample, so the cycles are summed in parallel, or
+// only those asked for with -c, and come out exactly as the one pass gave
+// them; they are taken in file order by the same code as ever (getut.h), so
+// any -j gives the same results.  A file whose time goes back (stitched by
+// tvicond.h) is summed in one pass, each cycle folded as it ends, so the
+// stitch notes come out between the cycle lines.  With -f the file is
+// followed as it is written (tvifol.h): one pass, each cycle's line out as
+// soon as it ends.
+
+struct job{
+  struct tvird *rd;
+  struct cyx *x;
+  struct acc *a;
+  long lo;
+  double Rs;
+};
+
+void sumcyc(void *arg, long k){ //cycle lo+k from its first sample
+  struct job *j=arg;
+  struct cyxrec *c=&j->x->c[j->lo+k];
+
+  sumcycle(j->rd, c->pos, c->n, c->tstart, j->Rs, &j->a[j->lo+k]);
+}
+
+void stitched(struct tvird *rd, struct cyx *x, struct gut *g, double Rs, long lo, long c0, long c1){ //one pass, cycles lo to c1 folded as they end
+  struct tvicstat st;
+  struct tvird s;
+  struct acc a;
+  double y[3], time;
+  long k=0, nseg=0;
+
+  tvicstinit(&st);
+  accinit(&a, 0.00, 0.00);
+  tvirdpart(rd, 0, tvirdblkpos(rd, tvirdnblk(rd)), &s);
+  while(k<=c1 && tvirdnext(&s, y, 3)){
+    time=tvicstitch(&st, y[0]);
+    if(st.nseg!=nseg){
+      nseg=st.nseg;
+      fprintf(stderr, "Non-monotonic time: segment %ld stitched on at %.1lf; dtmax=%.2lf, dtmin=%.2lf\n", nseg, time, st.dtmax, st.dtmin);
+    }
+    if(!step(&a, time, y[1], y[2], Rs)) continue;
+    if(k>=lo) gutcyc(g, &a, x->c[k].tstart, k>=c0);
+    k++;
+    accinit(&a, time, a.dQ);
+  }
+  tvirdclose(&s);
+}
+
+void summary(struct gut *g, struct tvicstat *st){
+  char tbuf[512];
+  double C_K=0.00;
+
+  //For future use
+  //currentMean=g->wholeMeanQ/totalTime;
+  //currentRMS=sqrt(g->wholeMeanQSq/totalTime);
+  //C_K=1+(currentMean/currentRMS-1)/50.00;
+
+  tvicstats(st, tbuf);
+  fprintf(stderr, "Time base: %s\n", tbuf);
+  fprintf(stderr, "Mean u = %.6lf, variance = %.3e (%.3e%%), SD = %.3e, %d cycles\n", g->umean, g->uVar, 100*g->uVar/g->umean, sqrt(g->uVar), g->ucount);
+  fprintf(stderr, "Whole file U = %.3lf, adjusted U = %.3lf, total dQ = %.3lf (%.3fAh), start time = %.3lf (%.3lfh), starting voltage = %.3lf\n", g->U, C_K*g->U, g->totQ, g->totQ/3600, g->origtime, g->origtime/3600, g->origv);
+  //fprintf(stderr, "usum=%.3lf uusum=%.3lf ucount=%d \n", usum, uusum, ucount);
+}
+
+void follow(char *fname, double Rs, long c0, long c1, double idle){ //-f: cycles c0 to c1 as they come
+  struct tvifol f;
+  struct tvicstat st;
+  struct acc a;
+  struct gut g;
+  double x[3], time;
+  long nseg=0;
+
+  if(tvifolopen(&f, fname, idle, stdout)) exit(1);
+  tvicstinit(&st);
+  accinit(&a, 0.00, 0.00);
+  gutinit(&g, Rs, 0, stdout, stderr);
+  while((c1<0 || g.count<=c1) && tvifolnext(&f, x, 3)){
+    time=tvicstitch(&st, x[0]);
+    if(st.nseg!=nseg){
+      nseg=st.nseg;
+      fprintf(stderr, "Non-monotonic time: segment %ld stitched on at %.1lf; dtmax=%.2lf, dtmin=%.2lf\n", nseg, time, st.dtmax, st.dtmin);
+    }
+    if(!step(&a, time, x[1], x[2], Rs)) continue;
+    gutcyc(&g, &a, g.timePeriod, g.count>=c0);
+    accinit(&a, time, a.dQ);
+    fflush(stdout);
+  }
+  if(f.nbad) fprintf(stderr, "%ld lines skipped\n", f.nbad);
+  tvifolclose(&f);
+  gutend(&g);
+  summary(&g, &st);
+}
+
 int main(int argc, char *argv[]) //*argv[] is an array of pointers
 {
-  double time=0.00, volts=0.00, curr=0.00, origv=0.00, vmax=0.00, vmin=100.00;
-  double current=0.00, voltage=0.00, V0=0.00, Va=0.00, CPEvoltage=0.00, currentMean=0.00, currentRMS=0.00, C_K=0.00;
-  double dt=0.00, lasttime=0.00, timePeriod=0.00, dtmin=0.00, dtmax=0.00, accumtime=0.00, origtime=0.00, totalTime=0.00;
-  double dQ=0.00, lastdQ=0.00, cumdQ=0.00, u=0.00, uLast=0.001, lastdQ2=0.00, allQ=0.00, allQSq=0.00, wholeMeanQ=0.00, wholeMeanQSq=0.00;
-  double Ein=0.00, Eout=0.00, totQ=0.00, totIn=0.00, totOut=0.00, Rs=0.00;
-  int count=0, ucount=0;
-  double usum=0.00, uusum=0.00, umean=0.00, uVar=0.00, costheta=0.00, theta=0.00, alpha=0.00;
-  //double uArray[12];
-  FILE *fileptr; //points to a random address in memory; initialised later with &time, &volts, etc.
-  char *sline;
-  size_t li;
+  double Rs=0.00;
+  struct gut g; //u, theta & alpha over the cycles, getut.h
+  struct tvird rd; //mapped .tvi/.tvib, parsed in place
+  struct cyx x; //cycle index, tvicyx.h
+  struct acc *cy;
+  struct job j;
+  char cname[512], *cr;
+  long k, c0=0, c1=-1, lo;
+  int nth;
 
   //float version=1.1f; //dynamic memory allocation added
   //float version=1.2f; //addition of prevoltages and currents to calculate u; increase similarity to getSoH
@@ -29,15 +126,32 @@ int main(int argc, char *argv[]) //*argv[] is an array of pointers
   //float version=1.4f; //addition of 'if' statement to catch non-monotonic timestamps
   //float version=1.5f; //reinstatement of Eout/Ein calculation and addition of C_K correction factor
   //float version=1.0f; //first version of getUTheta
-  float version=1.1f; //Addition of Rs as a parameter to be optionally passed in
+  //float version=1.1f; //Addition of Rs as a parameter to be optionally passed in
+  //float version=1.2f; //time stitching and dt statistics from tvicond.h
+  //float version=1.3f; //mmap reader with fast number parsing (tvird.h), 5-col & .tvib input
+  //float version=1.4f; //read in blocks on -jN threads, cycles merged exactly (tvipar.h)
+  //float version=1.5f; //cycles from the .cyx index (tvicyx.h), -c cycle range
+  //float version=1.6f; //cycle sums & fold shared with tviu & tvibatch (getut.h)
+  float version=1.7f; //-f follows a file still being written (tvifol.h)
 
   char year[20]="July 2023";
 
+  opt66(&argc, argv);
+  nth=(opt66val('j')!=NULL)? atoi(opt66val('j')) : tviparcpu();
+  if((cr=opt66val('c'))!=NULL){ //-cN, -ca:b, -ca:, -c:b
+    if(*cr!=':') c0=c1=atol(cr);
+    if((cr=strchr(cr, ':'))!=NULL) c1=(cr[1]!='\0')? atol(cr+1) : -1;
+  }
   if(argc<2 || argc>3){
     fprintf(stderr, "\ngetUTheta version %.2f Chris Dunn %s\n\n", version, year);
-    fprintf(stderr, "Usage: getUTheta inputfile.tvi [Rs] >outputfile.tu 2>resultsfile.txt\n");
+    fprintf(stderr, "Usage: getUTheta inputfile.tvi [Rs] [-jN] [-ca:b] [-f[s]] >outputfile.tu 2>resultsfile.txt\n");
     fprintf(stderr, "Rs (optional) = series resistance.\n");
-    fprintf(stderr, "Takes a .tvi (3-column ascii) file for a regular waveform,\n");
+    fprintf(stderr, "-jN (optional) = threads, default all cores; the results do not depend on N.\n");
+    fprintf(stderr, "-ca:b (optional) = only cycles a to b (-cN one, -ca: a on, -c:b up to b).\n");
+    fprintf(stderr, "-f[s] (optional) = follow the file as it is written, each cycle out as it ends,\n");
+    fprintf(stderr, "  until the writer closes it, s seconds (if given) pass with nothing new, or ^C.\n");
+    fprintf(stderr, "Cycles are found from inputfile.cyx if 'tvicyx' has indexed the file, else by a scan.\n");
+    fprintf(stderr, "Takes a .tvi (3- or 5-column ascii, or .tvib, .tvia) file for a regular waveform,\n");
     fprintf(stderr, "works out 'u' for each period and overall 'U' across all periods,\n");
     fprintf(stderr, "and writes period start times and u values to stdout.\n");
     fprintf(stderr, "getUTheta also calculates and writes out the phase angle for the CPE,\n");
@@ -47,12 +161,6 @@ int main(int argc, char *argv[]) //*argv[] is an array of pointers
     exit(1);
   }
 
-  fileptr=fopen(argv[1], "rb");
-
-  if(fileptr==NULL){
-    fprintf(stderr, "Cannot open .tvi file %s!\n", argv[1]); //check for the .tvi file
-    exit(1);
-    }
     if(argc==2){
       fprintf(stderr, "Rs set to zero\n");
     }
@@ -60,82 +168,38 @@ int main(int argc, char *argv[]) //*argv[] is an array of pointers
       Rs = atof(argv[2]);
       fprintf(stderr,"Rs set to %s\n",argv[2]);
     }
-    // while loop initialises *fileptr line by line
-    //while(fscanf(fileptr, "%f %f %f %f %d", &time, &volts, &curr, &dump, &cyc)!=EOF)
-    while(getline(&sline, &li, fileptr)>0 && sscanf(sline,"%le %le %le", &time, &volts, &curr)==3){
-      time+=accumtime;
-      if(time<=lasttime){
-	accumtime = lasttime;
-	time = lasttime+dt;
-	fprintf(stderr,"Non-monotonic time: accumulated time = %.1lf; dtmax=%.2lf, dtmin=%.2lf\n", accumtime, dtmax, dtmin);
-      }
-      dt=time-lasttime;
-      if(dt>dtmax){dtmax=dt;}
-      if(dt<dtmin){dtmin=dt;}
-      if(volts>vmax){vmax=volts;} //get vmax for theta calculation
-      if(volts<vmin){vmin=volts;} //get vmin for theta calculation
-      lasttime=time;
-      voltage=volts;
-      current=curr;
-      CPEvoltage=voltage+Rs*current;
-      if(current>0){
-	Ein+=dt*CPEvoltage*current;
-      }else{
-	Eout-=dt*CPEvoltage*current;
-      }
-      lastdQ=dQ;
-      dQ=current*dt;
-      cumdQ+=dQ;
-      allQ+=dt*fabs(current);
-      allQSq+=dt*current*current;
-
-      if(sign(dQ)!=sign(lastdQ) && sign(dQ)==sign(lastdQ2) && dQ!=-0.00){
-	if(count>0){
-	  u=Eout/Ein;
-	  Va=(vmax-vmin)/2;
-	  V0=Va+vmin;
-          costheta=(2*V0*(1-u))/(PI*Va);
-          theta=acos(costheta);
-          alpha=theta*2/PI;
-          vmax=0; //reset vmax
-          vmin=100; //reset vmin
-
-	  if(fabs((u-uLast)/uLast)<0.1){//wait for 'u' to settle down
-	    if(ucount<1){origv=voltage; origtime=timePeriod;}
-	    ucount++;
-	    fprintf(stderr, "%.3lf \tV=%.3lf \tdQ=%.3lf \tu=%.6lf \tTheta=%.2lf degrees \tAlpha=%.3lf \tT %.1lfh Cycle %d\n", timePeriod/3600, volts, cumdQ, u, theta*180/PI, alpha, (time-timePeriod)/3600, count);
-	    fprintf(stdout, "%.3lf %lf %lf %lf\n", timePeriod/3600, u, theta, alpha);
-	    //fprintf(stderr, "vmax=%.3lf vmin=%.3lf Va=%.3lf V0=%.3lf\n", vmax, vmin, Va, V0);
-	    usum+=u;
-	    uusum+=u*u;
-	    totQ+=cumdQ;
-	    totIn+=Ein;
-	    totOut+=Eout;
-	    wholeMeanQ+=allQ;
-	    wholeMeanQSq+=allQSq;
-	  }
-	}
-	uLast=u;
-        Ein=Eout=0.00;
-        timePeriod=time;
-        lastdQ2=dQ;
-        cumdQ=0.0f;
-        allQ=0.00;
-        allQSq=0.00;
-        count++;
+  if(opt66on('f')){
+    follow(argv[1], Rs, c0, c1, (opt66val('f')!=NULL)? atof(opt66val('f')) : 0.00);
+    return 0;
+  }
+  if(tvirdopen(&rd, argv[1])) exit(1);
+    cyxname(argv[1], cname);
+    if(cyxload(&x, cname, argv[1])==0){
+      fprintf(stderr, "Cycle index %s: %ld cycles\n", cname, (long)x.h.ncyc);
+    }else{
+      cyxbuild(&rd, nth, &x);
+    }
+    if(c1<0 || c1>=x.h.ncyc) c1=x.h.ncyc-1;
+    lo=(c0>1)? c0-1 : 0; //the cycle before, for uLast; cycle 0 for cycle 1's vmax & vmin
+    gutinit(&g, Rs, lo, stdout, stderr);
+    if(x.h.st.nseg>0){ //time goes back somewhere: one pass, stitched
+      stitched(&rd, &x, &g, Rs, lo, c0, c1);
+    }else{
+      cy=calloc(x.h.ncyc+1, sizeof(struct acc));
+      if(cy==NULL){fprintf(stderr, "Out of memory for cycles\n"); exit(1);}
+      if(c1>=lo){
+        j.rd=&rd; j.x=&x; j.a=cy; j.lo=lo; j.Rs=Rs;
+        tvipar(nth, c1-lo+1, sumcyc, &j);
       }
-    } //end of while loop
-
-    umean=usum/ucount;
-    uVar=(uusum - usum*usum/ucount)/(ucount-1);
-    totalTime=timePeriod-origtime;
-    
-    //For future use
-    //currentMean=wholeMeanQ/totalTime;
-    //currentRMS=sqrt(wholeMeanQSq/totalTime);
-    //C_K=1+(currentMean/currentRMS-1)/50.00;
-
-    fprintf(stderr, "Mean u = %.6lf, variance = %.3e (%.3e%%), SD = %.3e, %d cycles\n", umean, uVar, 100*uVar/umean, sqrt(uVar), ucount);
-    fprintf(stderr, "Whole file U = %.3lf, adjusted U = %.3lf, total dQ = %.3lf (%.3fAh), start time = %.3lf (%.3lfh), starting voltage = %.3lf\n", totOut/totIn, C_K*totOut/totIn, totQ, totQ/3600, origtime, origtime/3600, origv);
-    //fprintf(stderr, "usum=%.3lf uusum=%.3lf ucount=%d \n", usum, uusum, ucount);
+
+      // the cycles in file order, each ending on its boundary sample
+      for(k=lo;k<=c1;k++) gutcyc(&g, &cy[k], x.c[k].tstart, k>=c0);
+      free(cy);
+    }
+    if(x.h.nbad) fprintf(stderr, "%ld lines skipped\n", (long)x.h.nbad);
+    tvirdclose(&rd);
+
+    gutend(&g);
+    summary(&g, &x.h.st);
+    cyxfree(&x);
 }
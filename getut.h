@@ -0,0 +1,166 @@
+// getut.h: getUTheta's sums over a cycle and its fold over the cycles (u, theta, alpha, U)
+// for getUTheta, tviu & tvibatch, with tvicyx.h
+// JBS & CJD 2026
+//
+// struct acc holds one cycle's sums and step() adds a sample to them, saying
+// whether it ends the cycle (cyxedge()).  gutcyc() takes the cycles in file
+// order as getUTheta always has: u = Eout/Ein and theta from the V swing, and
+// once u has settled (within 10% of the cycle before's) the cycle counts
+// towards the file's mean u, variance, U and dQ.  Its lines go to g->tu
+// (getUTheta's stdout) and g->rep (its stderr) where those are not NULL, and
+// gutend() works out the file's figures for the summary.
+
+#ifndef GETUT_H
+#define GETUT_H
+
+#include	<stdio.h>
+#include	<string.h>
+#include	<math.h>
+#include	"tvicyx.h"
+
+#define PI 3.14159265358979323846
+
+struct acc {					// running sums over one cycle
+	double lasttime, lastv, dQ;
+	double Ein, Eout, cumdQ, allQ, allQSq, vmax, vmin;
+};
+
+struct gut {					// the fold over the cycles
+	double Rs;
+	FILE *tu, *rep;				// cycle lines, NULL for none
+	int count, ucount;			// cycles folded (from the first given), settled
+	double u, uLast, timePeriod, origv, origtime;
+	double v0max, v0min;		// cycle 0's, merged into cycle 1's
+	double usum, uusum, asum, totQ, totIn, totOut, wholeMeanQ, wholeMeanQSq;
+	double umean, uVar, U, alpha;	// gutend()
+};
+
+void accinit(struct acc *a, double lasttime, double dQ)
+{
+	memset(a,0,sizeof(*a));
+	a->lasttime=lasttime;
+	a->dQ=dQ;
+	a->vmin=100.00;
+}
+
+int step(struct acc *a, double time, double volts, double curr, double Rs)	// 1 if it ends a cycle
+{
+	double dt, CPEvoltage, lastdQ;
+
+	dt=time-a->lasttime;
+	if(volts>a->vmax){a->vmax=volts;}			// vmax & vmin for theta
+	if(volts<a->vmin){a->vmin=volts;}
+	a->lasttime=time;
+	a->lastv=volts;
+	CPEvoltage=volts+Rs*curr;
+	if(curr>0){
+		a->Ein+=dt*CPEvoltage*curr;
+	}else{
+		a->Eout-=dt*CPEvoltage*curr;
+	}
+	lastdQ=a->dQ;
+	a->dQ=curr*dt;
+	a->cumdQ+=a->dQ;
+	a->allQ+=dt*fabs(curr);
+	a->allQSq+=dt*curr*curr;
+	return cyxedge(a->dQ,lastdQ);
+}
+
+// sums of the cycle of n samples from position pos in r, the boundary before it at tstart
+void sumcycle(struct tvird *r, long pos, long n, double tstart, double Rs, struct acc *a)
+{
+	struct tvird s;
+	double x[3];
+	long k;
+
+	accinit(a,tstart,0.00);
+	tvirdpart(r,pos,tvirdblkpos(r,tvirdnblk(r)),&s);
+	for(k=0;k<n && tvirdnext(&s,x,3);k++) step(a,x[0],x[1],x[2],Rs);
+	tvirdclose(&s);
+}
+
+// one pass from r's start with stitched time (tvicond.h), up to ncyc cycles into cy;
+// stitches reported on rep unless NULL
+void sumall(struct tvird *r, struct acc *cy, long ncyc, double Rs, FILE *rep)
+{
+	struct tvicstat st;
+	struct tvird s;
+	struct acc a;
+	double x[3], time;
+	long k=0, nseg=0;
+
+	tvicstinit(&st);
+	accinit(&a,0.00,0.00);
+	tvirdpart(r,0,tvirdblkpos(r,tvirdnblk(r)),&s);
+	while(tvirdnext(&s,x,3)){
+		time=tvicstitch(&st,x[0]);
+		if(st.nseg!=nseg){
+			nseg=st.nseg;
+			if(rep!=NULL) fprintf(rep,"Non-monotonic time: segment %ld stitched on at %.1lf; dtmax=%.2lf, dtmin=%.2lf\n",nseg,time,st.dtmax,st.dtmin);
+		}
+		if(!step(&a,time,x[1],x[2],Rs)) continue;
+		if(k<ncyc) cy[k++]=a;
+		accinit(&a,time,a.dQ);
+	}
+	tvirdclose(&s);
+}
+
+void gutinit(struct gut *g, double Rs, int count, FILE *tu, FILE *rep)	// count: the first cycle's number
+{
+	memset(g,0,sizeof(*g));
+	g->Rs=Rs; g->tu=tu; g->rep=rep;
+	g->count=count;
+	g->uLast=0.001;
+}
+
+// the next cycle, c its sums, tstart the boundary before it; show: lines & totals if settled
+void gutcyc(struct gut *g, struct acc *c, double tstart, int show)
+{
+	double time, volts, vmax, vmin, Va, V0, costheta, theta, alpha;
+
+	time=c->lasttime;
+	volts=c->lastv;
+	vmax=c->vmax; vmin=c->vmin;
+	g->timePeriod=tstart;
+	if(g->count==0){g->v0max=vmax; g->v0min=vmin;}
+	if(g->count==1){							// vmax & vmin are not reset at the first boundary
+		if(g->v0max>vmax){vmax=g->v0max;}
+		if(g->v0min<vmin){vmin=g->v0min;}
+	}
+	if(g->count>0){
+		g->u=c->Eout/c->Ein;
+		Va=(vmax-vmin)/2;
+		V0=Va+vmin;
+		costheta=(2*V0*(1-g->u))/(PI*Va);
+		theta=acos(costheta);
+		alpha=theta*2/PI;
+		if(fabs((g->u-g->uLast)/g->uLast)<0.1 && show){	// wait for 'u' to settle down
+			if(g->ucount<1){g->origv=volts; g->origtime=g->timePeriod;}
+			g->ucount++;
+			if(g->rep!=NULL) fprintf(g->rep,"%.3lf \tV=%.3lf \tdQ=%.3lf \tu=%.6lf \tTheta=%.2lf degrees \tAlpha=%.3lf \tT %.1lfh Cycle %d\n",
+				g->timePeriod/3600,volts,c->cumdQ,g->u,theta*180/PI,alpha,(time-g->timePeriod)/3600,g->count);
+			if(g->tu!=NULL) fprintf(g->tu,"%.3lf %lf %lf %lf\n",g->timePeriod/3600,g->u,theta,alpha);
+			g->usum+=g->u;
+			g->uusum+=g->u*g->u;
+			g->asum+=alpha;
+			g->totQ+=c->cumdQ;
+			g->totIn+=c->Ein;
+			g->totOut+=c->Eout;
+			g->wholeMeanQ+=c->allQ;
+			g->wholeMeanQSq+=c->allQSq;
+		}
+	}
+	g->uLast=g->u;
+	g->timePeriod=time;
+	g->count++;
+}
+
+void gutend(struct gut *g)			// mean u, its variance, U & mean alpha of the settled cycles
+{
+	g->umean=g->usum/g->ucount;
+	g->uVar=(g->uusum - g->usum*g->usum/g->ucount)/(g->ucount-1);
+	g->U=g->totOut/g->totIn;
+	g->alpha=g->asum/g->ucount;
+}
+
+#endif
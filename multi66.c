@@ -0,0 +1,629 @@
+// Program to run several cells at once, each on its own 66332A, from one Raspberry Pi
+// via one or more Prologix/Fenrir adapters, several GPIB addresses per adapter
+// JBS & CJD 2026
+
+#define _GNU_SOURCE				// fopencookie for the .tvia writer (tvia.h)
+#include    <stdio.h>
+#include    <stdlib.h>
+#include    <string.h>
+#include    <time.h>
+#include    <math.h>
+#include    <fcntl.h>
+#include    <errno.h>
+#include 	<unistd.h> // write(), read(), close()
+#include 	<termios.h>
+#include 	<sys/epoll.h>
+
+#define MAX(A,B) (((A)>(B))?(A):(B))
+#define MIN(A,B) (((A)<(B))?(A):(B))
+#define TRUE 1
+#define FALSE 0
+#define PI 3.141592654
+
+#define MAXBUS 8			// Prologix adapters
+#define MAXCELL 32			// cells (instruments) over all adapters
+#define NFREQS 32			// tones per multitone cell
+#define ERRCHK 64			// samples between SYST:ERR? checks, as bcp66
+
+FILE *logfile;				// to log errors
+
+#include "prologix.h"
+#include "scpi66.h"
+#include "tviring.h"
+#include "tvia.h"
+#include "opt66.h"
+
+// One process, one thread for all the buses: every adapter has at most one
+// transaction in flight, and an epoll loop sends the next cell's setpoint +
+// measurement on an adapter as soon as its last reply is framed, so the
+// adapters all run flat out side by side instead of one process sleeping on
+// each.  Cells sharing an adapter take turns (round-robin, "++addr" switched
+// only when needed).  Each cell runs the bcp66 CCCV state machine or a
+// bz3p66-style multitone stimulus, and has its own ring, writer thread, .tvi
+// and .log.  Transactions are always the pipelined form of scpi66.h.
+
+#define CCCV 1
+#define TONE 2
+
+#define CHARGE 1
+#define DISCHARGE 2
+#define PRECHARGE 3
+#define POSTSET 4
+#define EQUILIBRATE 5
+char *statenames[]={"???","CHG","DIS","PRE","SET","EQU","TON","END"};
+
+#define TXSAMPLE 0			// set + measure
+#define TXERR 1				// SYST:ERR? until 0
+#define TXOFF 2				// output off, no reply, cell done
+
+struct bus66;
+
+struct cell66 {
+	int kind, n, addr, live, tx;
+	char base[64], line[256];
+	struct bus66 *bus;
+	FILE *tvi, *log;
+	struct ring66 ring;
+	struct rate66 rate;
+	double tdue;					// next sample not before (s from origin)
+	double vset, iset, vnow, inow;
+	long npts, nlines, nbad;
+	// CCCV, as bcp66
+	double Vmax, Vmin, Ich, Idis, Ich_end, Idis_end, Qfinal, Tsmin;
+	int tdwellplus, tdwellminus, restplus, restminus, ncyc, tfinal;
+	int state, CCmode, ccmodeCounter, cycle;
+	double batQ, Qmax, tmark, dwell, Tsincesec, lastt;
+	// multitone, as bz3p66 without pulses
+	double Imax, deltaQ, fmin, fmax, period, tend, Ts, dQ;
+	double f[NFREQS], a[NFREQS], ph[NFREQS];
+	int nf, sink;
+};
+
+struct bus66 {
+	char path[64];
+	int fd, addr, ncell, next;
+	struct cell66 *cell[MAXCELL];
+	struct cell66 *cur;				// transaction in flight, NULL if idle
+	double tsent, deadline, tquiet;
+	struct rx66 *rx;
+};
+
+struct bus66 bus[MAXBUS];
+struct cell66 cell[MAXCELL];
+int nbus=0, ncell=0, binary, archive;
+double t0;							// common time origin, CLOCK_MONOTONIC s
+
+// text to a cell's log (and screen for R66SAY), prefixed with the cell number
+void ctext(struct cell66 *c, int kind, char *s)
+{
+	char buf[R66TXT+8];
+
+	snprintf(buf,sizeof(buf),"[%d] %s",c->n,s);
+	r66text(&c->ring,kind,buf);
+}
+
+struct bus66 *getbus(char *path)	// open each adapter once
+{
+	struct termios spset;
+	struct bus66 *b;
+	int k;
+
+	for(k=0;k<nbus;k++) if(!strcmp(bus[k].path,path)) return &bus[k];
+	if(nbus>=MAXBUS) err("Too many Prologix adapters.");
+	if(strstr(path,"tty")==NULL) err("Bad USB address?");
+	if(strstr(path,"dev")==NULL) err("Bad USB address?");
+	b = &bus[nbus++];
+	strcpy(b->path,path);
+	b->fd = open(path,O_RDWR|O_NOCTTY|O_NONBLOCK);	// open read & write ASCII, without hanging
+	if(b->fd<0) {
+		fprintf(stderr,"Error %i from open %s: %s\n", errno, path, strerror(errno));
+		err("Cannot open the device.");
+	}
+	if (tcgetattr(b->fd, &spset) < 0) err("Cannot get port attributes.");
+	cfmakeraw(&spset);
+	if (tcsetattr(b->fd, TCSANOW, &spset) < 0) err("Cannot set port attributes.");
+	b->rx = malloc(sizeof(struct rx66));
+	if(b->rx==NULL) err("Out of memory for receive buffers.");
+	RX66INIT(b->rx);
+	b->addr = -1;
+	return b;
+}
+
+// one line of the cells file, "cccv USB Addr <bcp66 args>" or "tone USB Addr <multitone args>"
+void parsecell(char *line, int ln)
+{
+	struct cell66 *c;
+	char *av[32], *p, ebuf[128], keep[256];
+	double freq, iqf, Imultiplier, actualImax;
+	int ac=0, na=0, i, qloops;
+
+	strcpy(keep,line);
+	for(p=strtok(line," \t\r\n");p!=NULL && ac<32;p=strtok(NULL," \t\r\n")) av[ac++]=p;
+	if(ac==0 || av[0][0]=='#') return;				// blank or comment
+	if(ncell>=MAXCELL) err("Too many cells.");
+	c = &cell[ncell];
+	c->n = ++ncell;
+	strcpy(c->line,keep);
+	sprintf(ebuf,"Cells file line %d: too few fields.",ln);
+	if(ac<4) err(ebuf);
+	if(!strcmp(av[na],"cccv")) c->kind=CCCV;
+	else if(!strcmp(av[na],"tone")) c->kind=TONE;
+	else{ sprintf(ebuf,"Cells file line %d: kind must be cccv or tone.",ln); err(ebuf); }
+	na++;
+	c->bus = getbus(av[na++]);
+	c->addr = atoi(av[na++]);
+	if(c->addr<1 || c->addr>30) err("Bad GPIB_Address given.");
+	for(i=0;i<ncell-1;i++) if(cell[i].bus==c->bus && cell[i].addr==c->addr) err("Two cells on one GPIB address.");
+	c->bus->cell[c->bus->ncell++] = c;
+
+	if(c->kind==CCCV){
+		if(ac<na+12 || ac>na+13){ sprintf(ebuf,"Cells file line %d: cccv needs 12 or 13 parameters after Addr.",ln); err(ebuf); }
+		c->Vmax = atof(av[na++]);
+		if(c->Vmax<0.9) err("Vmax is too small");
+		if(c->Vmax>20.0) err("Vmax is too large");
+		c->Vmin = atof(av[na++]);
+		if(c->Vmin<0.25) err("Vmin is too small");
+		if(c->Vmin>15.0) err("Vmin is too large");
+		c->Ich = atof(av[na++]);
+		if(c->Ich<0.001) err("Ich too small");
+		if(c->Ich>5.10) err("Ich is too large");
+		c->Idis = atof(av[na++]);
+		if(c->Idis<0.001) err("Idis too small");
+		if(c->Idis>5.10) err("Idis is too large");
+		c->Ich_end = atof(av[na++]);
+		if(c->Ich_end<1e-3) err("Ich_end too small");
+		if(c->Ich_end>=c->Ich) err("Ich_end not less than Ich");
+		c->Idis_end = atof(av[na++]);
+		if(c->Idis_end<1e-3) err("Idis_end too small");
+		if(c->Idis_end>=c->Idis) err("Idis_end not less than Idis");
+		c->tdwellplus = atoi(av[na++]);
+		if(c->tdwellplus<0){c->tdwellplus=-c->tdwellplus;c->restplus=1;}
+		if(c->tdwellplus<5) err("tdwellplus must be at least 5 seconds.");
+		if(c->tdwellplus>605000) err("tdwellplus must be less than 1 week, 604ksec.");
+		c->tdwellminus = atoi(av[na++]);
+		if(c->tdwellminus<0){c->tdwellminus=-c->tdwellminus;c->restminus=1;}
+		if(c->tdwellminus<5) err("tdwellminus must be at least 5 seconds.");
+		if(c->tdwellminus>87000) err("tdwellminus must be less than 1 day, 87ksec.");
+		c->ncyc = atoi(av[na++]);
+		if(c->ncyc<1) err("Bad number of cycles.");
+		if(c->ncyc>1000) err("Count exceeds 1000 cycles.");
+		c->Qfinal = atof(av[na++]);
+		if(c->Qfinal<0.1) err("Qfinal less than 0.1\%.");
+		if(c->Qfinal>99.9) err("Qfinal is more than 99.9\%.");
+		c->tfinal = atoi(av[na++]);
+		if(c->tfinal<1) err("tfinal must be at least 1 second.");
+		if(c->tfinal>605000) err("tfinal must be less than 1 week, 604ksec.");
+		strcpy(c->base,av[na++]);
+		c->Tsmin = 1.0/0.94;
+		if(ac>na){
+			c->Tsmin = atof(av[na++]);
+			if(c->Tsmin>10.0 || c->Tsmin<0.01) err("fsmax must be 10>fsmax>1/100.");
+			c->Tsmin = 1.0/c->Tsmin;
+		}
+		c->state=CHARGE;
+		c->CCmode=TRUE; c->ccmodeCounter=0;
+		c->inow=c->Ich;
+		c->vset=c->Vmax; c->iset=fabs(c->Ich);
+	}else{
+		if(ac<na+7 || ac>na+8){ sprintf(ebuf,"Cells file line %d: tone needs 7 or 8 parameters after Addr.",ln); err(ebuf); }
+		c->Vmin = atof(av[na++]);
+		if(c->Vmin<0.2) err("Vmin is too small");
+		if(c->Vmin>12.0) err("Vmin is too large");
+		c->Vmax = atof(av[na++]);
+		if(c->Vmax<=c->Vmin) err("Vmin exceeds/equals Vmax");
+		if(c->Vmax>20.0) err("Vmax is too large");
+		c->Imax = atof(av[na++]);
+		if(c->Imax<0){c->Imax=-c->Imax; c->sink=TRUE;}
+		if(c->Imax<5e-3) err("Imax too small");
+		if(c->Imax>5.10) err("Imax is too large");
+		c->deltaQ = atof(av[na++]);
+		if(c->deltaQ<0.001) err("deltaQ is less than 1mAh");
+		if(c->deltaQ>30) err("deltaQ is more than 30Ah");
+		c->deltaQ *= 3600.0;								// Amp-seconds
+		c->ncyc = atoi(av[na++]);
+		if(c->ncyc<1) err("Too few cycles requested.");
+		c->fmin = atof(av[na++]);
+		if(c->fmin<0.1e-6) err("fmin is too small");
+		if(c->fmin>0.5) err("fmin is too large");
+		c->fmax = atof(av[na++]);
+		if(c->fmax>2.5) err("fmax is too large for polled sampling (bz3p66 uses the digitizer)");
+		if(c->fmin>=c->fmax) err("Fmin>=Fmax");
+		strcpy(c->base,av[na++]);
+		if(ac>na) c->Ts = atof(av[na++]);					// else as fast as the bus goes
+
+		for(i=0;i<NFREQS;i++){								// 1-2-5 sequence/decade, as bz3p66
+			freq = (i%3==0)? 1.0e-7 : ((i%3==1)? 2.0e-7 : 5.0e-7);
+			freq *= pow(10.0,(i/3));
+			if(freq>=c->fmin && freq<=c->fmax) c->f[c->nf++]=freq;
+		}
+		if(c->nf<1) err("No 1-2-5 frequencies between fmin and fmax.");
+		actualImax=0.00; Imultiplier=1.00; qloops=0;
+		while(++qloops<3000 && actualImax<c->Imax){		// push up I, as bz3p66
+			for(actualImax=0.00,i=0;i<c->nf;i++){
+				iqf=(c->deltaQ/c->nf)*c->f[i]*PI;
+				c->a[i]=MIN(c->Imax*Imultiplier/c->nf,iqf);
+				actualImax+=c->a[i];
+				c->ph[i] = -PI*i*i/c->nf;					// Schroeder phase
+			}
+			Imultiplier *= 1.004;
+		}
+		c->period = 1.0/c->f[0];
+		c->tend = c->ncyc*c->period;
+		c->state = 6;
+	}
+}
+
+// ---------------- per-cell sample handling, after each reply ----------------
+void cccvstep(struct cell66 *c, double t)
+{
+	char wbuf[128];
+	double deltat;
+
+	deltat = (c->npts>1)? t-c->lastt : 0.00;
+	c->lastt = t;
+	c->Tsincesec += deltat;
+	switch(c->state){									// chg/dischg/etc state machine, as bcp66
+		default:
+		case CHARGE:
+			if(c->restplus && !c->CCmode){ c->iset=0.00; }else{ c->iset=fabs(c->Ich); }
+			c->vset=c->Vmax;
+			c->dwell=t-c->tmark;
+			if(c->CCmode){c->tmark=t;}
+			else if(c->dwell>c->tdwellplus || (!c->restplus && c->inow<c->Ich_end)){	// charge done
+				if(c->cycle!=0){
+					sprintf(wbuf,"# Cycle=%d, dQ=%.1lfC, %sAh",c->cycle,c->batQ,sengstr(c->batQ/3600.0,3));
+					ctext(c,R66LOG,wbuf);
+				}
+				ctext(c,R66LOG,"Completed a cycle.");
+				sprintf(wbuf,"Charge transferred %sC, %sAh",sengstr(c->batQ,3),sengstr(c->batQ/3600.0,3));
+				ctext(c,R66LOG,wbuf);
+				c->cycle++;
+				c->batQ=0.00;
+				c->dwell=0;
+				if(c->cycle>c->ncyc){
+					c->state=POSTSET;
+					c->tmark=t;
+					ctext(c,R66SAY,"Moving to charge setting phase...");
+				}else{
+					c->state=DISCHARGE;
+					ctext(c,R66SAY,"Moving to DISCHARGE...");
+				}
+				c->CCmode=TRUE;c->ccmodeCounter=0;
+			}
+		break;
+		case DISCHARGE:
+			if(c->restminus && !c->CCmode){ c->iset=0.00; }else{ c->iset=fabs(c->Idis); }
+			c->vset=c->Vmin;
+			c->dwell=t-c->tmark;
+			if(c->CCmode){c->tmark=t;}
+			else if(c->dwell>c->tdwellminus || (!c->restminus && fabs(c->inow)<c->Idis_end)){	// discharge done
+				sprintf(wbuf,"Charge transferred %sC, %sAh",sengstr(c->batQ,3),sengstr(c->batQ/3600,3));
+				ctext(c,R66LOG,wbuf);
+				c->Qmax=MAX(c->Qmax,fabs(c->batQ));
+				c->batQ=0.00;
+				c->state=CHARGE;
+				c->dwell=0;
+				c->tmark=t;
+				ctext(c,R66SAY,"Moving to CHARGE...");
+				c->CCmode=TRUE;c->ccmodeCounter=0;
+			}
+		break;
+		case POSTSET:
+			c->iset=fabs(c->Idis);
+			c->vset=c->Vmin;
+			if(c->Qmax<0.001){
+				ctext(c,R66SAY,"Qmax too small... aborting SET phase");
+				c->tx=TXOFF;
+			}else if(fabs(c->batQ)/c->Qmax>(1-c->Qfinal/100.0)){
+				c->tmark=t;
+				c->state=EQUILIBRATE;
+				ctext(c,R66SAY,"Moving to final settling phase...");
+			}
+		break;
+		case EQUILIBRATE:
+			c->dwell=t-c->tmark;
+			c->vset=(c->Vmax+c->Vmin)/2.0; c->iset=0.00;
+			if(c->dwell>c->tfinal) c->tx=TXOFF;
+		break;
+	}
+
+	if(relerr(c->iset,fabs(c->inow))<0.05){			// CC or CV, as bcp66
+		if(++c->ccmodeCounter>5) c->ccmodeCounter=5;
+	}else{
+		if(--c->ccmodeCounter<-5) c->ccmodeCounter=-5;
+	}
+	if(c->ccmodeCounter>=4) c->CCmode=TRUE;
+	if(c->ccmodeCounter<=-4) c->CCmode=FALSE;
+
+	c->batQ += c->inow*deltat;
+	if(c->npts>1 && c->Tsincesec>c->Tsmin){
+		c->Tsincesec=0.0;
+		c->nlines++;
+		r66tvi5(&c->ring,t,c->vnow,c->inow,c->batQ/3600.0,c->cycle);
+	}
+}
+
+double tonestim(struct cell66 *c, double t)		// multitone current at t
+{
+	double I=0.00;
+	int i;
+
+	for(i=0;i<c->nf;i++) I += c->a[i]*sin(2.0*PI*c->f[i]*t+c->ph[i]);
+	if(c->sink) I -= c->Imax;
+	return I;
+}
+
+void tonestep(struct cell66 *c, double t)
+{
+	c->dQ += c->inow*(t-c->lastt);
+	c->lastt = t;
+	r66tvi(&c->ring,R66TVI,4,t,c->vnow,c->inow);
+	c->nlines++;
+	if(t>c->tend) c->tx=TXOFF;
+	if(c->Ts>0.00) c->tdue = c->Ts*(floor(t/c->Ts)+1.0);		// next grid slot
+}
+
+// ---------------- event loop pieces ----------------
+void send(struct bus66 *b, struct cell66 *c, double now)
+{
+	char wbuf[256], *p=wbuf;
+	double Istim;
+
+	if(b->addr!=c->addr){ p += sprintf(p,"++addr %d\n",c->addr); b->addr=c->addr; }
+	switch(c->tx){
+		case TXOFF:										// last word to this instrument
+			sprintf(p,"OUTP OFF\n");
+			wrtstr(b->fd,wbuf);
+			c->live=FALSE;
+			return;
+		case TXERR:
+			sprintf(p,"SYST:ERR?\n++read eoi\n");
+		break;
+		default:
+			if(c->kind==TONE){						// setpoint for the moment it goes out
+				Istim = tonestim(c,now-t0);
+				c->vset = (Istim<0.00)?(0.99*c->Vmin):(1.01*c->Vmax);
+				c->iset = fabs(Istim);
+			}
+			sprintf(p,"VOLT %.6lf;CURR %.6lf;:MEAS:CURR?;:FETC:VOLT?\n++read eoi\n",c->vset,c->iset);
+		break;
+	}
+	rx66drain(b->rx,b->fd);							// nothing stale may frame as our reply
+	wrtstr(b->fd,wbuf);
+	b->rx->nq++;
+	b->cur = c;
+	b->tsent = now;
+	b->deadline = now+rx66tmo(b->rx);
+}
+
+void reply(struct bus66 *b, char *line, double now)
+{
+	struct cell66 *c=b->cur;
+	char buf[128];
+	double x[2], t;
+	int e=0;
+
+	b->cur = NULL;
+	rx66rtt(b->rx,now-b->tsent);
+	if(c->tx==TXERR){
+		sscanf(line,"%d",&e);
+		if(e){ ctext(c,R66SAY,line); }else{ c->tx=TXSAMPLE; }
+		return;
+	}
+	if(fastnums(line,x,2)!=2 || x[0]>100.0 || x[0]<-100.0){ c->nbad++; return; }	// crazy result, go again
+	c->inow=x[0]; c->vnow=x[1];
+	t = b->tsent-t0;								// when the setpoint & measurement went out
+	c->npts++;
+	rate66tick(&c->rate);
+	if(c->kind==CCCV) cccvstep(c,t); else tonestep(c,t);
+	if(c->npts%ERRCHK==0 && c->tx==TXSAMPLE) c->tx=TXERR;
+	if(c->tx==TXOFF){
+		sprintf(buf,"Finished at %.1lfs.",t);
+		ctext(c,R66SAY,buf);
+	}
+}
+
+// next cell due on the bus, round-robin; NULL if none, *due then the earliest time one is
+struct cell66 *nextcell(struct bus66 *b, double now, double *due)
+{
+	struct cell66 *c;
+	int k;
+
+	*due = 1e30;
+	for(k=0;k<b->ncell;k++){
+		c = b->cell[(b->next+k)%b->ncell];
+		if(!c->live) continue;
+		if(c->tx!=TXSAMPLE || c->tdue<=now-t0){
+			b->next = (b->next+k+1)%b->ncell;
+			return c;
+		}
+		*due = MIN(*due,t0+c->tdue);
+	}
+	return NULL;
+}
+
+int main(int argc, char* argv[])
+{
+	FILE *cfg;
+	char rbuf[256], wbuf[384], logfname[128], *line, *p;
+	time_t tstart, tnow;
+	struct epoll_event ev, evs[MAXBUS];
+	struct cell66 *c;
+	struct bus66 *b;
+	int i, k, ep, ln, nlive, nev;
+	double now, wait, due, tshow=0.00, Imax;
+	long ntot;
+
+	// version 1.00: epoll loop over several adapters & addresses, bcp66 CCCV and multitone cells
+	// version 1.01: instruments brought up by up66(), *OPC? waits, *RST skipped when already set up
+	// version 1.02: -a option writes compressed .tvia archives (tvia.h)
+    float version = 1.02;
+
+	opt66(&argc,argv);							// -x options out of the positional args
+	binary = opt66on('b');
+	archive = opt66on('a');						// records handed over as for -b
+	if(archive) binary=1;
+
+    if (argc!=1+1) {
+        fprintf(stderr,"multi66 V%.2f jbs&cjd 2026\n", version);
+        fprintf(stderr,"Several cells at once on 66332As via Prologix gpib, from one process.\n");
+        fprintf(stderr,"Usage: multi66 cellsFile\n");
+        fprintf(stderr,"where each line of cellsFile (# comments) is one cell, either\n");
+        fprintf(stderr,"  cccv USB Addr Vmax Vmin Ich Idis I+end I-end tdwell+ tdwell- ncyc Qfinal tfinal baseName [fsmax]\n");
+        fprintf(stderr,"     cycled by the CCCV method exactly as bcp66 (see bcp66 for the parameters), or\n");
+        fprintf(stderr,"  tone USB Addr Vmin Vmax Imax deltaQ ncyc fmin fmax baseName [Ts]\n");
+        fprintf(stderr,"     driven by a Schroeder-phased 1-2-5 multitone as bz3p66 (no pulses, fmax<=2.5Hz),\n");
+        fprintf(stderr,"     for ncyc periods of fmin, sampled every Ts s (default: as fast as the bus goes).\n");
+        fprintf(stderr,"USB is the adapter (/dev/ttyUSB0, etc), Addr the GPIB address; any number of\n");
+        fprintf(stderr,"cells may share an adapter, up to %d cells on %d adapters.\n",MAXCELL,MAXBUS);
+        fprintf(stderr,"Each adapter keeps one transaction in flight, so all buses run concurrently.\n");
+        fprintf(stderr,"Creates baseName.tvi & baseName.log per cell, and cellsFile.log for the run.\n");
+        fprintf(stderr,"Option -b writes binary .tvib (tvib.h, tvibconv converts) instead of .tvi.\n");
+        fprintf(stderr,"Option -a writes compressed .tvia archives (tvia.h) instead, read as they are by tvibconv & the analysis tools.\n");
+        fprintf(stderr,"\n");
+        exit(1);
+    }
+
+	strcpy(logfname,argv[1]);
+	if((p=strrchr(logfname,'.'))!=NULL && strchr(p,'/')==NULL) *p='\0';
+	strcat(logfname,".log");
+	logfile = fopen(logfname,"w+");					// run log
+	if(logfile==NULL) err("Cannot open log file.");
+	time(&tstart);
+	sprintf(wbuf,"%s v%.2f started, logfile opened, at %s",argv[0],version,ctime(&tstart));
+	wbuf[strlen(wbuf)-1]='\0';
+	progress(wbuf);
+	for(wbuf[0]='\0',i=0;i<opt66argc;i++){strcat(wbuf,opt66argv[i]);strcat(wbuf," ");}
+	progress(wbuf);
+
+	cfg = fopen(argv[1],"r");
+	if(cfg==NULL) err("Cannot open cells file.");
+	for(ln=1;fgets(rbuf,sizeof(rbuf),cfg)!=NULL;ln++) parsecell(rbuf,ln);
+	fclose(cfg);
+	if(ncell<1) err("No cells in cells file.");
+	sprintf(wbuf,"%d cells on %d adapters.",ncell,nbus);
+	progress(wbuf);msg(wbuf);
+
+	for(k=0;k<ncell;k++){							// per-cell files & writer
+		c = &cell[k];
+		sprintf(logfname,"%s.log",c->base);
+		c->log = fopen(logfname,"w+");
+		if(c->log==NULL) err("Cannot open cell log file.");
+		fprintf(c->log,"multi66 v%.2f cell %d, started at %s%s",version,c->n,ctime(&tstart),c->line);
+		sprintf(logfname,"%s%s",c->base,archive?".tvia":binary?".tvib":".tvi");
+		if(binary){
+			sprintf(wbuf,"multi66 v%.2f",version);
+			if(archive) c->tvi = (c->kind==CCCV)? tviacreate(logfname,5,"t V I Ah cyc",NULL,wbuf,opt66argc,opt66argv,tstart)
+				: tviacreate(logfname,3,"t V I",NULL,wbuf,opt66argc,opt66argv,tstart);
+			else c->tvi = (c->kind==CCCV)? tvibcreate(logfname,5,"t V I Ah cyc",wbuf,opt66argc,opt66argv,tstart)
+				: tvibcreate(logfname,3,"t V I",wbuf,opt66argc,opt66argv,tstart);
+		}else c->tvi = fopen(logfname,"w+");
+		if(c->tvi==NULL) err("Cannot open tvi file");
+		if(c->kind==TONE){
+			for(i=0;i<c->nf;i++) fprintf(c->log,"f[%d]=%s a=%s, ph=%.2lf\n",i,sengstr(c->f[i],3),sengstr(c->a[i],3),180*c->ph[i]/PI);
+			sprintf(logfname,"%s.frq",c->base);
+			if((cfg=fopen(logfname,"w"))!=NULL){
+				for(i=0;i<c->nf;i++) fprintf(cfg,"%s\n",engstr(c->f[i],6));
+				fclose(cfg);
+			}
+		}
+		r66startlog(&c->ring,c->tvi,NULL,c->log,binary,NULL);
+	}
+
+	// bring up each instrument: clear, ID, reset only if not already set up (scpi66.h)
+	msg("Setting up prologix interfaces, bringing up instruments... ");
+	for(k=0;k<nbus;k++) initPrologix(bus[k].fd);
+	for(k=0;k<ncell;k++){
+		c = &cell[k];
+		Imax = (c->kind==CCCV)? MAX(c->Ich,c->Idis) : c->Imax;
+		ctext(c,R66LOG,up66(c->bus->fd,c->bus->path,c->addr,(Imax>0.02)? "SENSe:CURRent:RANGe MAX\n" : "SENSe:CURRent:RANGe MIN\n"));
+		c->bus->addr = c->addr;
+		wrtstr(c->bus->fd,"OUTP ON;\n");
+		c->live = TRUE;
+	}
+	rx66stats(wbuf);
+	progress(wbuf);
+
+	ep = epoll_create1(0);
+	if(ep<0) err("Cannot create epoll instance.");
+	for(k=0;k<nbus;k++){
+		ev.events = EPOLLIN;
+		ev.data.ptr = &bus[k];
+		if(epoll_ctl(ep,EPOLL_CTL_ADD,bus[k].fd,&ev)) err("Cannot watch adapter.");
+		bus[k].cur = NULL;
+	}
+
+	msg("Commencing main event loop... ");
+	progress("Commencing main event loop... ");
+	t0 = rx66now();
+	for(k=0;k<ncell;k++) rate66init(&cell[k].rate);
+	nlive = ncell;
+	while(nlive>0){
+		now = rx66now();
+		wait = 1.0;
+		for(k=0;k<nbus;k++){						// keep every adapter busy
+			b = &bus[k];
+			if(b->cur!=NULL){
+				if(now<b->deadline){ wait=MIN(wait,b->deadline-now); continue; }
+				rx66backoff(b->rx,b->deadline-b->tsent);	// lost reply, cell asks again
+				b->cur = NULL;
+				b->tquiet = now+rx66tmo(b->rx);		// let a late reply land before the next
+			}
+			if(now<b->tquiet){ wait=MIN(wait,b->tquiet-now); continue; }
+			c = nextcell(b,now,&due);
+			if(c!=NULL){
+				send(b,c,now);
+				if(b->cur!=NULL) wait=MIN(wait,b->deadline-now);
+				else wait=0.00;						// output-off needs no reply, go again
+			}else if(due<1e30) wait=MIN(wait,due-now);
+		}
+		nev = epoll_wait(ep,evs,MAXBUS,(int)ceil(1000.0*MAX(wait,0.00)));
+		if(nev<0 && errno!=EINTR) err("epoll_wait failed.");
+		now = rx66now();
+		for(i=0;i<nev;i++){
+			b = evs[i].data.ptr;
+			if(rx66fill(b->rx,b->fd)<=0) continue;
+			while((line=rx66frame(b->rx,&k))!=NULL){
+				if(b->cur==NULL){ b->rx->nlate+=k+1; continue; }	// nobody asked
+				reply(b,line,now);
+			}
+		}
+		for(nlive=0,k=0;k<ncell;k++) nlive += cell[k].live;
+
+		if(now-tshow>=5*R66SHOW){					// one status line for all cells
+			tshow=now;
+			for(p=wbuf,k=0;k<ncell && p-wbuf<R66TXT-32;k++){
+				c = &cell[k];
+				p += sprintf(p,"%d:%s %.3lf %+.3lf %.0lf/s  ",c->n,c->live?statenames[c->state]:"END",c->vnow,c->inow,c->rate.now);
+			}
+			msg(wbuf);
+		}
+	}
+	close(ep);
+
+	for(ntot=0,k=0;k<ncell;k++){					// per-cell summaries, drain writers
+		c = &cell[k];
+		sprintf(wbuf,"Achieved %.2lf samples/s over %ld samples, %ld bad replies.",c->rate.run,c->rate.n,c->nbad);
+		ctext(c,R66LOG,wbuf);
+		ntot += c->rate.n;
+		sprintf(wbuf,"Cell %d (%s %s %d): %ld samples, %.2lf/s.",c->n,c->kind==CCCV?"cccv":"tone",c->bus->path,c->addr,c->rate.n,c->rate.run);
+		progress(wbuf);
+		r66stop(&c->ring);
+		fclose(c->tvi);
+		fclose(c->log);
+	}
+	for(k=0;k<nbus;k++){
+		rx66statr(bus[k].rx,rbuf);
+		snprintf(wbuf,sizeof(wbuf),"%.63s %.255s",bus[k].path,rbuf);	// path[64] & rbuf[256] fit in wbuf
+		progress(wbuf);
+		close(bus[k].fd);
+	}
+	time(&tnow);
+	sprintf(wbuf,"Achieved %.2lf samples/s over all cells.",ntot/MAX(rx66now()-t0,1e-3));
+	progress(wbuf);
+	sprintf(wbuf,"multi66 done (took %ld secs, %.1f hours).\n",tnow-tstart,(tnow-tstart)/3600.00);
+	msg(wbuf);
+	progress(wbuf);
+	fclose(logfile);
+	return 0;
+}
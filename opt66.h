@@ -0,0 +1,49 @@
+// opt66.h: "-x" / "-xvalue" options mixed in with the positional arguments
+// JBS & CJD 2026
+//
+// opt66(&argc,argv) takes every "-<letter>[value]" argument out of argv, so
+// the positional parsing that follows is unchanged.  A '-' followed by a digit
+// or '.' is a negative number, not an option.  opt66on('b') says whether -b was
+// given, opt66val('s') returns the text after -s (or NULL).  The untouched
+// command line stays in opt66argc/opt66argv for logging.
+
+#ifndef OPT66_H
+#define OPT66_H
+
+#include	<stdlib.h>
+#include	<string.h>
+#include	<ctype.h>
+
+char *opt66v[128];				// value of each option letter given, "" if none
+int opt66argc;
+char **opt66argv;
+
+void opt66(int *argc, char **argv)
+{
+	int k, n;
+
+	opt66argc = *argc;
+	opt66argv = malloc((*argc+1)*sizeof(char *));
+	if(opt66argv!=NULL) memcpy(opt66argv,argv,(*argc+1)*sizeof(char *));
+	for(n=k=1;k<*argc;k++){
+		if(argv[k][0]=='-' && isalpha((unsigned char)argv[k][1])){
+			opt66v[(int)argv[k][1]] = argv[k]+2;
+		}else{
+			argv[n++]=argv[k];
+		}
+	}
+	argv[n]=NULL;
+	*argc=n;
+}
+
+int opt66on(int c)
+{
+	return opt66v[c&127]!=NULL;
+}
+
+char *opt66val(int c)
+{
+	return (opt66v[c&127]==NULL || opt66v[c&127][0]=='\0')? NULL : opt66v[c&127];
+}
+
+#endif
@@ -0,0 +1,28 @@
+function [data, hdr] = readtvib(fname)
+%READTVIB load a binary .tvib file (see tvib.h) as an N x ncol matrix,
+%same columns as the text .tvi: t V I [Ah cyc]. hdr has the run details.
+fid = fopen(fname, 'r', 'ieee-le');
+if fid < 0
+    error('Cannot open %s', fname);
+end
+magic = fread(fid, 4, '*char')';
+bom = fread(fid, 1, 'uint32');
+if ~strcmp(magic, 'TVIB') || bom ~= hex2dec('01020304')
+    fclose(fid);
+    error('%s is not a little-endian .tvib file', fname);
+end
+hdr.version = fread(fid, 1, 'uint16');
+hdrsize = fread(fid, 1, 'uint16');
+hdr.ncol = fread(fid, 1, 'uint16');
+fread(fid, 1, 'uint16'); %record size
+hdr.tstart = fread(fid, 1, 'int64');
+hdr.cols = deblank(fread(fid, 64, '*char')');
+hdr.prog = deblank(fread(fid, 64, '*char')');
+hdr.args = deblank(fread(fid, hdrsize-152, '*char')');
+hdr.cols = hdr.cols(hdr.cols ~= 0);
+hdr.prog = hdr.prog(hdr.prog ~= 0);
+hdr.args = hdr.args(hdr.args ~= 0);
+fseek(fid, hdrsize, 'bof');
+data = fread(fid, [hdr.ncol, Inf], 'double')';
+fclose(fid);
+end
@@ -0,0 +1,185 @@
+// rx66.h: event-driven receive path for replies through the Prologix adapter
+// include after prologix.h (uses wrtstr()); replaces tickle()+getmsg() on the hot path
+// JBS & CJD 2026
+//
+// Replies are read with poll() into one persistent buffer and framed on the
+// newline the 66332A sends with EOI, so a query returns as soon as its line is
+// complete and neither spins nor oversleeps.  The line is handed back in place
+// (no copy) for fastnum.h to parse.  Each query's deadline comes from the
+// measured round-trip time, srtt+4*rttvar (Jacobson/Karels), with at least
+// RX66SLACK*srtt of slack when the bus is very steady, clamped to
+// [RX66TMIN,RX66TMAX].  A timeout backs the estimate off, and whatever arrives
+// late is thrown away before the next query so replies can't get out of step.
+// The blocking calls use the one adapter in rx66s; an event loop driving several
+// adapters keeps a struct rx66 per adapter and uses rx66fill()/rx66frame().
+// Time spent writing to the adapter and waiting for replies is summed in twr
+// and trd for the loops' -t timing (tvitime.h), which takes and clears them.
+
+#ifndef RX66_H
+#define RX66_H
+
+#include	<stdio.h>
+#include	<string.h>
+#include	<time.h>
+#include	<poll.h>
+#include	<unistd.h>
+#include	<errno.h>
+#include	"fastnum.h"
+
+#define RX66BUF 262144			// receive buffer, holds a full digitizer reply
+#define RX66TMIN 0.020			// s, shortest deadline
+#define RX66TMAX 5.000			// s, longest deadline for an ordinary reply
+#define RX66SLACK 0.5			// least slack over srtt, as a fraction of it
+
+struct rx66 {
+	char buf[RX66BUF+1];
+	int lo, hi;					// unread bytes are buf[lo..hi)
+	double srtt, rttvar;		// round-trip estimate (s)
+	long nq, ntmo, nlate;		// queries, timeouts, stale bytes dropped
+	double twr, trd;			// s writing, s waiting for replies, since cleared
+} rx66s = {.srtt=0.25, .rttvar=0.25};
+
+#define RX66INIT(r) ((r)->srtt=(r)->rttvar=0.25, (r)->lo=(r)->hi=0, (r)->nq=(r)->ntmo=(r)->nlate=0)
+
+double rx66now(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC,&t);
+	return t.tv_sec+t.tv_nsec/1e9;
+}
+
+double rx66tmo(struct rx66 *r)	// deadline for the next ordinary query
+{
+	double t = r->srtt+MAX(4.0*r->rttvar,RX66SLACK*r->srtt);
+
+	return (t<RX66TMIN)? RX66TMIN : (t>RX66TMAX? RX66TMAX : t);
+}
+
+void rx66rtt(struct rx66 *r, double x)	// fold in one round-trip sample
+{
+	double d = x-r->srtt;
+
+	r->srtt += d/8.0;
+	r->rttvar += ((d<0?-d:d)-r->rttvar)/4.0;
+}
+
+void rx66backoff(struct rx66 *r, double tmo)	// a reply never came
+{
+	r->ntmo++;
+	r->rttvar = 2.0*r->rttvar+tmo;
+}
+
+void rx66drain(struct rx66 *r, int hp)	// discard anything left over from an earlier reply
+{
+	int k;
+
+	r->nlate += r->hi-r->lo;
+	r->lo = r->hi = 0;
+	while((k=read(hp,r->buf,RX66BUF))>0) r->nlate += k;
+}
+
+// next complete line already in the buffer, newline replaced by '\0'; NULL if none yet
+char *rx66frame(struct rx66 *r, int *len)
+{
+	char *nl, *line;
+
+	nl = memchr(r->buf+r->lo,'\n',r->hi-r->lo);
+	if(nl!=NULL){									// framed
+		line = r->buf+r->lo;
+		*nl='\0';
+		if(nl>line && nl[-1]=='\r') nl[-1]='\0';
+		if(len!=NULL) *len = nl-line;
+		r->lo = nl+1-r->buf;
+		if(r->lo==r->hi) r->lo=r->hi=0;
+		return line;
+	}
+	if(r->lo>0){									// slide partial line down
+		memmove(r->buf,r->buf+r->lo,r->hi-r->lo);
+		r->hi -= r->lo; r->lo=0;
+	}
+	if(r->hi>=RX66BUF){r->nlate+=r->hi; r->hi=0;}	// runaway line, drop it
+	return NULL;
+}
+
+int rx66fill(struct rx66 *r, int hp)	// read whatever has arrived, returns bytes added
+{
+	int k = read(hp,r->buf+r->hi,RX66BUF-r->hi);
+
+	if(k>0) r->hi+=k;
+	return k;
+}
+
+// next complete line by tmax (absolute, rx66now() time), newline replaced by '\0'; NULL if none
+char *rx66line(int hp, double tmax, int *len)
+{
+	struct pollfd pfd;
+	char *line;
+	int k, wait;
+
+	pfd.fd=hp; pfd.events=POLLIN;
+	while((line=rx66frame(&rx66s,len))==NULL){
+		wait = (int)(1000.0*(tmax-rx66now())+0.5);
+		if(wait<0) return NULL;
+		k = poll(&pfd,1,wait);
+		if(k<0 && errno!=EINTR) return NULL;
+		if(k>0) rx66fill(&rx66s,hp);					// else re-check the deadline
+	}
+	return line;
+}
+
+void rx66write(int hp, char *s)	// wrtstr(), timed into rx66s.twr
+{
+	double t0 = rx66now();
+
+	wrtstr(hp,s);
+	rx66s.twr += rx66now()-t0;
+}
+
+// send cmd (may be NULL), have the adapter read the reply, return it in place ("" on timeout);
+// extra adds time for long replies, which are then not used for the RTT estimate
+char *rx66query(int hp, char *cmd, double extra)
+{
+	double t0, t1, t2, tmo;
+	char *line;
+
+	rx66drain(&rx66s,hp);
+	t0 = rx66now();
+	if(cmd!=NULL) wrtstr(hp,cmd);
+	wrtstr(hp,"++read eoi\n");						// make prologix listen to the instrument
+	t1 = rx66now();
+	rx66s.twr += t1-t0;
+	rx66s.nq++;
+	tmo = rx66tmo(&rx66s);
+	line = rx66line(hp,t0+tmo+extra,NULL);
+	t2 = rx66now();
+	rx66s.trd += t2-t1;
+	if(line==NULL){									// back off, try to stay in step
+		rx66backoff(&rx66s,tmo);
+		return "";
+	}
+	if(extra==0.0) rx66rtt(&rx66s,t2-t0);
+	return line;
+}
+
+int rx66getmsg(int hp, char *buf)		// getmsg() replacement, copies up to 255 chars into buf
+{
+	char *line=rx66query(hp,NULL,0.0);
+
+	strncpy(buf,line,255);
+	buf[255]='\0';
+	return strlen(buf);
+}
+
+void rx66statr(struct rx66 *r, char *buf)	// summary for the log
+{
+	sprintf(buf,"Bus: %ld queries, rtt %.1lf+/-%.1lfms, %ld timeouts, %ld stale bytes dropped.",
+		r->nq,1000.0*r->srtt,1000.0*r->rttvar,r->ntmo,r->nlate);
+}
+
+void rx66stats(char *buf)
+{
+	rx66statr(&rx66s,buf);
+}
+
+#endif
@@ -0,0 +1,121 @@
+// sclk66.h: fixed-grid sample clock for the set/measure loops, optional real-time mode
+// include after prologix.h (uses progress())
+// JBS & CJD 2026
+//
+// Sample k is due at t0+k*Ts on CLOCK_MONOTONIC (immune to NTP steps) and the
+// loop sleeps to it with clock_nanosleep(TIMER_ABSTIME), so the .tvi time base
+// is a regular grid instead of whatever the loop happened to spin at.  How late
+// each wake-up is goes into a log-spaced histogram; a loop that overruns whole
+// periods skips every slot already gone (counted) and waits for the next one
+// still ahead, so a sample is never stamped with a time in its past.  sclk66rt() puts
+// the calling thread under SCHED_FIFO, locks memory and pins it to a CPU
+// (define _GNU_SOURCE before the first #include for the affinity calls).
+
+#ifndef SCLK66_H
+#define SCLK66_H
+
+#include	<stdio.h>
+#include	<string.h>
+#include	<math.h>
+#include	<time.h>
+#include	<errno.h>
+#include	<sched.h>
+#include	<pthread.h>
+#include	<sys/mman.h>
+
+#define SCLK66BINS 80			// lateness bins, 10 per decade from 1us
+#define SCLK66PRIO 80			// SCHED_FIFO priority in real-time mode
+
+struct sclk66 {
+	struct timespec t0;			// grid origin
+	double Ts;					// grid period (s)
+	long k;						// next slot
+	long n, nskip;				// samples, slots skipped
+	double maxlate;
+	long hist[SCLK66BINS];		// lateness, bin b covers 10^(b/10) us
+};
+
+void sclk66init(struct sclk66 *c, double Ts)
+{
+	memset(c,0,sizeof(*c));
+	c->Ts = Ts;
+	clock_gettime(CLOCK_MONOTONIC,&c->t0);
+}
+
+double sclk66now(struct sclk66 *c)		// s since the grid origin
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC,&t);
+	return (t.tv_sec-c->t0.tv_sec)+(t.tv_nsec-c->t0.tv_nsec)/1e9;
+}
+
+// sleep until the next grid slot, return its time (s since origin)
+double sclk66wait(struct sclk66 *c)
+{
+	struct timespec due;
+	double t, late, ns;
+	long behind;
+	int b;
+
+	t = sclk66now(c);
+	behind = (long)floor(t/c->Ts)+1-c->k;		// slot k is due or late; more means slots gone by
+	if(behind>1 && c->k>0){ c->nskip += behind; c->k += behind; }	// all of them, to the next one ahead
+	t = c->k*c->Ts;
+	ns = c->t0.tv_nsec+1e9*(t-floor(t));
+	due.tv_sec = c->t0.tv_sec+(time_t)floor(t)+(time_t)(ns/1e9);
+	due.tv_nsec = (long)fmod(ns,1e9);
+	while(clock_nanosleep(CLOCK_MONOTONIC,TIMER_ABSTIME,&due,NULL)==EINTR);
+	late = sclk66now(c)-t;
+	if(late>c->maxlate) c->maxlate=late;
+	b = (late>1e-6)? (int)(10.0*log10(late*1e6))+1 : 0;
+	c->hist[(b<SCLK66BINS)? b : SCLK66BINS-1]++;
+	c->n++;
+	c->k++;
+	return t;
+}
+
+double sclk66pct(struct sclk66 *c, double p)	// lateness (s) not exceeded by p% of samples
+{
+	long want=(long)ceil(p/100.0*c->n), sum=0;
+	int b;
+
+	for(b=0;b<SCLK66BINS;b++){
+		sum += c->hist[b];
+		if(sum>=want) return MIN(1e-6*pow(10.0,b/10.0),c->maxlate);	// upper edge of the bin
+	}
+	return c->maxlate;
+}
+
+void sclk66report(struct sclk66 *c, char *buf)
+{
+	sprintf(buf,"Sample clock %.3lfms: %ld samples, %ld slots skipped, lateness p50<%.3lfms p90<%.3lfms p99<%.3lfms p99.9<%.3lfms max %.3lfms",
+		1000.0*c->Ts,c->n,c->nskip,1000.0*sclk66pct(c,50),1000.0*sclk66pct(c,90),
+		1000.0*sclk66pct(c,99),1000.0*sclk66pct(c,99.9),1000.0*c->maxlate);
+}
+
+// real-time mode for the calling thread: SCHED_FIFO, memory locked, pinned to cpu (<0: last cpu)
+void sclk66rt(int cpu)
+{
+	struct sched_param sp;
+	cpu_set_t set;
+	char buf[128];
+	long ncpu=sysconf(_SC_NPROCESSORS_ONLN);
+
+	if(mlockall(MCL_CURRENT|MCL_FUTURE)) progress("Real-time: mlockall failed (need root/CAP_IPC_LOCK?).");
+	if(cpu<0 || cpu>=ncpu) cpu = ncpu-1;
+	CPU_ZERO(&set); CPU_SET(cpu,&set);
+	if(pthread_setaffinity_np(pthread_self(),sizeof(set),&set)) progress("Real-time: cannot pin to cpu.");
+	sp.sched_priority = SCLK66PRIO;
+	if(pthread_setschedparam(pthread_self(),SCHED_FIFO,&sp)) progress("Real-time: SCHED_FIFO refused (need root/CAP_SYS_NICE?).");
+	sprintf(buf,"Real-time mode: SCHED_FIFO %d, memory locked, cpu %d.",SCLK66PRIO,cpu);
+	progress(buf);
+}
+
+// grid period for a measured transaction time: 25% headroom, whole ms
+double sclk66auto(double tx)
+{
+	return 1e-3*ceil(1.25*tx*1e3);
+}
+
+#endif
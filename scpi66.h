@@ -0,0 +1,318 @@
+// scpi66.h: pipelined SCPI transactions for the 66332A behind a Prologix/Fenrir adapter
+// include after prologix.h (uses wrtstr(), msg(), err()); replies come back through rx66.h
+// JBS & CJD 2026
+//
+// One bus message carries the setpoint and a compound query; the 66332A answers
+// MEAS:CURR? and FETC:VOLT? from the same acquisition, as "<amps>;<volts>", so
+// a complete sample costs one Prologix/GPIB turnaround instead of three.
+// Compile with -DPIPELINE66=0 to fall back to the old three-exchange sequence,
+// for comparing samples/s before and after.
+
+#ifndef SCPI66_H
+#define SCPI66_H
+
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
+#include	<time.h>
+#include	<math.h>
+#include	<unistd.h>
+#include	"rx66.h"
+
+#ifndef PIPELINE66
+#define PIPELINE66 1
+#endif
+
+// sample-rate counter, reports achieved samples/s over the run and recently
+struct rate66 {
+	struct timespec t0, tw;		// start of run, start of current window
+	long n, nw;					// samples in run, samples in window
+	double now, run;			// samples/s in last window, over whole run
+};
+
+void rate66init(struct rate66 *r)
+{
+	clock_gettime(CLOCK_MONOTONIC, &r->t0);
+	r->tw = r->t0;
+	r->n = r->nw = 0;
+	r->now = r->run = 0.00;
+}
+
+void rate66tick(struct rate66 *r)	// count one sample, update rates each ~second
+{
+	struct timespec tn;
+	double dt;
+
+	r->n++; r->nw++;
+	clock_gettime(CLOCK_MONOTONIC, &tn);
+	dt = (tn.tv_sec-r->t0.tv_sec)+(tn.tv_nsec-r->t0.tv_nsec)/1e9;
+	if(dt>0) r->run = r->n/dt;					// whole run
+	dt = (tn.tv_sec-r->tw.tv_sec)+(tn.tv_nsec-r->tw.tv_nsec)/1e9;
+	if(dt>=1.0){								// new window
+		r->now = r->nw/dt;
+		r->nw = 0;
+		r->tw = tn;
+	}
+}
+
+// measure V & I from one acquisition; returns 2 if both numbers arrived
+int meas2(int hp, double *v, double *i)
+{
+	double x[2];
+	int n;
+
+#if PIPELINE66
+	n = fastnums(rx66query(hp,"MEAS:CURR?;:FETC:VOLT?\n",0.0),x,2);	// one acquisition, both readings
+	if(n==2){*i=x[0]; *v=x[1];}
+#else
+	n = fastnums(rx66query(hp,"MEAS:VOLT?\n",0.0),v,1);		// request the terminal voltage
+	n += fastnums(rx66query(hp,"MEAS:CURR?\n",0.0),i,1);		// request the current
+#endif
+	return n;
+}
+
+// send V & I setpoint and measure V & I in the same transaction; returns 2 if good
+int setmeas(int hp, double vset, double iset, double *v, double *i)
+{
+	char wbuf[128];
+	double x[2];
+	int n;
+
+#if PIPELINE66
+	sprintf(wbuf,"VOLT %.6lf;CURR %.6lf;:MEAS:CURR?;:FETC:VOLT?\n",vset,iset);
+	n = fastnums(rx66query(hp,wbuf,0.0),x,2);
+	if(n==2){*i=x[0]; *v=x[1];}
+#else
+	sprintf(wbuf,"VOLT %.6lf;CURR %.6lf\n",vset,iset);
+	rx66write(hp,wbuf);
+	n=meas2(hp,v,i);
+#endif
+	return n;
+}
+
+// send V & I setpoint only, no reply expected (used while the digitizer runs)
+void setonly(int hp, double vset, double iset)
+{
+	char wbuf[128];
+
+	sprintf(wbuf,"VOLT %.6lf;CURR %.6lf\n",vset,iset);
+	rx66write(hp,wbuf);
+}
+
+// ---------------- instrument bring-up ----------------
+// Instead of fixed tickle()s after ++ifc, ++clr and *RST, the instrument is
+// asked *OPC?, which it only answers once everything sent before has finished,
+// so each step takes as long as this instrument needs.  What the instrument is
+// and how it is set up (IDN, the program's setup commands, and read back the
+// current range and modes, the digitizer sweep and the trigger & list set up
+// that digsetup() and listsetup() leave behind) is kept as a fingerprint in
+// UP66DIR, one file per adapter & address; when the next program finds the
+// same fingerprint the *RST is skipped and the output is only switched off and
+// the error queue cleared.  A sweep left long by bz3p66 would make every
+// MEAS of the next program that long, so it always differs and gets the *RST.
+#define UP66TMAX 10.0			// s, longest any bring-up step may take
+#define UP66TRY 1.0				// s, wait per *OPC? (the adapter gives up on reads itself)
+#define UP66DIR "/tmp"			// fingerprints, cleared at boot
+
+// wait until the instrument has finished everything sent so far; s taken, <0 if it never did
+double ready66(int hp, double tmax)
+{
+	double t0=rx66now(), t=-1.0, srtt=rx66s.srtt, rttvar=rx66s.rttvar;
+	long ntmo=rx66s.ntmo;
+
+	while(rx66now()-t0<tmax){
+		if(atoi(rx66query(hp,"*OPC?\n",UP66TRY))==1){ t=rx66now()-t0; break; }
+	}
+	rx66s.srtt=srtt; rx66s.rttvar=rttvar; rx66s.ntmo=ntmo;	// busy isn't slow, keep the estimate
+	return t;
+}
+
+// one-line fingerprint: IDN, setup commands, range, modes, sweep, triggers & list as the instrument reports them
+void fp66(char *fp, int size, int hp, char *idn, char *setup)
+{
+	int n;
+
+	n = snprintf(fp,size,"%s|%s|",idn,setup);
+	snprintf(fp+n,size-n,"%s",rx66query(hp,"SENS:CURR:RANG?;:CURR:MODE?;:VOLT:MODE?;"
+		":SENS:SWE:POIN?;TINT?;:TRIG:ACQ:SOUR?;:TRIG:SOUR?;:LIST:COUN?;STEP?\n",0.0));
+	for(;*fp;fp++) if(*fp=='\n' || *fp=='\r') *fp=' ';
+}
+
+// clear, identify and set up the 66332A at addr on adapter usb; setup is the program's
+// configuration ("SENS:CURR:RANG MAX\n"...), sent after any *RST; returns the IDN
+char *up66(int hp, char *usb, int addr, char *setup)
+{
+	static char idn[256];
+	char wbuf[256], fpname[128], fp[1024], old[1024], *p;
+	FILE *f;
+	double t0=rx66now(), t;
+	int e;
+
+	sprintf(wbuf,"++addr %d\n++ifc\n++clr\n",addr);		// point at it, INTERFACE CLEAR, device CLEAR
+	wrtstr(hp,wbuf);
+	if(ready66(hp,UP66TMAX)<0.0) err("Instrument does not answer *OPC? after clear.");
+
+	strncpy(idn,rx66query(hp,"*IDN?\n",0.0),255);
+	idn[255]='\0';
+	if(strstr(idn,"66332")==NULL){
+		fprintf(stderr,"Instrument at %d identifies as:'%s' (%ld chars)",addr,idn,strlen(idn));
+		err("Bad instrument ID");
+	}
+	progress(idn);
+
+	p = strrchr(usb,'/');
+	sprintf(fpname,"%s/up66_%s_%d",UP66DIR,(p==NULL)?usb:p+1,addr);
+	fp66(fp,sizeof(fp),hp,idn,setup);
+	old[0]='\0';
+	if((f=fopen(fpname,"r"))!=NULL){
+		if(fgets(old,sizeof(old),f)==NULL) old[0]='\0';
+		old[strcspn(old,"\n")]='\0';
+		fclose(f);
+	}
+	if(!strcmp(fp,old)){								// already set up as we want
+		wrtstr(hp,"OUTP OFF;*CLS\n");
+		if(ready66(hp,UP66TMAX)<0.0) err("Instrument does not answer *OPC?.");
+		progress("Instrument set up as last time, *RST skipped.");
+	}else{
+		wrtstr(hp,"*RST;*CLS\n");
+		wrtstr(hp,setup);
+		if((t=ready66(hp,UP66TMAX))<0.0) err("Instrument does not answer *OPC? after *RST.");
+		sprintf(wbuf,"Instrument reset and set up in %.2lfs.",t);
+		progress(wbuf);
+		fp66(fp,sizeof(fp),hp,idn,setup);
+		if((f=fopen(fpname,"w"))!=NULL){ fprintf(f,"%s\n",fp); fclose(f); }
+	}
+
+	do{												// empty the error queue
+		e = atoi(p=rx66query(hp,"SYST:ERR?\n",0.0));
+		if(e){ progress(p); msg(p); }
+	}while(e);
+	sprintf(wbuf,"Bring-up took %.2lfs.",rx66now()-t0);
+	progress(wbuf);
+	return idn;
+}
+
+// ---------------- 66332A digitizer (array) acquisitions ----------------
+// The digitizer samples V & I together every TINT (15.6us steps) for up to
+// DIGPTS points per trigger; the host fetches both arrays in one reply.  There
+// is one sweep buffer, so a sweep can only be armed once the last is fetched:
+// nothing is sampled during the fetch & re-arm between sweeps.  The stimulus
+// is still the host's setpoints, a staircase on the steering grid, so the
+// highest tone is held to DIGSPP steps a period.
+#define DIGPTS 4096				// 66332A sweep buffer
+#define DIGTQ 15.6e-6			// sample interval quantum
+#define DIGSTEER 2				// ms between setpoint updates while sweeping (~500/s) at best
+#define DIGSPP 20				// setpoints a period of the highest tone
+#define DIGFMAX (1e3/(DIGSPP*DIGSTEER))	// highest tone usable in array mode, 25Hz
+
+double digtint(double want)		// nearest legal sample interval
+{
+	double q = floor(want/DIGTQ+0.5);
+
+	if(q<1) q=1;
+	if(q>32768) q=32768;
+	return q*DIGTQ;
+}
+
+// set up the sweep: npts points at tint seconds, triggered by the bus
+void digsetup(int hp, int npts, double tint)
+{
+	char wbuf[128];
+
+	sprintf(wbuf,"SENS:SWE:POIN %d;TINT %.7e;:TRIG:ACQ:SOUR BUS\n",npts,tint);
+	wrtstr(hp,wbuf);
+}
+
+// seconds a setpoint takes on this bus, from a few timed ones (outputs off)
+double digsteer(int hp, double vset)
+{
+	double t0 = rx66now();
+	int k;
+
+	for(k=0;k<10;k++) setonly(hp,vset,0.0);
+	ready66(hp,UP66TMAX);
+	return (rx66now()-t0)/10.0;
+}
+
+void digarm(int hp)				// start the next sweep now
+{
+	rx66write(hp,"INIT:NAME ACQ;:TRIG:ACQ\n");
+}
+
+// fetch the last sweep, both arrays in one reply, parsed in the receive buffer; returns # of V/I pairs
+int digfetch(int hp, double *v, double *i, int npts)
+{
+	char *rbuf, *p;
+	int ni, nv;
+
+	rbuf = rx66query(hp,"FETC:ARR:CURR?;:FETC:ARR:VOLT?\n",npts*0.001);	// ~28 chars per pair to move
+	ni = fastnums(rbuf,i,npts);					// currents, comma separated
+	p = strchr(rbuf,';');						// then volts after the ';'
+	nv = (p==NULL)? 0 : fastnums(p+1,v,npts);
+	return MIN(ni,nv);
+}
+
+// ---------------- 66332A LIST playback of current waveforms ----------------
+// A waveform is a run of (V, I, dwell) segments; each chunk of up to LISTPTS
+// segments is uploaded and triggered as one list, the next chunk is compiled
+// while this one plays.  The 66332A holds one list and refuses a new one while
+// it plays, so each list ends with *OPC and the host polls *ESR? once the list
+// is due, uploading the next only when its OPC bit says this one is done; a
+// SYST:ERR? straight after each upload both drains any error and confirms the
+// instrument has taken the whole message.  Late starts, and the gap each
+// boundary costs, are taken out of the following dwells so the waveform stays
+// on schedule.
+#define LISTPTS 20				// steps the 66332A holds in one list
+#define LISTDWMIN 0.001			// shortest dwell accepted
+#define LISTTMO 2.0				// s a list may run past its due time before the run is stopped
+#define ESROPC 0x01				// *ESR? operation complete
+#define ESRERR 0x3C				// *ESR? query, device, execution & command errors
+
+struct seg66 {
+	double v, i, dwell;
+};
+
+// build the upload+trigger message for n segments, first dwells cut by late seconds
+int listcmd(char *buf, struct seg66 *s, int n, double late)
+{
+	char *p=buf;
+	double d;
+	int k;
+
+	p += sprintf(p,"LIST:CURR ");
+	for(k=0;k<n;k++) p += sprintf(p,"%s%.6lf",k?",":"",s[k].i);
+	p += sprintf(p,";:LIST:VOLT ");
+	for(k=0;k<n;k++) p += sprintf(p,"%s%.6lf",k?",":"",s[k].v);
+	p += sprintf(p,";:LIST:DWEL ");
+	for(k=0;k<n;k++){
+		d = s[k].dwell;
+		if(late>0.0){								// absorb late start
+			if(d-late>=LISTDWMIN){d-=late; late=0.0;}
+			else{late-=d-LISTDWMIN; d=LISTDWMIN;}
+		}
+		p += sprintf(p,"%s%.4lf",k?",":"",d);
+	}
+	p += sprintf(p,";:INIT;:TRIG;*OPC\n");		// OPC once it has played out
+	return p-buf;
+}
+
+// drain the error queue after a list went up, # of errors and the first in buf ("" if
+// none); its reply comes once the instrument has parsed the whole upload
+int listerr(int hp, char *buf, int size)
+{
+	char *p;
+	int n=0;
+
+	buf[0]='\0';
+	while(atoi(p=rx66query(hp,"SYST:ERR?\n",0.0))!=0 && n<16){
+		if(n++==0) snprintf(buf,size,"%s",p);
+	}
+	return n;
+}
+
+void listsetup(int hp)			// outputs follow the list, one pass per trigger
+{
+	wrtstr(hp,"CURR:MODE LIST;:VOLT:MODE LIST;:LIST:STEP AUTO;:LIST:COUN 1;:TRIG:SOUR BUS\n");
+}
+
+#endif
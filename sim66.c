@@ -0,0 +1,592 @@
+// Simulated HP/Agilent 66332A behind a Prologix GPIB-USB adapter, on a pseudo-terminal,
+// driving an equivalent-circuit battery model, so bcp66/bap66/bz3p66/bzdcp66 can run without hardware
+// JBS & CJD 2026
+
+#define _GNU_SOURCE			// posix_openpt(), ptsname(), cfmakeraw()
+#include    <stdio.h>
+#include    <stdlib.h>
+#include    <string.h>
+#include    <strings.h>
+#include    <ctype.h>
+#include    <time.h>
+#include    <math.h>
+#include    <fcntl.h>
+#include    <errno.h>
+#include    <poll.h>
+#include 	<unistd.h> // write(), read(), close()
+#include 	<termios.h>
+
+#define MAX(A,B) (((A)>(B))?(A):(B))
+#define MIN(A,B) (((A)<(B))?(A):(B))
+#define TRUE 1
+#define FALSE 0
+#define PI 3.14159265358979323846
+
+#define NBRANCH 32			// RC branches incl. CPE approximation
+#define NOCV 32				// points in OCV curve
+#define MAXPTS 4096			// digitizer buffer
+#define MAXLIST 100			// list steps accepted
+#define HSTEP 0.002			// model integration step (s)
+
+// ---------------- battery model ----------------
+struct cell {
+	double Rs;						// series resistance
+	int nb;							// RC branches
+	double R[NBRANCH], tau[NBRANCH], Vb[NBRANCH];
+	double Ctail, Vtail;			// long-time-constant part of CPE (capacitor)
+	int nocv;
+	double socp[NOCV], ocvp[NOCV];	// OCV curve
+	double cap, soc;				// capacity (Ah), state of charge 0..1
+	double vnoise, inoise;			// readback noise (1 sigma)
+} b;
+
+// ---------------- instrument ----------------
+struct inst {
+	int addr, on;
+	double vset, iset, rang;		// setpoints, current range (A)
+	double vmeas, imeas;			// last acquisition, for FETC
+	int npts;						// digitizer
+	double tint, tacq;				// sample interval, trigger time (<0 idle)
+	int acqinit, nacq;
+	char acqsrc[8], trgsrc[8];		// TRIG:ACQ:SOUR, TRIG:SOUR
+	int lcoun, lauto;				// LIST:COUN, LIST:STEP AUTO
+	double av[MAXPTS], ai[MAXPTS];
+	int vlist, ilist, nlv, nli, nld;	// LIST mode
+	double lv[MAXLIST], li[MAXLIST], ld[MAXLIST];
+	int tinit;
+	double tlist, tlend;			// list start (<0 idle) & end
+	int opc, esr;					// *OPC armed, event status bits
+	int errs[16], nerr;
+} h;
+
+struct bus {
+	int addr, autord;				// prologix ++addr, ++auto
+	char out[1<<17];				// reply waiting for ++read
+	int nout;
+	double latency, acq;			// per-transaction bus delay, MEAS acquisition time (s)
+	double rst;						// instrument busy after *RST (s)
+} p;
+
+double tmodel;						// model time (s since start)
+struct timespec t0;
+unsigned int seed=12345;
+long ncmds=0;
+
+double now(void)
+{
+	struct timespec tn;
+
+	clock_gettime(CLOCK_MONOTONIC, &tn);
+	return (tn.tv_sec-t0.tv_sec)+(tn.tv_nsec-t0.tv_nsec)/1e9;
+}
+
+double gauss(void)			// unit normal deviate
+{
+	double u1=(rand_r(&seed)+1.0)/(RAND_MAX+2.0), u2=(rand_r(&seed)+1.0)/(RAND_MAX+2.0);
+
+	return sqrt(-2.0*log(u1))*cos(2.0*PI*u2);
+}
+
+void scpierr(int e)
+{
+	if(h.nerr<16) h.errs[h.nerr++]=e;
+	h.esr |= (e<=-200)? 16 : 32;	// execution or command error
+}
+
+double ocv(double soc)		// open circuit voltage, linear between points
+{
+	int k;
+
+	if(soc<=b.socp[0]) return b.ocvp[0];
+	for(k=1;k<b.nocv;k++){
+		if(soc<=b.socp[k]){
+			return b.ocvp[k-1]+(b.ocvp[k]-b.ocvp[k-1])*(soc-b.socp[k-1])/(b.socp[k]-b.socp[k-1]);
+		}
+	}
+	return b.ocvp[b.nocv-1];
+}
+
+double emf(void)			// cell voltage behind Rs
+{
+	double e=ocv(b.soc)+b.Vtail;
+	int k;
+
+	for(k=0;k<b.nb;k++) e+=b.Vb[k];
+	return e;
+}
+
+void setpts(double t, double *vs, double *is)	// setpoints at time t, following a running list
+{
+	double tl;
+	int k, n;
+
+	*vs=h.vset; *is=h.iset;
+	if(h.tlist<0 || t<h.tlist) return;
+	n=MAX(h.nld,MAX(h.nli,h.nlv));
+	for(tl=h.tlist,k=0;k<n;k++){
+		tl += h.ld[MIN(k,h.nld-1)];
+		if(t<tl || k==n-1) break;
+	}
+	if(h.ilist && h.nli) *is=h.li[MIN(k,h.nli-1)];
+	if(h.vlist && h.nlv) *vs=h.lv[MIN(k,h.nlv-1)];
+}
+
+int listbusy(double t)		// a list initiated and not yet played out
+{
+	return h.tinit || (h.tlist>=0 && t<h.tlend);
+}
+
+double current(double t)	// what the supply pushes into the cell right now
+{
+	double vs, is, i;
+
+	if(!h.on) return 0.00;
+	setpts(t,&vs,&is);
+	i=(vs-emf())/b.Rs;		// current needed to hold V at vs (CV)
+	if(i>is) i=is;			// CC limits either way
+	if(i<-is) i=-is;
+	return i;
+}
+
+void step(double dt)		// advance the cell by dt at the current that flows now
+{
+	double i=current(tmodel), e;
+	int k;
+
+	for(k=0;k<b.nb;k++){
+		e=exp(-dt/b.tau[k]);
+		b.Vb[k] = b.Vb[k]*e + i*b.R[k]*(1.0-e);
+	}
+	if(b.Ctail>0) b.Vtail += i*dt/b.Ctail;
+	b.soc += i*dt/(3600.0*b.cap);
+	if(b.soc<0.0) b.soc=0.0;
+	if(b.soc>1.0) b.soc=1.0;
+	tmodel += dt;
+}
+
+void readback(double t, double *v, double *i)	// noisy, range limited readings
+{
+	double ii=current(t);
+
+	*v = emf()+ii*b.Rs + b.vnoise*gauss();
+	*i = ii + b.inoise*gauss();
+	if(*i>h.rang*1.02) *i=h.rang*1.02;
+	if(*i<-h.rang*1.02) *i=-h.rang*1.02;
+}
+
+void advance(double tto)	// run the model up to tto, catching digitizer samples on the way
+{
+	double next, ts;
+
+	while(tmodel<tto){
+		next = MIN(tto,tmodel+HSTEP);
+		if(h.tacq>=0 && h.nacq<h.npts){
+			ts = h.tacq+h.nacq*h.tint;
+			if(ts<=tmodel){readback(tmodel,&h.av[h.nacq],&h.ai[h.nacq]); h.nacq++; continue;}
+			next = MIN(next,ts);
+		}
+		step(next-tmodel);
+	}
+	if(h.tacq>=0 && h.nacq>=h.npts) h.tacq=-1.0;	// sweep complete
+}
+
+void instreset(void)
+{
+	h.on=FALSE; h.vset=0.0; h.iset=0.0; h.rang=5.12;
+	h.npts=2048; h.tint=15.6e-6; h.tacq=-1.0; h.acqinit=FALSE; h.nacq=0;
+	h.vlist=h.ilist=FALSE; h.nlv=h.nli=h.nld=0; h.tinit=FALSE; h.tlist=-1.0;
+	strcpy(h.acqsrc,"BUS"); strcpy(h.trgsrc,"BUS"); h.lcoun=1; h.lauto=TRUE;
+	h.opc=FALSE; h.esr=0; h.nerr=0;
+}
+
+// ---------------- model set up ----------------
+void cpe(double Q, double alpha)	// CPE as log-spaced RC branches + tail capacitor
+{
+	double tmin=1e-3, tmax=1e6, lt, dl, g;
+	int k, n=16;
+
+	if(alpha<=0.0 || alpha>=1.0){ fprintf(stderr,"CPE alpha must be 0<alpha<1.\n"); exit(1); }
+	dl = log(tmax/tmin)/(n-1);
+	g = sin(alpha*PI)/(PI*Q);				// distribution of relaxation times ~ tau^alpha
+	for(k=0;k<n && b.nb<NBRANCH;k++){
+		lt = log(tmin)+k*dl;
+		b.tau[b.nb] = exp(lt);
+		b.R[b.nb] = g*pow(b.tau[b.nb],alpha)*dl;
+		b.Vb[b.nb++] = 0.0;
+	}
+	b.Ctail = PI*Q*(1.0-alpha)/(sin(alpha*PI)*pow(tmax*exp(dl/2),alpha-1.0));
+}
+
+void readmodel(char *fname)
+{
+	FILE *cfg;
+	char line[256], key[32];
+	double x, y;
+
+	cfg = fopen(fname,"r");
+	if(cfg==NULL){ fprintf(stderr,"Cannot open model file %s\n",fname); exit(1); }
+	b.nocv=0;
+	while(fgets(line,255,cfg)!=NULL){
+		if(line[0]=='#' || sscanf(line,"%31s",key)!=1) continue;
+		y=0.0;
+		if(sscanf(line,"%*s %lf %lf",&x,&y)<1){ fprintf(stderr,"Bad model line: %s",line); exit(1); }
+		if(!strcasecmp(key,"Rs")) b.Rs=x;
+		else if(!strcasecmp(key,"RC") && b.nb<NBRANCH){ b.R[b.nb]=x; b.tau[b.nb]=x*y; b.Vb[b.nb++]=0.0; }
+		else if(!strcasecmp(key,"CPE")) cpe(x,y);
+		else if(!strcasecmp(key,"OCV") && b.nocv<NOCV){ b.socp[b.nocv]=x; b.ocvp[b.nocv++]=y; }
+		else if(!strcasecmp(key,"Cap")) b.cap=x;
+		else if(!strcasecmp(key,"SOC")) b.soc=x;
+		else if(!strcasecmp(key,"noise")){ b.vnoise=x; b.inoise=y; }
+		else if(!strcasecmp(key,"latency")) p.latency=x/1000.0;
+		else if(!strcasecmp(key,"acq")) p.acq=x/1000.0;
+		else if(!strcasecmp(key,"rst")) p.rst=x/1000.0;
+		else if(!strcasecmp(key,"addr")) h.addr=(int)x;
+		else { fprintf(stderr,"Unknown model key: %s\n",key); exit(1); }
+	}
+	fclose(cfg);
+	if(b.nocv<2){ fprintf(stderr,"Model needs at least 2 OCV points.\n"); exit(1); }
+}
+
+void defmodel(void)			// ~2.5Ah Li-ion cell
+{
+	double s[]={0.0,0.05,0.2,0.5,0.8,1.0}, v[]={3.0,3.3,3.55,3.7,3.95,4.2};
+	int k;
+
+	b.Rs=0.05; b.nb=0; b.Ctail=0.0; b.Vtail=0.0;
+	b.R[0]=0.02; b.tau[0]=0.02*50.0; b.Vb[0]=0.0; b.nb=1;		// 20mOhm || 50F
+	b.nocv=6;
+	for(k=0;k<6;k++){b.socp[k]=s[k]; b.ocvp[k]=v[k];}
+	b.cap=2.5; b.soc=0.5;
+	b.vnoise=50e-6; b.inoise=20e-6;
+	p.latency=0.008; p.acq=0.030; p.rst=1.2;
+	h.addr=5;
+}
+
+// ---------------- SCPI ----------------
+// long forms, short form is the leading capitals; optional nodes are dropped
+char *kwords[]={"SENSe","CURRent","VOLTage","RANGe","MEASure","FETCh","ARRay","OUTPut","SYSTem",
+	"ERRor","SWEep","POINts","TINTerval","TRIGger","ACQuire","SOURce","INITiate","DWELl","COUNt",
+	"MODE","STEP","LIST","NAME","STATe","WINDow","PROTection","STATus","OPERation","CONDition",NULL};
+char *optional[]={"LEVel","IMMediate","AMPLitude","SCALar","DC","SEQuence",NULL};
+
+int kwmatch(char *node, char *kw)
+{
+	char shrt[16];
+	int k;
+
+	for(k=0;isupper(kw[k]) || isdigit(kw[k]);k++) shrt[k]=kw[k];
+	shrt[k]='\0';
+	return !strcasecmp(node,shrt) || !strcasecmp(node,kw);
+}
+
+void shortnode(char *node)	// canonical short upper-case form
+{
+	int k, j;
+
+	for(k=0;kwords[k];k++){
+		if(kwmatch(node,kwords[k])){
+			for(j=0;isupper(kwords[k][j]);j++) node[j]=kwords[k][j];
+			node[j]='\0';
+			return;
+		}
+	}
+	for(j=0;node[j];j++) node[j]=toupper(node[j]);
+}
+
+int isopt(char *node)
+{
+	int k;
+
+	for(k=0;optional[k];k++) if(kwmatch(node,optional[k])) return TRUE;
+	return FALSE;
+}
+
+void reply(char *s)			// append one query result to the pending response
+{
+	int n=strlen(s);
+
+	if(p.nout && p.out[p.nout-1]!='\n' && p.nout<(int)sizeof(p.out)-1) p.out[p.nout++]=';';
+	if(p.nout+n<(int)sizeof(p.out)-2){ memcpy(p.out+p.nout,s,n); p.nout+=n; }
+}
+
+void replyarr(double *x, int n)
+{
+	char *s=malloc(n*16+16), *q=s;
+	int k;
+
+	for(k=0;k<n;k++) q+=sprintf(q,"%s%+.5E",k?",":"",x[k]);
+	*q='\0';
+	reply(s);
+	free(s);
+}
+
+int numlist(char *s, double *x, int nmax)
+{
+	int n=0;
+	char *e;
+
+	while(n<nmax && *s){
+		x[n]=strtod(s,&e);
+		if(e==s) break;
+		n++;
+		for(s=e;*s==',' || *s==' ';s++);
+	}
+	return n;
+}
+
+int onoff(char *a)
+{
+	return !strncasecmp(a,"ON",2) || atoi(a)!=0;
+}
+
+double minmax(char *a, double lo, double hi)
+{
+	if(!strncasecmp(a,"MIN",3)) return lo;
+	if(!strncasecmp(a,"MAX",3)) return hi;
+	return atof(a);
+}
+
+void scpi(char *hdr, char *arg, int q)	// execute one canonical command
+{
+	char buf[128];
+	int k;
+	double t=now();
+
+	advance(t);
+	if(!strcmp(hdr,"*IDN")){ reply("HEWLETT-PACKARD,66332A,0,A.03.01 sim66"); return; }
+	if(!strcmp(hdr,"*RST")){ instreset(); usleep((int)(1e6*p.rst)); return; }	// deaf while it resets
+	if(!strcmp(hdr,"*CLS")){ h.nerr=0; h.esr=0; h.opc=FALSE; return; }
+	if(!strcmp(hdr,"*OPC")){ if(q) reply("1"); else h.opc=TRUE; return; }	// *OPC: bit 0 of *ESR once the list is done
+	if(!strcmp(hdr,"*ESR")){
+		if(h.opc && !listbusy(t)){ h.esr|=1; h.opc=FALSE; }
+		sprintf(buf,"%d",h.esr);
+		h.esr=0;
+		reply(buf);
+		return;
+	}
+	if(!strcmp(hdr,"*STB")){ reply(h.nerr?"4":"0"); return; }
+	if(!strcmp(hdr,"*TRG") || !strcmp(hdr,"TRIG")){
+		if(h.tinit){
+			h.tlist=h.tlend=t; h.tinit=FALSE;
+			for(k=0;h.nld>0 && k<MAX(h.nld,MAX(h.nli,h.nlv));k++) h.tlend += h.ld[MIN(k,h.nld-1)];
+		}
+		return;
+	}
+	if(!strcmp(hdr,"SYST:ERR")){
+		if(h.nerr){
+			sprintf(buf,"%d,\"%s\"",h.errs[0],h.errs[0]==-113?"Undefined header":h.errs[0]==-221?"Settings conflict":
+				h.errs[0]==-213?"Init ignored":"Error");
+			memmove(h.errs,h.errs+1,(--h.nerr)*sizeof(int));
+			reply(buf);
+		}else reply("+0,\"No error\"");
+		return;
+	}
+	if(!strcmp(hdr,"VOLT")){ if(q){sprintf(buf,"%.6E",h.vset);reply(buf);} else h.vset=minmax(arg,0.0,20.475); return; }
+	if(!strcmp(hdr,"CURR")){ if(q){sprintf(buf,"%.6E",h.iset);reply(buf);} else h.iset=minmax(arg,0.0,5.1175); return; }
+	if(!strcmp(hdr,"VOLT:MODE")){ if(q) reply(h.vlist?"LIST":"FIX"); else h.vlist=!strncasecmp(arg,"LIST",4); return; }
+	if(!strcmp(hdr,"CURR:MODE")){ if(q) reply(h.ilist?"LIST":"FIX"); else h.ilist=!strncasecmp(arg,"LIST",4); return; }
+	if(!strcmp(hdr,"OUTP") || !strcmp(hdr,"OUTP:STAT")){
+		if(q) reply(h.on?"1":"0"); else h.on=onoff(arg);
+		return;
+	}
+	if(!strcmp(hdr,"SENS:CURR:RANG")){
+		if(q){sprintf(buf,"%.6E",h.rang);reply(buf);}
+		else h.rang = (minmax(arg,0.02,5.12)<=0.02)? 0.02 : 5.12;
+		return;
+	}
+	if(!strcmp(hdr,"MEAS:VOLT") || !strcmp(hdr,"MEAS:CURR")){	// a fresh acquisition, a whole sweep
+		readback(t,&h.vmeas,&h.imeas);
+		usleep((int)(1e6*MAX(p.acq,h.npts*h.tint)));
+		sprintf(buf,"%+.5E",hdr[5]=='V'?h.vmeas:h.imeas);
+		reply(buf);
+		return;
+	}
+	if(!strcmp(hdr,"FETC:VOLT")){ sprintf(buf,"%+.5E",h.vmeas); reply(buf); return; }
+	if(!strcmp(hdr,"FETC:CURR")){ sprintf(buf,"%+.5E",h.imeas); reply(buf); return; }
+	if(!strcmp(hdr,"SENS:SWE:POIN")){
+		if(q){sprintf(buf,"%d",h.npts);reply(buf);} else h.npts=MAX(1,MIN(MAXPTS,atoi(arg)));
+		return;
+	}
+	if(!strcmp(hdr,"SENS:SWE:TINT")){
+		if(q){sprintf(buf,"%.6E",h.tint);reply(buf);} else h.tint=MAX(15.6e-6,atof(arg));
+		return;
+	}
+	if(!strcmp(hdr,"TRIG:ACQ:SOUR")){ if(q) reply(h.acqsrc); else{ strncpy(h.acqsrc,arg,3); h.acqsrc[3]='\0'; } return; }
+	if(!strcmp(hdr,"TRIG:SOUR")){ if(q) reply(h.trgsrc); else{ strncpy(h.trgsrc,arg,3); h.trgsrc[3]='\0'; } return; }
+	if(!strcmp(hdr,"SENS:WIND")) return;
+	if(!strcmp(hdr,"INIT:NAME")){
+		if(!strncasecmp(arg,"ACQ",3)) h.acqinit=TRUE; else h.tinit=TRUE;
+		return;
+	}
+	if(!strcmp(hdr,"INIT")){ if(listbusy(t)) scpierr(-213); else h.tinit=TRUE; return; }	// init ignored
+	if(!strcmp(hdr,"TRIG:ACQ")){
+		if(h.acqinit){ h.tacq=t; h.nacq=0; h.acqinit=FALSE; }
+		return;
+	}
+	if(!strcmp(hdr,"FETC:ARR:VOLT") || !strcmp(hdr,"FETC:ARR:CURR") ||
+			!strcmp(hdr,"MEAS:ARR:VOLT") || !strcmp(hdr,"MEAS:ARR:CURR")){
+		if(hdr[0]=='M'){ h.tacq=t; h.nacq=0; }
+		while(h.tacq>=0){						// wait for the sweep to finish
+			usleep(1000);
+			advance(now());
+		}
+		if(!strcmp(hdr+9,"VOLT")) replyarr(h.av,h.nacq); else replyarr(h.ai,h.nacq);
+		return;
+	}
+	if(!strncmp(hdr,"LIST:",5) && !q && listbusy(t)){ scpierr(-221); return; }	// not while one plays
+	if(!strcmp(hdr,"LIST:CURR")){ h.nli=numlist(arg,h.li,MAXLIST); return; }
+	if(!strcmp(hdr,"LIST:VOLT")){ h.nlv=numlist(arg,h.lv,MAXLIST); return; }
+	if(!strcmp(hdr,"LIST:DWEL")){ h.nld=numlist(arg,h.ld,MAXLIST); return; }
+	if(!strcmp(hdr,"LIST:COUN")){ if(q){sprintf(buf,"%d",h.lcoun);reply(buf);} else h.lcoun=atoi(arg); return; }
+	if(!strcmp(hdr,"LIST:STEP")){ if(q) reply(h.lauto?"AUTO":"ONCE"); else h.lauto=!strncasecmp(arg,"AUTO",4); return; }
+	scpierr(-113);
+}
+
+void message(char *m)		// one newline-terminated message for the instrument
+{
+	char *unit, *save, *a, *path[8], node[32], hdr[96], arg[2048];
+	char nodes[8][32];
+	int np=0, nk, q, k, j;
+
+	for(unit=strtok_r(m,";",&save); unit; unit=strtok_r(NULL,";",&save)){
+		while(isspace(*unit)) unit++;
+		if(!*unit) continue;
+		ncmds++;
+		for(a=unit;*a && !isspace(*a);a++);		// header ends at first space
+		strncpy(arg,*a?a+1:"",sizeof(arg)-1); arg[sizeof(arg)-1]='\0';
+		*a='\0';
+		q = (a>unit && a[-1]=='?');
+		if(q) a[-1]='\0';
+		if(unit[0]=='*'){							// common command, path unchanged
+			for(k=0;unit[k];k++) unit[k]=toupper(unit[k]);
+			scpi(unit,arg,q);
+			continue;
+		}
+		if(unit[0]==':'){ np=0; unit++; }		// absolute
+		nk=np;
+		for(k=0;k<np;k++) path[k]=nodes[k];
+		while(*unit && nk<8){
+			for(j=0;*unit && *unit!=':' && j<31;j++) node[j]=*unit++;
+			node[j]='\0';
+			if(*unit==':') unit++;
+			while(j>0 && isdigit(node[j-1])) node[--j]='\0';	// numeric suffix
+			if(isopt(node) || (nk==0 && kwmatch(node,"SOURce"))) continue;
+			shortnode(node);
+			strcpy(nodes[nk],node); path[nk]=nodes[nk]; nk++;
+		}
+		for(hdr[0]='\0',k=0;k<nk;k++){ if(k) strcat(hdr,":"); strcat(hdr,path[k]); }
+		np = nk>0? nk-1 : 0;						// following units are relative to this one
+		scpi(hdr,arg,q);
+	}
+}
+
+// ---------------- prologix ----------------
+void sendout(int fd)		// deliver the pending reply after the bus delay
+{
+	if(!p.nout) return;
+	usleep((int)(1e6*p.latency));
+	if(p.out[p.nout-1]!='\n') p.out[p.nout++]='\n';
+	if(write(fd,p.out,p.nout)<0) perror("write");
+	p.nout=0;
+}
+
+void prologix(int fd, char *line)
+{
+	char buf[128];
+
+	if(!strncmp(line,"++addr",6)){
+		if(sscanf(line+6,"%d",&p.addr)!=1){ sprintf(buf,"%d\n",p.addr); if(write(fd,buf,strlen(buf))<0) perror("write"); }
+	}else if(!strncmp(line,"++auto",6)){
+		sscanf(line+6,"%d",&p.autord);
+	}else if(!strncmp(line,"++read",6)){
+		sendout(fd);
+	}else if(!strncmp(line,"++clr",5)){
+		p.nout=0; h.tinit=FALSE; h.acqinit=FALSE;		// device clear
+	}else if(!strncmp(line,"++ifc",5)){
+		p.nout=0;
+	}else if(!strncmp(line,"++ver",5)){
+		sprintf(buf,"Prologix GPIB-USB Controller version 6.107 (sim66)\n");
+		if(write(fd,buf,strlen(buf))<0) perror("write");
+	}else if(!strncmp(line,"++spoll",7)){
+		sprintf(buf,"%d\n",h.nerr?4:0);
+		if(write(fd,buf,strlen(buf))<0) perror("write");
+	}										// ++mode, ++eoi, ++eos, ++read_tmo_ms, ... accepted
+}
+
+int main(int argc, char* argv[])
+{
+	int mfd, sfd, n, k, lo=0;
+	char *sname, ibuf[1<<16], line[1<<16];
+	struct termios tio;
+	struct pollfd pfd;
+	double tshow=0.0, v, i;
+
+	// version 1.00: pty, prologix ++ subset, 66332A SCPI subset incl. digitizer & list, RC/CPE cell
+	// version 1.01: *RST takes time (rst), CURR:MODE? & VOLT:MODE? answered
+    float version = 1.01;
+    if (argc<1+1 || argc>2+1) {
+        fprintf(stderr,"sim66 V%.2f jbs&cjd 2026\n", version);
+        fprintf(stderr,"Simulated 66332A on a Prologix adapter, served on a pseudo-terminal.\n");
+        fprintf(stderr,"Usage: sim66 link [model]\n");
+        fprintf(stderr,"where-  link is the name for the pty, e.g. /tmp/dev/ttySIM0 (needs 'dev' & 'tty'\n");
+        fprintf(stderr,"          in it to pass the acquisition programs' USB path check);\n");
+        fprintf(stderr,"        model is an optional file of 'key values' lines:\n");
+        fprintf(stderr,"          Rs ohms | RC ohms farads | CPE Q alpha | OCV soc volts (>=2 lines)\n");
+        fprintf(stderr,"          Cap Ah | SOC 0..1 | noise Vsd Isd | latency ms | acq ms | rst ms | addr gpib\n");
+        fprintf(stderr,"Default cell: 2.5Ah Li-ion, Rs=50mOhm, 20mOhm||50F, 8ms bus latency, 30ms MEAS,\n");
+        fprintf(stderr,"busy 1.2s after *RST.\n");
+        fprintf(stderr,"Then run e.g.: bcp66 /tmp/dev/ttySIM0 4.1 3.4 1 1 0.1 0.1 60 60 1 50 10 test\n");
+        fprintf(stderr,"\n");
+        exit(1);
+    }
+
+	defmodel();
+	if(argc>2) readmodel(argv[2]);
+	instreset();
+	p.addr=h.addr; p.autord=0;
+
+	mfd = posix_openpt(O_RDWR|O_NOCTTY);
+	if(mfd<0 || grantpt(mfd)<0 || unlockpt(mfd)<0 || (sname=ptsname(mfd))==NULL){
+		fprintf(stderr,"Error %i opening pty: %s\n", errno, strerror(errno));
+		exit(1);
+	}
+	sfd = open(sname,O_RDWR|O_NOCTTY);	// held open so clients can come and go
+	if(sfd<0 || tcgetattr(sfd,&tio)<0){ fprintf(stderr,"Cannot open %s\n",sname); exit(1); }
+	cfmakeraw(&tio);
+	tcsetattr(sfd,TCSANOW,&tio);
+	unlink(argv[1]);
+	if(symlink(sname,argv[1])<0){
+		fprintf(stderr,"Error %i linking %s -> %s: %s\n", errno, argv[1], sname, strerror(errno));
+		exit(1);
+	}
+	fprintf(stderr,"sim66: %s -> %s, GPIB addr %d, Rs=%.3lf, %d branches, %.2lfAh at SOC %.2lf\n",
+		argv[1],sname,h.addr,b.Rs,b.nb,b.cap,b.soc);
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	tmodel=0.0;
+	pfd.fd=mfd; pfd.events=POLLIN;
+	while(1){
+		if(poll(&pfd,1,200)<0 && errno!=EINTR) break;
+		advance(now());
+		if(now()>tshow){					// status line
+			tshow=now()+1.0;
+			readback(tmodel,&v,&i);
+			fprintf(stderr,"sim66 %.0lfs: V=%.4lf I=%+.4lf SOC=%.4lf out=%d cmds=%ld     \r",
+				tmodel,v,i,b.soc,h.on,ncmds);
+		}
+		if(!(pfd.revents&POLLIN)) continue;
+		n = read(mfd,ibuf,sizeof(ibuf));
+		if(n<=0){ usleep(10000); continue; }
+		for(k=0;k<n;k++){
+			if(ibuf[k]=='\r') continue;
+			if(ibuf[k]!='\n' && lo<(int)sizeof(line)-1){ line[lo++]=ibuf[k]; continue; }
+			line[lo]='\0'; lo=0;
+			if(!strncmp(line,"++",2)){ prologix(mfd,line); continue; }
+			if(p.addr!=h.addr) continue;	// somebody else's instrument
+			message(line);
+			if(p.autord) sendout(mfd);
+		}
+	}
+	unlink(argv[1]);
+	return 0;
+}
@@ -3,51 +3,170 @@
 #include	<stdlib.h>
 #include	<math.h>
 #include	<ctype.h>
+#include	"tvird.h"
+#include	"tvipar.h"
+#include	"tvifol.h"
+#include	"opt66.h"
 
+// The file is read in blocks (tvird.h) on -jN threads.  Pass 1 sums each
+// block's energy in and out from zero, with the sample before the block for
+// its first dt; the running totals at each block start are then those sums
+// added up in block order, and pass 2 writes each block's lines from its
+// starting totals.  Blocks are fixed by the file, so any -j gives the same output.
+// With -f the file is followed as it is written (tvifol.h), in one pass, each
+// line out as its sample lands.
 
-int main(int argc, char *argv[]){
-  FILE *fileptr;
-  char *sline;
-  size_t li;
-  double mtime=0.00, voltage, current;
-  double lastmtime=0, dt;
-  double u, q=0.00, ein=0.00, eout=0.00;
-  long int cntr;
-
-  if ( argc != 2) { 
-    fprintf(stderr,"tvi2u                  V3.0 CJD & JBS August 2023\n");
-    fprintf(stderr,"Usage: tvi2u file.tvi >file.tu\n");
-    fprintf(stderr,"Takes in a 3-col ascii file giving time, voltage, current,\n");
-    fprintf(stderr,"writes same time steps and device cycle efficiency to stdout.\n");
-    exit(1);
+#define WAVE 4					// blocks held for output per thread
+
+struct blk {
+  double tprev;					// time of the sample before the block (0 if none)
+  int prev;						// there is one
+  long n;						// samples
+  double ein, eout;				// sums over the block / totals at its start
+  double u;						// u at its last line
+  long nbad;					// lines skipped
+  char *out;					// its lines
+  size_t len;
+};
+
+struct job {
+  struct tvird *rd;
+  struct blk *b;
+  long k0;						// first block of the wave (pass 2)
+};
+
+void pass1(void *arg, long k){
+  struct job *j=arg;
+  struct blk *b=&j->b[k];
+  struct tvird s;
+  double x[3], y[3], lastmtime, dt;
+  long p;
+
+  b->prev = tvirdprev(j->rd, tvirdblkpos(j->rd, k), y, 3, &p)>0;
+  b->tprev = lastmtime = b->prev? y[0] : 0.00;
+  tvirdblock(j->rd, k, &s);
+  while(tvirdnext(&s, x, 3)){
+    dt=x[0]-lastmtime;
+    lastmtime=x[0];
+    if(b->prev || b->n>0){
+      if(x[2]>0.00){b->ein+=dt*x[2]*x[1];}
+      else{b->eout-=dt*x[2]*x[1];}
+    }
+    b->n++;
   }
+  b->nbad=s.nbad;
+  tvirdclose(&s);
+}
 
-  //	time(&t);
-  //	printf("%s", ctime(&t));
+void pass2(void *arg, long k){
+  struct job *j=arg;
+  struct blk *b=&j->b[j->k0+k];
+  struct tvird s;
+  FILE *f;
+  double x[3], mtime, voltage, current, lastmtime=b->tprev, dt;
+  double ein=b->ein, eout=b->eout, u=0.00;
+  long cntr=b->prev;
 
-  fileptr = fopen( argv[1], "rb");
-  if(fileptr==NULL){
-    fprintf(stderr, "Cannot open .tvi file %s!\n", argv[1]); //check for the .tvi file
-    exit(1);
+  f = open_memstream(&b->out, &b->len);
+  if(f==NULL){ fprintf(stderr,"Out of memory for output\n"); exit(1); }
+  tvirdblock(j->rd, j->k0+k, &s);
+  while(tvirdnext(&s, x, 3)){
+    mtime=x[0]; voltage=x[1]; current=x[2];
+    dt=mtime-lastmtime;
+    lastmtime=mtime;
+    if(cntr>0){
+      if(current>0.00){ein+=dt*current*voltage;}
+      else{eout-=dt*current*voltage;}
+      if(ein!=0){u=eout/ein;}else{u=0.00;}
+      fprintf(f, "%.3lf %.3lf \n", mtime, u);
+    }
+    cntr++;
   }
+  tvirdclose(&s);
+  fclose(f);
+  b->u=u;
+}
 
+void follow(char *fname, double idle){
+  struct tvifol f;
+  double x[3], mtime, voltage, current, lastmtime=0.00, dt;
+  double ein=0.00, eout=0.00, u=0.00;
+  long cntr=0;
 
-  cntr=0;
-  while(getline(&sline, &li, fileptr)>0 && sscanf(sline,"%le %le %le", &mtime, &voltage, &current)==3){
-    //while ( fscanf(fileptr, "%le %le %le", &mtime, &voltage, &current) != EOF) { 
+  if(tvifolopen(&f, fname, idle, stdout)) exit(1);
+  while(tvifolnext(&f, x, 3)){
+    mtime=x[0]; voltage=x[1]; current=x[2];
     dt=mtime-lastmtime;
     lastmtime=mtime;
-    q+= dt*current;
     if(cntr>0){
       if(current>0.00){ein+=dt*current*voltage;}
       else{eout-=dt*current*voltage;}
       if(ein!=0){u=eout/ein;}else{u=0.00;}
       printf("%.3lf %.3lf \n", mtime, u);
     }
-    cntr++; 
+    cntr++;
+  }
+  fflush(stdout);
+  fprintf(stderr,"total # lines = %ld; final u = %.3lf\n", cntr, u);
+  if(f.nbad) fprintf(stderr,"%ld lines skipped\n", f.nbad);
+  tvifolclose(&f);
+}
+
+int main(int argc, char *argv[]){
+  struct tvird rd;
+  struct blk *b;
+  struct job j;
+  double ein=0.00, eout=0.00, s, u=0.00;
+  long cntr=0, nb, k, k0, k1, nbad=0;
+  int nth;
+
+  opt66(&argc, argv);
+  nth = (opt66val('j')!=NULL)? atoi(opt66val('j')) : tviparcpu();
+  if ( argc != 2) {
+    fprintf(stderr,"tvi2u                  V3.3 CJD & JBS 2026\n");
+    fprintf(stderr,"Usage: tvi2u file.tvi[b|a] [-jN] [-f[s]] >file.tu\n");
+    fprintf(stderr,"Takes in a 3- or 5-col ascii file (or .tvib, .tvia) giving time, voltage, current,\n");
+    fprintf(stderr,"writes same time steps and device cycle efficiency to stdout.\n");
+    fprintf(stderr,"-jN: N threads, default all cores; the output does not depend on N.\n");
+    fprintf(stderr,"-f[s]: follow the file as it is written, until the writer closes it,\n");
+    fprintf(stderr,"s seconds (if given) pass with nothing new, or ^C.\n");
+    exit(1);
+  }
+
+  //	time(&t);
+  //	printf("%s", ctime(&t));
+
+  if(opt66on('f')){
+    follow(argv[1], (opt66val('f')!=NULL)? atof(opt66val('f')) : 0.00);
+    return(0);
+  }
+  if(tvirdopen(&rd, argv[1])) exit(1);	//mapped, parsed in place (tvird.h)
+  nb = tvirdnblk(&rd);
+  b = calloc(nb, sizeof(struct blk));
+  if(b==NULL){ fprintf(stderr,"Out of memory for blocks\n"); exit(1); }
+  j.rd=&rd; j.b=b;
+  tvipar(nth, nb, pass1, &j);
+  for(k=0;k<nb;k++){				// block sums -> totals at each block start
+    s=b[k].ein; b[k].ein=ein; ein+=s;
+    s=b[k].eout; b[k].eout=eout; eout+=s;
+    cntr+=b[k].n;
+    nbad+=b[k].nbad;
+  }
+  for(k0=0;k0<nb;k0=k1){			// a wave of blocks at a time, written in order
+    k1 = k0+WAVE*(nth>1? nth : 1);
+    if(k1>nb) k1=nb;
+    j.k0=k0;
+    tvipar(nth, k1-k0, pass2, &j);
+    for(k=k0;k<k1;k++){
+      fwrite(b[k].out, 1, b[k].len, stdout);
+      free(b[k].out);
+      if(b[k].n>0 && (b[k].prev || b[k].n>1)) u=b[k].u;
+    }
   }
   fprintf(stderr,"total # lines = %ld; final u = %.3lf\n", cntr, u);
+  if(nbad) fprintf(stderr,"%ld lines skipped\n", nbad);
+  free(b);
+  tvirdclose(&rd);
 
   return(0);
 }
-
@@ -0,0 +1,421 @@
+// tvia.h: columnar compressed archive (.tvia) of t V I records, streaming writer & block reader
+// stand-alone, usable by the acquisition programs and the analysis tools; the writer
+// is there only with _GNU_SOURCE (fopencookie) defined before the first #include
+// JBS & CJD 2026
+//
+// Records go into blocks of up to TVIABLK samples or TVIASPAN seconds, so a
+// crash loses at most the block in hand.  Within a block each column is stored
+// on its own: values are rounded to the column's quantum (the header keeps it,
+// set below the instrument's resolution; a decimal one such as 1e-6 is undone
+// by dividing by 1e6, so a value of 6 decimals or fewer comes back as the very
+// double its text parses to) and stored as zigzag varints, time as
+// delta-of-delta (a steady sample interval costs one byte) and V, I, Ah, cycle
+// as deltas.  A column with a quantum of 0, or a block where a value will not
+// quantise (inf, nan, overflow), is stored losslessly instead: each double
+// XORed with the last and only its nonzero middle bytes kept.  Every block
+// header carries its sample count and each column's min & max (the first is
+// the time span), so a reader can skip to a time, or past blocks it has no use
+// for, without decoding them.  tviacreate() returns a FILE that takes the same
+// native-double records as a .tvib (tvibput(), the sample ring), so it is a
+// drop-in sink for the acquisition programs; fclose() writes the last block.
+
+#ifndef TVIA_H
+#define TVIA_H
+
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
+#include	<stdint.h>
+#include	<math.h>
+#include	<time.h>
+#include	<fcntl.h>
+#include	<unistd.h>
+#include	<sys/types.h>
+#include	<sys/mman.h>
+#include	<sys/stat.h>
+#include	"tvib.h"
+
+#define TVIAMAGIC "TVIA"
+#define TVIABMAGIC "TVAB"
+#define TVIAVER 1
+#define TVIAHDR 1024			// header bytes, blocks start here
+#define TVIABLK 4096			// samples per block at most
+#define TVIASPAN 60.0			// s of samples per block at most
+#define TVIAQMAX 4.0e18			// largest |x/q| quantised
+
+struct tviahdr {
+	char magic[4];				// "TVIA"
+	uint32_t bom;				// TVIBBOM as written
+	uint16_t version, hdrsize;
+	uint16_t ncol, spare;
+	int64_t tstart;				// run start, unix seconds
+	double q[TVIBMAXCOL];		// quantum of each column, 0 lossless
+	char cols[64];				// column names, e.g. "t V I"
+	char prog[64];				// program & version
+	char args[TVIAHDR-216];		// command line
+};
+
+struct tviablk {				// block header, payload follows
+	char magic[4];				// "TVAB"
+	uint32_t n, bytes;			// samples, payload bytes
+	uint32_t ncol;
+	double min[TVIBMAXCOL], max[TVIBMAXCOL];	// of each column as stored
+};
+
+// ---------------- encoding ----------------
+double tviadiv(double q)		// 1/q when q is 1/integer (1e-6...), else 0
+{
+	double s;
+
+	if(q<=0.0 || q>=1.0) return 0.0;
+	s = round(1.0/q);
+	return (fabs(s*q-1.0)<1e-12)? s : 0.0;
+}
+
+double tviaval(int64_t v, double q, double s)	// v quanta back to a value
+{
+	return (s>0.0)? v/s : v*q;		// v/1e6 is the double of the decimal, v*1e-6 may not be
+}
+
+uint64_t tviazz(int64_t x){ return ((uint64_t)x<<1)^(uint64_t)(x>>63); }
+int64_t tviaunzz(uint64_t u){ return (int64_t)(u>>1)^-(int64_t)(u&1); }
+
+unsigned char *tviaput(unsigned char *p, int64_t x)	// zigzag varint
+{
+	uint64_t u=tviazz(x);
+
+	while(u>=0x80){ *p++ = (u&0x7f)|0x80; u>>=7; }
+	*p++ = u;
+	return p;
+}
+
+unsigned char *tviaget(unsigned char *p, unsigned char *e, int64_t *x)	// NULL if past e
+{
+	uint64_t u=0;
+	int s=0;
+
+	do{
+		if(p>=e || s>63) return NULL;
+		u |= (uint64_t)(*p&0x7f)<<s;
+		s += 7;
+	}while(*p++&0x80);
+	*x = tviaunzz(u);
+	return p;
+}
+
+int tviaquant(double *x, int n, int ncol, int c, double q)	// will column c quantise?
+{
+	int k;
+
+	if(q<=0.0) return 0;
+	for(k=0;k<n;k++) if(!(fabs(x[k*ncol+c]/q)<TVIAQMAX)) return 0;	// catches nan too
+	return 1;
+}
+
+// n records of ncol into one block at p (header + payload); returns its bytes
+size_t tviaenc(double *x, int n, int ncol, double *q, unsigned char *p)
+{
+	struct tviablk *h=(struct tviablk *)p;
+	unsigned char *o=p+sizeof(struct tviablk), *s;
+	int64_t v, last=0, dlast=0;
+	uint64_t b, bl=0, d;
+	double y, sc;
+	int c, k, lz, tz;
+
+	memset(h,0,sizeof(*h));
+	memcpy(h->magic,TVIABMAGIC,4);
+	h->n=n; h->ncol=ncol;
+	for(c=0;c<ncol;c++){
+		h->min[c]=1e300; h->max[c]=-1e300;
+		if(tviaquant(x,n,ncol,c,q[c])){
+			*o++ = 0;									// quantised deltas
+			sc = tviadiv(q[c]);
+			for(k=0;k<n;k++){
+				v = llround((sc>0.0)? x[k*ncol+c]*sc : x[k*ncol+c]/q[c]);
+				if(k==0) o=tviaput(o,v);
+				else if(c==0 && k>1) o=tviaput(o,(v-last)-dlast);	// time: delta of delta
+				else o=tviaput(o,v-last);
+				if(k>0) dlast=v-last;
+				last=v;
+				y = tviaval(v,q[c],sc);
+				if(y<h->min[c]) h->min[c]=y;
+				if(y>h->max[c]) h->max[c]=y;
+			}
+		}else{
+			*o++ = 1;									// lossless, XOR with the last
+			for(k=0;k<n;k++){
+				y = x[k*ncol+c];
+				memcpy(&b,&y,8);
+				d = b^bl; bl=b;
+				if(y<h->min[c]) h->min[c]=y;			// nan never counts
+				if(y>h->max[c]) h->max[c]=y;
+				if(d==0){ *o++ = 0xff; continue; }
+				for(lz=0;lz<7 && !(d>>(56-8*lz)&0xff);lz++);
+				for(tz=0;tz<7 && !(d>>(8*tz)&0xff);tz++);
+				*o++ = lz<<4|tz;
+				for(s=o,d>>=8*tz;s<o+8-lz-tz;s++,d>>=8) *s = d&0xff;
+				o = s;
+			}
+		}
+	}
+	h->bytes = o-(p+sizeof(struct tviablk));
+	return o-p;
+}
+
+// block at h into n*ncol doubles; 0 if OK, -1 if it does not decode
+int tviadec(struct tviablk *h, double *q, double *x)
+{
+	unsigned char *p=(unsigned char *)(h+1), *e=p+h->bytes;
+	int64_t v=0, d=0, dd;
+	uint64_t b=0, m;
+	double y, sc;
+	int c, k, lz, tz, j, ncol=h->ncol, n=h->n;
+
+	for(c=0;c<ncol;c++){
+		if(p>=e) return -1;
+		if(*p++==0){
+			sc = tviadiv(q[c]);
+			for(k=0;k<n;k++){
+				if((p=tviaget(p,e,&dd))==NULL) return -1;
+				if(k==0) v=dd;
+				else if(c==0 && k>1){ d+=dd; v+=d; }
+				else{ d=dd; v+=d; }
+				x[k*ncol+c] = tviaval(v,q[c],sc);
+			}
+		}else{
+			for(k=0;k<n;k++){
+				if(p>=e) return -1;
+				if(*p==0xff){ p++; memcpy(&y,&b,8); x[k*ncol+c]=y; continue; }
+				lz = *p>>4; tz = *p++&15;
+				if(lz+tz>7 || p+8-lz-tz>e) return -1;
+				for(m=0,j=8-lz-tz-1;j>=0;j--) m = m<<8|p[j];
+				p += 8-lz-tz;
+				b ^= m<<(8*tz);
+				memcpy(&y,&b,8);
+				x[k*ncol+c] = y;
+			}
+		}
+	}
+	return 0;
+}
+
+// ---------------- writing ----------------
+#ifdef _GNU_SOURCE
+struct tviaw {					// the FILE's state
+	FILE *f;
+	struct tviahdr h;
+	double *x;					// records of the block in hand
+	int n;
+	unsigned char part[TVIBMAXCOL*sizeof(double)];	// record written so far
+	size_t npart, recsize;
+	unsigned char *out;
+};
+
+void tviaquanta(char *cols, int ncol, double *q)	// defaults by column name
+{
+	char c[64], *s, *save=NULL;
+	int k;
+
+	strncpy(c,cols,63); c[63]='\0';
+	for(k=0,s=strtok_r(c," ",&save);k<ncol;k++,s=(s!=NULL)? strtok_r(NULL," ",&save) : NULL){
+		if(s==NULL) q[k]=0.0;
+		else if(!strcmp(s,"t")) q[k]=1e-6;			// us
+		else if(!strcmp(s,"V")) q[k]=1e-6;			// uV
+		else if(!strcmp(s,"I") || !strcmp(s,"Ah")) q[k]=1e-9;	// nA, nAh
+		else if(!strcmp(s,"cyc")) q[k]=1.0;
+		else q[k]=0.0;
+	}
+}
+
+int tviaflush(struct tviaw *w)	// the block in hand out
+{
+	size_t len;
+
+	if(w->n==0) return 0;
+	len = tviaenc(w->x,w->n,w->h.ncol,w->h.q,w->out);
+	w->n=0;
+	if(fwrite(w->out,1,len,w->f)!=len) return -1;
+	return fflush(w->f);
+}
+
+ssize_t tviawrite(void *cookie, const char *buf, size_t size)
+{
+	struct tviaw *w=cookie;
+	size_t k, ncol=w->h.ncol;
+	double *r;
+
+	for(k=0;k<size;k++){
+		w->part[w->npart++] = buf[k];
+		if(w->npart<w->recsize) continue;
+		w->npart=0;
+		r = w->x+w->n*ncol;
+		memcpy(r,w->part,w->recsize);
+		if(w->n>0 && (w->n>=TVIABLK || r[0]-w->x[0]>=TVIASPAN)){	// this record starts the next block
+			if(tviaflush(w)) return -1;
+			memcpy(w->x,w->part,w->recsize);
+		}
+		w->n++;
+	}
+	return size;
+}
+
+int tviaclosefn(void *cookie)
+{
+	struct tviaw *w=cookie;
+	int bad;
+
+	bad = tviaflush(w);
+	if(fclose(w->f)) bad=-1;
+	free(w->x); free(w->out); free(w);
+	return bad;
+}
+
+// open a .tvia for writing; q[] the quantum per column (NULL: by name, tviaquanta(),
+// zeros: lossless); the FILE takes ncol-double records; NULL on failure
+FILE *tviacreate(char *fname, int ncol, char *cols, double *q, char *prog, int argc, char **argv, time_t tstart)
+{
+	cookie_io_functions_t io={NULL,tviawrite,NULL,tviaclosefn};
+	struct tviaw *w;
+	FILE *f;
+	int k;
+
+	if(ncol<1 || ncol>TVIBMAXCOL) return NULL;
+	w = calloc(1,sizeof(*w));
+	if(w==NULL) return NULL;
+	w->x = malloc((TVIABLK+1)*ncol*sizeof(double));
+	w->out = malloc(sizeof(struct tviablk)+ncol+(size_t)TVIABLK*ncol*10);
+	w->f = fopen(fname,"wb");
+	if(w->x==NULL || w->out==NULL || w->f==NULL){
+		if(w->f!=NULL) fclose(w->f);
+		free(w->x); free(w->out); free(w);
+		return NULL;
+	}
+	memcpy(w->h.magic,TVIAMAGIC,4);
+	w->h.bom = TVIBBOM;
+	w->h.version = TVIAVER; w->h.hdrsize = TVIAHDR;
+	w->h.ncol = ncol;
+	w->h.tstart = tstart;
+	if(q!=NULL) memcpy(w->h.q,q,ncol*sizeof(double));
+	else tviaquanta(cols,ncol,w->h.q);
+	strncpy(w->h.cols,cols,sizeof(w->h.cols)-1);
+	strncpy(w->h.prog,prog,sizeof(w->h.prog)-1);
+	for(k=0;k<argc;k++){
+		if(strlen(w->h.args)+strlen(argv[k])+2>=sizeof(w->h.args)) break;
+		if(k) strcat(w->h.args," ");
+		strcat(w->h.args,argv[k]);
+	}
+	w->recsize = ncol*sizeof(double);
+	if(fwrite(&w->h,sizeof(w->h),1,w->f)!=1){ fclose(w->f); free(w->x); free(w->out); free(w); return NULL; }
+	f = fopencookie(w,"w",io);
+	if(f==NULL){ fclose(w->f); free(w->x); free(w->out); free(w); }
+	return f;
+}
+#endif
+
+// ---------------- reading ----------------
+struct tviaix {
+	size_t off;					// block header's offset
+	long k0;					// its first record
+};
+
+struct tvia {
+	struct tviahdr *h;
+	size_t size;				// bytes mapped
+	int ncol;
+	long n, nblk;				// records, blocks
+	struct tviaix *ix;
+};
+
+int istvia(char *fname)
+{
+	char m[4];
+	FILE *f=fopen(fname,"rb");
+	int yes;
+
+	if(f==NULL) return 0;
+	yes = fread(m,1,4,f)==4 && !memcmp(m,TVIAMAGIC,4);
+	fclose(f);
+	return yes;
+}
+
+// map a .tvia and walk its block headers; 0 if OK, else prints why and returns -1
+int tviaopen(struct tvia *a, char *fname)
+{
+	struct stat st;
+	struct tviablk *b;
+	size_t off;
+	long max=0;
+	int fd;
+
+	memset(a,0,sizeof(*a));
+	fd = open(fname,O_RDONLY);
+	if(fd<0 || fstat(fd,&st)<0){fprintf(stderr,"Cannot open %s\n",fname); if(fd>=0) close(fd); return -1;}
+	if(st.st_size<(off_t)sizeof(struct tviahdr)){fprintf(stderr,"%s too short for .tvia\n",fname); close(fd); return -1;}
+	a->size = st.st_size;
+	a->h = mmap(NULL,a->size,PROT_READ,MAP_SHARED,fd,0);
+	close(fd);
+	if(a->h==MAP_FAILED){fprintf(stderr,"Cannot map %s\n",fname); a->h=NULL; return -1;}
+	if(memcmp(a->h->magic,TVIAMAGIC,4) || a->h->bom!=TVIBBOM || a->h->version>TVIAVER ||
+			a->h->ncol<1 || a->h->ncol>TVIBMAXCOL){
+		fprintf(stderr,"%s: not a .tvia this build can read (version/byte order)\n",fname);
+		munmap(a->h,a->size); a->h=NULL;
+		return -1;
+	}
+	a->ncol = a->h->ncol;
+	for(off=a->h->hdrsize;off+sizeof(struct tviablk)<=a->size;off+=sizeof(struct tviablk)+b->bytes){
+		b = (struct tviablk *)((char *)a->h+off);
+		if(memcmp(b->magic,TVIABMAGIC,4) || b->ncol!=(uint32_t)a->ncol || b->n>TVIABLK ||
+			off+sizeof(struct tviablk)+b->bytes>a->size) break;	// a torn last block is ignored
+		if(a->nblk>=max){
+			max = 2*max+256;
+			a->ix = realloc(a->ix,max*sizeof(struct tviaix));
+			if(a->ix==NULL){fprintf(stderr,"Out of memory for %s\n",fname); munmap(a->h,a->size); a->h=NULL; return -1;}
+		}
+		a->ix[a->nblk].off=off; a->ix[a->nblk].k0=a->n;
+		a->nblk++;
+		a->n += b->n;
+	}
+	madvise(a->h,a->size,MADV_SEQUENTIAL);
+	return 0;
+}
+
+struct tviablk *tviablock(struct tvia *a, long b)	// header of block b: n, min, max
+{
+	return (struct tviablk *)((char *)a->h+a->ix[b].off);
+}
+
+int tviaread(struct tvia *a, long b, double *x)		// block b into x (TVIABLK*ncol); 0 if OK
+{
+	return tviadec(tviablock(a,b),a->h->q,x);
+}
+
+long tviaseek(struct tvia *a, long k)			// block holding record k
+{
+	long lo=0, hi=a->nblk-1, m;
+
+	while(lo<hi){
+		m = (lo+hi+1)/2;
+		if(a->ix[m].k0<=k) lo=m; else hi=m-1;
+	}
+	return lo;
+}
+
+long tviafind(struct tvia *a, double t)			// first block that reaches time t
+{
+	long lo=0, hi=a->nblk, m;
+
+	while(lo<hi){
+		m = (lo+hi)/2;
+		if(tviablock(a,m)->max[0]<t) lo=m+1; else hi=m;
+	}
+	return lo;
+}
+
+void tviaclose(struct tvia *a)
+{
+	if(a->h!=NULL) munmap(a->h,a->size);
+	free(a->ix);
+	a->h=NULL; a->ix=NULL;
+}
+
+#endif
@@ -0,0 +1,134 @@
+// tvib.h: binary time-volts-amps files (.tvib), writer and mmap reader
+// stand-alone, usable by the acquisition programs and the analysis tools
+// JBS & CJD 2026
+//
+// A .tvib file is a TVIBHDR-byte header followed by fixed-width records of
+// ncol native doubles: t V I for the multitone/arbitrary programs, and
+// t V I Ah cycle for bcp66.  The header carries the format version, the
+// column names, the program, its command line and the start time, so a run
+// can be identified without its .log.  Records are host byte order (the
+// header holds a byte-order mark, readers refuse a mismatch).
+
+#ifndef TVIB_H
+#define TVIB_H
+
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
+#include	<stdint.h>
+#include	<time.h>
+#include	<fcntl.h>
+#include	<unistd.h>
+#include	<sys/mman.h>
+#include	<sys/stat.h>
+
+#define TVIBMAGIC "TVIB"
+#define TVIBVER 1
+#define TVIBHDR 1024			// header bytes, records start here
+#define TVIBBOM 0x01020304		// byte-order mark
+#define TVIBMAXCOL 8
+
+struct tvibhdr {
+	char magic[4];				// "TVIB"
+	uint32_t bom;				// TVIBBOM as written
+	uint16_t version, hdrsize;	// format version, offset of first record
+	uint16_t ncol, recsize;		// doubles per record, bytes per record
+	int64_t tstart;				// run start, unix seconds
+	char cols[64];				// column names, e.g. "t V I Ah cyc"
+	char prog[64];				// program & version
+	char args[TVIBHDR-152];		// command line (run parameters)
+};
+
+// ---------------- writing ----------------
+// open a .tvib for writing and put the header out; NULL on failure
+FILE *tvibcreate(char *fname, int ncol, char *cols, char *prog, int argc, char **argv, time_t tstart)
+{
+	struct tvibhdr h;
+	FILE *f;
+	int k;
+
+	if(ncol<1 || ncol>TVIBMAXCOL) return NULL;
+	f = fopen(fname,"wb");
+	if(f==NULL) return NULL;
+	memset(&h,0,sizeof(h));
+	memcpy(h.magic,TVIBMAGIC,4);
+	h.bom = TVIBBOM;
+	h.version = TVIBVER; h.hdrsize = TVIBHDR;
+	h.ncol = ncol; h.recsize = ncol*sizeof(double);
+	h.tstart = tstart;
+	strncpy(h.cols,cols,sizeof(h.cols)-1);
+	strncpy(h.prog,prog,sizeof(h.prog)-1);
+	for(k=0;k<argc;k++){
+		if(strlen(h.args)+strlen(argv[k])+2>=sizeof(h.args)) break;
+		if(k) strcat(h.args," ");
+		strcat(h.args,argv[k]);
+	}
+	if(fwrite(&h,sizeof(h),1,f)!=1){fclose(f); return NULL;}
+	return f;
+}
+
+int tvibput(FILE *f, double *rec, int ncol)		// one record, 1 if written
+{
+	return fwrite(rec,sizeof(double),ncol,f)==(size_t)ncol;
+}
+
+// ---------------- reading ----------------
+struct tvib {
+	struct tvibhdr *h;
+	double *rec;				// first record
+	long n;						// # records
+	int ncol;
+	size_t size;				// bytes mapped
+};
+
+int istvib(char *fname)			// does the file start with the magic?
+{
+	char m[4];
+	FILE *f=fopen(fname,"rb");
+	int yes;
+
+	if(f==NULL) return 0;
+	yes = fread(m,1,4,f)==4 && !memcmp(m,TVIBMAGIC,4);
+	fclose(f);
+	return yes;
+}
+
+// map a .tvib read-only; 0 if OK, else prints why and returns -1
+int tvibopen(struct tvib *tb, char *fname)
+{
+	struct stat st;
+	int fd;
+
+	memset(tb,0,sizeof(*tb));
+	fd = open(fname,O_RDONLY);
+	if(fd<0 || fstat(fd,&st)<0){fprintf(stderr,"Cannot open %s\n",fname); if(fd>=0) close(fd); return -1;}
+	if(st.st_size<(off_t)sizeof(struct tvibhdr)){fprintf(stderr,"%s too short for .tvib\n",fname); close(fd); return -1;}
+	tb->size = st.st_size;
+	tb->h = mmap(NULL,tb->size,PROT_READ,MAP_SHARED,fd,0);
+	close(fd);
+	if(tb->h==MAP_FAILED){fprintf(stderr,"Cannot map %s\n",fname); tb->h=NULL; return -1;}
+	if(memcmp(tb->h->magic,TVIBMAGIC,4) || tb->h->bom!=TVIBBOM || tb->h->version>TVIBVER ||
+			tb->h->ncol<1 || tb->h->ncol>TVIBMAXCOL || tb->h->recsize!=tb->h->ncol*sizeof(double)){
+		fprintf(stderr,"%s: not a .tvib this build can read (version/byte order)\n",fname);
+		munmap(tb->h,tb->size); tb->h=NULL;
+		return -1;
+	}
+	tb->ncol = tb->h->ncol;
+	tb->rec = (double *)((char *)tb->h+tb->h->hdrsize);
+	tb->n = (tb->size-tb->h->hdrsize)/tb->h->recsize;	// a torn last record is ignored
+	madvise(tb->h,tb->size,MADV_SEQUENTIAL);
+	return 0;
+}
+
+double *tvibrec(struct tvib *tb, long k)	// k'th record, ncol doubles
+{
+	return tb->rec+k*tb->ncol;
+}
+
+void tvibclose(struct tvib *tb)
+{
+	if(tb->h!=NULL) munmap(tb->h,tb->size);
+	tb->h=NULL;
+}
+
+#endif
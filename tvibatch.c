@@ -0,0 +1,242 @@
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
+#include	<math.h>
+#include	<glob.h>
+#include	<dirent.h>
+#include	<time.h>
+#include	<sys/stat.h>
+#include	"getut.h"
+#include	"opt66.h"
+
+// getUTheta over a whole campaign, one summary line a file.  Every file is a
+// job on a work-stealing pool (tvipar.h); opening one puts a job for each of
+// its blocks to find the cycles (tvicyx.h, none if its .cyx is up to date),
+// the last of those puts jobs summing runs of cycles (getut.h), and the last
+// of those folds the cycles in order for the file's figures.  A big file so
+// becomes many jobs and small ones few, and an idle core steals whatever is
+// oldest on another's deque, so a mix of sizes keeps every core busy; the
+// figures are those getUTheta gives for the file, whatever the order.
+
+#define CYCSAMP (1L<<18)		// samples of cycles summed in one job
+
+struct file {
+  char *name;
+  struct tvird rd;
+  struct cyx x;
+  struct cyxjob cj;				// the index, block by block
+  long nblk;
+  struct acc *cy;				// sums of each cycle
+  long *grp, ngrp;				// first cycle of each job's run
+  long left;					// jobs of the stage in hand not yet done
+  pthread_mutex_t mx;
+  struct gut g;
+  double t0, t1;				// wall time opened, finished
+  int bad, indexed;
+};
+
+struct file *fl;
+long nf, ndone;
+double Rs, tstart;
+int savecyx;
+struct tvipool pool;
+pthread_mutex_t pmx=PTHREAD_MUTEX_INITIALIZER;
+
+double now(void){
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec+1e-9*ts.tv_nsec;
+}
+
+int done(struct file *f){			// one job of the stage finished; 1 if it was the last
+  int last;
+
+  pthread_mutex_lock(&f->mx);
+  last = (--f->left==0);
+  pthread_mutex_unlock(&f->mx);
+  return last;
+}
+
+void finish(struct file *f){
+  long k;
+
+  if(!f->bad){
+    gutinit(&f->g, Rs, 0, NULL, NULL);
+    for(k=0;k<f->x.h.ncyc;k++) gutcyc(&f->g, &f->cy[k], f->x.c[k].tstart, 1);
+    gutend(&f->g);
+    free(f->cy); free(f->grp);
+    tvirdclose(&f->rd);
+  }
+  f->t1=now();
+  pthread_mutex_lock(&pmx);
+  ndone++;
+  if(f->bad) fprintf(stderr, "[%ld/%ld %.1lfs] %s: not read\n", ndone, nf, f->t1-tstart, f->name);
+  else fprintf(stderr, "[%ld/%ld %.1lfs] %s: %ld cycles, %ld samples%s, %.2lfs\n", ndone, nf, f->t1-tstart,
+    f->name, (long)f->x.h.ncyc, (long)f->x.h.nsamp, f->indexed? " (.cyx)" : "", f->t1-f->t0);
+  pthread_mutex_unlock(&pmx);
+}
+
+void sumrun(void *arg, long k){	// cycles grp[k].. of a file
+  struct file *f=arg;
+  struct cyxrec *c;
+  long i;
+
+  for(i=f->grp[k];i<f->grp[k+1];i++){
+    c=&f->x.c[i];
+    sumcycle(&f->rd, c->pos, c->n, c->tstart, Rs, &f->cy[i]);
+  }
+  if(done(f)) finish(f);
+}
+
+void sumstitched(void *arg, long k){	// time goes back: the file in one pass
+  struct file *f=arg;
+
+  (void)k;					// one task, no part number
+  sumall(&f->rd, f->cy, f->x.h.ncyc, Rs, NULL);
+  finish(f);
+}
+
+void sums(struct file *f){			// the cycles are known: jobs to sum them
+  long k, n, m;
+
+  f->cy=calloc(f->x.h.ncyc+1, sizeof(struct acc));
+  f->grp=malloc((f->x.h.ncyc+2)*sizeof(long));
+  if(f->cy==NULL || f->grp==NULL){ fprintf(stderr, "Out of memory for cycles\n"); exit(1); }
+  if(f->x.h.ncyc==0){ finish(f); return; }
+  if(f->x.h.st.nseg>0){ tvipoolput(&pool, sumstitched, f, 0); return; }
+  for(m=0,n=0,k=0;k<f->x.h.ncyc;k++){
+    if(n==0) f->grp[m++]=k;
+    n+=f->x.c[k].n;
+    if(n>=CYCSAMP) n=0;
+  }
+  f->grp[m]=f->x.h.ncyc;
+  f->ngrp=f->left=m;
+  for(k=0;k<m;k++) tvipoolput(&pool, sumrun, f, k);
+}
+
+void index1(void *arg, long k){		// block k of a file's cycle index
+  struct file *f=arg;
+  char cname[512];
+
+  cyxpass(&f->cj, k);
+  if(!done(f)) return;
+  cyxjoin(&f->rd, f->cj.blk, f->nblk, &f->x);
+  if(savecyx){
+    cyxname(f->name, cname);
+    if(cyxsave(&f->x, cname, f->name)) fprintf(stderr, "Cannot write %s\n", cname);
+  }
+  sums(f);
+}
+
+void open1(void *arg, long k){
+  struct file *f=(struct file *)arg+k;
+  char cname[512];
+
+  f->t0=now();
+  if(strlen(f->name)>500 || tvirdopen(&f->rd, f->name)){ f->bad=1; finish(f); return; }
+  cyxname(f->name, cname);
+  if(cyxload(&f->x, cname, f->name)==0){ f->indexed=1; sums(f); return; }
+  f->cj.rd=&f->rd;
+  f->cj.blk=cyxblocks(&f->rd, &f->nblk);
+  f->left=f->nblk;
+  for(k=0;k<f->nblk;k++) tvipoolput(&pool, index1, f, k);
+}
+
+int istvi(char *name){				// .tvi, .tvib or .tvia
+  char *d=strrchr(name, '.');
+
+  return d!=NULL && (!strcmp(d, ".tvi") || !strcmp(d, ".tvib") || !strcmp(d, ".tvia"));
+}
+
+int bystr(const void *a, const void *b){
+  return strcmp(*(char **)a, *(char **)b);
+}
+
+void add(char *name){
+  static long max=0;
+
+  if(nf>=max){
+    max=2*max+256;
+    fl=realloc(fl, max*sizeof(struct file));
+    if(fl==NULL){ fprintf(stderr, "Out of memory for files\n"); exit(1); }
+  }
+  memset(&fl[nf], 0, sizeof(struct file));
+  fl[nf].name=strdup(name);
+  pthread_mutex_init(&fl[nf].mx, NULL);
+  nf++;
+}
+
+void adddir(char *dir){			// the records in a directory, in name order
+  DIR *d;
+  struct dirent *e;
+  char **v=NULL, path[1024];
+  long n=0, max=0, k;
+
+  if((d=opendir(dir))==NULL){ fprintf(stderr, "Cannot read %s\n", dir); return; }
+  while((e=readdir(d))!=NULL){
+    if(!istvi(e->d_name)) continue;
+    if(n>=max){ max=2*max+64; v=realloc(v, max*sizeof(char *)); if(v==NULL) exit(1); }
+    snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+    v[n++]=strdup(path);
+  }
+  closedir(d);
+  qsort(v, n, sizeof(char *), bystr);
+  for(k=0;k<n;k++){ add(v[k]); free(v[k]); }
+  free(v);
+}
+
+int main(int argc, char *argv[]){
+  struct stat st;
+  glob_t gl;
+  FILE *out=stdout;
+  struct file *f;
+  long k, i, nsamp=0;
+  int nth;
+
+  opt66(&argc, argv);
+  nth = (opt66val('j')!=NULL)? atoi(opt66val('j')) : tviparcpu();
+  Rs = (opt66val('R')!=NULL)? atof(opt66val('R')) : 0.00;
+  savecyx = opt66on('x');
+  if ( argc<2 ) {
+    fprintf(stderr,"tvibatch               V1.0 CJD & JBS 2026\n");
+    fprintf(stderr,"Usage: tvibatch dir|file|'glob' ... [-jN] [-RRs] [-x] [-osummary.txt]\n");
+    fprintf(stderr,"getUTheta's figures for every .tvi, .tvib and .tvia named, matched or in the\n");
+    fprintf(stderr,"directories given, one line a file to stdout (or -o): cycles settled, mean u,\n");
+    fprintf(stderr,"its variance, whole-file U, total dQ (Ah), mean alpha, cycles, samples, seconds.\n");
+    fprintf(stderr,"Big files are cut into blocks and runs of cycles, all shared out on N threads\n");
+    fprintf(stderr,"(default all cores); progress and each file's time go to stderr.\n");
+    fprintf(stderr,"-RRs: series resistance.  -x: write each file's .cyx cycle index (tvicyx).\n");
+    exit(1);
+  }
+  for(k=1;k<argc;k++){
+    if(stat(argv[k], &st)==0 && S_ISDIR(st.st_mode)){ adddir(argv[k]); continue; }
+    if(glob(argv[k], GLOB_NOCHECK, NULL, &gl)==0){
+      for(i=0;i<(long)gl.gl_pathc;i++) add(gl.gl_pathv[i]);
+      globfree(&gl);
+    }
+  }
+  if(nf==0){ fprintf(stderr, "No files\n"); exit(1); }
+  if(opt66val('o')!=NULL && (out=fopen(opt66val('o'), "w"))==NULL){
+    fprintf(stderr, "Cannot write %s\n", opt66val('o')); exit(1);
+  }
+
+  tstart=now();
+  tvipoolinit(&pool, nth);
+  for(k=nf-1;k>=0;k--) tvipoolput(&pool, open1, fl, k);	// the first file on top
+  tvipoolrun(&pool);
+  fprintf(out, "# file settled mean_u var_u U dQ_Ah alpha cycles samples seconds\n");
+  for(k=0;k<nf;k++){
+    f=&fl[k];
+    if(f->bad){ fprintf(out, "%s - - - - - - - - -\n", f->name); continue; }
+    fprintf(out, "%s %d %.6lf %.3e %.4lf %.4e %.4lf %ld %ld %.3lf\n", f->name, f->g.ucount, f->g.umean, f->g.uVar,
+      f->g.U, f->g.totQ/3600, f->g.alpha, (long)f->x.h.ncyc, (long)f->x.h.nsamp, f->t1-f->t0);
+    nsamp+=f->x.h.nsamp;
+    cyxfree(&f->x);
+  }
+  if(out!=stdout) fclose(out);
+  fprintf(stderr, "%ld files, %ld samples in %.2lfs on %d threads, %ld jobs (%ld stolen)\n",
+    nf, nsamp, now()-tstart, pool.nth, pool.nput, pool.nsteal);
+  tvipoolfree(&pool);
+  return 0;
+}
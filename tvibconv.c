@@ -0,0 +1,97 @@
+#define _GNU_SOURCE				// the .tvia writer (tvia.h)
+#include	<time.h>
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
+#include	"tvib.h"
+#include	"tvia.h"
+#include	"tvird.h"
+#include	"opt66.h"
+
+// text .tvi <-> binary .tvib <-> archive .tvia; input kind from its magic, output
+// from its name (.tvib, .tvia), else text from a .tvib/.tvia and .tvib from text
+
+int outkind(char *fname)			// 1 .tvib, 2 .tvia, 0 neither
+{
+  size_t len=strlen(fname);
+
+  if(len>5 && !strcmp(fname+len-5,".tvib")) return 1;
+  if(len>5 && !strcmp(fname+len-5,".tvia")) return 2;
+  return 0;
+}
+
+int main(int argc, char *argv[]){
+  FILE *out=NULL;
+  struct tvird rd, part, *in=&rd;
+  char cols[64], *w;
+  double x[TVIBMAXCOL], q[TVIBMAXCOL], t0=-1e300, t1=1e300;
+  long k=0, nbad=0, b;
+  int n, ncol=0, kind;
+  time_t tnow;
+
+  opt66(&argc, argv);
+  if ( argc != 3) {
+    fprintf(stderr,"tvibconv               V1.1 CJD & JBS 2026\n");
+    fprintf(stderr,"Usage: tvibconv in.tvi[b|a] out.tvi[b|a] [-l] [-tA:B]\n");
+    fprintf(stderr,"Converts 3-col (t V I) or 5-col (t V I Ah cyc) ascii tvi files to\n");
+    fprintf(stderr,"binary .tvib or archive .tvia (tvia.h) and back; a .tvib or .tvia input\n");
+    fprintf(stderr,"is recognised by its header, which is also listed on stderr.  The output\n");
+    fprintf(stderr,"is .tvib or .tvia by its name, else text from a .tvib/.tvia, .tvib from text.\n");
+    fprintf(stderr,"-l: .tvia lossless (default t & V to 1e-6, I & Ah to 1e-9).\n");
+    fprintf(stderr,"-tA:B: only samples with A<=t<B (a .tvia input is read only where they are).\n");
+    exit(1);
+  }
+  if(opt66val('t')!=NULL){
+    w = strchr(opt66val('t'),':');
+    if(*opt66val('t')!=':') t0 = atof(opt66val('t'));
+    if(w!=NULL && w[1]) t1 = atof(w+1);
+  }
+
+  if(tvirdopen(&rd,argv[1])) exit(1);
+  if(rd.bin){
+    tnow=rd.tb.h->tstart;
+    fprintf(stderr,"%s: %s, %ld records of [%s], started %s  %s\n",
+      argv[1],rd.tb.h->prog,rd.tb.n,rd.tb.h->cols,ctime(&tnow),rd.tb.h->args);
+  }
+  if(rd.arch){
+    tnow=rd.ta.h->tstart;
+    fprintf(stderr,"%s: %s, %ld records of [%s] in %ld blocks, %.1lf bytes each, started %s  %s\n",
+      argv[1],rd.ta.h->prog,rd.ta.n,rd.ta.h->cols,rd.ta.nblk,
+      rd.ta.n? (double)(rd.ta.size-rd.ta.h->hdrsize)/rd.ta.n : 0.0,ctime(&tnow),rd.ta.h->args);
+    if(opt66val('t')!=NULL){					// skip the blocks outside [A,B)
+      b = tviafind(&rd.ta,t1);
+      tvirdpart(&rd,rd.ta.ix[tviafind(&rd.ta,t0)].k0,(b+1<rd.ta.nblk)? rd.ta.ix[b+1].k0 : rd.ta.n,&part);
+      in=&part;
+    }
+  }
+  kind = outkind(argv[2]);
+  if(kind==0 && !rd.bin && !rd.arch) kind=1;
+
+  while((n=tvirdnext(in,x,5))>0){
+    if(out==NULL){						// first record decides the width
+      ncol = (n>=5)? 5 : 3;
+      strcpy(cols,(ncol==5)?"t V I Ah cyc":"t V I");
+      if(rd.bin) strcpy(cols,rd.tb.h->cols);
+      if(rd.arch) strcpy(cols,rd.ta.h->cols);
+      memset(q,0,sizeof(q));
+      if(kind==1) out = tvibcreate(argv[2],ncol,cols,"tvibconv 1.1",opt66argc,opt66argv,time(NULL));
+      else if(kind==2) out = tviacreate(argv[2],ncol,cols,opt66on('l')? q : NULL,"tvibconv 1.1",opt66argc,opt66argv,time(NULL));
+      else out = fopen(argv[2],"w");
+      if(out==NULL){ fprintf(stderr,"Cannot create %s\n",argv[2]); exit(1); }
+    }
+    if(n<ncol){ nbad++; continue; }
+    if(x[0]<t0 || x[0]>=t1) continue;
+    if(kind) tvibput(out,x,ncol);
+    else if(ncol>=5) fprintf(out,"%.6lf %.9g %.9g  %.9g %.0lf\n",x[0],x[1],x[2],x[3],x[4]);
+    else fprintf(out,"%.6lf %.9g %.9g\n",x[0],x[1],x[2]);
+    k++;
+  }
+  if(out==NULL){ fprintf(stderr,"No t V I lines in %s\n",argv[1]); exit(1); }
+  if(fclose(out)){ fprintf(stderr,"Error writing %s\n",argv[2]); exit(1); }
+  nbad += in->nbad;
+  if(in!=&rd) tvirdclose(in);
+  tvirdclose(&rd);
+  if(nbad) fprintf(stderr,"%ld lines skipped.\n",nbad);
+  fprintf(stderr,"%ld records written.\n",k);
+  return 0;
+}
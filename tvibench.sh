@@ -0,0 +1,151 @@
+#!/bin/sh
+# tvibench.sh: throughput of the analysis tools on synthetic records (tvigen), against a baseline
+# JBS & CJD 2026
+#
+# For each size asked for, tvigen makes a cycling record (s), a multisine (m)
+# and a dense multisine of 500 tones (d), the same samples in each format, and
+# each tool is timed on them, the best of R runs: tvi2u, getUTheta, tviu,
+# tviica, tvicyx and tvibconv on the cycling record, the impedance paths (tviz,
+# DFT and -r fit) on the multisine and tviz -d, FFT, on the dense one.
+# A line a run: samples, MB, seconds, samples/s and MB/s, then the baseline's
+# samples/s for the same tool, format and size and the ratio; one under 1-tol
+# is marked SLOWER and the exit status is 1.  The last column checks the tool's
+# answer against tvigen's (u, U or worst |Z| & phase).  -w saves the run into
+# the baseline, keeping what it had for tools, formats and sizes not run.  No
+# baseline is shipped, as rates are the machine's own: the first run on a
+# machine is made with -w.
+
+usage(){
+  cat >&2 <<EOF
+tvibench.sh            V1.0 CJD & JBS 2026
+Usage: tvibench.sh [-s 20M,200M,2G] [-f tvi,tvib,tvia] [-t tools] [-r R] [-j N]
+                   [-b baseline] [-w] [-l tol] [-B bindir] [-d workdir] [-k]
+Times the analysis tools on tvigen records of each size (bytes of text, 20M),
+in each format (tvi), the best of R runs (3), on N threads (all cores).
+tools: tvi2u getUTheta tviu tviica tvicyx tvibconv tviz tvizfit tvizfft (all).
+Compares samples/s with the baseline file (tvibench.base), SLOWER if under
+1-tol of it (0.1), and checks each answer against tvigen's.  -w: save the run
+as the baseline; there is none until a first run with -w on this machine.  Tools from bindir (this script's directory), records in
+workdir (\$TMPDIR/tvibench.PID), removed after unless -k.
+EOF
+  exit 1
+}
+
+SIZES=20M
+FMTS=tvi
+TOOLS="tvi2u getUTheta tviu tviica tvicyx tvibconv tviz tvizfit tvizfft"
+R=3
+N=$(getconf _NPROCESSORS_ONLN 2>/dev/null || echo 1)
+BASE=tvibench.base
+SAVE=0
+TOL=0.1
+B=$(dirname "$0")
+W=${TMPDIR:-/tmp}/tvibench.$$
+KEEP=0
+while getopts s:f:t:r:j:b:wl:B:d:kh o; do
+  case $o in
+    s) SIZES=$OPTARG ;;
+    f) FMTS=$OPTARG ;;
+    t) TOOLS=$OPTARG ;;
+    r) R=$OPTARG ;;
+    j) N=$OPTARG ;;
+    b) BASE=$OPTARG ;;
+    w) SAVE=1 ;;
+    l) TOL=$OPTARG ;;
+    B) B=$OPTARG ;;
+    d) W=$OPTARG ;;
+    k) KEEP=1 ;;
+    *) usage ;;
+  esac
+done
+shift $((OPTIND-1))
+[ $# -eq 0 ] || usage
+for t in tvigen $TOOLS; do
+  case $t in tvizfit|tvizfft) t=tviz ;; esac
+  [ -x "$B/$t" ] || { echo "No $B/$t (built?)" >&2; exit 1; }
+done
+mkdir -p "$W" || exit 1
+[ $KEEP -eq 1 ] || trap 'rm -rf "$W"' EXIT
+trap 'exit 1' INT TERM
+
+now(){ date +%s.%N; }
+
+# the tools as timed, on record $1
+run_tvi2u(){ "$B/tvi2u" "$1" -j"$N"; }
+run_getUTheta(){ rm -f "${1%.*}.cyx"; "$B/getUTheta" "$1" -j"$N"; }
+run_tviu(){ "$B/tviu" "$1"; }
+run_tviica(){ "$B/tviica" "$1" -j"$N"; }
+run_tvicyx(){ rm -f "${1%.*}.cyx"; "$B/tvicyx" "$1" -j"$N"; }
+run_tvibconv(){ case $1 in *.tvi) "$B/tvibconv" "$1" "$W/conv.tvib" ;; *) "$B/tvibconv" "$1" "$W/conv.tvi" ;; esac; }
+run_tviz(){ "$B/tviz" "$1" -a"${1%.*}.ans"; }
+run_tvizfit(){ "$B/tviz" "$1" -a"${1%.*}.ans" -r; }
+run_tvizfft(){ "$B/tviz" "$1" -a"${1%.*}.ans" -d; }
+
+best(){		# T: the least wall time of R runs of tool $1 on $2; its output in $W/out & $W/err
+  T=
+  i=0
+  while [ $i -lt "$R" ]; do
+    t0=$(now)
+    if ! run_$1 "$2" >"$W/out" 2>"$W/err"; then
+      echo "$1 $2 failed:" >&2; cat "$W/err" >&2; T=; return 1
+    fi
+    t1=$(now)
+    T=$(awk -v a="$t0" -v b="$t1" -v t="$T" 'BEGIN{ d=b-a; if(t=="" || d<t+0) t=d; printf "%.4f", t }')
+    i=$((i+1))
+  done
+}
+
+check(){	# the answer of tool $1 on $2 against tvigen's
+  a=${2%.*}.ans
+  case $1 in
+    tvi2u) echo "U $(sed -n 's/.*final u = \([^ ]*\).*/\1/p' "$W/err") ($(awk '/^U /{print $2}' "$a"))" ;;
+    getUTheta|tviu) echo "u $(sed -n 's/^Mean u = \([^,]*\),.*/\1/p' "$W/err") ($(awk '/^u /{print $2}' "$a"))" ;;
+    tviz|tvizfit|tvizfft) awk 'FNR==NR{ if($1=="z"){ zm[$2]=$3; zp[$2]=$4 } next }
+        ($1 in zm){ e=($2-zm[$1])/zm[$1]; if(e<0) e=-e; if(e>em) em=e
+          p=$3-zp[$1]; if(p<0) p=-p; if(p>pm) pm=p }
+        END{ printf "|Z| %.1e phase %.4f deg\n", em, pm }' "$a" "$W/out" ;;
+    *) echo - ;;
+  esac
+}
+
+b=$BASE
+[ -f "$b" ] || { b=/dev/null; [ $SAVE -eq 1 ] || echo "No baseline $BASE: run with -w first to make one" >&2; }
+printf "%-10s %-4s %-5s %10s %9s %8s %10s %8s %10s %6s  %s\n" tool fmt size samples MB seconds samples/s MB/s base ratio check
+: >"$W/res"
+slow=0
+for S in $(echo "$SIZES" | tr , ' '); do
+  "$B/tvigen" "$W/s$S.tvi" s -z"$S" 2>/dev/null || exit 1
+  "$B/tvigen" "$W/m$S.tvi" m -z"$S" 2>/dev/null || exit 1
+  "$B/tvigen" "$W/d$S.tvi" m -t500 -I0.02 -z"$S" 2>/dev/null || exit 1
+  for F in $(echo "$FMTS" | tr , ' '); do
+    for k in s m d; do			# the same samples in the other formats
+      [ "$F" = tvi ] && continue
+      n=$(awk '/^samples /{print $2}' "$W/$k$S.ans")
+      case $k in d) "$B/tvigen" "$W/d$S.$F" m -t500 -I0.02 -n"$n" ;; *) "$B/tvigen" "$W/$k$S.$F" $k -n"$n" ;; esac 2>/dev/null || exit 1
+    done
+    for t in $TOOLS; do
+      case $t in tviz|tvizfit) rec=$W/m$S.$F ;; tvizfft) rec=$W/d$S.$F ;; *) rec=$W/s$S.$F ;; esac
+      best $t "$rec" || { slow=1; continue; }
+      n=$(awk '/^samples /{print $2}' "${rec%.*}.ans")
+      mb=$(ls -l "$rec" | awk '{printf "%.1f", $5/1e6}')
+      ck=$(check $t "$rec")
+      echo "$t $F $S $n $mb $T" >>"$W/res"
+      awk -v t=$t -v f=$F -v s=$S -v n=$n -v mb=$mb -v T=$T -v tol=$TOL -v ck="$ck" '
+        BEGIN{ rate=(T>0)? n/T : 0; base="-"; ratio="-" }
+        $1==t && $2==f && $3==s{ base=$4 }
+        END{ if(base!="-"){ ratio=sprintf("%.2f", rate/base); if(rate<(1-tol)*base){ ratio=ratio " SLOWER"; st=1 } }
+          printf "%-10s %-4s %-5s %10d %9.1f %8.3f %10.0f %8.1f %10s %6s  %s\n", t, f, s, n, mb, T, rate, (T>0)? mb/T : 0, base, ratio, ck
+          exit st }' "$b" || slow=1
+    done
+    rm -f "$W"/conv.* "$W"/*.cyx "$W"/*.tu "$W"/*.txt "$W"/*.ica
+    [ "$F" = tvi ] || rm -f "$W/s$S.$F" "$W/m$S.$F" "$W/d$S.$F"
+  done
+  [ $KEEP -eq 1 ] || rm -f "$W/s$S.tvi" "$W/m$S.tvi" "$W/d$S.tvi"
+done
+if [ $SAVE -eq 1 ]; then		# this run's samples/s over the baseline's
+  { [ -f "$BASE" ] && cat "$BASE"; awk '{ printf "%s %s %s %.0f\n", $1, $2, $3, ($6>0)? $4/$6 : 0 }' "$W/res"; } |
+    awk '$1!~/^#/{ k=$1 " " $2 " " $3; if(!(k in v)) o[n++]=k; v[k]=$4 }
+      END{ print "# tool format size samples/s"; for(i=0;i<n;i++) print o[i], v[o[i]] }' >"$W/base" &&
+    cp "$W/base" "$BASE" && echo "Baseline saved in $BASE" >&2
+fi
+exit $slow
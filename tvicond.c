@@ -0,0 +1,93 @@
+#include	<time.h>
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
+#include	"tvib.h"
+#include	"fastnum.h"
+#include	"tvicond.h"
+
+// stitch, resample onto a uniform grid and summarise the time base of a .tvi/.tvib
+
+struct sink {
+  FILE *f;
+  int bin;
+};
+
+void put(void *arg, double t, double v, double i){
+  struct sink *s=arg;
+  double r[3];
+
+  if(s->bin){ r[0]=t; r[1]=v; r[2]=i; tvibput(s->f,r,3); }
+  else fprintf(s->f,"%.6lf %.9g %.9g\n",t,v,i);
+}
+
+void drop(void *arg, double t, double v, double i){ (void)arg; (void)t; (void)v; (void)i; }	// the statistics pass keeps nothing
+
+long feed(char *fname, struct tvicond *c){	// every t V I of the file through c, returns # lines skipped
+  struct tvib tb;
+  FILE *in;
+  char *sline=NULL;
+  size_t li;
+  double x[3], *r;
+  long k, nbad=0;
+
+  if(istvib(fname)){
+    if(tvibopen(&tb,fname)) exit(1);
+    for(k=0;k<tb.n;k++){ r=tvibrec(&tb,k); tvicput(c,r[0],r[1],r[2]); }
+    tvibclose(&tb);
+  }else{
+    in = fopen(fname,"rb");
+    if(in==NULL){ fprintf(stderr,"Cannot open .tvi file %s!\n",fname); exit(1); }
+    while(getline(&sline,&li,in)>0){
+      if(fastnums(sline,x,3)==3) tvicput(c,x[0],x[1],x[2]);
+      else nbad++;
+    }
+    free(sline);
+    fclose(in);
+  }
+  tvicend(c);
+  return nbad;
+}
+
+int main(int argc, char *argv[]){
+  static struct tvicond c;
+  struct sink s;
+  char buf[512];
+  double Ts, dt;
+  long nbad;
+  size_t len;
+
+  if ( argc<2 || argc>4) {
+    fprintf(stderr,"tvicond                V1.0 CJD & JBS 2026\n");
+    fprintf(stderr,"Usage: tvicond file.tvi[b]  or  tvicond file.tvi[b] out.tvi[b] [Ts]\n");
+    fprintf(stderr,"Conditions the time base of a t V I file (tvicond.h): where time goes back\n");
+    fprintf(stderr,"(files run together, a restarted run) the next segment is stitched on after\n");
+    fprintf(stderr,"the last sample; V & I are resampled onto a uniform Ts grid, by cubics through\n");
+    fprintf(stderr,"the samples and a Lanczos low-pass when Ts is coarser than the data\n");
+    fprintf(stderr,"(Ts omitted: the mean interval; Ts=0: stitch only, no resampling).\n");
+    fprintf(stderr,"dt statistics go to stderr; with no output file that is all it does.\n");
+    fprintf(stderr,"out.tvib is written binary (tvib.h), anything else as text.\n");
+    exit(1);
+  }
+
+  tvicinit(&c,0.0,0.0,drop,NULL);				// a first pass for the statistics, Ts & the hint
+  nbad = feed(argv[1],&c);
+  tvicstats(&c.st,buf);
+  fprintf(stderr,"%s: %s\n",argv[1],buf);
+  if(nbad) fprintf(stderr,"%ld lines skipped.\n",nbad);
+  if(argc==2) exit(0);
+  dt = tvicmean(&c.st);
+  Ts = (argc==4)? atof(argv[3]) : dt;
+
+  len = strlen(argv[2]);
+  s.bin = (len>5 && !strcmp(argv[2]+len-5,".tvib"));
+  if(s.bin) s.f = tvibcreate(argv[2],3,"t V I","tvicond 1.0",argc,argv,time(NULL));
+  else s.f = fopen(argv[2],"w");
+  if(s.f==NULL){ fprintf(stderr,"Cannot create %s\n",argv[2]); exit(1); }
+  tvicinit(&c,Ts,dt,put,&s);
+  nbad = feed(argv[1],&c);
+  fclose(s.f);
+  tvicstats(&c.st,buf);
+  fprintf(stderr,"%s -> %s: %s; %ld points on a %.6lfs grid\n",argv[1],argv[2],buf,c.nout,Ts);
+  return 0;
+}
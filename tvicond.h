@@ -0,0 +1,241 @@
+// tvicond.h: time-base conditioning for .tvi records, stitching, uniform resampling, dt statistics
+// stand-alone, usable by the acquisition programs and the analysis tools
+// JBS & CJD 2026
+//
+// Polled .tvi times are irregular, and files run together (or a restarted run)
+// go back in time.  tvicstitch() takes raw times in file order and returns a
+// monotonic time base: whenever time fails to advance a new segment is started
+// and shifted to follow on one interval after the last sample.  Every interval
+// goes into min/mean/max/sd and a log-spaced histogram (10 bins per decade from
+// 1us) for percentiles and gaps (intervals over TVICGAP times the mean, to the
+// histogram's resolution).  Sums are kept in whole ns, so the statistics of a
+// record read in pieces combine exactly, tvicmerge(), in any grouping.
+// tvicput() also resamples V & I, streaming, onto a uniform grid of
+// period Ts from the first sample.  A cubic through the four samples around each
+// point (a straight line across a gap) puts the data on a grid R times finer
+// than Ts, no coarser than the interval hint; when R>1 that grid is low-passed
+// to Ts by a Lanczos (windowed-sinc, TVICA lobes) kernel, which is exact on
+// uniform data, so thinning a record does not alias.  Grid points go to out();
+// Ts<=0 just passes the stitched samples on.
+
+#ifndef TVICOND_H
+#define TVICOND_H
+
+#include	<stdio.h>
+#include	<string.h>
+#include	<stdint.h>
+#include	<math.h>
+
+#define TVICBUF 65536			// fine grid points kept for the kernel, power of 2
+#define TVICA 3					// Lanczos lobes
+#define TVICBINS 100			// dt histogram, 10 per decade from 1us
+#define TVICGAP 3.0				// an interval this many times the mean is a gap
+
+struct tvicstat {				// stitching & interval statistics, small, mergeable
+	double off, tfirst, tlast, dtlast;	// offset of this segment, first & last time out, last interval
+	long n, nseg;				// samples, segments stitched on
+	double dtmin, dtmax;
+	int64_t dts;				// sum of intervals, ns
+	__int128 dts2;				// of their squares, ns^2
+	long ndt, hist[TVICBINS];
+};
+
+struct tvicond {
+	struct tvicstat st;
+	double Ts, t0, h;			// grid period (<=0: no resampling), origin, fine grid period
+	int R;						// fine points per grid point
+	double qt[4], qv[4], qi[4];	// last four samples, oldest first
+	int nq;
+	long m, k, nout;			// next fine point, next grid point, points out
+	double uv[TVICBUF], ui[TVICBUF];	// fine grid, index & (TVICBUF-1)
+	void (*out)(void *arg, double t, double v, double i);
+	void *arg;
+};
+
+// dt is the expected sample interval (mean from a first pass; <=0 if unknown)
+void tvicinit(struct tvicond *c, double Ts, double dt, void (*out)(void *, double, double, double), void *arg)
+{
+	memset(c,0,sizeof(*c));
+	c->Ts = Ts;
+	c->R = (Ts>0.0 && dt>0.0 && Ts>dt)? (int)ceil(Ts/dt) : 1;
+	if(c->R>(TVICBUF-1)/(2*TVICA)) c->R = (TVICBUF-1)/(2*TVICA);
+	c->h = Ts/c->R;
+	c->out = out;
+	c->arg = arg;
+	c->st.dtmin = 1e300;
+}
+
+void tvicstinit(struct tvicstat *s)
+{
+	memset(s,0,sizeof(*s));
+	s->dtmin = 1e300;
+}
+
+double tvicmean(struct tvicstat *s)
+{
+	return (s->ndt>0)? 1e-9*s->dts/s->ndt : 0.0;
+}
+
+void tvicdt(struct tvicstat *s, double dt)		// one interval into the statistics
+{
+	int64_t ns=llround(dt*1e9);
+	int b;
+
+	if(dt<s->dtmin) s->dtmin=dt;
+	if(dt>s->dtmax) s->dtmax=dt;
+	s->dts += ns; s->dts2 += (__int128)ns*ns; s->ndt++;
+	b = (dt>1e-6)? (int)(10.0*log10(dt*1e6))+1 : 0;
+	s->hist[(b<TVICBINS)? b : TVICBINS-1]++;
+}
+
+// raw time (file order) -> stitched monotonic time, interval statistics
+double tvicstitch(struct tvicstat *s, double t)
+{
+	double dt;
+
+	if(s->n++==0){ s->off=0.0; s->tfirst=s->tlast=t; return t; }
+	t += s->off;
+	if(t<=s->tlast){								// back in time (or stuck): new segment
+		dt = (s->dtlast>0.0)? s->dtlast : (s->ndt>0? tvicmean(s) : 1e-3);
+		s->off += s->tlast+dt-t;
+		s->nseg++;
+		s->tlast += dt;
+		return s->tlast;
+	}
+	dt = t-s->tlast;
+	tvicdt(s,dt);
+	s->dtlast = dt;
+	s->tlast = t;
+	return t;
+}
+
+// b, the statistics of the samples that follow a's, into a; -1 (a unchanged)
+// if b does not start after a ends, which would have needed a stitch
+int tvicmerge(struct tvicstat *a, struct tvicstat *b)
+{
+	int k;
+
+	if(b->n==0) return 0;
+	if(a->n==0){ *a=*b; return 0; }
+	if(b->tfirst<=a->tlast) return -1;
+	tvicdt(a,b->tfirst-a->tlast);
+	a->n += b->n; a->nseg += b->nseg;
+	if(b->dtmin<a->dtmin) a->dtmin=b->dtmin;
+	if(b->dtmax>a->dtmax) a->dtmax=b->dtmax;
+	a->dts += b->dts; a->dts2 += b->dts2; a->ndt += b->ndt;
+	for(k=0;k<TVICBINS;k++) a->hist[k] += b->hist[k];
+	if(b->ndt>0) a->dtlast=b->dtlast;
+	a->tlast = b->tlast;
+	return 0;
+}
+
+double tvicpct(struct tvicstat *s, double p)		// interval (s) not exceeded by p% of them
+{
+	long want=(long)ceil(p/100.0*s->ndt), sum=0;
+	int b;
+
+	for(b=0;b<TVICBINS;b++){
+		sum += s->hist[b];
+		if(sum>=want){
+			double e=1e-6*pow(10.0,b/10.0);			// upper edge of the bin
+			return (e<s->dtmax)? e : s->dtmax;
+		}
+	}
+	return s->dtmax;
+}
+
+long tvicgaps(struct tvicstat *s)				// intervals in bins wholly over TVICGAP x mean
+{
+	double g=TVICGAP*tvicmean(s);
+	long n=0;
+	int b;
+
+	for(b=1;b<TVICBINS;b++) if(1e-6*pow(10.0,(b-1)/10.0)>=g) n += s->hist[b];
+	return n;
+}
+
+double tviclanczos(double x)
+{
+	if(x==0.0) return 1.0;
+	if(x<=-TVICA || x>=TVICA) return 0.0;
+	return TVICA*sin(M_PI*x)*sin(M_PI*x/TVICA)/(M_PI*M_PI*x*x);
+}
+
+void tvicgrid(struct tvicond *c, long k, long mlast)	// grid point k from fine points up to mlast
+{
+	double w, sw=0.0, sv=0.0, si=0.0;
+	long j, j0=k*c->R-TVICA*c->R+1, j1=k*c->R+TVICA*c->R-1;
+
+	if(j0<0) j0=0;
+	if(j1>mlast) j1=mlast;
+	for(j=j0;j<=j1;j++){
+		w = tviclanczos((double)(j-k*c->R)/c->R);
+		sw += w; sv += w*c->uv[j&(TVICBUF-1)]; si += w*c->ui[j&(TVICBUF-1)];
+	}
+	c->out(c->arg,c->t0+k*c->Ts,sv/sw,si/sw);
+	c->nout++;
+}
+
+void tvicfine(struct tvicond *c, double v, double i)	// next fine point, grid points it completes
+{
+	if(c->R==1){ c->out(c->arg,c->t0+c->m*c->h,v,i); c->nout++; c->m++; return; }
+	c->uv[c->m&(TVICBUF-1)] = v; c->ui[c->m&(TVICBUF-1)] = i;
+	while(c->k*c->R+TVICA*c->R-1<=c->m){ tvicgrid(c,c->k,c->m); c->k++; }
+	c->m++;
+}
+
+void tviccubic(struct tvicond *c, double tg)	// fine point at tg from the buffered samples
+{
+	double v=0.0, i=0.0, l, u;
+	int a, p, q;
+
+	for(a=0;a<c->nq-2 && c->qt[a+1]<=tg;a++);		// qt[a] <= tg < qt[a+1] (or the last pair)
+	if(c->qt[a+1]-c->qt[a]>TVICGAP*tvicmean(&c->st) || c->nq<4){	// gap (or too few yet): straight line
+		u = (c->qt[a+1]>c->qt[a])? (tg-c->qt[a])/(c->qt[a+1]-c->qt[a]) : 0.0;
+		tvicfine(c,c->qv[a]+u*(c->qv[a+1]-c->qv[a]),c->qi[a]+u*(c->qi[a+1]-c->qi[a]));
+		return;
+	}
+	for(p=0;p<4;p++){								// Lagrange through all four
+		for(l=1.0,q=0;q<4;q++) if(q!=p) l *= (tg-c->qt[q])/(c->qt[p]-c->qt[q]);
+		v += l*c->qv[p]; i += l*c->qi[p];
+	}
+	tvicfine(c,v,i);
+}
+
+// next raw sample (file order): stitched, counted, and resampled or passed on
+void tvicput(struct tvicond *c, double t, double v, double i)
+{
+	double tg;
+	int p;
+
+	t = tvicstitch(&c->st,t);
+	if(c->Ts<=0.0){ c->out(c->arg,t,v,i); c->nout++; return; }
+	if(c->st.n==1) c->t0=t;							// grid starts at the first sample
+	if(c->nq==4) for(p=0;p<3;p++){ c->qt[p]=c->qt[p+1]; c->qv[p]=c->qv[p+1]; c->qi[p]=c->qi[p+1]; }
+	else c->nq++;
+	c->qt[c->nq-1]=t; c->qv[c->nq-1]=v; c->qi[c->nq-1]=i;
+	if(c->nq<4) return;
+	while((tg=c->t0+c->m*c->h)<c->qt[2]) tviccubic(c,tg);	// between the middle two from here on
+}
+
+void tvicend(struct tvicond *c)					// grid points up to the last sample
+{
+	double tg;
+	long mlast;
+
+	if(c->Ts<=0.0 || c->nq<2) return;
+	while((tg=c->t0+c->m*c->h)<=c->st.tlast) tviccubic(c,tg);
+	if(c->R==1) return;
+	for(mlast=c->m-1;c->k*c->R<=mlast;c->k++) tvicgrid(c,c->k,mlast);
+}
+
+void tvicstats(struct tvicstat *s, char *buf)
+{
+	double m=tvicmean(s), sd=0.0;
+
+	if(s->ndt>1) sd = 1e-9*sqrt((double)(s->dts2*s->ndt-(__int128)s->dts*s->dts)/s->ndt/(s->ndt-1));
+	sprintf(buf,"%ld samples, %ld segments stitched on, dt min %.6lf mean %.6lf max %.6lf sd %.6lfs, p1<%.6lf p50<%.6lf p99<%.6lf, %ld gaps >%.0lfx mean",
+		s->n,s->nseg,(s->ndt>0)? s->dtmin : 0.0,m,s->dtmax,sd,tvicpct(s,1),tvicpct(s,50),tvicpct(s,99),tvicgaps(s),TVICGAP);
+}
+
+#endif
@@ -0,0 +1,48 @@
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	"tvicyx.h"
+#include	"opt66.h"
+
+// build (or list) the cycle index sidecar of a regular-waveform .tvi/.tvib
+
+int main(int argc, char *argv[]){
+  struct tvird rd;
+  struct cyx x;
+  char cname[512], buf[512];
+  long k;
+  int nth;
+
+  opt66(&argc, argv);
+  nth = (opt66val('j')!=NULL)? atoi(opt66val('j')) : tviparcpu();
+  if ( argc!=2 ) {
+    fprintf(stderr,"tvicyx                 V1.0 CJD & JBS 2026\n");
+    fprintf(stderr,"Usage: tvicyx file.tvi[b|a] [-jN] [-l]\n");
+    fprintf(stderr,"Finds the cycles of a regular waveform (ending where dQ turns from charge to\n");
+    fprintf(stderr,"discharge, as getUTheta and getURegCyc.awk count them) and writes the index\n");
+    fprintf(stderr,"file.cyx: for each cycle the position of its first sample, its start time and\n");
+    fprintf(stderr,"sample count.  getUTheta then reads cycles straight from it (-c a range).\n");
+    fprintf(stderr,"-jN: N threads (default all cores).  -l: list the cycles to stdout,\n");
+    fprintf(stderr,"cycle, position (byte, or record in a .tvib or .tvia), start time and samples.\n");
+    exit(1);
+  }
+
+  cyxname(argv[1], cname);
+  if(tvirdopen(&rd, argv[1])) exit(1);
+  if(cyxload(&x, cname, argv[1])==0){
+    fprintf(stderr,"%s is up to date\n", cname);
+  }else{
+    cyxbuild(&rd, nth, &x);
+    if(cyxsave(&x, cname, argv[1])){ fprintf(stderr,"Cannot write %s\n", cname); exit(1); }
+  }
+  tvicstats(&x.h.st, buf);
+  fprintf(stderr,"%s: %ld cycles (cycle 0 the lead-in), %ld samples after the last; %s\n",
+    cname, (long)x.h.ncyc, (long)x.h.tailn, buf);
+  if(x.h.nbad) fprintf(stderr,"%ld lines skipped\n", (long)x.h.nbad);
+  if(opt66on('l')){
+    for(k=0;k<x.h.ncyc;k++)
+      printf("%ld %ld %.6lf %ld\n", k, (long)x.c[k].pos, x.c[k].tstart, (long)x.c[k].n);
+  }
+  cyxfree(&x);
+  tvirdclose(&rd);
+  return 0;
+}
@@ -0,0 +1,254 @@
+// tvicyx.h: cycle index (.cyx sidecar) of a regular-waveform .tvi/.tvib record
+// for the analysis tools, with tvird.h, tvicond.h & tvipar.h; link with -lpthread
+// JBS & CJD 2026
+//
+// A cycle ends on the sample where dQ=I dt turns from charge to discharge
+// (getUTheta's and getURegCyc.awk's sign(dQ)!=sign(lastdQ) && sign(dQ)==
+// sign(lastdQ2) test: lastdQ2, the dQ at the last boundary, is never >0, so
+// it is the turn to dQ<0).  That sample is the last of its cycle.  Cycle 0 is
+// the lead-in up to the first boundary and is numbered the way getUTheta
+// counts, so cycle N closes on boundary N.  cyxbuild() finds the boundaries
+// block by block on several threads (each block with the two samples before
+// it as context, so the result is the one pass's), or in one pass with
+// stitched time where the file goes back in time.  The .cyx sidecar
+// (base.cyx next to base.tvi) holds, for every cycle, the reader position of
+// its first sample (byte offset in a .tvi, record number in a .tvib or .tvia), its
+// sample count and its start time (the boundary before it), then the part
+// after the last boundary and the file's time-base statistics.  The source's
+// size and mtime are kept, so a stale index is refused.
+
+#ifndef TVICYX_H
+#define TVICYX_H
+
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
+#include	<stdint.h>
+#include	<sys/stat.h>
+#include	"tvird.h"
+#include	"tvicond.h"
+#include	"tvipar.h"
+
+#define CYXMAGIC "TCYX"
+#define CYXVER 1
+#define CYXHDR 2048				// header bytes, cycles start here
+#define CYXBOM 0x01020304
+
+struct cyxrec {					// one cycle
+	int64_t pos;				// position of its first sample
+	int64_t n;					// samples, the boundary last
+	double tstart;				// time of the boundary before it (0 for cycle 0)
+};
+
+struct cyxhdr {
+	char magic[4];				// "TCYX"
+	uint32_t bom;
+	uint16_t version, hdrsize;
+	uint32_t bin;				// positions are record numbers (.tvib, .tvia)
+	int64_t srcsize, srcmtime, srcmtimens;	// the file indexed
+	int64_t ncyc, nsamp, nbad;	// cycles (lead-in included), samples, lines skipped
+	int64_t tailpos, tailn;		// after the last boundary
+	double tailstart;
+	struct tvicstat st;			// time base (tvicond.h), st.nseg>0: time was stitched
+};
+
+struct cyx {
+	struct cyxhdr h;
+	struct cyxrec *c;			// h.ncyc of them
+};
+
+struct cyxbnd {					// a boundary found
+	int64_t k;					// sample number in its block
+	int64_t pos;				// position after it
+	double t;
+};
+
+struct cyxblk {
+	struct tvicstat st;
+	long n, nbad, nb, maxb;
+	struct cyxbnd *b;
+};
+
+struct cyxjob {
+	struct tvird *rd;
+	struct cyxblk *blk;
+};
+
+int cyxedge(double dQ, double lastdQ)	// does this sample end a cycle?
+{
+	return dQ<0.0 && !(lastdQ<=0.0);			// sign(lastdQ)==1, sign(dQ)==-1, dQ!=0
+}
+
+// boundaries in r from the state (lasttime, dQ) of the sample before it
+void cyxscan(struct tvird *r, struct cyxblk *b, double lasttime, double dQ)
+{
+	double x[3], t, lastdQ;
+
+	tvicstinit(&b->st);
+	while(tvirdnext(r,x,3)){
+		t = tvicstitch(&b->st,x[0]);
+		lastdQ = dQ;
+		dQ = x[2]*(t-lasttime);
+		lasttime = t;
+		if(cyxedge(dQ,lastdQ)){
+			if(b->nb>=b->maxb){
+				b->maxb = 2*b->maxb+64;
+				b->b = realloc(b->b,b->maxb*sizeof(struct cyxbnd));
+				if(b->b==NULL){ fprintf(stderr,"Out of memory for cycle index\n"); exit(1); }
+			}
+			b->b[b->nb].k=b->n; b->b[b->nb].pos=tvirdtell(r); b->b[b->nb].t=t;
+			b->nb++;
+		}
+		b->n++;
+	}
+	b->nbad = r->nbad;
+}
+
+void cyxpass(void *arg, long k)		// block k, the two samples before it as context
+{
+	struct cyxjob *j=arg;
+	struct tvird s;
+	double x[3], y[3], t=0.0, dQ=0.0;
+	long p, pp;
+
+	if(tvirdprev(j->rd,tvirdblkpos(j->rd,k),x,3,&p)){
+		t = x[0];
+		dQ = x[2]*(x[0]-(tvirdprev(j->rd,p,y,3,&pp)? y[0] : 0.0));
+	}
+	tvirdblock(j->rd,k,&s);
+	cyxscan(&s,&j->blk[k],t,dQ);
+	tvirdclose(&s);
+}
+
+struct cyxblk *cyxblocks(struct tvird *r, long *nblk)	// a result for each of r's blocks
+{
+	struct cyxblk *blk;
+
+	*nblk = tvirdnblk(r);
+	blk = calloc(*nblk,sizeof(struct cyxblk));
+	if(blk==NULL){ fprintf(stderr,"Out of memory for cycle index\n"); exit(1); }
+	return blk;
+}
+
+// the index from the blocks' boundaries (cyxpass() on each), or one pass where time goes back
+void cyxjoin(struct tvird *r, struct cyxblk *blk, long nblk, struct cyx *x)
+{
+	struct cyxblk one;
+	struct tvird s;
+	long nb, k, m, base;
+	int whole=0;
+	double tlast=0.0;
+	int64_t plast=0, klast=-1;
+
+	memset(x,0,sizeof(*x));
+	tvicstinit(&x->h.st);
+	for(k=0;k<nblk;k++) if(blk[k].st.nseg>0 || tvicmerge(&x->h.st,&blk[k].st)) whole=1;
+	if(whole){										// time goes back: one pass, stitched
+		for(k=0;k<nblk;k++) free(blk[k].b);
+		memset(&one,0,sizeof(one));
+		tvirdpart(r,0,tvirdblkpos(r,nblk),&s);		// r itself is left at its start
+		cyxscan(&s,&one,0.0,0.0);
+		tvirdclose(&s);
+		blk[0]=one; nblk=1;
+		x->h.st = one.st;
+	}
+	for(nb=0,k=0;k<nblk;k++) nb += blk[k].nb;
+	x->c = malloc((nb+1)*sizeof(struct cyxrec));
+	if(x->c==NULL){ fprintf(stderr,"Out of memory for cycle index\n"); exit(1); }
+	for(m=0,base=0,k=0;k<nblk;k++){
+		for(nb=0;nb<blk[k].nb;nb++,m++){
+			x->c[m].pos = plast;
+			x->c[m].n = base+blk[k].b[nb].k-klast;
+			x->c[m].tstart = tlast;
+			klast = base+blk[k].b[nb].k; plast = blk[k].b[nb].pos; tlast = blk[k].b[nb].t;
+		}
+		base += blk[k].n;
+		x->h.nbad += blk[k].nbad;
+		free(blk[k].b);
+	}
+	free(blk);
+	memcpy(x->h.magic,CYXMAGIC,4);
+	x->h.bom=CYXBOM; x->h.version=CYXVER; x->h.hdrsize=CYXHDR;
+	x->h.bin=r->bin || r->arch;
+	x->h.ncyc=m; x->h.nsamp=base;
+	x->h.tailpos=plast; x->h.tailn=base-1-klast; x->h.tailstart=tlast;
+}
+
+// index the record r is open on, nth threads
+void cyxbuild(struct tvird *r, int nth, struct cyx *x)
+{
+	struct cyxjob j;
+	long nblk;
+
+	j.rd=r; j.blk=cyxblocks(r,&nblk);
+	tvipar(nth,nblk,cyxpass,&j);
+	cyxjoin(r,j.blk,nblk,x);
+}
+
+void cyxname(char *fname, char *out)	// base.cyx for base.tvi[b] (or any name)
+{
+	char *d;
+
+	strcpy(out,fname);
+	d = strrchr(out,'.');
+	if(d!=NULL && strchr(d,'/')==NULL) *d='\0';
+	strcat(out,".cyx");
+}
+
+int cyxsave(struct cyx *x, char *fname, char *src)	// 0 if written
+{
+	struct stat st;
+	char h[CYXHDR];
+	FILE *f;
+	int ok;
+
+	if(stat(src,&st)<0) return -1;
+	x->h.srcsize=st.st_size; x->h.srcmtime=st.st_mtim.tv_sec; x->h.srcmtimens=st.st_mtim.tv_nsec;
+	memset(h,0,sizeof(h));
+	memcpy(h,&x->h,sizeof(x->h));
+	f = fopen(fname,"wb");
+	if(f==NULL) return -1;
+	ok = fwrite(h,CYXHDR,1,f)==1 && fwrite(x->c,sizeof(struct cyxrec),x->h.ncyc,f)==(size_t)x->h.ncyc;
+	if(fclose(f) || !ok) return -1;
+	return 0;
+}
+
+// the index of src from fname: 0 if there and up to date, -1 if not (says why unless absent)
+int cyxload(struct cyx *x, char *fname, char *src)
+{
+	struct stat st;
+	FILE *f;
+
+	memset(x,0,sizeof(*x));
+	f = fopen(fname,"rb");
+	if(f==NULL) return -1;
+	if(fread(&x->h,sizeof(x->h),1,f)!=1 || memcmp(x->h.magic,CYXMAGIC,4) || x->h.bom!=CYXBOM ||
+			x->h.version>CYXVER || x->h.hdrsize<sizeof(x->h) || x->h.ncyc<0){
+		fprintf(stderr,"%s: not a cycle index this build can read\n",fname);
+		fclose(f);
+		return -1;
+	}
+	if(stat(src,&st)<0 || st.st_size!=x->h.srcsize || st.st_mtim.tv_sec!=x->h.srcmtime || st.st_mtim.tv_nsec!=x->h.srcmtimens){
+		fprintf(stderr,"%s is older than %s, not used\n",fname,src);
+		fclose(f);
+		return -1;
+	}
+	x->c = malloc((x->h.ncyc+1)*sizeof(struct cyxrec));
+	if(x->c==NULL || fseek(f,x->h.hdrsize,SEEK_SET) ||
+			fread(x->c,sizeof(struct cyxrec),x->h.ncyc,f)!=(size_t)x->h.ncyc){
+		fprintf(stderr,"%s is short\n",fname);
+		free(x->c); x->c=NULL;
+		fclose(f);
+		return -1;
+	}
+	fclose(f);
+	return 0;
+}
+
+void cyxfree(struct cyx *x)
+{
+	free(x->c);
+	x->c=NULL;
+}
+
+#endif
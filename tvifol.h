@@ -0,0 +1,239 @@
+// tvifol.h: follow a .tvi, .tvib or .tvia while it is still being written
+// for getUTheta & tvi2u -f (Linux, inotify), with tvird.h
+// JBS & CJD 2026
+//
+// The file is read on from where the last read stopped, and only whole lines
+// (whole records of a .tvib) are handed out: a line the writer is part way
+// through is kept until the rest of it lands, and taken without its newline
+// only once the writer has closed the file.  When all that is there has been
+// read, tvifolnext() flushes the caller's output and sleeps on inotify until
+// the writer appends, so a tool keeps its running sums and sees each sample
+// once, as it comes.  A .tvia is re-mapped as it grows and read a whole block
+// at a time, so it is followed a block (4096 samples or a minute) behind.  The
+// kind is taken from the first bytes, which need not be there yet when it
+// starts.  It ends when the writer closes the file (the acquisition programs
+// hold it open for the whole run) and the rest is read, after idle seconds
+// with nothing new if idle>0, or on ^C or SIGTERM (tvifolstop), so the caller
+// can still give its summary.
+
+#ifndef TVIFOL_H
+#define TVIFOL_H
+
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
+#include	<errno.h>
+#include	<signal.h>
+#include	<poll.h>
+#include	<fcntl.h>
+#include	<unistd.h>
+#include	<sys/stat.h>
+#include	<sys/inotify.h>
+#include	"tvird.h"
+
+#define TVIFOLBUF (1L<<20)		// bytes read at a time; longest line
+
+struct tvifol {
+	char *fname;
+	int fd, in;					// the file, its inotify watch
+	int kind;					// 0 text, 1 .tvib, 2 .tvia, -1 not known yet
+	char *buf;					// bytes read, [pos,len) not yet handed out
+	size_t len, pos;
+	off_t off;					// bytes of the file seen
+	int ncol;					// .tvib/.tvia columns
+	size_t recsize;
+	struct tvia ta;				// .tvia as far as it is written
+	double *abuf;				// its decoded block ablk
+	long ablk;
+	long k;						// records handed out
+	long nbad;					// text lines skipped
+	int closed;					// the writer has closed it
+	double idle;				// seconds to wait for more, 0 for ever
+	FILE *flush;				// flushed before each wait, NULL for none
+};
+
+volatile sig_atomic_t tvifolstop;
+
+void tvifolsig(int s)
+{
+	(void)s;						// SIGINT or SIGTERM, either stops
+	tvifolstop=1;
+}
+
+// 0 if OK, else prints why and returns -1; catches SIGINT & SIGTERM
+int tvifolopen(struct tvifol *f, char *fname, double idle, FILE *flush)
+{
+	struct sigaction sa;
+
+	memset(f,0,sizeof(*f));
+	f->fname=fname; f->idle=idle; f->flush=flush;
+	f->kind=-1; f->ablk=-1;
+	f->fd = open(fname,O_RDONLY);
+	if(f->fd<0){fprintf(stderr,"Cannot open %s\n",fname); return -1;}
+	f->in = inotify_init1(IN_CLOEXEC);
+	if(f->in<0 || inotify_add_watch(f->in,fname,IN_MODIFY|IN_CLOSE_WRITE|IN_DELETE_SELF|IN_MOVE_SELF)<0){
+		fprintf(stderr,"Cannot watch %s\n",fname);
+		if(f->in>=0) close(f->in);
+		close(f->fd);
+		return -1;
+	}
+	f->buf = malloc(TVIFOLBUF+1);
+	if(f->buf==NULL){fprintf(stderr,"Out of memory for %s\n",fname); close(f->in); close(f->fd); return -1;}
+	memset(&sa,0,sizeof(sa));
+	sa.sa_handler = tvifolsig;			// no SA_RESTART: a wait ends at once
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGINT,&sa,NULL);
+	sigaction(SIGTERM,&sa,NULL);
+	return 0;
+}
+
+// until the file has grown past f->off; 0 if it will not
+int tvifolwait(struct tvifol *f)
+{
+	char ev[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	struct inotify_event *e;
+	struct pollfd p;
+	struct stat st;
+	ssize_t n, i;
+	int r;
+
+	if(f->flush!=NULL) fflush(f->flush);
+	for(;;){
+		if(tvifolstop) return 0;
+		if(fstat(f->fd,&st)<0) return 0;
+		if(st.st_size>f->off) return 1;
+		if(st.st_size<f->off){fprintf(stderr,"%s was cut short, stopped\n",f->fname); return 0;}
+		if(f->closed) return 0;
+		p.fd=f->in; p.events=POLLIN;
+		r = poll(&p,1,(f->idle>0)? (int)(1000*f->idle) : -1);
+		if(r==0) return 0;					// nothing for idle seconds
+		if(r<0){ if(errno==EINTR) continue; return 0; }
+		n = read(f->in,ev,sizeof(ev));
+		for(i=0;i+(ssize_t)sizeof(struct inotify_event)<=n;i+=sizeof(struct inotify_event)+e->len){
+			e = (struct inotify_event *)(ev+i);
+			if(e->mask&(IN_CLOSE_WRITE|IN_DELETE_SELF|IN_MOVE_SELF|IN_IGNORED)) f->closed=1;
+		}
+	}
+}
+
+// more bytes after [pos,len), which move to the buffer's start; 0 at the end
+int tvifolfill(struct tvifol *f)
+{
+	ssize_t n;
+
+	if(f->pos>0){
+		memmove(f->buf,f->buf+f->pos,f->len-f->pos);
+		f->len -= f->pos; f->pos=0;
+	}
+	for(;;){
+		n = read(f->fd,f->buf+f->len,TVIFOLBUF-f->len);
+		if(n>0){ f->len+=n; f->off+=n; return 1; }
+		if(n<0 && errno!=EINTR){fprintf(stderr,"Cannot read %s\n",f->fname); return 0;}
+		if(!tvifolwait(f)) return 0;
+	}
+}
+
+// .tvia: mapped again once it holds records past f->k; 0 at the end
+int tvifolgrow(struct tvifol *f)
+{
+	struct stat st;
+
+	for(;;){
+		if(!tvifolwait(f)) return 0;
+		if(fstat(f->fd,&st)<0) return 0;
+		f->off = st.st_size;
+		if(st.st_size<(off_t)sizeof(struct tviahdr)) continue;	// header not all out yet
+		tviaclose(&f->ta);
+		if(tviaopen(&f->ta,f->fname)) return 0;
+		f->ablk = -1;
+		if(f->ta.n>f->k) return 1;
+	}
+}
+
+// next record, up to n columns into x, waiting for it if need be;
+// returns the columns there (>=3), 0 at the end
+int tvifolnext(struct tvifol *f, double *x, int n)
+{
+	struct tvibhdr *h;
+	double y[TVIRDCOL];
+	char *s, *e;
+	size_t avail;
+	long b;
+	int k;
+
+	for(;;){
+		if(f->kind==2){
+			if(f->k>=f->ta.n && !tvifolgrow(f)) return 0;
+			if(f->ablk<0 || f->k>=f->ta.ix[f->ablk].k0+tviablock(&f->ta,f->ablk)->n){
+				b = tviaseek(&f->ta,f->k);
+				if(tviaread(&f->ta,b,f->abuf)){fprintf(stderr,"Archive block %ld does not decode\n",b); return 0;}
+				f->ablk = b;
+			}
+			k = (n<f->ncol)? n : f->ncol;
+			memcpy(x,f->abuf+(f->k-f->ta.ix[f->ablk].k0)*f->ncol,k*sizeof(double));
+			f->k++;
+			return k;
+		}
+		s = f->buf+f->pos;
+		avail = f->len-f->pos;
+		if(f->kind<0){								// what it is, from the first bytes
+			if(avail>=4 && !memcmp(s,TVIAMAGIC,4)){
+				f->kind=2; f->off=0;
+				f->abuf = malloc(TVIABLK*TVIBMAXCOL*sizeof(double));
+				if(f->abuf==NULL){fprintf(stderr,"Out of memory for archive block\n"); return 0;}
+				if(!tvifolgrow(f)) return 0;
+				f->ncol = f->ta.ncol;
+				continue;
+			}
+			if(avail>=4 && !memcmp(s,TVIBMAGIC,4)){
+				if(avail<TVIBHDR){ if(!tvifolfill(f)) return 0; continue; }
+				h = (struct tvibhdr *)s;
+				if(h->bom!=TVIBBOM || h->version>TVIBVER || h->ncol<1 || h->ncol>TVIBMAXCOL ||
+						h->recsize!=h->ncol*sizeof(double) || h->hdrsize<sizeof(struct tvibhdr) || h->hdrsize>avail){
+					fprintf(stderr,"%s: not a .tvib this build can read (version/byte order)\n",f->fname);
+					return 0;
+				}
+				f->kind=1; f->ncol=h->ncol; f->recsize=h->recsize;
+				f->pos += h->hdrsize;
+				continue;
+			}
+			if(avail>=4 || memchr(s,'\n',avail)!=NULL) f->kind=0;
+			else if(!tvifolfill(f)) return 0;
+			continue;
+		}
+		if(f->kind==1){
+			if(avail<f->recsize){ if(!tvifolfill(f)) return 0; continue; }
+			k = (n<f->ncol)? n : f->ncol;
+			memcpy(x,s,k*sizeof(double));
+			f->pos += f->recsize;
+			f->k++;
+			return k;
+		}
+		e = memchr(s,'\n',avail);
+		if(e==NULL){
+			if(avail>=TVIFOLBUF){ f->nbad++; f->pos=f->len; }	// no end to it: dropped
+			if(tvifolfill(f)) continue;
+			if(f->pos>=f->len || !f->closed) return 0;	// may be half written
+			s = f->buf+f->pos;						// the writer's unterminated last line
+			e = f->buf+f->len; *e=0;
+			f->pos = f->len;
+		}else f->pos = e+1-f->buf;
+		k = tvirdline(s,e,y,TVIRDCOL);
+		if(k<3){ if(k>0 || e>s+1) f->nbad++; continue; }	// blank lines are not counted
+		if(f->k++==0) f->ncol=k;
+		if(k>n) k=n;
+		memcpy(x,y,k*sizeof(double));
+		return k;
+	}
+}
+
+void tvifolclose(struct tvifol *f)
+{
+	tviaclose(&f->ta);
+	free(f->abuf);
+	free(f->buf);
+	close(f->in);
+	close(f->fd);
+}
+
+#endif
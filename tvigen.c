@@ -0,0 +1,338 @@
+#define _GNU_SOURCE				// the .tvia writer (tvia.h)
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
+#include	<stdint.h>
+#include	<math.h>
+#include	<complex.h>
+#include	<time.h>
+#include	"tvib.h"
+#include	"tvia.h"
+#include	"opt66.h"
+
+// Synthetic records with answers known, to check the analysis tools and time
+// them (tvibench).  The cell is V0 behind a series R and a CPE,
+// Z(f) = Rs + 1/(Q (j 2 pi f)^alpha), driven by
+//   m: a multisine, ntones harmonics of fmin spaced evenly in log f (Schroeder phases);
+//      past zdft.h's 48 tones it is a dense spectrum, for zfft.h
+//   s: a sine of f Hz, amplitude Ia
+//   q: a square wave of the same (the CPE's part from its odd harmonics, tabled)
+// or, for c, cycled CCCV as bcp66 does it, OCV straight from Vmin to Vmax over
+// the capacity, with bcp66's t V I Ah cyc columns.  Sample intervals can be
+// jittered, V & I given gaussian noise and the logger restarted (time back to
+// 0) a number of times.  Values are rounded to tvia.h's default quanta, so text,
+// .tvib and .tvia of the same run read the same.  The answers, from the model
+// and the samples before noise, go to base.ans: Z at each tone; u, theta &
+// alpha of a cycle; each CCCV cycle's charge and u; and the whole-file U as
+// tvi2u sums it.
+
+#define GENHARM 1023			// square wave: odd harmonics up to this
+#define GENTAB 8192				// points a period in its table
+#define GENLINE 128
+
+struct gen {
+  int kind;
+  double dt, jit, vn, in;		// interval, jitter (fraction), noise (V, A)
+  double V0, Ia, Rs, Q, al, f;	// the cell & drive
+  int nt;						// multisine: tones from fmin to f*fmin
+  double fmin;
+  double *ft, *pt;				// each tone's f & phase, nt of them
+  double complex *zt;
+  double *tab;					// square: CPE volts over a period
+  double C, Vmax, Vmin, Ich, Idis, Iend;	// CCCV
+  double soc, ilast;
+  int ph, cyc;
+  double cq[2], ce[2];			// this cycle's charge & energy in, out
+  uint64_t rng;
+};
+
+double p10[10]={1e0,1e1,1e2,1e3,1e4,1e5,1e6,1e7,1e8,1e9};
+
+double uni(struct gen *g){		// uniform on [0,1), xorshift64*
+  g->rng ^= g->rng>>12; g->rng ^= g->rng<<25; g->rng ^= g->rng>>27;
+  return ((g->rng*0x2545F4914F6CDD1DULL)>>11)*(1.0/9007199254740992.0);
+}
+
+double gauss(struct gen *g){
+  double u=uni(g);
+
+  return sqrt(-2.0*log(1.0-u))*cos(2.0*M_PI*uni(g));
+}
+
+double complex zcell(struct gen *g, double f){
+  return g->Rs+1.0/(g->Q*cpow(I*2.0*M_PI*f, g->al));
+}
+
+double q6(double x, int d){		// x to d decimals, as fastnum.h reads the text back
+  return llround(x*p10[d])/p10[d];
+}
+
+char *fix(char *p, double x, int d){	// x with d decimals, as %.*lf
+  long long m=llround(x*p10[d]), w, fr;
+  char b[24];
+  int k;
+
+  if(m<0){ *p++='-'; m=-m; }
+  w=m/(long long)p10[d]; fr=m%(long long)p10[d];
+  k=0;
+  do{ b[k++]='0'+w%10; w/=10; }while(w);
+  while(k) *p++=b[--k];
+  if(d>0){
+    *p++='.';
+    for(k=d-1;k>=0;k--){ p[k]='0'+fr%10; fr/=10; }
+    p+=d;
+  }
+  return p;
+}
+
+void setup(struct gen *g){
+  double complex z;
+  double w, x, s;
+  long j, h=0;
+  int k;
+
+  if(g->kind=='m'){
+    for(k=0;k<g->nt;k++){		// harmonics of fmin, log spaced, none twice
+      j = (g->nt>1)? llround(pow(g->f, (double)k/(g->nt-1))) : 1;
+      if(j<=h) j=h+1;
+      h = j;
+      g->ft[k] = j*g->fmin;
+      g->zt[k] = zcell(g, g->ft[k]);
+      g->pt[k] = -M_PI*k*(k+1)/g->nt;	// Schroeder, for a low crest factor
+    }
+  }
+  if(g->kind=='q'){				// sign(cos x) = 4/pi sum (-1)^((k-1)/2) cos(kx)/k
+    g->tab = calloc(GENTAB+1, sizeof(double));
+    if(g->tab==NULL){ fprintf(stderr,"Out of memory for table\n"); exit(1); }
+    for(k=1;k<=GENHARM;k+=2){
+      w = 2.0*M_PI*g->f*k;
+      z = 1.0/(g->Q*cpow(I*w, g->al));
+      s = ((k/2)%2? -4.0 : 4.0)/(M_PI*k)*g->Ia*cabs(z);
+      for(j=0;j<=GENTAB;j++){
+        x = 2.0*M_PI*j/GENTAB;
+        g->tab[j] += s*cos(k*x+carg(z));
+      }
+    }
+  }
+}
+
+// V & I at time t (s from the start, never going back); dt since the last sample
+void sample(struct gen *g, double t, double dt, double *v, double *i){
+  double x, fr, ocv;
+  int k, j;
+
+  switch(g->kind){
+  case 'm':
+    *v=g->V0; *i=0.0;
+    for(k=0;k<g->nt;k++){
+      x = 2.0*M_PI*g->ft[k]*t+g->pt[k];
+      *i += g->Ia*cos(x);
+      *v += g->Ia*cabs(g->zt[k])*cos(x+carg(g->zt[k]));
+    }
+    break;
+  case 's':
+    x = 2.0*M_PI*g->f*t;
+    *i = g->Ia*cos(x);
+    *v = g->V0+g->Ia*cabs(g->zt[0])*cos(x+carg(g->zt[0]));
+    break;
+  case 'q':
+    x = g->f*t; x -= floor(x);
+    fr = x*GENTAB; j=(int)fr; fr-=j;
+    *i = (x<0.25 || x>=0.75)? g->Ia : -g->Ia;
+    *v = g->V0+g->Rs*(*i)+(1.0-fr)*g->tab[j]+fr*g->tab[j+1];
+    break;
+  case 'c':						// bcp66: CC to Vmax, CV to Iend, CC to Vmin, CV to Iend
+    g->soc += g->ilast*dt/3600.0;
+    ocv = g->Vmin+(g->Vmax-g->Vmin)*g->soc/g->C;
+    for(k=0;k<4;k++){
+      if(g->ph==0){ *i=g->Ich; if(ocv+g->Rs*(*i)<g->Vmax) break; g->ph=1; }
+      if(g->ph==1){ *i=(g->Vmax-ocv)/g->Rs; if(*i>g->Iend) break; g->ph=2; }
+      if(g->ph==2){ *i=-g->Idis; if(ocv+g->Rs*(*i)>g->Vmin) break; g->ph=3; }
+      if(g->ph==3){ *i=(g->Vmin-ocv)/g->Rs; if(*i<-g->Iend) break; g->ph=0; g->cyc++; }
+    }
+    *v = ocv+g->Rs*(*i);
+    g->ilast=*i;
+    break;
+  }
+}
+
+void basename66(char *fname, char *out, char *suffix){	// base+suffix for base.tvi[b|a]
+  char *d;
+
+  strcpy(out, fname);
+  d = strrchr(out, '.');
+  if(d!=NULL && strchr(d, '/')==NULL) *d='\0';
+  strcat(out, suffix);
+}
+
+double bytes(char *s){			// 100k, 20M, 1G
+  double x=atof(s);
+  char c=s[strlen(s)-1];
+
+  if(c=='k' || c=='K') x*=1e3;
+  if(c=='m' || c=='M') x*=1e6;
+  if(c=='g' || c=='G') x*=1e9;
+  return x;
+}
+
+int main(int argc, char *argv[]){
+  struct gen g;
+  FILE *out, *ans;
+  char aname[512], line[GENLINE], *p, *s;
+  double x[5], tw=0.0, t=0.0, dt, v, i, size=0.0, nbytes=0.0;
+  double ein=0.0, eout=0.0, Va, c, u, th, ae, nrec=0.0;
+  long n=1000000, k, nb=0, *brk=NULL;
+  int kind=0, ncol, cyc0, bin, j;
+
+  opt66(&argc, argv);
+  if(argc==3 && strlen(argv[2])==1 && strchr("msqc", argv[2][0])!=NULL) kind=argv[2][0];
+  if(kind==0 || strlen(argv[1])>500){
+    fprintf(stderr,"tvigen                 V1.0 CJD & JBS 2026\n");
+    fprintf(stderr,"Usage: tvigen out.tvi[b|a] m|s|q|c [-nN|-zSize] [-dDt] [-jJit] [-eVn:In] [-bN] [-rSeed]\n");
+    fprintf(stderr,"  [-VV0] [-IIa] [-RRs] [-QQ] [-aAlpha] [-fF] [-tNtones]\n");
+    fprintf(stderr,"  [-cAh] [-vVmin:Vmax] [-iIch:Idis:Iend]\n");
+    fprintf(stderr,"Writes a synthetic record whose answers are known, and them to out.ans.\n");
+    fprintf(stderr,"The cell is V0 (3.7V) behind Rs (0.01 ohm) and a CPE 1/(Q (jw)^alpha), Q 100,\n");
+    fprintf(stderr,"alpha 0.8, driven by m: Ntones (10) harmonics of fmin from fmin to F*fmin\n");
+    fprintf(stderr,"(-fFmin:F, default 0.01:1000; more tones than F go on up) of Ia A each, Z of\n");
+    fprintf(stderr,"each in out.ans (over 48 tones: for tviz -d); s: a sine\n");
+    fprintf(stderr,"current of F Hz (0.01) and Ia A (1); q: a square wave of the same, u theta & alpha in out.ans;\n");
+    fprintf(stderr,"c: CCCV as bcp66 cycles, -cAh capacity (1), OCV straight from Vmin to Vmax\n");
+    fprintf(stderr,"(3.0:4.2), -i currents (1:1:0.05), t V I Ah cyc, each cycle in out.ans.\n");
+    fprintf(stderr,"N samples (1000000) or Size bytes (100k, 50M, 2G; records of a .tvib/.tvia),\n");
+    fprintf(stderr,"Dt apart (0.01s) jittered by up to +/-Jit of Dt (0); gaussian noise of Vn V\n");
+    fprintf(stderr,"and In A (0); time back to 0 N times (a logger restarted); -r the seed.\n");
+    fprintf(stderr,"The output is .tvib or .tvia by its name, else text.\n");
+    exit(1);
+  }
+
+  memset(&g, 0, sizeof(g));
+  g.kind=kind;
+  g.dt=(opt66val('d')!=NULL)? atof(opt66val('d')) : 0.01;
+  g.jit=(opt66val('j')!=NULL)? atof(opt66val('j')) : 0.0;
+  if((s=opt66val('e'))!=NULL){ g.vn=atof(s); if((s=strchr(s, ':'))!=NULL) g.in=atof(s+1); }
+  g.rng=(opt66val('r')!=NULL)? (uint64_t)atoll(opt66val('r'))*2654435761ULL+1 : 88172645463325252ULL;
+  g.V0=(opt66val('V')!=NULL)? atof(opt66val('V')) : 3.7;
+  g.Ia=(opt66val('I')!=NULL)? atof(opt66val('I')) : 1.0;
+  g.Rs=(opt66val('R')!=NULL)? atof(opt66val('R')) : 0.01;
+  g.Q=(opt66val('Q')!=NULL)? atof(opt66val('Q')) : 100.0;
+  g.al=(opt66val('a')!=NULL)? atof(opt66val('a')) : 0.8;
+  g.nt=(opt66val('t')!=NULL)? atoi(opt66val('t')) : 10;
+  if(g.nt<1){ fprintf(stderr,"1 tone at least\n"); exit(1); }
+  g.ft=malloc(g.nt*sizeof(double)); g.pt=malloc(g.nt*sizeof(double));	// dense multisines for zfft.h too
+  g.zt=malloc(g.nt*sizeof(double complex));
+  if(g.ft==NULL || g.pt==NULL || g.zt==NULL){ fprintf(stderr,"Out of memory for tones\n"); exit(1); }
+  g.f=g.fmin=0.01;
+  if(kind=='m'){
+    g.f=1000.0;
+    if((s=opt66val('f'))!=NULL){ g.fmin=atof(s); if((s=strchr(s, ':'))!=NULL) g.f=atof(s+1); }
+  }else if(opt66val('f')!=NULL) g.f=atof(opt66val('f'));
+  g.C=(opt66val('c')!=NULL)? atof(opt66val('c')) : 1.0;
+  g.Vmin=3.0; g.Vmax=4.2;
+  if((s=opt66val('v'))!=NULL){ g.Vmin=atof(s); if((s=strchr(s, ':'))!=NULL) g.Vmax=atof(s+1); }
+  g.Ich=g.Idis=1.0; g.Iend=0.05;
+  if((s=opt66val('i'))!=NULL){
+    g.Ich=atof(s);
+    if((s=strchr(s, ':'))!=NULL){ g.Idis=atof(++s); if((s=strchr(s, ':'))!=NULL) g.Iend=atof(s+1); }
+  }
+  g.cyc=1;
+  if(g.dt<=0.0 || g.f<=0.0 || g.fmin<=0.0 || g.Q<=0.0 || g.C<=0.0 || (kind=='c' && (g.Rs<=0.0 || g.Vmax<=g.Vmin))){
+    fprintf(stderr,"Dt, F, Q and Ah must be >0, and for CCCV Rs>0 and Vmax>Vmin\n"); exit(1);
+  }
+  if(opt66val('z')!=NULL){ size=bytes(opt66val('z')); n=-1; }
+  else if(opt66val('n')!=NULL) n=atol(opt66val('n'));
+  if(opt66val('b')!=NULL) nb=atol(opt66val('b'));
+  if(kind=='s') g.zt[0]=zcell(&g, g.f);
+  setup(&g);
+
+  ncol=(kind=='c')? 5 : 3;
+  j=(strlen(argv[1])>5)? (int)strlen(argv[1])-5 : 0;
+  bin=!strcmp(argv[1]+j, ".tvib") || !strcmp(argv[1]+j, ".tvia");
+  if(!strcmp(argv[1]+j, ".tvib")) out=tvibcreate(argv[1], ncol, (ncol==5)? "t V I Ah cyc" : "t V I", "tvigen 1.0", opt66argc, opt66argv, time(NULL));
+  else if(!strcmp(argv[1]+j, ".tvia")) out=tviacreate(argv[1], ncol, (ncol==5)? "t V I Ah cyc" : "t V I", NULL, "tvigen 1.0", opt66argc, opt66argv, time(NULL));
+  else out=fopen(argv[1], "w");
+  if(out==NULL){ fprintf(stderr,"Cannot create %s\n", argv[1]); exit(1); }
+  if(!bin) setvbuf(out, NULL, _IOFBF, 1<<20);
+  basename66(argv[1], aname, ".ans");
+  if((ans=fopen(aname, "w"))==NULL){ fprintf(stderr,"Cannot write %s\n", aname); exit(1); }
+  fprintf(ans, "# tvigen 1.0:");
+  for(k=0;k<opt66argc;k++) fprintf(ans, " %s", opt66argv[k]);
+  fprintf(ans, "\n");
+  if(kind=='c') fprintf(ans, "# cycle Qcharge_Ah Qdischarge_Ah u (bcp66's cycles, charge then discharge)\n");
+
+  if(nb>0){						// where the logger restarts: evenly, by sample or by size
+    brk=malloc(nb*sizeof(long));
+    if(brk==NULL) exit(1);
+    for(k=0;k<nb;k++) brk[k]=(k+1)*((n>0)? n : (long)(size/(bin? ncol*8.0 : 30.0)))/(nb+1);
+  }
+  cyc0=g.cyc;
+  for(k=0,j=0;n<0 || k<n;k++){
+    if(n<0 && nbytes>=size) break;
+    if(k>0){
+      dt=g.dt*(1.0+g.jit*(2.0*uni(&g)-1.0));
+      t+=dt; tw+=dt;
+    }else dt=0.0;
+    if(j<nb && k>=brk[j]){ tw=0.0; j++; }	// restarted: time from 0 again
+    sample(&g, t+0.3*g.dt, dt, &v, &i);	// off the zero crossings, where I=0 would hide an edge from getUTheta
+    x[0]=q6(tw, 6); x[1]=q6(v, 6); x[2]=q6(i, 9); x[3]=q6(g.soc, 9); x[4]=g.cyc;
+    if(k>0){						// as tvi2u sums it, before the noise
+      if(x[2]>0.0) ein+=dt*x[2]*x[1];
+      else eout-=dt*x[2]*x[1];
+    }
+    if(kind=='c'){
+      if(g.cyc!=cyc0){
+        fprintf(ans, "%d %.6lf %.6lf %.6lf\n", cyc0, g.cq[0], g.cq[1], g.ce[1]/g.ce[0]);
+        memset(g.cq, 0, sizeof(g.cq)); memset(g.ce, 0, sizeof(g.ce));
+        cyc0=g.cyc;
+      }
+      g.cq[x[2]<0.0]+=fabs(x[2])*dt/3600.0;
+      g.ce[x[2]<0.0]+=fabs(x[2]*x[1])*dt;
+    }
+    if(g.vn>0.0) x[1]=q6(v+g.vn*gauss(&g), 6);
+    if(g.in>0.0) x[2]=q6(i+g.in*gauss(&g), 9);
+    nrec+=1.0;
+    if(bin){
+      tvibput(out, x, ncol);
+      nbytes+=ncol*8.0;
+      continue;
+    }
+    p=fix(line, x[0], 6); *p++=' ';
+    p=fix(p, x[1], 6); *p++=' ';
+    p=fix(p, x[2], 9);
+    if(ncol==5){ *p++=' '; *p++=' '; p=fix(p, x[3], 9); *p++=' '; p=fix(p, x[4], 0); }
+    *p++='\n';
+    fwrite(line, 1, p-line, out);
+    nbytes+=p-line;
+  }
+  if(fclose(out)){ fprintf(stderr,"Error writing %s\n", argv[1]); exit(1); }
+
+  fprintf(ans, "samples %.0lf\n", nrec);
+  fprintf(ans, "seconds %.6lf\n", t);
+  fprintf(ans, "restarts %ld\n", nb);
+  fprintf(ans, "U %.6lf\n", (ein!=0.0)? eout/ein : 0.0);	// tvi2u's final u, noise aside
+  if(kind=='m'){
+    fprintf(ans, "# f |Z| phase_deg\n");
+    for(k=0;k<g.nt;k++) fprintf(ans, "z %e %e %.4lf\n", g.ft[k], cabs(g.zt[k]), carg(g.zt[k])*180.0/M_PI);
+  }
+  if(kind=='s'){				// Ein & Eout over a cycle of V0 + Va cos(wt-th) by Ia cos(wt)
+    Va=g.Ia*cabs(g.zt[0]); th=-carg(g.zt[0]); c=cos(th);
+    u=(4.0*g.V0-M_PI*Va*c)/(4.0*g.V0+M_PI*Va*c);
+    ae=acos(2.0*g.V0*(1.0-u)/(M_PI*Va))*2.0/M_PI;		// as getUTheta has it
+    fprintf(ans, "u %.6lf\ntheta %.6lf\nalpha %.6lf\ngetUTheta_alpha %.6lf\ncpe_alpha %.6lf\n", u, th, 2.0*th/M_PI, ae, g.al);
+  }
+  if(kind=='q'){				// over the table, midpoints
+    double tq;					// t is the record's length, printed below
+
+    for(c=0.0,Va=0.0,k=0;k<GENTAB;k++){
+      tq=(k+0.5)/GENTAB/g.f;
+      sample(&g, tq, 0.0, &v, &i);
+      if(i>0.0) c+=v*i; else Va-=v*i;
+    }
+    fprintf(ans, "u %.6lf\ncpe_alpha %.6lf\n", Va/c, g.al);
+  }
+  if(kind=='c') fprintf(ans, "cycles %d\n", cyc0-1);
+  fclose(ans);
+  fprintf(stderr, "%s: %.0lf samples, %.0lf bytes of records, %.1lfs; answers in %s\n", argv[1], nrec, nbytes, t, aname);
+  free(g.tab); free(brk); free(g.ft); free(g.pt); free(g.zt);
+  return 0;
+}
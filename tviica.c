@@ -0,0 +1,168 @@
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
+#include	<math.h>
+#include	"tvicyx.h"
+#include	"opt66.h"
+
+// Incremental capacity (dQ/dV) and CV (dQ/dt) curves as tvi2ica.awk and
+// Cyc_tvi2ica_Plot.m make them, in one pass with nothing held but the
+// smoothing window.  Charge is summed sample by sample (I dt); each time V has
+// moved more than vstep from the last point, a point is made of the charge,
+// time and V moved since.  A curve is a run of points one way in V within one
+// cycle; -sN averages each point with N/2 either side on its own curve, as
+// sums of dQ, dt and dV so that dQ/dt and dQ/dV stay the ratios they are.
+// Several files are done at once, one per thread.
+
+#define SMAX 101				// widest smoothing window
+
+struct pt {
+  double v, dq, dt, dv;			// V at the point; charge, time & V moved since the last
+  long n;						// samples in it
+  long cyc;
+};
+
+struct curve {					// the curve in hand
+  int h, w;						// smoothing half-width, window 2h+1
+  struct pt r[SMAX];			// its last w points
+  long n, out;					// points in, written
+  FILE *f;
+  long npt, ncurve;
+};
+
+struct job {
+  char *in;
+  double vstep;
+  int h, bycyc;
+  long npt, ncurve, ncyc, nsamp, nbad;
+  int bad;
+};
+
+void emit(struct curve *c, long hi){	// point c->out, averaged up to point hi
+  struct pt *p=&c->r[c->out%c->w], *q;
+  double dq=0.0, dt=0.0, dv=0.0;
+  long j;
+
+  for(j=(c->out>c->h)? c->out-c->h : 0; j<=hi; j++){
+    q=&c->r[j%c->w];
+    dq+=q->dq; dt+=q->dt; dv+=q->dv;
+  }
+  fprintf(c->f,"%e %e %ld %e %.6lf %ld\n", p->v, (dt>0.0)? dq/dt : 0.0, p->n,
+    (dv!=0.0)? dq/dv/3600.0 : 0.0, p->dt, p->cyc);
+  c->out++;
+  c->npt++;
+}
+
+void flush(struct curve *c){		// the curve in hand ends
+  while(c->out<c->n) emit(c, (c->out+c->h<c->n)? c->out+c->h : c->n-1);
+  if(c->n>0) c->ncurve++;
+  c->n=c->out=0;
+}
+
+void push(struct curve *c, struct pt *p){
+  if(c->n>0 && (p->dv>0.0)!=(c->r[(c->n-1)%c->w].dv>0.0)) flush(c);	// turned: a new curve
+  c->r[c->n++%c->w] = *p;
+  while(c->out+c->h<c->n) emit(c, c->out+c->h);
+}
+
+void icaname(char *fname, char *out){	// base.ica for base.tvi[b|a]
+  char *d;
+
+  strcpy(out, fname);
+  d = strrchr(out, '.');
+  if(d!=NULL && strchr(d, '/')==NULL) *d='\0';
+  strcat(out, ".ica");
+}
+
+void ica(void *arg, long k){
+  struct job *j=(struct job *)arg+k;
+  struct tvird rd;
+  struct tvicstat st;
+  struct curve c;
+  struct pt p;
+  char oname[512];
+  double x[5], t, tlast=0.0, lastt=0.0, lastv=0.0, Q=0.0, dQ=0.0, lastdQ, dv;
+  long lines=0, cyc=0, npts=0;
+  int n;
+
+  if(strlen(j->in)>500 || tvirdopen(&rd, j->in)){ j->bad=1; return; }
+  icaname(j->in, oname);
+  memset(&c, 0, sizeof(c));
+  c.h=j->h; c.w=2*j->h+1;
+  c.f = fopen(oname, "w");
+  if(c.f==NULL){ fprintf(stderr,"Cannot write %s\n", oname); tvirdclose(&rd); j->bad=1; return; }
+  tvicstinit(&st);
+  while((n=tvirdnext(&rd, x, 5))>0){
+    t = tvicstitch(&st, x[0]);
+    if(j->nsamp++==0){
+      tlast=lastt=t; lastv=x[1];
+      if(j->bycyc && n>=5) cyc=llround(x[4]);
+    }
+    if(j->bycyc && n>=5 && llround(x[4])!=cyc){	// bcp66's cycle column: this sample starts the next
+      flush(&c);
+      cyc=llround(x[4]); j->ncyc++;
+      Q=0.0; lines=0; lastv=x[1]; lastt=t;
+    }
+    lastdQ = dQ;
+    dQ = x[2]*(t-tlast);
+    tlast = t;
+    Q += dQ;
+    lines++;
+    dv = x[1]-lastv;
+    if(fabs(dv)>j->vstep){						// moved the required voltage step
+      p.v=x[1]; p.dq=Q; p.dt=t-lastt; p.dv=dv; p.n=lines; p.cyc=cyc;
+      if(npts++>0) push(&c, &p);				// the first, from wherever the record starts, dropped as tvi2ica.awk does
+      Q=0.0; lines=0; lastv=x[1]; lastt=t;
+    }
+    if(j->bycyc && n<5 && cyxedge(dQ, lastdQ)){	// no cycle column: cycles as getUTheta counts them
+      flush(&c);
+      cyc++; j->ncyc++;
+      Q=0.0; lines=0; lastv=x[1]; lastt=t;
+    }
+  }
+  flush(&c);
+  j->npt=c.npt; j->ncurve=c.ncurve; j->nbad=rd.nbad;
+  if(fclose(c.f)){ fprintf(stderr,"Error writing %s\n", oname); j->bad=1; }
+  tvirdclose(&rd);
+}
+
+int main(int argc, char *argv[]){
+  struct job *j;
+  char oname[512];
+  int nth, k, bad=0;
+
+  opt66(&argc, argv);
+  nth = (opt66val('j')!=NULL)? atoi(opt66val('j')) : tviparcpu();
+  if ( argc<2 ) {
+    fprintf(stderr,"tviica                 V1.0 CJD & JBS 2026\n");
+    fprintf(stderr,"Usage: tviica file.tvi[b|a] [file2 ...] [-vVstep] [-sN] [-c] [-jN]\n");
+    fprintf(stderr,"Incremental capacity and cyclic voltammetry from t V I records (as tvi2ica.awk):\n");
+    fprintf(stderr,"a point each time V has moved more than Vstep (default 0.005V), to file.ica:\n");
+    fprintf(stderr,"V, dQ/dt (A), samples, dQ/dV (Ah/V), dt (s), cycle.\n");
+    fprintf(stderr,"-sN: each point averaged with N/2 either side on its own curve (one way in V).\n");
+    fprintf(stderr,"-c: curves cycle by cycle, from bcp66's cycle column, else as getUTheta counts.\n");
+    fprintf(stderr,"-jN: N files at a time (default all cores).\n");
+    exit(1);
+  }
+  j = calloc(argc-1, sizeof(struct job));
+  if(j==NULL){ fprintf(stderr,"Out of memory\n"); exit(1); }
+  for(k=0;k<argc-1;k++){
+    j[k].in = argv[k+1];
+    j[k].vstep = (opt66val('v')!=NULL)? atof(opt66val('v')) : 0.005;
+    j[k].h = (opt66val('s')!=NULL)? atoi(opt66val('s'))/2 : 0;
+    if(j[k].h<0) j[k].h=0;
+    if(2*j[k].h+1>SMAX) j[k].h=SMAX/2;
+    j[k].bycyc = opt66on('c');
+  }
+  tvipar(nth, argc-1, ica, j);
+  for(k=0;k<argc-1;k++){
+    if(j[k].bad){ bad=1; continue; }
+    icaname(j[k].in, oname);
+    fprintf(stderr,"%s: %ld samples, %ld points on %ld curves", oname, j[k].nsamp, j[k].npt, j[k].ncurve);
+    if(j[k].bycyc) fprintf(stderr,", %ld cycles", j[k].ncyc+1);
+    fprintf(stderr,"\n");
+    if(j[k].nbad) fprintf(stderr,"%s: %ld lines skipped\n", j[k].in, j[k].nbad);
+  }
+  free(j);
+  return bad;
+}
@@ -0,0 +1,214 @@
+// tvipar.h: run a job over the blocks of a record on several cores, or a pool of jobs that make jobs
+// for the analysis tools; link with -lpthread
+// JBS & CJD 2026
+//
+// tvipar(nth,n,fn,arg) calls fn(arg,k) for k = 0..n-1 on nth threads, each
+// taking the next k as it finishes the last, and returns when all are done.
+// The jobs keep their results per k and the caller combines them in k order,
+// so what comes out never depends on nth; nth<=1 is a plain loop.  tviparcpu()
+// is the default, the cores online.
+//
+// A tvipool is for work whose size is not known at the start (a batch of files,
+// each cut into blocks, then cycles, once it has been looked at).  Each worker
+// has its own deque of jobs: tvipoolput() from inside a job pushes on the back
+// of its own, it takes its next from the back (the newest, whose data it has
+// just touched), and with none left it steals from the front of another's (the
+// oldest, the biggest piece of work left there).  tvipoolrun() returns when
+// every job put, and every job those put, is done.
+
+#ifndef TVIPAR_H
+#define TVIPAR_H
+
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
+#include	<unistd.h>
+#include	<pthread.h>
+
+#define TVIPARMAX 256			// threads at most
+
+struct tvipar {
+	void (*fn)(void *arg, long k);
+	void *arg;
+	long n, next;
+	pthread_mutex_t mx;
+};
+
+void *tviparrun(void *arg)		// thread function
+{
+	struct tvipar *p = arg;
+	long k;
+
+	for(;;){
+		pthread_mutex_lock(&p->mx);
+		k = p->next++;
+		pthread_mutex_unlock(&p->mx);
+		if(k>=p->n) return NULL;
+		p->fn(p->arg,k);
+	}
+}
+
+void tvipar(int nth, long n, void (*fn)(void *, long), void *arg)
+{
+	struct tvipar p;
+	pthread_t th[TVIPARMAX];
+	int t, nt=0;
+	long k;
+
+	if(nth>n) nth=n;
+	if(nth>TVIPARMAX) nth=TVIPARMAX;
+	if(nth<=1){ for(k=0;k<n;k++) fn(arg,k); return; }
+	p.fn=fn; p.arg=arg; p.n=n; p.next=0;
+	pthread_mutex_init(&p.mx,NULL);
+	for(t=1;t<nth;t++) if(pthread_create(&th[nt],NULL,tviparrun,&p)==0) nt++;
+	tviparrun(&p);									// this thread works too
+	for(t=0;t<nt;t++) pthread_join(th[t],NULL);
+	pthread_mutex_destroy(&p.mx);
+}
+
+#define TVIPOOLQ 256			// deque size to start with, grows
+
+struct tvitask {
+	void (*fn)(void *arg, long k);
+	void *arg;
+	long k;
+};
+
+struct tvideq {
+	pthread_mutex_t mx;
+	struct tvitask *t;
+	long head, tail, max;		// jobs in [head,tail)
+};
+
+struct tvipool {
+	int nth;
+	struct tvideq q[TVIPARMAX];
+	pthread_mutex_t mx;			// pending, nput & the wait for work
+	pthread_cond_t cv;
+	long pending, nput, nsteal;	// jobs not yet finished, put so far, stolen
+};
+
+struct tvipoolarg {
+	struct tvipool *p;
+	int me;
+};
+
+static __thread int tvipoolme;	// the worker this thread is
+
+void tvipoolinit(struct tvipool *p, int nth)
+{
+	int t;
+
+	memset(p,0,sizeof(*p));
+	if(nth<1) nth=1;
+	if(nth>TVIPARMAX) nth=TVIPARMAX;
+	p->nth=nth;
+	for(t=0;t<nth;t++) pthread_mutex_init(&p->q[t].mx,NULL);
+	pthread_mutex_init(&p->mx,NULL);
+	pthread_cond_init(&p->cv,NULL);
+}
+
+void tvipoolput(struct tvipool *p, void (*fn)(void *, long), void *arg, long k)
+{
+	struct tvideq *q = &p->q[tvipoolme%p->nth];
+
+	pthread_mutex_lock(&q->mx);
+	if(q->tail>=q->max){
+		if(q->head>0){									// room at the front
+			memmove(q->t,q->t+q->head,(q->tail-q->head)*sizeof(struct tvitask));
+			q->tail -= q->head; q->head=0;
+		}
+		if(q->tail>=q->max){
+			q->max = 2*q->max+TVIPOOLQ;
+			q->t = realloc(q->t,q->max*sizeof(struct tvitask));
+			if(q->t==NULL){ fprintf(stderr,"Out of memory for jobs\n"); exit(1); }
+		}
+	}
+	q->t[q->tail].fn=fn; q->t[q->tail].arg=arg; q->t[q->tail].k=k;
+	q->tail++;
+	pthread_mutex_unlock(&q->mx);
+	pthread_mutex_lock(&p->mx);
+	p->pending++; p->nput++;
+	pthread_cond_signal(&p->cv);
+	pthread_mutex_unlock(&p->mx);
+}
+
+int tvipoolget(struct tvipool *p, int me, struct tvitask *t)	// 1 if a job was found
+{
+	struct tvideq *q;
+	int i, got=0;
+
+	q = &p->q[me];											// own, newest first
+	pthread_mutex_lock(&q->mx);
+	if(q->tail>q->head){ *t = q->t[--q->tail]; got=1; }
+	pthread_mutex_unlock(&q->mx);
+	for(i=1;!got && i<p->nth;i++){							// another's, oldest first
+		q = &p->q[(me+i)%p->nth];
+		pthread_mutex_lock(&q->mx);
+		if(q->tail>q->head){ *t = q->t[q->head++]; got=1; }
+		pthread_mutex_unlock(&q->mx);
+		if(got){
+			pthread_mutex_lock(&p->mx);
+			p->nsteal++;
+			pthread_mutex_unlock(&p->mx);
+		}
+	}
+	return got;
+}
+
+void *tvipoolwork(void *arg)		// thread function
+{
+	struct tvipoolarg *a = arg;
+	struct tvipool *p = a->p;
+	struct tvitask t;
+	long nput;
+
+	tvipoolme = a->me;
+	for(;;){
+		pthread_mutex_lock(&p->mx);
+		nput = p->nput;
+		pthread_mutex_unlock(&p->mx);
+		if(tvipoolget(p,a->me,&t)){
+			t.fn(t.arg,t.k);
+			pthread_mutex_lock(&p->mx);
+			if(--p->pending==0) pthread_cond_broadcast(&p->cv);
+			pthread_mutex_unlock(&p->mx);
+			continue;
+		}
+		pthread_mutex_lock(&p->mx);
+		if(p->pending==0){ pthread_mutex_unlock(&p->mx); return NULL; }
+		if(p->nput==nput) pthread_cond_wait(&p->cv,&p->mx);	// nothing put since the look: wait
+		pthread_mutex_unlock(&p->mx);
+	}
+}
+
+void tvipoolrun(struct tvipool *p)
+{
+	struct tvipoolarg a[TVIPARMAX];
+	pthread_t th[TVIPARMAX];
+	int t, nt=0, me=tvipoolme;
+
+	for(t=0;t<p->nth;t++){ a[t].p=p; a[t].me=t; }
+	for(t=1;t<p->nth;t++) if(pthread_create(&th[nt],NULL,tvipoolwork,&a[t])==0) nt++;
+	tvipoolwork(&a[0]);								// this thread works too
+	for(t=0;t<nt;t++) pthread_join(th[t],NULL);
+	tvipoolme = me;
+}
+
+void tvipoolfree(struct tvipool *p)
+{
+	int t;
+
+	for(t=0;t<p->nth;t++){ free(p->q[t].t); pthread_mutex_destroy(&p->q[t].mx); }
+	pthread_mutex_destroy(&p->mx);
+	pthread_cond_destroy(&p->cv);
+}
+
+int tviparcpu(void)
+{
+	long n=sysconf(_SC_NPROCESSORS_ONLN);
+
+	return (n>0)? (int)n : 1;
+}
+
+#endif
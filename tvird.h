@@ -0,0 +1,281 @@
+// tvird.h: one reader for .tvi text, .tvib records and .tvia archives, mapped, parsed in place
+// stand-alone, usable by the acquisition programs and the analysis tools
+// JBS & CJD 2026
+//
+// A text .tvi is mapped read-only and split at the newlines where it lies; each
+// line's columns (space, tab or comma separated, CR ignored) are decoded by
+// fastnum.h, never copied and never through sscanf(), and nothing is read
+// beyond the line end.  3-column t V I and bcp66's 5-column t V I Ah cycle are
+// both taken; a line with fewer than 3 numbers is skipped and counted.  A .tvib
+// is recognised by its magic and its records are handed out directly from the
+// mapping, so tvirdnext() is the same loop for either.  tvirdload() gives the
+// whole record as an array for the tools that go back over it: the mapping
+// itself for .tvib, t V I triples for text.  For reading in parallel the file is
+// cut into TVIRDBLK-byte blocks (at line starts), fixed by the file and not by
+// the number of threads, and tvirdpart() gives a reader over any stretch
+// between two tvirdtell() positions, sharing the one mapping.  A .tvia archive
+// (tvia.h) is read a block at a time into a buffer each reader keeps to
+// itself; its positions are record numbers, as in a .tvib.
+
+#ifndef TVIRD_H
+#define TVIRD_H
+
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
+#include	<fcntl.h>
+#include	<unistd.h>
+#include	<sys/mman.h>
+#include	<sys/stat.h>
+#include	"tvib.h"
+#include	"tvia.h"
+#include	"fastnum.h"
+
+#define TVIRDCOL 8				// most columns taken from a text line
+#define TVIRDLINE 256			// longest unterminated last line
+#define TVIRDBLK (4L<<20)		// bytes per block when read in pieces
+
+struct tvird {
+	int bin;					// .tvib
+	struct tvib tb;
+	char *map, *p, *end;		// text mapping, next line, end of file
+	size_t size;
+	long k, kend;				// records handed out (.tvib: next, end)
+	int sub;					// a part of another reader's mapping
+	long nbad;					// text lines skipped
+	int ncol;					// columns of the first record
+	double *mem;				// tvirdload() copy of a text file
+	int arch;					// .tvia
+	struct tvia ta;
+	double *abuf;				// its decoded block ablk
+	long ablk;
+};
+
+// 0 if OK, else prints why and returns -1
+int tvirdopen(struct tvird *r, char *fname)
+{
+	struct stat st;
+	int fd;
+
+	memset(r,0,sizeof(*r));
+	if(istvib(fname)){
+		if(tvibopen(&r->tb,fname)) return -1;
+		r->bin=1; r->ncol=r->tb.ncol; r->kend=r->tb.n;
+		return 0;
+	}
+	if(istvia(fname)){
+		if(tviaopen(&r->ta,fname)) return -1;
+		r->arch=1; r->ncol=r->ta.ncol; r->kend=r->ta.n; r->ablk=-1;
+		return 0;
+	}
+	fd = open(fname,O_RDONLY);
+	if(fd<0 || fstat(fd,&st)<0){fprintf(stderr,"Cannot open .tvi file %s!\n",fname); if(fd>=0) close(fd); return -1;}
+	r->size = st.st_size;
+	if(r->size>0){
+		r->map = mmap(NULL,r->size,PROT_READ,MAP_PRIVATE,fd,0);
+		if(r->map==MAP_FAILED){fprintf(stderr,"Cannot map %s\n",fname); r->map=NULL; close(fd); return -1;}
+		madvise(r->map,r->size,MADV_SEQUENTIAL);
+	}
+	close(fd);
+	r->p = r->map; r->end = r->map+r->size;
+	return 0;
+}
+
+// numbers on the line [s,e), up to n; returns # found, stops at the first non-number
+int tvirdline(char *s, char *e, double *x, int n)
+{
+	char *q;
+	int k=0;
+
+	while(k<n){
+		while(s<e && (*s==' ' || *s=='\t' || *s==',' || *s==';' || *s=='\r')) s++;
+		if(s>=e) break;
+		x[k] = fastnum(s,&q);
+		if(q==s || q>e) break;
+		k++;
+		s=q;
+	}
+	return k;
+}
+
+// .tvia record k, up to n columns into x, through the buffer abuf; 0 if it will not decode
+int tvirdarec(struct tvird *r, double *abuf, long *ablk, long k, double *x, int n)
+{
+	long b;
+
+	if(*ablk<0 || k<r->ta.ix[*ablk].k0 || k>=r->ta.ix[*ablk].k0+tviablock(&r->ta,*ablk)->n){
+		b = tviaseek(&r->ta,k);
+		if(tviaread(&r->ta,b,abuf)){ fprintf(stderr,"Archive block %ld does not decode\n",b); *ablk=-1; return 0; }
+		*ablk = b;
+	}
+	if(n>r->ncol) n=r->ncol;
+	memcpy(x,abuf+(k-r->ta.ix[*ablk].k0)*r->ncol,n*sizeof(double));
+	return n;
+}
+
+// next record, up to n columns into x; returns the columns there (>=3), 0 at the end
+int tvirdnext(struct tvird *r, double *x, int n)
+{
+	char *s, *e, last[TVIRDLINE];
+	double y[TVIRDCOL];
+	size_t len;
+	int k;
+
+	if(r->bin){
+		if(r->k>=r->kend) return 0;
+		k = (n<r->ncol)? n : r->ncol;
+		memcpy(x,tvibrec(&r->tb,r->k++),k*sizeof(double));
+		return k;
+	}
+	if(r->arch){
+		if(r->k>=r->kend) return 0;
+		if(r->abuf==NULL && (r->abuf=malloc(TVIABLK*r->ncol*sizeof(double)))==NULL){
+			fprintf(stderr,"Out of memory for archive block\n"); return 0;
+		}
+		k = tvirdarec(r,r->abuf,&r->ablk,r->k,x,n);
+		if(k) r->k++;
+		return k;
+	}
+	while(r->p<r->end){
+		s = r->p;
+		e = memchr(s,'\n',r->end-s);
+		if(e==NULL){								// unterminated last line: parse a copy
+			len = r->end-s;
+			if(len>=TVIRDLINE) len=TVIRDLINE-1;
+			memcpy(last,s,len); last[len]=0;
+			r->p = r->end;
+			s = last; e = last+len;
+		}else r->p = e+1;
+		k = tvirdline(s,e,y,TVIRDCOL);
+		if(k<3){ if(k>0 || e>s+1) r->nbad++; continue; }	// blank lines are not counted
+		if(r->k++==0) r->ncol=k;
+		if(k>n) k=n;
+		memcpy(x,y,k*sizeof(double));
+		return k;
+	}
+	return 0;
+}
+
+// the whole record: *ncol doubles per record, t first, *n of them; NULL if out of memory
+double *tvirdload(struct tvird *r, long *n, int *ncol)
+{
+	long max=0, b;
+
+	if(r->bin){ *n=r->tb.n; *ncol=r->tb.ncol; return r->tb.rec; }
+	if(r->arch){
+		*n=r->ta.n; *ncol=r->ncol;
+		r->mem = malloc((r->ta.n+1)*r->ncol*sizeof(double));
+		if(r->mem==NULL) return NULL;
+		for(b=0;b<r->ta.nblk;b++)
+			if(tviaread(&r->ta,b,r->mem+r->ta.ix[b].k0*r->ncol)){
+				fprintf(stderr,"Archive block %ld does not decode\n",b);
+				*n=r->ta.ix[b].k0;
+				break;
+			}
+		return r->mem;
+	}
+	*n=0; *ncol=3;
+	for(;;){
+		if(*n>=max){
+			max = (2*max>65536)? 2*max : 65536;
+			r->mem = realloc(r->mem,3*max*sizeof(double));
+			if(r->mem==NULL) return NULL;
+		}
+		if(tvirdnext(r,r->mem+3*(*n),3)==0) break;
+		(*n)++;
+	}
+	return r->mem;
+}
+
+long tvirdtell(struct tvird *r)				// position of the next record
+{
+	return (r->bin || r->arch)? r->k : r->p-r->map;
+}
+
+long tvirdnblk(struct tvird *r)
+{
+	long n = r->bin? r->tb.n*(long)r->tb.h->recsize : r->arch? r->ta.n*r->ncol*(long)sizeof(double) : (long)r->size;
+
+	return (n>0)? (n+TVIRDBLK-1)/TVIRDBLK : 1;
+}
+
+long tvirdblkpos(struct tvird *r, long b)		// position where block b starts
+{
+	long x, rpb;
+	char *e;
+
+	if(r->bin || r->arch){
+		rpb = TVIRDBLK/(r->ncol*sizeof(double));
+		x = b*rpb;
+		return (x<r->kend)? x : r->kend;
+	}
+	x = b*TVIRDBLK;
+	if(x<=0) return 0;
+	if(x>=(long)r->size) return r->size;
+	e = memchr(r->map+x-1,'\n',r->size-x+1);		// first line starting at or after x
+	return (e==NULL)? (long)r->size : e+1-r->map;
+}
+
+// s reads r's records from position from up to (not including) position to
+void tvirdpart(struct tvird *r, long from, long to, struct tvird *s)
+{
+	*s = *r;
+	s->sub=1; s->mem=NULL; s->nbad=0;
+	s->abuf=NULL; s->ablk=-1;
+	if(r->bin || r->arch){ s->k=from; s->kend=to; return; }
+	s->k=0;
+	s->p = r->map+from; s->end = r->map+to;
+}
+
+void tvirdblock(struct tvird *r, long b, struct tvird *s)	// s reads block b
+{
+	tvirdpart(r,tvirdblkpos(r,b),tvirdblkpos(r,b+1),s);
+}
+
+// the record before position pos (skipping bad lines), up to n columns into x and
+// its position into *prev; returns the columns there, 0 if there is none
+int tvirdprev(struct tvird *r, long pos, double *x, int n, long *prev)
+{
+	double y[TVIRDCOL], *buf;
+	char *s, *e;
+	long b=-1;
+	int k;
+
+	if(r->bin){
+		if(pos<=0) return 0;
+		k = (n<r->ncol)? n : r->ncol;
+		memcpy(x,tvibrec(&r->tb,pos-1),k*sizeof(double));
+		*prev=pos-1;
+		return k;
+	}
+	if(r->arch){								// r may be shared: a buffer of its own
+		if(pos<=0 || (buf=malloc(TVIABLK*r->ncol*sizeof(double)))==NULL) return 0;
+		k = tvirdarec(r,buf,&b,pos-1,x,n);
+		free(buf);
+		*prev=pos-1;
+		return k;
+	}
+	for(e=r->map+pos;e>r->map;e=s){					// e: start of the line after
+		for(s=e-1;s>r->map && s[-1]!='\n';s--);
+		k = tvirdline(s,e-1,y,TVIRDCOL);
+		if(k<3) continue;
+		if(k>n) k=n;
+		memcpy(x,y,k*sizeof(double));
+		*prev=s-r->map;
+		return k;
+	}
+	return 0;
+}
+
+void tvirdclose(struct tvird *r)
+{
+	if(!r->sub){
+		if(r->bin) tvibclose(&r->tb);
+		if(r->arch) tviaclose(&r->ta);
+		if(r->map!=NULL) munmap(r->map,r->size);
+	}
+	free(r->mem); free(r->abuf);
+	r->map=NULL; r->mem=NULL; r->abuf=NULL;
+}
+
+#endif
@@ -0,0 +1,267 @@
+// tviring.h: sample records from the measurement loop to a writer thread
+// include after prologix.h (uses msg(), progress(), err(), logfile)
+// JBS & CJD 2026
+//
+// The timed loop only copies fixed-size binary records into a single-producer,
+// single-consumer lock-free ring; the writer thread formats and flushes .tvi,
+// .ptvi, .log and the screen display in batches, so slow SD-card writes stay
+// out of the sample interval.  A full ring never blocks the loop: the record is
+// dropped and counted.  High-water mark and overruns are logged by r66stop().
+// With bin set, tvi/ptvi are .tvib streams (tvib.h) and get raw records.
+// Text records go to the program's logfile, or to the ring's own log when it
+// was started with r66startlog() (one ring and log per cell in multi66).
+// Started with r66starttim() and a .timing file (tvitime.h), the loop's sample
+// timing records go there too, and the writer adds one for each batch, timed
+// formatting, flushing and screen update.
+// Link with -lpthread.
+
+#ifndef TVIRING_H
+#define TVIRING_H
+
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
+#include	<math.h>
+#include	<time.h>
+#include	<pthread.h>
+#include	<stdatomic.h>
+#include	"tvib.h"
+#include	"tvitime.h"
+
+#define R66SIZE 16384			// records in ring, power of 2 (2MB)
+#define R66SHOW 0.1				// s between screen updates
+#define R66TXT 120				// longest text record
+
+enum {R66TVI, R66PTVI, R66TVI5, R66LOG, R66SAY, R66MSG, R66SHOWREC, R66SHOWLOG, R66TIME};
+
+struct rec66 {
+	int kind, k;				// record kind, integer field (digits, cycle...)
+	union {
+		double x[15];			// numbers for files & display
+		char s[R66TXT];			// or a line of text
+		struct tvitrec t;		// or a sample's timing
+	} u;
+};
+
+struct ring66 {
+	struct rec66 *rec;
+	_Atomic long head, tail;	// written only by loop / only by writer
+	_Atomic int stop;
+	long hiwater, overrun, nrec;
+	FILE *tvi, *ptvi, *log, *tim;
+	int bin;					// tvi/ptvi are .tvib
+	void (*show)(struct rec66 *r, char *buf);	// program's display line, runs in writer
+	pthread_t tid;
+};
+
+// engineering notation for the writer threads only (engstr()'s buffers belong to the loop)
+char *r66s(double x, int digits)
+{
+	static _Thread_local char b[16][40];
+	static _Thread_local int n=0;
+	char *p=b[n=(n+1)%16];
+	int e=0, d;
+	double m;
+
+	if(x!=0.0 && isfinite(x)){
+		e = (int)floor(log10(fabs(x)));
+		e = (e>=0)? (e/3)*3 : -((-e+2)/3)*3;
+	}
+	m = x/pow(10.0,e);
+	d = digits-1-(fabs(m)>=100.0?2:(fabs(m)>=10.0?1:0));		// significant figures
+	sprintf(p,"%.*lfe%d",MAX(d,0),m,e);
+	return p;
+}
+
+void *r66writer(void *arg)
+{
+	struct ring66 *r=arg;
+	struct rec66 *q;
+	struct timespec nap={0,20000000}, tn, tl={0,0};
+	struct tvitrec b;
+	char line[512];
+	double x[5], tb=0.0;
+	long h, t;
+	int stop, shown=TRUE;
+
+	while(1){
+		stop = atomic_load_explicit(&r->stop,memory_order_acquire);
+		h = atomic_load_explicit(&r->head,memory_order_acquire);
+		t = atomic_load_explicit(&r->tail,memory_order_relaxed);
+		if(r->tim!=NULL){						// this batch's timing
+			memset(&b,0,sizeof(b));
+			b.t = tb = tvitnow();
+			b.k = t-h;
+			b.d[TVITQ] = h-t;
+		}
+		for(;t<h;t++){							// one batch
+			q = &r->rec[t&(R66SIZE-1)];
+			switch(q->kind){
+				case R66TVI:
+				case R66PTVI:
+					if(r->bin) tvibput(q->kind==R66TVI?r->tvi:r->ptvi,q->u.x,3);
+					else fprintf(q->kind==R66TVI?r->tvi:r->ptvi,"%.*lf %s %s\n",
+						q->k,q->u.x[0],r66s(q->u.x[1],6),r66s(q->u.x[2],6));
+				break;
+				case R66TVI5:
+					if(r->bin){
+						memcpy(x,q->u.x,4*sizeof(double)); x[4]=q->k;
+						tvibput(r->tvi,x,5);
+					}else fprintf(r->tvi,"%.3lf %.3lf %.3lf  %s %d\n",q->u.x[0],q->u.x[1],q->u.x[2],r66s(q->u.x[3],3),q->k);
+				break;
+				case R66LOG:
+				case R66SAY:
+					if(r->log!=NULL) fprintf(r->log,"%s\n",q->u.s);
+					if(q->kind==R66SAY){strcpy(line,q->u.s); shown=FALSE;}
+				break;
+				case R66MSG:
+					strcpy(line,q->u.s); shown=FALSE;
+				break;
+				case R66SHOWREC:
+				case R66SHOWLOG:
+					if(r->show==NULL) break;
+					r->show(q,line); shown=FALSE;
+					if(q->kind==R66SHOWLOG && r->log!=NULL) fprintf(r->log,"%s\n",line);
+				break;
+				case R66TIME:
+					if(r->tim!=NULL) fwrite(&q->u.t,sizeof(q->u.t),1,r->tim);
+				break;
+			}
+		}
+		if(r->tim!=NULL){ b.d[TVITFMT] = tvitnow()-tb; tb+=b.d[TVITFMT]; }
+		if(t!=atomic_load_explicit(&r->tail,memory_order_relaxed)){	// wrote something
+			atomic_store_explicit(&r->tail,t,memory_order_release);
+			if(r->tvi!=NULL) fflush(r->tvi);
+			if(r->ptvi!=NULL) fflush(r->ptvi);
+			if(r->log!=NULL) fflush(r->log);
+			if(r->tim!=NULL) fflush(r->tim);
+		}
+		if(r->tim!=NULL){ b.d[TVITFLUSH] = tvitnow()-tb; tb+=b.d[TVITFLUSH]; }
+		clock_gettime(CLOCK_MONOTONIC,&tn);
+		if(!shown && (stop || (tn.tv_sec-tl.tv_sec)+(tn.tv_nsec-tl.tv_nsec)/1e9>=R66SHOW)){
+			msg(line);							// latest display line only
+			shown=TRUE; tl=tn;
+			if(r->tim!=NULL) b.d[TVITSHOW] = tvitnow()-tb;
+		}
+		if(r->tim!=NULL && b.k<0) fwrite(&b,sizeof(b),1,r->tim);	// goes out with the next batch
+		if(stop && t==atomic_load_explicit(&r->head,memory_order_acquire)) break;
+		nanosleep(&nap,NULL);
+	}
+	return NULL;
+}
+
+// start the writer; tvi/ptvi may be NULL, bin if they are .tvib, show formats R66SHOW* records
+// (may be NULL), text records go to log, timing records to tim (may be NULL)
+void r66starttim(struct ring66 *r, FILE *tvi, FILE *ptvi, FILE *log, FILE *tim, int bin, void (*show)(struct rec66 *, char *))
+{
+	r->rec = malloc(R66SIZE*sizeof(struct rec66));
+	if(r->rec==NULL) err("Out of memory for sample ring.");
+	atomic_init(&r->head,0); atomic_init(&r->tail,0); atomic_init(&r->stop,0);
+	r->hiwater = r->overrun = r->nrec = 0;
+	r->tvi=tvi; r->ptvi=ptvi; r->log=log; r->tim=tim; r->bin=bin; r->show=show;
+	if(pthread_create(&r->tid,NULL,r66writer,r)) err("Cannot start writer thread.");
+}
+
+void r66startlog(struct ring66 *r, FILE *tvi, FILE *ptvi, FILE *log, int bin, void (*show)(struct rec66 *, char *))
+{
+	r66starttim(r,tvi,ptvi,log,NULL,bin,show);
+}
+
+void r66start(struct ring66 *r, FILE *tvi, FILE *ptvi, int bin, void (*show)(struct rec66 *, char *))
+{
+	r66startlog(r,tvi,ptvi,logfile,bin,show);
+}
+
+// claim the next free record, NULL (and counted) if the writer has fallen behind
+struct rec66 *r66get(struct ring66 *r, int kind)
+{
+	long h=atomic_load_explicit(&r->head,memory_order_relaxed);
+	long used=h-atomic_load_explicit(&r->tail,memory_order_acquire);
+	struct rec66 *q;
+
+	if(used>=R66SIZE){r->overrun++; return NULL;}
+	if(used+1>r->hiwater) r->hiwater=used+1;
+	q = &r->rec[h&(R66SIZE-1)];
+	q->kind=kind;
+	return q;
+}
+
+void r66put(struct ring66 *r)		// publish the record from r66get()
+{
+	r->nrec++;
+	atomic_store_explicit(&r->head,atomic_load_explicit(&r->head,memory_order_relaxed)+1,memory_order_release);
+}
+
+// t v i triple to .tvi (R66TVI) or .ptvi (R66PTVI), time with tdig decimals
+void r66tvi(struct ring66 *r, int kind, int tdig, double t, double v, double i)
+{
+	struct rec66 *q=r66get(r,kind);
+
+	if(q==NULL) return;
+	q->k=tdig; q->u.x[0]=t; q->u.x[1]=v; q->u.x[2]=i;
+	r66put(r);
+}
+
+void r66tvi5(struct ring66 *r, double t, double v, double i, double ah, int cyc)	// bcp66 quintuple
+{
+	struct rec66 *q=r66get(r,R66TVI5);
+
+	if(q==NULL) return;
+	q->k=cyc; q->u.x[0]=t; q->u.x[1]=v; q->u.x[2]=i; q->u.x[3]=ah;
+	r66put(r);
+}
+
+// text line: R66LOG to the log, R66SAY to log & screen (progress()+msg()), R66MSG screen only
+void r66text(struct ring66 *r, int kind, char *s)
+{
+	struct rec66 *q=r66get(r,kind);
+
+	if(q==NULL) return;
+	strncpy(q->u.s,s,R66TXT-1);
+	q->u.s[R66TXT-1]='\0';
+	r66put(r);
+}
+
+// display record, up to 15 numbers + k for the program's show(); logit also logs the line
+void r66show(struct ring66 *r, int logit, int k, double *x, int n)
+{
+	struct rec66 *q=r66get(r,logit?R66SHOWLOG:R66SHOWREC);
+
+	if(q==NULL) return;
+	q->k=k;
+	memcpy(q->u.x,x,MIN(n,15)*sizeof(double));
+	r66put(r);
+}
+
+// top of each pass of the loop: the timing of the sample just ended (tvitime.h) to the ring
+static inline void r66time(struct ring66 *r, struct tvit *tt)
+{
+	struct tvitrec *p=tvitnext(tt);
+	struct rec66 *q;
+
+	if(p==NULL || (q=r66get(r,R66TIME))==NULL) return;
+	q->u.t = *p;
+	r66put(r);
+}
+
+void r66stop(struct ring66 *r)		// drain, stop the writer, log ring statistics
+{
+	char buf[128];
+
+	if(r->rec==NULL) return;
+	atomic_store_explicit(&r->stop,1,memory_order_release);
+	pthread_join(r->tid,NULL);
+	sprintf(buf,"Sample ring: %ld records, high-water %ld/%d, %ld overruns (dropped).",
+		r->nrec,r->hiwater,R66SIZE,r->overrun);
+	progress(buf);
+	free(r->rec);
+	r->rec=NULL;
+}
+
+void r66err(struct ring66 *r, char *s)	// fatal error inside the loop, keep what was logged
+{
+	r66stop(r);
+	err(s);
+}
+
+#endif
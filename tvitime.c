@@ -0,0 +1,172 @@
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
+#include	<math.h>
+#include	<time.h>
+#include	<sys/param.h>
+#include	"tvitime.h"
+#include	"opt66.h"
+
+// Where the time of an acquisition run went, from the .timing sidecar of a
+// -t run (tvitime.h).  For each loop phase, the sample period and the writer
+// thread's batches: mean, percentiles and max, from log-spaced histograms (40
+// bins a decade, so a percentile is good to 6%).  Then the achieved sample
+// rate over time, a line a window to stdout with the mean of each phase, the
+// longest period and the writer's longest flush and backlog, for plotting.
+// Samples longer than the stall threshold are counted by the phase that took
+// most of them, and the worst are listed with what the writer was doing then:
+// a stall in reply or write is the bus or adapter, in wait the sample clock,
+// in calc the program or the machine, and one in flush is the SD card.
+
+#define NB 400					// bins, 40 a decade from 0.1us
+#define NL 6					// loop phases and the period
+#define NW 3					// writer times
+#define NWORST 10
+
+struct hist{
+  long n, h[NB];
+  double sum, max;
+};
+
+void hadd(struct hist *h, double x){
+  int b=(x>1e-7)? (int)(40.0*log10(x*1e7))+1 : 0;
+
+  h->h[(b<NB)? b : NB-1]++;
+  h->n++;
+  h->sum+=x;
+  if(x>h->max) h->max=x;
+}
+
+double hpct(struct hist *h, double p){	// not exceeded by p% (upper edge of its bin)
+  long want=(long)ceil(p/100.0*h->n), sum=0;
+  int b;
+
+  for(b=0;b<NB;b++){
+    sum+=h->h[b];
+    if(sum>=want && sum>0) return MIN(1e-7*pow(10.0, b/40.0), h->max);
+  }
+  return h->max;
+}
+
+void hprint(char *name, struct hist *h, double total){
+  if(h->n==0) return;
+  fprintf(stderr, "%-8s %10.3f %9.3f %9.3f %9.3f %9.3f %10.3f %6.1f%%\n", name, 1e3*h->sum/h->n,
+    1e3*hpct(h, 50), 1e3*hpct(h, 90), 1e3*hpct(h, 99), 1e3*hpct(h, 99.9), 1e3*h->max, (total>0)? 100.0*h->sum/total : 0.0);
+}
+
+double period(struct tvitrec *r){		// the marks are contiguous
+  double p=0.0;
+  int j;
+
+  for(j=0;j<=TVITCALC;j++) p+=r->d[j];
+  return p;
+}
+
+int main(int argc, char *argv[]){
+  struct tvitf tf;
+  struct tvitrec *r, *worst[NWORST];
+  struct hist hl[NL], hw[NW];
+  char *lname[NL]={"wait", "write", "reply", "bus", "calc", "period"}, *wname[NW]={"format", "flush", "show"};
+  char *s;
+  time_t ts;
+  double t0=0.0, t1=0.0, w, thr, p, sum[NL], pmax, fmax, qmax, wt, fl, span;
+  long k, nl=0, nwb=0, nst=0, bydom[TVITCALC+1], qhi=0, ns, nw;
+  int j, d, nworst=0, listn=NWORST;
+
+  opt66(&argc, argv);
+  if(argc!=2){
+    fprintf(stderr,"tvitime                V1.0 CJD & JBS 2026\n");
+    fprintf(stderr,"Usage: tvitime file.timing [-wSecs] [-sMs] [-nN] >file.rate\n");
+    fprintf(stderr,"Where the time went in a run made with -t (bcp66, bap66, bz3p66, bzdcp66):\n");
+    fprintf(stderr,"mean, p50, p90, p99, p99.9 & max (ms) of each loop phase, the sample period and\n");
+    fprintf(stderr,"the writer thread's formatting, flushes & screen updates, to stderr.\n");
+    fprintf(stderr,"wait: sleeping to the grid slot; write: to the adapter; reply: waiting for\n");
+    fprintf(stderr,"replies; bus: the rest of the transaction; calc: everything else in the loop.\n");
+    fprintf(stderr,"To stdout a line each window of Secs (1/40 of the run): t(s) samples/s, mean\n");
+    fprintf(stderr,"period & each phase, longest period, longest flush (ms) & most records waiting.\n");
+    fprintf(stderr,"Samples longer than Ms (5x the median period) are stalls, counted by the phase\n");
+    fprintf(stderr,"that took most of them; the N worst (%d) are listed with the writer's flushes.\n", NWORST);
+    exit(1);
+  }
+  if(opt66val('n')!=NULL) listn=MIN(MAX(atoi(opt66val('n')), 0), NWORST);
+  if(tvitopen(&tf, argv[1])) exit(1);
+  memset(hl, 0, sizeof(hl));
+  memset(hw, 0, sizeof(hw));
+  memset(bydom, 0, sizeof(bydom));
+
+  for(k=0;k<tf.n;k++){				// percentiles
+    r=tf.rec+k;
+    if(r->k<0){
+      for(j=0;j<NW;j++) hadd(&hw[j], r->d[j]);
+      if(r->d[TVITQ]>qhi) qhi=r->d[TVITQ];
+      nwb++;
+      continue;
+    }
+    p=period(r);
+    if(nl++==0) t0=r->t;
+    if(r->t+p>t1) t1=r->t+p;
+    for(j=0;j<=TVITCALC;j++) hadd(&hl[j], r->d[j]);
+    hadd(&hl[NL-1], p);
+  }
+  if(nl==0){fprintf(stderr, "No samples in %s\n", argv[1]); exit(1);}
+  span=t1-t0;
+  ts=tf.h->tstart;
+  fprintf(stderr, "%s: %s, started %s", argv[1], tf.h->prog, ctime(&ts));
+  fprintf(stderr, "%s\n", tf.h->args);
+  fprintf(stderr, "%ld samples over %.1lfs, %.2lf samples/s; %ld writer batches, at most %ld records waiting.\n",
+    nl, span, (span>0)? nl/span : 0.0, nwb, qhi);
+  fprintf(stderr, "%-8s %10s %9s %9s %9s %9s %10s %7s\n", "ms", "mean", "p50", "p90", "p99", "p99.9", "max", "share");
+  for(j=0;j<NL;j++) hprint(lname[j], &hl[j], hl[NL-1].sum);
+  for(j=0;j<NW;j++) hprint(wname[j], &hw[j], span);
+
+  w=(opt66val('w')!=NULL)? atof(opt66val('w')) : MAX(1.0, ceil(span/40.0));
+  thr=(opt66val('s')!=NULL)? 1e-3*atof(opt66val('s')) : 5.0*hpct(&hl[NL-1], 50);
+  printf("# t(s) samples/s period wait write reply bus calc maxperiod maxflush(ms) backlog\n");
+  wt=t0; ns=nw=0; pmax=fmax=qmax=0.0;
+  memset(sum, 0, sizeof(sum));
+  for(k=0;k<=tf.n;k++){				// windows & stalls, in the order the samples were taken
+    r=(k<tf.n)? tf.rec+k : NULL;
+    while(r==NULL || r->t>=wt+w){		// window done, empty ones too
+      printf("%.1lf %.2lf", wt-t0, ns/w);
+      for(j=0;j<NL;j++) printf(" %.3lf", (ns>0)? 1e3*sum[(j+NL-1)%NL]/ns : 0.0);	// period first
+      printf(" %.3lf %.3lf %.0lf\n", 1e3*pmax, 1e3*fmax, qmax);
+      wt+=w;
+      ns=nw=0; pmax=fmax=qmax=0.0;
+      memset(sum, 0, sizeof(sum));
+      if(r==NULL && wt>=t1) break;
+    }
+    if(r==NULL) break;
+    if(r->k<0){
+      nw++;
+      fmax=MAX(fmax, r->d[TVITFLUSH]);
+      qmax=MAX(qmax, r->d[TVITQ]);
+      continue;
+    }
+    p=period(r);
+    ns++;
+    for(j=0;j<=TVITCALC;j++) sum[j]+=r->d[j];
+    sum[NL-1]+=p;
+    pmax=MAX(pmax, p);
+    if(p<=thr) continue;
+    nst++;
+    for(d=0,j=1;j<=TVITCALC;j++) if(r->d[j]>r->d[d]) d=j;
+    bydom[d]++;
+    for(j=nworst;j>0 && period(worst[j-1])<p;j--) if(j<listn) worst[j]=worst[j-1];
+    if(j<listn){ worst[j]=r; if(nworst<listn) nworst++; }
+  }
+
+  fprintf(stderr, "%ld stalls over %.3lfms", nst, 1e3*thr);
+  for(s=": ",j=0;j<=TVITCALC;j++) if(bydom[j]){ fprintf(stderr, "%s%ld mostly %s", s, bydom[j], lname[j]); s=", "; }
+  fprintf(stderr, ".\n");
+  for(j=0;j<nworst;j++){
+    r=worst[j];
+    p=period(r);
+    for(fl=0.0,k=0;k<tf.n;k++)			// the writer's batches that overlap it
+      if(tf.rec[k].k<0 && tf.rec[k].t<=r->t+p && tf.rec[k].t+tf.rec[k].d[TVITFMT]+tf.rec[k].d[TVITFLUSH]>=r->t)
+        fl=MAX(fl, tf.rec[k].d[TVITFLUSH]);
+    fprintf(stderr, "  sample %d at %.3lfs: %.3lfms = wait %.3lf write %.3lf reply %.3lf bus %.3lf calc %.3lf, writer flush %.3lf\n",
+      r->k, r->t-t0, 1e3*p, 1e3*r->d[TVITWAIT], 1e3*r->d[TVITWRITE], 1e3*r->d[TVITREPLY], 1e3*r->d[TVITBUS], 1e3*r->d[TVITCALC], 1e3*fl);
+  }
+  tvitfclose(&tf);
+  return 0;
+}
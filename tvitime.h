@@ -0,0 +1,201 @@
+// tvitime.h: per-sample phase timing of the acquisition loops, the .timing sidecar
+// stand-alone, usable by the acquisition programs (-t, through tviring.h) and by tvitime
+// JBS & CJD 2026
+//
+// With -t the set/measure loop marks where each sample's time goes, on
+// CLOCK_MONOTONIC: sleeping to the grid slot (wait), writing to the adapter
+// (write), waiting for replies, the round trips (reply), the rest of the bus
+// transaction, stale-byte drains, parsing and retries (bus), and everything
+// else, stimulus, state machine, live DFT and handing records to the ring
+// (calc).  The marks are contiguous, so the phases of a sample add up to the
+// time from its start to the next one's.  The record goes through the ring
+// like any other, and the writer thread, where formatting, msg() and the file
+// writes have run since tviring.h, adds one record for each batch it writes:
+// formatting, fflush (SD-card stalls show here), the screen update, and the
+// records that were waiting.  A .timing file is a TVITHDR-byte header then
+// fixed 32-byte records, host byte order as for .tvib; tvitime summarises it.
+// Without -t each mark is one test of a flag.
+
+#ifndef TVITIME_H
+#define TVITIME_H
+
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
+#include	<stdint.h>
+#include	<time.h>
+#include	<fcntl.h>
+#include	<unistd.h>
+#include	<sys/mman.h>
+#include	<sys/stat.h>
+
+#define TVITMAGIC "TVIT"
+#define TVITVER 1
+#define TVITHDR 512				// header bytes, records start here
+#define TVITBOM 0x01020304		// byte-order mark
+#define TVITNPH 5				// floats a record
+
+enum {TVITWAIT, TVITWRITE, TVITREPLY, TVITBUS, TVITCALC};	// loop phases
+enum {TVITFMT, TVITFLUSH, TVITSHOW, TVITQ};			// writer batch: s, s, s, records waiting
+#define TVITLOOP "wait write reply bus calc"
+#define TVITWR "format flush show backlog"
+
+struct tvithdr {
+	char magic[4];				// "TVIT"
+	uint32_t bom;				// TVITBOM as written
+	uint16_t version, hdrsize;	// format version, offset of first record
+	uint16_t nph, recsize;		// floats a record, bytes a record
+	int64_t tstart;				// run start, unix seconds
+	double t0;					// CLOCK_MONOTONIC when the file was made
+	char loop[48];				// loop phase names
+	char wr[48];				// writer batch fields
+	char prog[64];				// program & version
+	char args[TVITHDR-192];		// command line
+};
+
+struct tvitrec {
+	double t;					// CLOCK_MONOTONIC, start of the sample or batch
+	int32_t k;					// sample, or -(records written) for a writer batch
+	float d[TVITNPH];			// loop phases or writer fields
+};
+
+double tvitnow(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC,&t);
+	return t.tv_sec+t.tv_nsec/1e9;
+}
+
+// ---------------- the loop's marks ----------------
+struct tvit {
+	FILE *f;					// the .timing, NULL when off
+	double ts, last;			// this sample's start, last mark
+	double *wr, *rd;			// the bus's running write & reply times (rx66.h), cleared as taken
+	long k;						// samples
+	struct tvitrec r, done;		// sample in hand, the last one closed
+};
+
+// open fname and put the header out, or with fname NULL just mark nothing; 0 if OK
+int tvitcreate(struct tvit *t, char *fname, char *prog, int argc, char **argv, time_t tstart, double *wr, double *rd)
+{
+	struct tvithdr h;
+	int k;
+
+	memset(t,0,sizeof(*t));
+	t->wr=wr; t->rd=rd;
+	if(fname==NULL) return 0;
+	t->f = fopen(fname,"wb");
+	if(t->f==NULL) return -1;
+	memset(&h,0,sizeof(h));
+	memcpy(h.magic,TVITMAGIC,4);
+	h.bom = TVITBOM;
+	h.version = TVITVER; h.hdrsize = TVITHDR;
+	h.nph = TVITNPH; h.recsize = sizeof(struct tvitrec);
+	h.tstart = tstart;
+	h.t0 = tvitnow();
+	strcpy(h.loop,TVITLOOP);
+	strcpy(h.wr,TVITWR);
+	strncpy(h.prog,prog,sizeof(h.prog)-1);
+	for(k=0;k<argc;k++){
+		if(strlen(h.args)+strlen(argv[k])+2>=sizeof(h.args)) break;
+		if(k) strcat(h.args," ");
+		strcat(h.args,argv[k]);
+	}
+	if(fwrite(&h,sizeof(h),1,t->f)!=1){fclose(t->f); t->f=NULL; return -1;}
+	return 0;
+}
+
+// time since the last mark to phase ph
+static inline void tvitmark(struct tvit *t, int ph)
+{
+	double now;
+
+	if(t->f==NULL) return;
+	now = tvitnow();
+	t->r.d[ph] += now-t->last;
+	t->last = now;
+}
+
+// the same for a bus transaction, less what went on writing and on waiting for replies
+static inline void tvitbus(struct tvit *t)
+{
+	double now;
+
+	if(t->f==NULL) return;
+	now = tvitnow();
+	t->r.d[TVITWRITE] += *t->wr;
+	t->r.d[TVITREPLY] += *t->rd;
+	t->r.d[TVITBUS] += now-t->last-*t->wr-*t->rd;
+	*t->wr = *t->rd = 0.0;
+	t->last = now;
+}
+
+// close the sample in hand (what is left to calc) and start the next; the record
+// to hand on, NULL before the first sample and when off
+static inline struct tvitrec *tvitnext(struct tvit *t)
+{
+	double now;
+
+	if(t->f==NULL) return NULL;
+	now = tvitnow();
+	if(t->k++==0){						// first sample, nothing to close
+		*t->wr = *t->rd = 0.0;			// bring-up traffic is not this sample's
+		t->ts = t->last = now;
+		return NULL;
+	}
+	t->r.d[TVITCALC] += now-t->last;
+	t->r.t = t->ts; t->r.k = t->k-2;
+	t->done = t->r;
+	memset(&t->r,0,sizeof(t->r));
+	t->ts = t->last = now;
+	return &t->done;
+}
+
+void tvitclose(struct tvit *t)
+{
+	if(t->f!=NULL) fclose(t->f);
+	t->f=NULL;
+}
+
+// ---------------- reading ----------------
+struct tvitf {
+	struct tvithdr *h;
+	struct tvitrec *rec;		// first record
+	long n;						// # records
+	size_t size;				// bytes mapped
+};
+
+// map a .timing read-only; 0 if OK, else prints why and returns -1
+int tvitopen(struct tvitf *tf, char *fname)
+{
+	struct stat st;
+	int fd;
+
+	memset(tf,0,sizeof(*tf));
+	fd = open(fname,O_RDONLY);
+	if(fd<0 || fstat(fd,&st)<0){fprintf(stderr,"Cannot open %s\n",fname); if(fd>=0) close(fd); return -1;}
+	if(st.st_size<(off_t)sizeof(struct tvithdr)){fprintf(stderr,"%s too short for .timing\n",fname); close(fd); return -1;}
+	tf->size = st.st_size;
+	tf->h = mmap(NULL,tf->size,PROT_READ,MAP_SHARED,fd,0);
+	close(fd);
+	if(tf->h==MAP_FAILED){fprintf(stderr,"Cannot map %s\n",fname); tf->h=NULL; return -1;}
+	if(memcmp(tf->h->magic,TVITMAGIC,4) || tf->h->bom!=TVITBOM || tf->h->version>TVITVER ||
+			tf->h->nph!=TVITNPH || tf->h->recsize!=sizeof(struct tvitrec)){
+		fprintf(stderr,"%s: not a .timing this build can read (version/byte order)\n",fname);
+		munmap(tf->h,tf->size); tf->h=NULL;
+		return -1;
+	}
+	tf->rec = (struct tvitrec *)((char *)tf->h+tf->h->hdrsize);
+	tf->n = (tf->size-tf->h->hdrsize)/tf->h->recsize;	// a torn last record is ignored
+	madvise(tf->h,tf->size,MADV_SEQUENTIAL);
+	return 0;
+}
+
+void tvitfclose(struct tvitf *tf)
+{
+	if(tf->h!=NULL) munmap(tf->h,tf->size);
+	tf->h=NULL;
+}
+
+#endif
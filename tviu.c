@@ -0,0 +1,234 @@
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
+#include	<math.h>
+#include	"getut.h"
+#include	"opt66.h"
+
+// tvi2u.c, tvi2u.awk, getURegCyc.awk and getUTheta.c in one pass over the file.
+// Each is a metric with its own running sums and step, and keeps its tool's
+// output exactly: getUTheta's .tu on stdout and report on stderr, the others
+// to files by the input's name (below).  The sample loop is one always-inline
+// function of a constant metric mask, made once for every mask (RUN()), so
+// the loop for a set of metrics has only their steps in it and the rest cost
+// nothing.  Like the tools, tvi2u and the awk scripts take time as it is and
+// getUTheta stitched (tvicond.h); getUTheta's cycles are folded (getut.h) as
+// each one ends, so nothing is held but the sums of the cycle in hand.
+
+#define MU 1					// tvi2u.c: running u at each sample -> baseRun.tu
+#define MW 2					// tvi2u.awk: the same, I>=0 as charge, %f -> baseRunAwk.tu
+#define MR 4					// getURegCyc.awk: u=E/I2 a cycle -> baseRegCyc.tu & .txt
+#define MT 8					// getUTheta.c: u, theta, alpha a cycle -> stdout & stderr
+#define MALL 15
+
+struct eng{
+  long n;						// samples
+  double Rs;
+  FILE *tu, *wtu, *rtu, *rtxt;
+  // tvi2u.c
+  double lastmtime, ein, eout, u;
+  // tvi2u.awk
+  double tnow, Ein, Eout, wu;
+  // getURegCyc.awk
+  double rlast, rdQ, rlastdQ2, energy, loss, cumdQ, timePeriod;
+  double rusum, E, L, totQ, *uArray;
+  long count, maxu;
+  // getUTheta.c
+  struct tvicstat st;
+  long nseg;
+  struct acc a;
+  struct gut g;
+};
+
+int sign(double x){
+  if(x<=0) return -1;
+  else return 1;
+}
+
+static inline void stepu(struct eng *e, double *x){	// tvi2u.c
+  double dt=x[0]-e->lastmtime;
+
+  e->lastmtime=x[0];
+  if(e->n>0){
+    if(x[2]>0.00){e->ein+=dt*x[2]*x[1];}
+    else{e->eout-=dt*x[2]*x[1];}
+    if(e->ein!=0){e->u=e->eout/e->ein;}else{e->u=0.00;}
+    fprintf(e->tu, "%.3lf %.3lf \n", x[0], e->u);
+  }
+}
+
+static inline void stepw(struct eng *e, double *x){	// tvi2u.awk
+  double dt=x[0]-e->tnow;
+
+  e->tnow=x[0];
+  if(e->n>0){
+    if(x[2]>=0) e->Ein+=dt*fabs(x[1])*x[2];
+    else e->Eout+=dt*fabs(x[1])*fabs(x[2]);
+    if(e->Ein!=0) e->wu=e->Eout/e->Ein;
+    else e->wu=0;
+    fprintf(e->wtu, "%f %f\n", x[0], e->wu);
+  }
+}
+
+static inline void stepr(struct eng *e, double *x){	// getURegCyc.awk
+  double dt=x[0]-e->rlast, lastdQ, u;
+
+  e->rlast=x[0];
+  e->energy+=dt*x[1]*x[2];
+  lastdQ=e->rdQ;
+  e->rdQ=x[2]*dt;
+  e->cumdQ+=e->rdQ;
+  e->loss+=dt*x[2]*x[2];
+  if((sign(e->rdQ)!=sign(lastdQ)) && (sign(e->rdQ)==sign(e->rlastdQ2))){
+    u=e->energy/e->loss;
+    if(e->count>0){
+      fprintf(e->rtxt, "%.3f \tV=%.3f dQ=%f \tE=%f \tI2=%f \tu=%f \tT %.1fh Cycle %ld\n",
+        e->timePeriod/3600, x[1], e->cumdQ, e->energy, e->loss, u, (x[0]-e->timePeriod)/3600, e->count);
+      fprintf(e->rtu, "%.3f %f\n", e->timePeriod/3600, u);
+      if(e->count>=e->maxu){
+        e->maxu=2*e->maxu+1024;
+        e->uArray=realloc(e->uArray, e->maxu*sizeof(double));
+        if(e->uArray==NULL){fprintf(stderr, "Out of memory for cycles\n"); exit(1);}
+      }
+      e->uArray[e->count]=u;
+      e->rusum+=u;
+      e->E+=e->energy;
+      e->L+=e->loss;
+      e->totQ+=e->cumdQ;
+    }
+    e->timePeriod=x[0];
+    e->rlastdQ2=e->rdQ;
+    e->energy=0.00;
+    e->loss=0.00;
+    e->cumdQ=0.00;
+    e->count++;
+  }
+}
+
+static inline void stept(struct eng *e, double *x){	// getUTheta.c
+  double time;
+
+  time=tvicstitch(&e->st, x[0]);
+  if(e->st.nseg!=e->nseg){
+    e->nseg=e->st.nseg;
+    fprintf(stderr,"Non-monotonic time: segment %ld stitched on at %.1lf; dtmax=%.2lf, dtmin=%.2lf\n", e->nseg, time, e->st.dtmax, e->st.dtmin);
+  }
+  if(step(&e->a, time, x[1], x[2], e->Rs)){
+    gutcyc(&e->g, &e->a, e->g.timePeriod, 1);
+    accinit(&e->a, time, e->a.dQ);
+  }
+}
+
+// the one pass, with the steps of the metrics in m only
+static inline __attribute__((always_inline)) void run(struct eng *e, struct tvird *r, const int m){
+  double x[3];
+
+  while(tvirdnext(r, x, 3)){
+    if(m&MU) stepu(e, x);
+    if(m&MW) stepw(e, x);
+    if(m&MR) stepr(e, x);
+    if(m&MT) stept(e, x);
+    e->n++;
+  }
+}
+
+#define RUN(m) void run##m(struct eng *e, struct tvird *r){ run(e, r, m); }
+RUN(1) RUN(2) RUN(3) RUN(4) RUN(5) RUN(6) RUN(7) RUN(8)
+RUN(9) RUN(10) RUN(11) RUN(12) RUN(13) RUN(14) RUN(15)
+void (*runs[MALL+1])(struct eng *, struct tvird *)={NULL, run1, run2, run3, run4, run5, run6, run7,
+  run8, run9, run10, run11, run12, run13, run14, run15};
+
+FILE *outfile(char *fname, char *suffix){	// base+suffix for base.tvi[b|a]
+  char out[512], *d;
+  FILE *f;
+
+  if(strlen(fname)+strlen(suffix)>=sizeof(out)){fprintf(stderr, "File name too long\n"); exit(1);}
+  strcpy(out, fname);
+  d=strrchr(out, '.');
+  if(d!=NULL && strchr(d, '/')==NULL) *d='\0';
+  strcat(out, suffix);
+  f=fopen(out, "w");
+  if(f==NULL){fprintf(stderr, "Cannot write %s\n", out); exit(1);}
+  return f;
+}
+
+int main(int argc, char *argv[]){
+  struct tvird rd;
+  struct eng e;
+  char tbuf[512], *s;
+  double umean, uVar, uusum=0.00, C_K=0.00;
+  long i, ucount;
+  int m=0;
+
+  opt66(&argc, argv);
+  if((s=opt66val('m'))!=NULL) for(;*s;s++) switch(*s){
+    case 'u': m|=MU; break;
+    case 'w': m|=MW; break;
+    case 'r': m|=MR; break;
+    case 't': m|=MT; break;
+    default: argc=0;
+  }
+  if(m==0) m=MALL;
+  if(argc<2 || argc>3){
+    fprintf(stderr,"tviu                   V1.0 CJD & JBS 2026\n");
+    fprintf(stderr,"Usage: tviu file.tvi[b|a] [Rs] [-m[uwrt]] >file.tu 2>results.txt\n");
+    fprintf(stderr,"The cycle and efficiency metrics of tvi2u, tvi2u.awk, getURegCyc.awk and getUTheta\n");
+    fprintf(stderr,"in one pass over the file, each as its own tool writes it (-m picks, default all):\n");
+    fprintf(stderr,"u: tvi2u, running u at each sample to fileRun.tu, final u on stderr.\n");
+    fprintf(stderr,"w: tvi2u.awk, the same in its format to fileRunAwk.tu.\n");
+    fprintf(stderr,"r: getURegCyc.awk, u=E/I2 a cycle to fileRegCyc.tu, its report to fileRegCyc.txt.\n");
+    fprintf(stderr,"t: getUTheta (Rs its series resistance), u, theta & alpha a cycle to stdout,\n");
+    fprintf(stderr,"   its report to stderr.\n");
+    exit(1);
+  }
+
+  if(tvirdopen(&rd, argv[1])) exit(1);
+  memset(&e, 0, sizeof(e));
+  if(m&MT){
+    if(argc==2){
+      fprintf(stderr, "Rs set to zero\n");
+    }
+    if(argc==3){
+      e.Rs = atof(argv[2]);
+      fprintf(stderr,"Rs set to %s\n",argv[2]);
+    }
+    tvicstinit(&e.st);
+    accinit(&e.a, 0.00, 0.00);
+    gutinit(&e.g, e.Rs, 0, stdout, stderr);
+  }
+  if(m&MU) e.tu=outfile(argv[1], "Run.tu");
+  if(m&MW) e.wtu=outfile(argv[1], "RunAwk.tu");
+  if(m&MR){ e.rtu=outfile(argv[1], "RegCyc.tu"); e.rtxt=outfile(argv[1], "RegCyc.txt"); }
+
+  runs[m](&e, &rd);
+
+  if(m&MT){
+    if(rd.nbad) fprintf(stderr, "%ld lines skipped\n", rd.nbad);
+    gutend(&e.g);
+    tvicstats(&e.st, tbuf);
+    fprintf(stderr, "Time base: %s\n", tbuf);
+    fprintf(stderr, "Mean u = %.6lf, variance = %.3e (%.3e%%), SD = %.3e, %d cycles\n", e.g.umean, e.g.uVar, 100*e.g.uVar/e.g.umean, sqrt(e.g.uVar), e.g.ucount);
+    fprintf(stderr, "Whole file U = %.3lf, adjusted U = %.3lf, total dQ = %.3lf (%.3fAh), start time = %.3lf (%.3lfh), starting voltage = %.3lf\n", e.g.U, C_K*e.g.U, e.g.totQ, e.g.totQ/3600, e.g.origtime, e.g.origtime/3600, e.g.origv);
+  }
+  if(m&MU){
+    fclose(e.tu);
+    fprintf(stderr,"total # lines = %ld; final u = %.3lf\n", e.n, e.u);
+  }
+  if(m&MW){
+    fclose(e.wtu);
+    fprintf(stderr,"\n%s %.5f\n", "For the file you just read in, final u value =", e.Eout/e.Ein);
+  }
+  if(m&MR){
+    ucount=e.count-1;
+    umean=e.rusum/ucount;
+    for(i=1; i<=ucount; i++)
+      uusum+=(e.uArray[i]-umean)*(e.uArray[i]-umean);
+    uVar=uusum/(ucount-1);
+    fprintf(e.rtxt, "Mean u = %.6f, variance = %.6f or %.3f%%, %ld cycles\n", umean, uVar, 100.00*uVar/umean, ucount);
+    fprintf(e.rtxt, "Whole file U = %.3f, total dQ = %.3f (%.3fAh)\n", e.E/e.L, e.totQ, e.totQ/3600);
+    fclose(e.rtu); fclose(e.rtxt);
+    free(e.uArray);
+  }
+  tvirdclose(&rd);
+  return 0;
+}
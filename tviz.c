@@ -0,0 +1,118 @@
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
+#include	<math.h>
+#include	<sys/param.h>
+#include	"opt66.h"
+
+void err(char *s){				// zdft.h & zfit.h stop on it (prologix.h's in the acquisition programs)
+  fprintf(stderr,"%s\n", s);
+  exit(1);
+}
+
+#include	"zdft.h"
+#include	"zfit.h"
+#include	"zfft.h"
+
+// Z at each tone of a multisine record, off line, as bz3p66 gets it after a
+// run: V & I at every tone in one pass over all whole cycles of fmin (zdft.h),
+// with -r all the tones and a drift of the given order fitted at once
+// (zfit.h), or with -d, for a dense spectrum of any number of tones on the
+// harmonics of fmin, an FFT of each cycle (zfft.h).  One line a tone to
+// stdout, f |Z| phase (degrees), the .fmp/.ffz columns; the tones are given,
+// or taken from the z lines of a tvigen .ans.
+
+double span(char *fname){			// seconds from the first sample to the last
+  struct tvird rd;
+  double x[3], y[3];
+  long p;
+
+  if(tvirdopen(&rd, fname)) exit(1);
+  if(tvirdnext(&rd, x, 3)==0 || tvirdprev(&rd, tvirdblkpos(&rd, tvirdnblk(&rd)), y, 3, &p)<=0) y[0]=x[0]=0.0;
+  tvirdclose(&rd);
+  return y[0]-x[0];
+}
+
+double *tone(double *f, int *nf, int *maxf, double x){	// x onto the tones, room made
+  if(*nf>=*maxf){
+    *maxf=2*(*maxf)+64;
+    f=realloc(f, *maxf*sizeof(double));
+    if(f==NULL) err("Out of memory for tones.");
+  }
+  f[(*nf)++]=x;
+  return f;
+}
+
+double wrap(double d){				// degrees into (-180,180]
+  d=fmod(d, 360.0);
+  if(d>180.0) d-=360.0;
+  if(d<=-180.0) d+=360.0;
+  return d;
+}
+
+int main(int argc, char *argv[]){
+  struct zdft zd;
+  struct zfit zv, zi;
+  FILE *a;
+  char line[256];
+  double *f=NULL, *vmag, *vpha, *imag, *ipha, *se, fmin=1e30, T;
+  long n;
+  int nf=0, maxf=0, k, np, j, pts;
+
+  opt66(&argc, argv);
+  if(opt66val('a')!=NULL){
+    if((a=fopen(opt66val('a'), "r"))==NULL){ fprintf(stderr,"Cannot read %s\n", opt66val('a')); exit(1); }
+    while(fgets(line, sizeof(line), a)!=NULL)
+      if(line[0]=='z' && line[1]==' ') f=tone(f, &nf, &maxf, atof(line+2));
+    fclose(a);
+  }
+  for(k=2;k<argc;k++) f=tone(f, &nf, &maxf, atof(argv[k]));
+  if(argc<2 || nf==0){
+    fprintf(stderr,"tviz                   V1.0 CJD & JBS 2026\n");
+    fprintf(stderr,"Usage: tviz file.tvi[b|a] f1 [f2 ...] [-afile.ans] [-r[order]|-d] >file.fmp\n");
+    fprintf(stderr,"Z at each tone (Hz) of a multisine record, as bz3p66 works it out after a run:\n");
+    fprintf(stderr,"f, |Z| & phase (degrees, +/-180) to stdout.  V & I at every tone from one pass\n");
+    fprintf(stderr,"over all whole cycles of the lowest, or -r a least-squares fit of all the tones\n");
+    fprintf(stderr,"and a drift polynomial of the order given (1) at once, or -d an FFT of each\n");
+    fprintf(stderr,"cycle, for any number of tones all on harmonics of the lowest (a dense\n");
+    fprintf(stderr,"spectrum, as bz3p66 -d).  -a: the tones of a tvigen .ans.\n");
+    exit(1);
+  }
+  for(k=0;k<nf;k++){
+    if(f[k]<=0.0){ fprintf(stderr,"Tones must be >0 Hz\n"); exit(1); }
+    fmin=MIN(fmin, f[k]);
+  }
+
+  vmag=malloc(nf*sizeof(double)); vpha=malloc(nf*sizeof(double));
+  imag=malloc(nf*sizeof(double)); ipha=malloc(nf*sizeof(double)); se=malloc(nf*sizeof(double));
+  if(vmag==NULL || vpha==NULL || imag==NULL || ipha==NULL || se==NULL) err("Out of memory for tones.");
+
+  if(opt66on('d')){
+    j=zfftfile(argv[1], nf, f, vmag, vpha, imag, ipha, se, &pts);
+    for(k=0,np=1;np<nf;np++) if(se[np]>se[k]) k=np;
+    fprintf(stderr,"FFT: %d tones, %d whole cycles at fmin, %d points per cycle, Z within +/-%.2lf%% (worst at %gHz).\n",
+      nf, j, pts, 100.0*se[k], f[k]);
+    for(k=0;k<nf;k++) printf("%e %e %.4lf\n", f[k], vmag[k]/imag[k], wrap(vpha[k]-ipha[k]));
+    return 0;
+  }
+  if(opt66on('r')){
+    if(nf>ZFITMAX) err("Too many tones to fit (-d for a dense spectrum).");
+    np=(opt66val('r')!=NULL)? atoi(opt66val('r'))+1 : 2;
+    T=span(argv[1]);
+    j=(int)floor(T*fmin);
+    n=zfitvi(argv[1], nf, f, np, 0.0, (j>0)? (j-0.01)/fmin : T, &zv, &zi);
+    if(!zv.ok || !zi.ok) err("Least-squares fit failed (too few samples, or tones not resolved).");
+    fprintf(stderr,"Fit: %ld samples, %d whole cycles, residual %.3eV & %.3eA rms.\n", n, j, zv.rms, zi.rms);
+    for(k=0;k<nf;k++) printf("%e %e %.4lf\n", f[k], zv.amp[k]/zi.amp[k], wrap(zv.pha[k]-zi.pha[k]));
+    return 0;
+  }
+  if(nf>ZDFTMAX) err("Too many DFT bins (-d for a dense spectrum).");
+  zdftinit(&zd, nf, f, 1.0/fmin);
+  n=zdftfile(&zd, argv[1]);
+  j=zdftcycles(&zd);
+  fprintf(stderr,"DFT: %ld samples, %d bins, %d whole cycles at fmin.\n", n, zd.nb, j);
+  zdftwin(&zd, 0, MAX(j,1), vmag, vpha, imag, ipha);
+  for(k=0;k<nf;k++) printf("%e %e %.4lf\n", f[k], vmag[k]/imag[k], wrap(vpha[k]-ipha[k]));
+  zdftfree(&zd);
+  return 0;
+}
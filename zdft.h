@@ -0,0 +1,234 @@
+// zdft.h: V & I phasors at every tone from one pass over a .tvi/.tvib record
+// include after prologix.h (uses err(), progress()); replaces the dftp .bat/.tmp round trip
+// JBS & CJD 2026
+//
+// Each sample is weighted by half the intervals either side of it (trapezoid,
+// so uneven sample times are fine) and multiplied into every bin's rotating
+// phasor e^{-jwt}.  The phasors advance by one complex multiply per bin per
+// sample; the step factor is only recomputed when the sample interval changes
+// and each phasor is set exactly at the start of every block, so nothing drifts.
+// Sums are kept per block of one fundamental period (1/fmin), so afterwards any
+// run of whole cycles can be taken as the window, and a straight line through
+// the block means (drift in V, charge walk in I) is taken out of every bin
+// exactly through the sums of e^{-jwt} and t e^{-jwt}, without reading the data again.
+// Phases are in degrees for x = A cos(2 pi f t + phase), t from the first sample.
+// Fed sample by sample from the measurement loop, zdftlive() gives Z at each
+// tone as each cycle completes, with a standard error from the scatter of the
+// one-cycle estimates, so a run can stop once every tone has settled.
+
+#ifndef ZDFT_H
+#define ZDFT_H
+
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
+#include	<math.h>
+#include	<complex.h>
+#include	"tvird.h"
+
+#define ZDFTMAX 48				// bins: tones plus square-wave harmonics
+#define ZDFTSTOP 3				// least whole cycles before a live estimate may end a run
+
+struct zdftblk {				// sums over one fundamental period
+	double complex Xv[ZDFTMAX], Xi[ZDFTMAX], E0[ZDFTMAX], E1[ZDFTMAX];
+	double w, wt, wv, wi;
+};
+
+struct zdft {
+	int nb;						// bins
+	double f[ZDFTMAX];
+	double T;					// block length (s)
+	double t0;					// first sample time
+	long n;						// samples taken
+	struct zdftblk *blk;
+	int nblk, maxblk;
+	double complex ph[ZDFTMAX], step[ZDFTMAX];	// e^{-jw tau} now, e^{-jw dt}
+	double dtstep;				// dt the step factors are for
+	double tp, vp, ip, dtp;		// pending sample and the interval before it
+	int cur;					// block the phasors are in
+};
+
+void zdftinit(struct zdft *z, int nb, double *f, double T)
+{
+	memset(z,0,sizeof(*z));
+	if(nb>ZDFTMAX) err("Too many DFT bins.");
+	z->nb=nb;
+	memcpy(z->f,f,nb*sizeof(double));
+	z->T=T;
+	z->cur=-1;
+}
+
+struct zdftblk *zdftblock(struct zdft *z, int b)	// block b, grown & zeroed on demand
+{
+	if(b>=z->maxblk){
+		z->maxblk = MAX(2*z->maxblk,b+16);
+		z->blk = realloc(z->blk,z->maxblk*sizeof(struct zdftblk));
+		if(z->blk==NULL) err("Out of memory for DFT blocks.");
+	}
+	while(z->nblk<=b) memset(&z->blk[z->nblk++],0,sizeof(struct zdftblk));
+	return &z->blk[b];
+}
+
+// fold one sample (tau from the first sample) with weight w into the sums
+void zdftsum(struct zdft *z, double tau, double v, double i, double w)
+{
+	struct zdftblk *bk;
+	double complex e;
+	int b=(int)floor(tau/z->T), k;
+
+	if(b<0) b=0;
+	bk = zdftblock(z,b);
+	if(b!=z->cur){									// exact phasors at each new block
+		for(k=0;k<z->nb;k++) z->ph[k] = cexp(-2.0*I*M_PI*z->f[k]*tau);
+		z->cur=b;
+	}
+	bk->w += w; bk->wt += w*tau;
+	bk->wv += w*v; bk->wi += w*i;
+	for(k=0;k<z->nb;k++){
+		e = w*z->ph[k];
+		bk->Xv[k] += v*e; bk->Xi[k] += i*e;
+		bk->E0[k] += e; bk->E1[k] += tau*e;
+	}
+}
+
+void zdftadd(struct zdft *z, double t, double v, double i)	// next sample, times increasing
+{
+	double dt;
+	int k;
+
+	if(z->n++==0){ z->t0=t; z->tp=t; z->vp=v; z->ip=i; z->dtp=0.0; return; }
+	dt = t-z->tp;
+	if(dt<=0.0) return;								// repeated or out of order, skip
+	zdftsum(z,z->tp-z->t0,z->vp,z->ip,0.5*(z->dtp+dt));	// pending sample, both sides known
+	if(fabs(dt-z->dtstep)>1e-9*dt){
+		for(k=0;k<z->nb;k++) z->step[k] = cexp(-2.0*I*M_PI*z->f[k]*dt);
+		z->dtstep=dt;
+	}
+	if((int)floor((t-z->t0)/z->T)==z->cur)
+		for(k=0;k<z->nb;k++) z->ph[k] *= z->step[k];
+	z->tp=t; z->vp=v; z->ip=i; z->dtp=dt;
+}
+
+void zdftend(struct zdft *z)					// last sample, half an interval
+{
+	if(z->n>1) zdftsum(z,z->tp-z->t0,z->vp,z->ip,0.5*z->dtp);
+	z->n=0;
+}
+
+int zdftcycles(struct zdft *z)					// whole blocks recorded
+{
+	if(z->nblk<1) return 0;
+	return (z->blk[z->nblk-1].w>=0.99*z->T)? z->nblk : z->nblk-1;
+}
+
+// detrended amplitude & phase (degrees) of V and I at each bin over blocks [b0,b1);
+// the trend is fitted to the block means, where whole cycles of the tones average out
+void zdftwin(struct zdft *z, int b0, int b1, double *vmag, double *vpha, double *imag, double *ipha)
+{
+	struct zdftblk s, *bk;
+	double complex X;
+	double tc, m0=0.0, m1=0.0, m2=0.0, mv=0.0, mtv=0.0, mi=0.0, mti=0.0, det;
+	double av=0.0, bv=0.0, ai=0.0, bi=0.0;
+	int b, k;
+
+	memset(&s,0,sizeof(s));
+	b1 = MIN(b1,z->nblk);
+	for(b=b0;b<b1;b++){
+		bk = &z->blk[b];
+		s.w += bk->w; s.wt += bk->wt; s.wv += bk->wv; s.wi += bk->wi;
+		for(k=0;k<z->nb;k++){
+			s.Xv[k] += bk->Xv[k]; s.Xi[k] += bk->Xi[k];
+			s.E0[k] += bk->E0[k]; s.E1[k] += bk->E1[k];
+		}
+		if(bk->w<=0.0) continue;
+		tc = bk->wt/bk->w;								// block centre & means, weighted by length
+		m0 += bk->w; m1 += bk->w*tc; m2 += bk->w*tc*tc;
+		mv += bk->wv; mtv += tc*bk->wv;
+		mi += bk->wi; mti += tc*bk->wi;
+	}
+	if(s.w<=0.0){ for(k=0;k<z->nb;k++) vmag[k]=vpha[k]=imag[k]=ipha[k]=0.0; return; }
+	det = m0*m2-m1*m1;
+	if(b1-b0>1 && det>1e-12*m0*m2){					// straight line through the block means
+		bv = (m0*mtv-m1*mv)/det;
+		bi = (m0*mti-m1*mi)/det;
+	}
+	av = (s.wv-bv*s.wt)/s.w;
+	ai = (s.wi-bi*s.wt)/s.w;
+	for(k=0;k<z->nb;k++){
+		X = s.Xv[k]-av*s.E0[k]-bv*s.E1[k];
+		vmag[k] = 2.0*cabs(X)/s.w;
+		vpha[k] = carg(X)*180.0/M_PI;
+		X = s.Xi[k]-ai*s.E0[k]-bi*s.E1[k];
+		imag[k] = 2.0*cabs(X)/s.w;
+		ipha[k] = carg(X)*180.0/M_PI;
+	}
+}
+
+struct zdftlive {				// running Z while the record is still growing
+	int ncyc;					// whole cycles folded in
+	double complex Z[ZDFTMAX];	// over all of them, trend removed
+	double complex s[ZDFTMAX];	// sum of the one-cycle estimates
+	double s2[ZDFTMAX];			// and of their |.|^2
+	double se[ZDFTMAX];			// standard error of Z, relative to |Z|
+};
+
+void zdftliveinit(struct zdftlive *l)
+{
+	memset(l,0,sizeof(*l));
+}
+
+double complex zdftratio(double vm, double vp, double im, double ip)	// V/I from amplitude & phase
+{
+	return (im>0.0)? vm/im*cexp(I*(vp-ip)*M_PI/180.0) : 0.0;
+}
+
+// fold in cycles completed since the last call (blocks before the one being
+// filled); returns # added, Z and se are updated when that is >0
+int zdftlive(struct zdft *z, struct zdftlive *l)
+{
+	double vm[ZDFTMAX], vp[ZDFTMAX], im[ZDFTMAX], ip[ZDFTMAX], v;
+	double complex Zb;
+	int k, add=0;
+
+	for(;l->ncyc<z->cur;l->ncyc++,add++){
+		zdftwin(z,l->ncyc,l->ncyc+1,vm,vp,im,ip);
+		for(k=0;k<z->nb;k++){
+			Zb = zdftratio(vm[k],vp[k],im[k],ip[k]);
+			l->s[k] += Zb;
+			l->s2[k] += creal(Zb*conj(Zb));
+		}
+	}
+	if(add==0) return 0;
+	zdftwin(z,0,l->ncyc,vm,vp,im,ip);
+	for(k=0;k<z->nb;k++){
+		l->Z[k] = zdftratio(vm[k],vp[k],im[k],ip[k]);
+		l->se[k] = 1.0;									// unknown from one cycle
+		if(l->ncyc<2 || cabs(l->Z[k])<=0.0) continue;
+		v = (l->s2[k]-creal(l->s[k]*conj(l->s[k]))/l->ncyc)/(l->ncyc-1.0);	// scatter of one-cycle Z
+		l->se[k] = sqrt(MAX(v,0.0)/l->ncyc)/cabs(l->Z[k]);
+	}
+	return add;
+}
+
+// one pass over a 3- or 5-column .tvi or a .tvib file; returns samples read
+long zdftfile(struct zdft *z, char *fname)
+{
+	struct tvird rd;
+	double x[3];
+	long n=0;
+
+	if(tvirdopen(&rd,fname)) err("Cannot open .tvi file for DFT.");
+	for(;tvirdnext(&rd,x,3);n++) zdftadd(z,x[0],x[1],x[2]);
+	tvirdclose(&rd);
+	zdftend(z);
+	return n;
+}
+
+void zdftfree(struct zdft *z)
+{
+	free(z->blk);
+	z->blk=NULL;
+	z->nblk=z->maxblk=0;
+}
+
+#endif
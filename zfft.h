@@ -0,0 +1,172 @@
+// zfft.h: dense-spectrum Z, hundreds to thousands of tones on harmonics of fmin, by FFT
+// include after prologix.h (uses err()); for tone counts beyond zdft.h's ZDFTMAX
+// JBS & CJD 2026
+//
+// zfftgrid() spreads n tones logarithmically over the harmonics of fmin up to
+// fmax, so one period 1/fmin holds whole cycles of every tone.  zfftfile() then
+// takes the record a cycle at a time from its first sample, resamples each cycle
+// linearly onto P (a power of 2) uniform points and FFTs it, so every tone lands
+// exactly on bin h (its harmonic number) and the cost is P log P per cycle
+// whatever the number of tones.  Linear interpolation rolls off the highest
+// tones a little, but V and I share the time base so Z is not affected.  A line
+// through the cycle means (drift, charge walk) is taken out of each bin in closed
+// form, and the scatter of the one-cycle Z gives each tone a standard error.
+// Phases are in degrees for x = A cos(2 pi f t + phase), t from the first sample,
+// the same as zdft.h.
+
+#ifndef ZFFT_H
+#define ZFFT_H
+
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
+#include	<math.h>
+#include	<complex.h>
+#include	"tvird.h"
+
+#define ZFFTMAXP (1<<22)		// most points per cycle
+#define ZFFTOVER 4				// points per cycle >= ZFFTOVER * highest harmonic
+
+// n tones log-spaced over the harmonics of fmin to fmax (all of them if there are
+// fewer than n); returns how many were put in f
+int zfftgrid(double fmin, double fmax, int n, double *f)
+{
+	int H=(int)floor(fmax/fmin+1e-9), k, h, last=0, m=0;
+
+	for(k=0;k<n && H>=1;k++){
+		h = (n>1)? (int)floor(exp(log((double)H)*k/(n-1.0))+0.5) : 1;
+		if(h<=last) h=last+1;							// crowded at the bottom, next harmonic up
+		if(h>H) break;
+		f[m++] = h*fmin;
+		last = h;
+	}
+	return m;
+}
+
+double zfftlowest(int nf, double *f)
+{
+	double fmin=1e30;
+	int k;
+
+	for(k=0;k<nf;k++) fmin = MIN(fmin,f[k]);
+	return fmin;
+}
+
+int zfftharm(int nf, double *f)			// 1 if every tone is a harmonic of the lowest
+{
+	double fmin=zfftlowest(nf,f), h;
+	int k;
+
+	for(k=0;k<nf;k++){
+		h = f[k]/fmin;
+		if(fabs(h-floor(h+0.5))>1e-6*h) return 0;
+	}
+	return 1;
+}
+
+// in place, radix 2, n a power of 2, X[k] = sum x[j] e^{-2 pi i jk/n}; tw holds e^{-2 pi i k/n}, k<n/2
+void zfftrun(double complex *x, int n, double complex *tw)
+{
+	double complex u, v;
+	int i, j, k, len, step;
+
+	for(i=1,j=0;i<n;i++){								// bit reversal
+		for(k=n>>1;j&k;k>>=1) j^=k;
+		j|=k;
+		if(i<j){ u=x[i]; x[i]=x[j]; x[j]=u; }
+	}
+	for(len=2;len<=n;len<<=1){
+		step = n/len;
+		for(i=0;i<n;i+=len)
+			for(k=0;k<len/2;k++){
+				u = x[i+k];
+				v = x[i+k+len/2]*tw[k*step];
+				x[i+k] = u+v;
+				x[i+k+len/2] = u-v;
+			}
+	}
+}
+
+// V & I amplitude & phase at each tone (all harmonics of the lowest) over the whole
+// cycles of a 3- or 5-column .tvi or a .tvib; se[] is each tone's relative standard
+// error of Z; returns the cycles used, *pts the points per cycle
+int zfftfile(char *fname, int nf, double *f, double *vmag, double *vpha, double *imag, double *ipha, double *se, int *pts)
+{
+	struct tvird rd;
+	double *rec, *r0, *r1, T, tf, t, u, *mv, *mi, m0=0.0, m1=0.0, m2=0.0, sv=0.0, stv=0.0, si=0.0, sti=0.0;
+	double bv=0.0, bi=0.0, det, tc, zz, s2;
+	double complex *xv, *xi, *tw, *Xv, *Xi, Sv, Si, Zc, Zs, cv, ci, w;
+	long n, j=0, nn;
+	int ncol, C, P, H=0, c, k, *h;
+
+	if(tvirdopen(&rd,fname)) err("Cannot open .tvi file for FFT.");
+	rec = tvirdload(&rd,&n,&ncol);
+	if(rec==NULL) err("Out of memory for FFT.");
+	if(!zfftharm(nf,f)) err("Dense analysis needs every tone on a harmonic of the lowest.");
+	T = 1.0/zfftlowest(nf,f);
+	h = malloc(nf*sizeof(int));
+	if(h==NULL) err("Out of memory for FFT.");
+	for(k=0;k<nf;k++){ h[k] = (int)floor(f[k]*T+0.5); H = MAX(H,h[k]); }
+	C = (n>1)? (int)floor((rec[(n-1)*ncol]-rec[0])/T+1e-9) : 0;
+	if(C<1){
+		for(k=0;k<nf;k++) vmag[k]=vpha[k]=imag[k]=ipha[k]=0.0, se[k]=1.0;
+		tvirdclose(&rd);
+		free(h);
+		*pts=0;
+		return 0;
+	}
+	for(P=2;P<ZFFTOVER*H || P<n/C;P<<=1);			// never coarser than the data
+	if(P>ZFFTMAXP) err("Too many points per cycle for FFT.");
+	xv = malloc(P*sizeof(double complex)); xi = malloc(P*sizeof(double complex));
+	tw = malloc(P/2*sizeof(double complex));
+	Xv = malloc((long)C*nf*sizeof(double complex)); Xi = malloc((long)C*nf*sizeof(double complex));
+	mv = malloc(C*sizeof(double)); mi = malloc(C*sizeof(double));
+	if(xv==NULL || xi==NULL || tw==NULL || Xv==NULL || Xi==NULL || mv==NULL || mi==NULL) err("Out of memory for FFT.");
+	for(k=0;k<P/2;k++) tw[k] = cexp(-2.0*I*M_PI*k/P);
+	tf = rec[0];
+	for(c=0;c<C;c++){									// resample one cycle, FFT it
+		for(mv[c]=mi[c]=0.0,nn=0;nn<P;nn++){
+			t = tf+(c+(double)nn/P)*T;
+			while(j<n-2 && rec[(j+1)*ncol]<=t) j++;
+			r0 = rec+j*ncol; r1 = r0+ncol;
+			u = (r1[0]>r0[0])? (t-r0[0])/(r1[0]-r0[0]) : 0.0;
+			xv[nn] = r0[1]+u*(r1[1]-r0[1]);
+			xi[nn] = r0[2]+u*(r1[2]-r0[2]);
+			mv[c] += creal(xv[nn]); mi[c] += creal(xi[nn]);
+		}
+		mv[c] /= P; mi[c] /= P;
+		zfftrun(xv,P,tw);
+		zfftrun(xi,P,tw);
+		for(k=0;k<nf;k++){ Xv[(long)c*nf+k] = xv[h[k]]; Xi[(long)c*nf+k] = xi[h[k]]; }
+	}
+	for(c=0;c<C;c++){									// line through the cycle means
+		tc = (c+0.5)*T;
+		m0 += 1.0; m1 += tc; m2 += tc*tc;
+		sv += mv[c]; stv += tc*mv[c];
+		si += mi[c]; sti += tc*mi[c];
+	}
+	det = m0*m2-m1*m1;
+	if(C>1 && det>0.0){ bv = (m0*stv-m1*sv)/det; bi = (m0*sti-m1*si)/det; }
+	for(k=0;k<nf;k++){
+		w = cexp(-2.0*I*M_PI*h[k]/P);
+		cv = bv*(T/P)*P/(w-1.0);						// slope b contributes b dt sum j w^j = b dt P/(w-1)
+		ci = bi*(T/P)*P/(w-1.0);
+		for(Sv=Si=Zs=0.0,s2=0.0,c=0;c<C;c++){
+			Sv += Xv[(long)c*nf+k]-cv;
+			Si += Xi[(long)c*nf+k]-ci;
+			Zc = (Xv[(long)c*nf+k]-cv)/(Xi[(long)c*nf+k]-ci);
+			Zs += Zc; s2 += creal(Zc*conj(Zc));
+		}
+		vmag[k] = 2.0*cabs(Sv)/((double)C*P); vpha[k] = carg(Sv)*180.0/M_PI;
+		imag[k] = 2.0*cabs(Si)/((double)C*P); ipha[k] = carg(Si)*180.0/M_PI;
+		zz = cabs(Sv/Si);
+		se[k] = 1.0;
+		if(C>1 && zz>0.0) se[k] = sqrt(MAX((s2-creal(Zs*conj(Zs))/C)/(C-1.0),0.0)/C)/zz;
+	}
+	*pts = P;
+	free(xv); free(xi); free(tw); free(Xv); free(Xi); free(mv); free(mi); free(h);
+	tvirdclose(&rd);
+	return C;
+}
+
+#endif
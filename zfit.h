@@ -0,0 +1,144 @@
+// zfit.h: simultaneous least-squares fit of all the tones to V & I of a .tvi/.tvib record
+// include after prologix.h (uses err()); replaces the ff/.gs/hold.ffi round trip; link with -lpthread
+// JBS & CJD 2026
+//
+// With the frequencies known, x(t) = sum_k a_k cos(w_k t) + b_k sin(w_k t) + drift
+// is linear in every unknown, so the fit is one pass building the normal
+// equations and a Cholesky solve; no starting guess and no iterations.  The drift
+// is a polynomial (order 0 = offset only, up to ZFITPOLY-1) in time scaled to
+// [-1,1] over the window, which keeps the equations well conditioned.  The
+// record is read once (a .tvib is just mapped) and V and I are fitted at the same
+// time in two threads.  Phases are in degrees for x = A cos(2 pi f t + phase),
+// t from the first sample, the same as zdft.h, so .ffz and .fmp compare directly.
+
+#ifndef ZFIT_H
+#define ZFIT_H
+
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
+#include	<math.h>
+#include	<pthread.h>
+#include	"tvird.h"
+
+#define ZFITMAX 48				// tones
+#define ZFITPOLY 4				// drift terms at most (cubic)
+#define ZFITM (2*ZFITMAX+ZFITPOLY)
+
+struct zfit {
+	int nf, np;					// tones, drift terms (order+1)
+	double f[ZFITMAX];
+	double *rec;				// records of ncol doubles, t first
+	long n;
+	int ncol, col;				// doubles per record, column fitted (1 V, 2 I)
+	double t0, t1;				// window, s after the first sample
+	double amp[ZFITMAX], pha[ZFITMAX];	// results
+	double drift[ZFITPOLY];		// polynomial coefficients, scaled time
+	double rms;					// residual
+	long used;					// samples in the window
+	int ok;						// 0 if the equations were singular
+};
+
+// solve A c = b by Cholesky, A symmetric positive definite (upper triangle used); 0 if singular
+int zfitchol(int m, double A[ZFITM][ZFITM], double *b, double *c)
+{
+	double L[ZFITM][ZFITM], s;
+	int i, j, k;
+
+	for(j=0;j<m;j++){
+		for(s=A[j][j],k=0;k<j;k++) s -= L[j][k]*L[j][k];
+		if(s<=1e-13*A[j][j] || s<=0.0) return 0;
+		L[j][j] = sqrt(s);
+		for(i=j+1;i<m;i++){
+			for(s=A[j][i],k=0;k<j;k++) s -= L[i][k]*L[j][k];
+			L[i][j] = s/L[j][j];
+		}
+	}
+	for(i=0;i<m;i++){									// L y = b
+		for(s=b[i],k=0;k<i;k++) s -= L[i][k]*c[k];
+		c[i] = s/L[i][i];
+	}
+	for(i=m-1;i>=0;i--){								// L' c = y
+		for(s=c[i],k=i+1;k<m;k++) s -= L[k][i]*c[k];
+		c[i] = s/L[i][i];
+	}
+	return 1;
+}
+
+void *zfitrun(void *arg)		// fit one channel, thread function
+{
+	struct zfit *z = arg;
+	static _Thread_local double A[ZFITM][ZFITM];
+	double b[ZFITM], c[ZFITM], p[ZFITM], xx=0.0, tf, tau, tm, th, u, x, rss;
+	double *r;
+	int m = z->np+2*z->nf, i, j, k;
+	long n;
+
+	memset(A,0,sizeof(A));
+	memset(b,0,sizeof(b));
+	z->ok=0; z->used=0;
+	if(z->n<1) return NULL;
+	tf = z->rec[0];
+	tm = 0.5*(z->t0+z->t1); th = 0.5*(z->t1-z->t0);
+	for(n=0;n<z->n;n++){
+		r = z->rec+n*z->ncol;
+		tau = r[0]-tf;
+		if(tau<z->t0 || tau>=z->t1) continue;
+		x = r[z->col];
+		u = (tau-tm)/th;
+		for(p[0]=1.0,j=1;j<z->np;j++) p[j] = p[j-1]*u;	// drift basis
+		for(k=0;k<z->nf;k++){
+			p[z->np+2*k] = cos(2.0*M_PI*z->f[k]*tau);
+			p[z->np+2*k+1] = sin(2.0*M_PI*z->f[k]*tau);
+		}
+		for(i=0;i<m;i++){
+			b[i] += p[i]*x;
+			for(j=i;j<m;j++) A[i][j] += p[i]*p[j];
+		}
+		xx += x*x;
+		z->used++;
+	}
+	if(z->used<=m || !zfitchol(m,A,b,c)) return NULL;
+	for(rss=xx,i=0;i<m;i++) rss -= c[i]*b[i];			// residual from the normal equations
+	z->rms = sqrt(MAX(rss,0.0)/(z->used-m));
+	for(j=0;j<z->np;j++) z->drift[j] = c[j];
+	for(k=0;k<z->nf;k++){								// a cos + b sin = A cos(wt+ph)
+		z->amp[k] = hypot(c[z->np+2*k],c[z->np+2*k+1]);
+		z->pha[k] = atan2(-c[z->np+2*k+1],c[z->np+2*k])*180.0/M_PI;
+	}
+	z->ok=1;
+	return NULL;
+}
+
+// fit V & I of a 3- or 5-column .tvi or a .tvib over [t0,t1) s after its first
+// sample, drift order np-1, V and I in parallel; returns samples in the window
+long zfitvi(char *fname, int nf, double *f, int np, double t0, double t1, struct zfit *v, struct zfit *i)
+{
+	struct tvird rd;
+	struct zfit *zz[2]={v,i};
+	pthread_t th;
+	double *rec;
+	long n;
+	int ncol, k;
+
+	if(nf>ZFITMAX) err("Too many tones for zfit.");
+	if(np<1 || np>ZFITPOLY) err("Drift order for zfit out of range.");
+	if(tvirdopen(&rd,fname)) err("Cannot open .tvi file for fit.");
+	rec = tvirdload(&rd,&n,&ncol);					// .tvib fitted in place, text read once
+	if(rec==NULL) err("Out of memory for fit.");
+	for(k=0;k<2;k++){
+		memset(zz[k],0,sizeof(struct zfit));
+		zz[k]->nf=nf; zz[k]->np=np;
+		memcpy(zz[k]->f,f,nf*sizeof(double));
+		zz[k]->rec=rec; zz[k]->n=n; zz[k]->ncol=ncol; zz[k]->col=k+1;
+		zz[k]->t0=t0; zz[k]->t1=t1;
+	}
+	if(pthread_create(&th,NULL,zfitrun,v)==0){		// V in a thread, I here
+		zfitrun(i);
+		pthread_join(th,NULL);
+	}else{ zfitrun(v); zfitrun(i); }
+	tvirdclose(&rd);
+	return v->used;
+}
+
+#endif